@@ -11,6 +11,10 @@
 
 #include <assert.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 
 NAMESPACE_BEGIN(System);
 
@@ -834,6 +838,7 @@ void AsyncSplit::Initialize(CAsyncStream *stream, int header, bool borrow)
 	_split->user = this;
 	_split->callback = SplitCB;
 	_split->receiver = SplitReceiver;
+	_split->batch = ((*_batch_ptr) != nullptr)? SplitBatch : NULL;
 	_loop = stream->loop;
 }
 
@@ -889,6 +894,19 @@ void AsyncSplit::SetReceiver(std::function<void(void *data, long size)> receiver
 }
 
 
+//---------------------------------------------------------------------
+// setup batch data callback
+//---------------------------------------------------------------------
+void AsyncSplit::SetBatchReceiver(std::function<void(void * const vecptr[], const long veclen[], int count)> receiver)
+{
+	_batch_ptr = std::make_shared<BatchReceiver>(std::move(receiver));
+	if (_split) {
+		_split->batch = ((*_batch_ptr) != nullptr)? SplitBatch : NULL;
+		_split->user = this;
+	}
+}
+
+
 //---------------------------------------------------------------------
 // callback
 //---------------------------------------------------------------------
@@ -935,6 +953,29 @@ void AsyncSplit::SplitReceiver(CAsyncSplit *split, void *data, long size)
 }
 
 
+//---------------------------------------------------------------------
+// batch receiver callback
+//---------------------------------------------------------------------
+void AsyncSplit::SplitBatch(CAsyncSplit *split, void * const vecptr[], const long veclen[], int count)
+{
+	AsyncSplit *self = (AsyncSplit*)split->user;
+	if ((*self->_batch_ptr) != nullptr) {
+		auto ref_batch = self->_batch_ptr;
+		try {
+			(*ref_batch)(vecptr, veclen, count);
+		}
+		catch (std::exception &e) {
+			async_loop_log(self->_loop, -1,
+				"AsyncSplit batch receiver threw an exception: %s", e.what());
+		}
+		catch (...) {
+			async_loop_log(self->_loop, -1,
+				"AsyncSplit batch receiver threw an unknown exception");
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // write message
 //---------------------------------------------------------------------
@@ -1042,15 +1083,40 @@ int AsyncMessage::MsgCB(CAsyncMessage *msg, int mid, IINT32 wparam, IINT32 lpara
 }
 
 
+//---------------------------------------------------------------------
+// internal batch callback
+//---------------------------------------------------------------------
+void AsyncMessage::MsgBatch(CAsyncMessage *msg, const CAsyncMessageItem *items, int count)
+{
+	AsyncMessage *self = (AsyncMessage*)msg->user;
+	if ((*self->_batch_ptr) != nullptr) {
+		auto ref_batch = self->_batch_ptr;
+		try {
+			(*ref_batch)(items, count);
+		}
+		catch (std::exception &e) {
+			async_loop_log(self->_msg->loop, -1,
+				"AsyncMessage batch callback threw an exception: %s", e.what());
+		}
+		catch (...) {
+			async_loop_log(self->_msg->loop, -1,
+				"AsyncMessage batch callback threw an unknown exception");
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // move ctor
 //---------------------------------------------------------------------
 AsyncMessage::AsyncMessage(AsyncMessage &&src):
 	_cb_ptr(std::move(src._cb_ptr)),
+	_batch_ptr(std::move(src._batch_ptr)),
 	_msg(src._msg)
 {
 	src._msg = NULL;
 	_msg->callback = MsgCB;
+	_msg->batch = ((*_batch_ptr) != nullptr)? MsgBatch : NULL;
 	_msg->user = this;
 }
 
@@ -1065,6 +1131,16 @@ void AsyncMessage::SetCallback(std::function<void(int, int, int, const void *, i
 }
 
 
+//---------------------------------------------------------------------
+// setup batch callback
+//---------------------------------------------------------------------
+void AsyncMessage::SetBatchCallback(std::function<void(const CAsyncMessageItem *items, int count)> cb)
+{
+	_batch_ptr = std::make_shared<BatchCallback>(std::move(cb));
+	_msg->batch = ((*_batch_ptr) != nullptr)? MsgBatch : NULL;
+}
+
+
 //---------------------------------------------------------------------
 // start message listening
 //---------------------------------------------------------------------
@@ -1094,6 +1170,15 @@ int AsyncMessage::Post(int mid, int wparam, int lparam, const void *ptr, int siz
 }
 
 
+//---------------------------------------------------------------------
+// post message with producer stats
+//---------------------------------------------------------------------
+int AsyncMessage::Post(CAsyncMessageProducer *producer, int mid, int wparam, int lparam, const void *ptr, int size)
+{
+	return async_msg_post_from(_msg, producer, mid, wparam, lparam, ptr, (size < 0)? 0 : size);
+}
+
+
 //---------------------------------------------------------------------
 // post message
 //---------------------------------------------------------------------
@@ -1611,6 +1696,900 @@ void AsyncStreamBackend::_WaterMarkCB(CAsyncStream *stream, long hiwater, long l
 }
 
 
+//=====================================================================
+// AsyncWebSocket
+//=====================================================================
+#define ASYNC_WS_GUID         "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define ASYNC_WS_HEADER_MAX   8192
+#define ASYNC_WS_CHUNK        65536
+
+#define ASYNC_WS_CONTINUE     0x0
+#define ASYNC_WS_TEXT         0x1
+#define ASYNC_WS_BINARY       0x2
+#define ASYNC_WS_CLOSE        0x8
+#define ASYNC_WS_PING         0x9
+#define ASYNC_WS_PONG         0xa
+
+
+//---------------------------------------------------------------------
+// case insensitive compare of size bytes
+//---------------------------------------------------------------------
+static bool AsyncWsEqual(const char *a, const char *b, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		int x = (unsigned char)a[i];
+		int y = (unsigned char)b[i];
+		if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+		if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+		if (x != y) return false;
+	}
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// find a header field in the handshake text, value is trimmed
+//---------------------------------------------------------------------
+static bool AsyncWsField(const std::string &head, const char *name, 
+		std::string &value)
+{
+	size_t length = strlen(name);
+	size_t pos = head.find("\r\n");
+	while (pos != std::string::npos && pos + 2 < head.size()) {
+		size_t start = pos + 2;
+		size_t end = head.find("\r\n", start);
+		if (end == std::string::npos) end = head.size();
+		if (end - start > length && head[start + length] == ':' &&
+			AsyncWsEqual(head.c_str() + start, name, length)) {
+			size_t p1 = start + length + 1;
+			size_t p2 = end;
+			while (p1 < p2 && (head[p1] == ' ' || head[p1] == '\t')) p1++;
+			while (p2 > p1 && (head[p2 - 1] == ' ' || head[p2 - 1] == '\t')) p2--;
+			value = head.substr(p1, p2 - p1);
+			return true;
+		}
+		pos = end;
+	}
+	return false;
+}
+
+
+//---------------------------------------------------------------------
+// check a comma separated field contains token
+//---------------------------------------------------------------------
+static bool AsyncWsToken(const std::string &value, const char *token)
+{
+	size_t length = strlen(token);
+	size_t pos = 0;
+	while (pos < value.size()) {
+		size_t end = value.find(',', pos);
+		if (end == std::string::npos) end = value.size();
+		size_t p1 = pos, p2 = end;
+		while (p1 < p2 && value[p1] == ' ') p1++;
+		while (p2 > p1 && value[p2 - 1] == ' ') p2--;
+		if (p2 - p1 == length && AsyncWsEqual(value.c_str() + p1, token, length))
+			return true;
+		pos = end + 1;
+	}
+	return false;
+}
+
+
+//---------------------------------------------------------------------
+// dtor
+//---------------------------------------------------------------------
+AsyncWebSocket::~AsyncWebSocket()
+{
+	ims_destroy(&_input);
+	ims_destroy(&_bounds);
+}
+
+
+//---------------------------------------------------------------------
+// ctor
+//---------------------------------------------------------------------
+AsyncWebSocket::AsyncWebSocket(CAsyncLoop *loop):
+	AsyncStreamBackend(loop, ASYNC_STREAM_NAME_WEBSOCKET)
+{
+	_server = false;
+	_requested = false;
+	_upgraded = false;
+	_failed = false;
+	_closing = false;
+	_closed = false;
+	_pumping = false;
+	_blocked = false;
+	_opcode = ASYNC_WS_BINARY;
+	_fragment = 0;
+	_limit = 0;
+	_hiwater = 0;
+	_fhead_size = 0;
+	_fhead_need = 2;
+	_fopcode = 0;
+	_ffin = false;
+	_fmasked = false;
+	_fmask_pos = 0;
+	_fremain = 0;
+	_message = 0;
+	_fragmented = false;
+	_consumed = 0;
+	_mopcode = ASYNC_WS_BINARY;
+	_chunk.resize(ASYNC_WS_CHUNK);
+	ims_init(&_input, NULL, 0, 0);
+	ims_init(&_bounds, NULL, 0, 0);
+	RANDOM_PCG_Init(&_random, (IUINT64)iclock64(), (IUINT64)((size_t)this));
+	cstream.state = ASYNC_STREAM_CONNECTING;
+	cstream.enabled = 0;
+}
+
+
+//---------------------------------------------------------------------
+// ctor
+//---------------------------------------------------------------------
+AsyncWebSocket::AsyncWebSocket(AsyncLoop &loop):
+	AsyncWebSocket(loop.GetLoop())
+{
+}
+
+
+//---------------------------------------------------------------------
+// server side: wait for the upgrade request
+//---------------------------------------------------------------------
+bool AsyncWebSocket::Accept(CAsyncStream *underlying, bool own)
+{
+	if (GetUnderlying() != NULL) return false;
+	if (AttachUnderlying(underlying, own) == false) return false;
+	_server = true;
+	async_stream_enable(underlying, ASYNC_EVENT_READ);
+	Pump();
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// client side: send the upgrade request
+//---------------------------------------------------------------------
+bool AsyncWebSocket::Connect(CAsyncStream *underlying, bool own, 
+		const char *host, const char *path, const char *protocol)
+{
+	unsigned char nonce[16];
+	char text[32];
+	if (GetUnderlying() != NULL) return false;
+	if (AttachUnderlying(underlying, own) == false) return false;
+	_server = false;
+	_host = (host)? host : "";
+	_path = (path && path[0])? path : "/";
+	_protocol = (protocol)? protocol : "";
+	for (int i = 0; i < 16; i += 4) {
+		IUINT32 x = RANDOM_PCG_Next(&_random);
+		memcpy(nonce + i, &x, 4);
+	}
+	_key.assign(text, (size_t)ibase64_encode(nonce, 16, text));
+	async_stream_enable(underlying, ASYNC_EVENT_READ);
+	if (underlying->state == ASYNC_STREAM_ESTAB) {
+		SendRequest();
+	}
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// send messages as TEXT or BINARY
+//---------------------------------------------------------------------
+void AsyncWebSocket::SetTextMode(bool text)
+{
+	_opcode = text? ASYNC_WS_TEXT : ASYNC_WS_BINARY;
+}
+
+void AsyncWebSocket::SetFragment(long size)
+{
+	_fragment = (size > 0)? size : 0;
+}
+
+void AsyncWebSocket::SetMaxMessage(long size)
+{
+	_limit = (size > 0)? size : 0;
+}
+
+
+//---------------------------------------------------------------------
+// send ping
+//---------------------------------------------------------------------
+int AsyncWebSocket::Ping(const void *data, int size)
+{
+	if (_upgraded == false || _closing || _failed) return -1;
+	if (size < 0 || size > 125) return -2;
+	return SendFrame(ASYNC_WS_PING, true, data, size);
+}
+
+
+//---------------------------------------------------------------------
+// start the closing handshake
+//---------------------------------------------------------------------
+int AsyncWebSocket::Shutdown(int code, const char *reason)
+{
+	unsigned char payload[125];
+	long size = 2;
+	if (_upgraded == false || _closing || _failed) return -1;
+	payload[0] = (unsigned char)((code >> 8) & 0xff);
+	payload[1] = (unsigned char)(code & 0xff);
+	if (reason) {
+		long length = (long)strlen(reason);
+		if (length > 123) length = 123;
+		memcpy(payload + 2, reason, length);
+		size += length;
+	}
+	_closing = true;
+	return SendFrame(ASYNC_WS_CLOSE, true, payload, size);
+}
+
+
+//---------------------------------------------------------------------
+// read payload
+//---------------------------------------------------------------------
+long AsyncWebSocket::Read(void *ptr, long size)
+{
+	long hr = (long)ims_read(&_input, ptr, size);
+	if (hr > 0) Consume(hr);
+	UpdateReading();
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// read one complete message
+//---------------------------------------------------------------------
+long AsyncWebSocket::ReadMessage(std::string &data, int &opcode)
+{
+	long record[2];
+	if (ims_peek(&_bounds, record, sizeof(record)) < (long)sizeof(record)) {
+		return -1;
+	}
+	long size = record[0] - _consumed;
+	data.resize((size_t)size);
+	if (size > 0) {
+		ims_read(&_input, &data[0], size);
+	}
+	ims_drop(&_bounds, sizeof(record));
+	_consumed = 0;
+	opcode = (int)record[1];
+	UpdateReading();
+	return size;
+}
+
+
+//---------------------------------------------------------------------
+// advance message boundaries after Read() took size bytes
+//---------------------------------------------------------------------
+void AsyncWebSocket::Consume(long size)
+{
+	long record[2];
+	while (size > 0) {
+		if (ims_peek(&_bounds, record, sizeof(record)) < 
+				(long)sizeof(record)) {
+			// bytes of the message still being received
+			_consumed += size;
+			break;
+		}
+		long left = record[0] - _consumed;
+		if (size < left) {
+			_consumed += size;
+			break;
+		}
+		size -= left;
+		_consumed = 0;
+		ims_drop(&_bounds, sizeof(record));
+	}
+}
+
+
+//---------------------------------------------------------------------
+// write a data message
+//---------------------------------------------------------------------
+long AsyncWebSocket::Write(const void *ptr, long size)
+{
+	const char *lptr = (const char*)ptr;
+	int opcode = _opcode;
+	long offset = 0;
+	if (_upgraded == false || _closing || _failed) return -1;
+	if (size <= 0) return 0;
+	while (offset < size) {
+		long canwrite = size - offset;
+		if (_fragment > 0 && canwrite > _fragment) canwrite = _fragment;
+		bool fin = (offset + canwrite >= size);
+		if (SendFrame(opcode, fin, lptr + offset, canwrite) != 0) {
+			// a message cut after its first frame can not be resumed
+			if (offset > 0) Fail(ERR_UNDERLYING);
+			return -1;
+		}
+		opcode = ASYNC_WS_CONTINUE;
+		offset += canwrite;
+	}
+	return size;
+}
+
+
+//---------------------------------------------------------------------
+// peek payload
+//---------------------------------------------------------------------
+long AsyncWebSocket::Peek(void *ptr, long size)
+{
+	return (long)ims_peek(&_input, ptr, size);
+}
+
+
+//---------------------------------------------------------------------
+// enable events
+//---------------------------------------------------------------------
+void AsyncWebSocket::Enable(int event)
+{
+	cstream.enabled |= event;
+	if (GetUnderlying() == NULL || _upgraded == false) return;
+	if (event & ASYNC_EVENT_WRITE) {
+		async_stream_enable(GetUnderlying(), ASYNC_EVENT_WRITE);
+	}
+	if (event & ASYNC_EVENT_READ) {
+		UpdateReading();
+		if (_input.size > 0 || _bounds.size > 0) NotifyReading();
+	}
+}
+
+
+//---------------------------------------------------------------------
+// disable events
+//---------------------------------------------------------------------
+void AsyncWebSocket::Disable(int event)
+{
+	cstream.enabled &= ~event;
+	if (GetUnderlying() == NULL || _upgraded == false) return;
+	if (event & ASYNC_EVENT_WRITE) {
+		async_stream_disable(GetUnderlying(), ASYNC_EVENT_WRITE);
+	}
+	if (event & ASYNC_EVENT_READ) {
+		UpdateReading();
+	}
+}
+
+
+//---------------------------------------------------------------------
+// payload bytes ready to read
+//---------------------------------------------------------------------
+long AsyncWebSocket::Remain() const
+{
+	return (long)_input.size;
+}
+
+
+//---------------------------------------------------------------------
+// bytes pending in the underlying send buffer
+//---------------------------------------------------------------------
+long AsyncWebSocket::Pending() const
+{
+	const CAsyncStream *underlying = GetUnderlying();
+	if (underlying == NULL) return 0;
+	return async_stream_pending((CAsyncStream*)underlying);
+}
+
+
+//---------------------------------------------------------------------
+// hiwater also bounds the decoded payload buffer
+//---------------------------------------------------------------------
+void AsyncWebSocket::WaterMark(long hiwater, long lowater)
+{
+	if (hiwater >= 0) _hiwater = hiwater;
+	if (GetUnderlying()) {
+		async_stream_watermark(GetUnderlying(), hiwater, lowater);
+	}
+	UpdateReading();
+}
+
+
+//---------------------------------------------------------------------
+// options are passed to the underlying stream
+//---------------------------------------------------------------------
+long AsyncWebSocket::Option(int option, long value)
+{
+	if (GetUnderlying() == NULL) return -1;
+	return async_stream_option(GetUnderlying(), option, value);
+}
+
+
+//---------------------------------------------------------------------
+// underlying events
+//---------------------------------------------------------------------
+void AsyncWebSocket::OnUnderlyingEvent(int event, int args)
+{
+	if (_failed) return;
+	if (event & ASYNC_STREAM_EVT_ESTAB) {
+		if (_server == false && _requested == false) {
+			SendRequest();
+		}
+	}
+	if (event & ASYNC_STREAM_EVT_READING) {
+		Pump();
+	}
+	if (_failed) return;
+	if (event & ASYNC_STREAM_EVT_WRITING) {
+		if (_upgraded) NotifyWriting(args);
+	}
+	if (event & ASYNC_STREAM_EVT_ERROR) {
+		Fail(ERR_UNDERLYING);
+	}
+	else if (event & ASYNC_STREAM_EVT_EOF) {
+		Pump();
+		if (_failed) return;
+		if (_upgraded == false) {
+			Fail(ERR_HANDSHAKE);
+		}
+		else if (_closed == false) {
+			_closed = true;
+			NotifyEof(ASYNC_STREAM_INPUT);
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// enter error state
+//---------------------------------------------------------------------
+void AsyncWebSocket::Fail(int error)
+{
+	if (_failed) return;
+	_failed = true;
+	if (GetUnderlying()) {
+		async_stream_disable(GetUnderlying(), ASYNC_EVENT_READ);
+	}
+	NotifyError(error);
+}
+
+
+//---------------------------------------------------------------------
+// drain the underlying input
+//---------------------------------------------------------------------
+void AsyncWebSocket::Pump()
+{
+	CAsyncStream *underlying = GetUnderlying();
+	bool received = false;
+	if (underlying == NULL || _pumping) return;
+	_pumping = true;
+	while (_failed == false && _blocked == false) {
+		long hr = async_stream_read(underlying, &_chunk[0], (long)_chunk.size());
+		if (hr <= 0) break;
+		if (_upgraded == false) {
+			if (Handshake(&_chunk[0], hr) == false) break;
+		}
+		else {
+			if (Feed(&_chunk[0], hr) == false) break;
+		}
+		received = true;
+		UpdateReading();
+	}
+	_pumping = false;
+	if (received && _failed == false && 
+		(_input.size > 0 || _bounds.size > 0)) {
+		if (cstream.enabled & ASYNC_EVENT_READ) {
+			NotifyReading();
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// stop reading the underlying stream above hiwater
+//---------------------------------------------------------------------
+void AsyncWebSocket::UpdateReading()
+{
+	CAsyncStream *underlying = GetUnderlying();
+	bool blocked = false;
+	if (underlying == NULL || _failed) return;
+	if (_upgraded) {
+		if ((cstream.enabled & ASYNC_EVENT_READ) == 0) blocked = true;
+		if (_hiwater > 0 && (long)_input.size >= _hiwater) blocked = true;
+	}
+	if (blocked == _blocked) return;
+	_blocked = blocked;
+	if (blocked) {
+		async_stream_disable(underlying, ASYNC_EVENT_READ);
+	}
+	else {
+		async_stream_enable(underlying, ASYNC_EVENT_READ);
+		if (async_stream_remain(underlying) > 0) {
+			Pump();
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// collect the handshake text, leftover is fed to the frame parser
+//---------------------------------------------------------------------
+bool AsyncWebSocket::Handshake(char *data, long size)
+{
+	size_t start = (_header.size() > 3)? _header.size() - 3 : 0;
+	_header.append(data, size);
+	size_t pos = _header.find("\r\n\r\n", start);
+	if (pos == std::string::npos) {
+		if (_header.size() > ASYNC_WS_HEADER_MAX) {
+			Fail(ERR_HANDSHAKE);
+			return false;
+		}
+		return true;
+	}
+	std::string rest = _header.substr(pos + 4);
+	_header.resize(pos + 4);
+	bool hr = _server? HandshakeServer() : HandshakeClient();
+	_header.clear();
+	if (hr == false) {
+		Fail(ERR_HANDSHAKE);
+		return false;
+	}
+	_upgraded = true;
+	NotifyEstab();
+	if (cstream.enabled & ASYNC_EVENT_WRITE) {
+		async_stream_enable(GetUnderlying(), ASYNC_EVENT_WRITE);
+	}
+	if (rest.size() > 0) {
+		if (Feed(&rest[0], (long)rest.size()) == false) return false;
+	}
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// validate the upgrade request and reply 101
+//---------------------------------------------------------------------
+bool AsyncWebSocket::HandshakeServer()
+{
+	static const char bad[] = 
+		"HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+	std::string value, key, reply;
+	size_t p1 = _header.find(' ');
+	size_t p2 = (p1 == std::string::npos)? p1 : _header.find(' ', p1 + 1);
+	bool valid = true;
+	if (p2 == std::string::npos || _header.compare(0, 4, "GET ") != 0) {
+		valid = false;
+	}
+	else {
+		_path = _header.substr(p1 + 1, p2 - p1 - 1);
+	}
+	if (!AsyncWsField(_header, "Upgrade", value) || 
+		!AsyncWsToken(value, "websocket")) {
+		valid = false;
+	}
+	if (!AsyncWsField(_header, "Connection", value) ||
+		!AsyncWsToken(value, "upgrade")) {
+		valid = false;
+	}
+	if (!AsyncWsField(_header, "Sec-WebSocket-Version", value) ||
+		value != "13") {
+		valid = false;
+	}
+	if (!AsyncWsField(_header, "Sec-WebSocket-Key", key) || key.empty()) {
+		valid = false;
+	}
+	if (valid == false) {
+		async_stream_write(GetUnderlying(), bad, (long)sizeof(bad) - 1);
+		return false;
+	}
+	_protocol.clear();
+	if (AsyncWsField(_header, "Sec-WebSocket-Protocol", value)) {
+		size_t end = value.find(',');
+		_protocol = value.substr(0, end);
+		while (!_protocol.empty() && _protocol[_protocol.size() - 1] == ' ')
+			_protocol.resize(_protocol.size() - 1);
+	}
+	reply = "HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: ";
+	reply += AcceptKey(key);
+	reply += "\r\n";
+	if (!_protocol.empty()) {
+		reply += "Sec-WebSocket-Protocol: " + _protocol + "\r\n";
+	}
+	reply += "\r\n";
+	async_stream_write(GetUnderlying(), reply.c_str(), (long)reply.size());
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// validate the 101 response
+//---------------------------------------------------------------------
+bool AsyncWebSocket::HandshakeClient()
+{
+	std::string value;
+	if (_header.size() < 12 || _header.compare(0, 5, "HTTP/") != 0) {
+		return false;
+	}
+	size_t p1 = _header.find(' ');
+	if (p1 == std::string::npos || _header.compare(p1 + 1, 3, "101") != 0) {
+		return false;
+	}
+	if (!AsyncWsField(_header, "Sec-WebSocket-Accept", value) ||
+		value != AcceptKey(_key)) {
+		return false;
+	}
+	if (!AsyncWsField(_header, "Upgrade", value) ||
+		!AsyncWsToken(value, "websocket")) {
+		return false;
+	}
+	if (AsyncWsField(_header, "Sec-WebSocket-Extensions", value)) {
+		return false;   // nothing was offered, nothing can be accepted
+	}
+	if (AsyncWsField(_header, "Sec-WebSocket-Protocol", value)) {
+		_protocol = value;
+	}
+	else {
+		_protocol.clear();
+	}
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// send the upgrade request
+//---------------------------------------------------------------------
+void AsyncWebSocket::SendRequest()
+{
+	std::string request;
+	_requested = true;
+	request = "GET " + _path + " HTTP/1.1\r\n";
+	request += "Host: " + _host + "\r\n";
+	request += "Upgrade: websocket\r\nConnection: Upgrade\r\n";
+	request += "Sec-WebSocket-Key: " + _key + "\r\n";
+	request += "Sec-WebSocket-Version: 13\r\n";
+	if (!_protocol.empty()) {
+		request += "Sec-WebSocket-Protocol: " + _protocol + "\r\n";
+	}
+	request += "\r\n";
+	async_stream_write(GetUnderlying(), request.c_str(), (long)request.size());
+}
+
+
+//---------------------------------------------------------------------
+// frame parser: headers are collected into _fhead, payload is
+// unmasked in place and appended to _input (or _control)
+//---------------------------------------------------------------------
+bool AsyncWebSocket::Feed(char *data, long size)
+{
+	while (size > 0) {
+		if (_fhead_size < _fhead_need) {
+			int need = _fhead_need - _fhead_size;
+			if (need > size) need = (int)size;
+			memcpy(_fhead + _fhead_size, data, need);
+			_fhead_size += need;
+			data += need;
+			size -= need;
+			if (_fhead_size < _fhead_need) break;
+			int length = _fhead[1] & 0x7f;
+			int full = 2 + ((_fhead[1] & 0x80)? 4 : 0) +
+				((length == 126)? 2 : ((length == 127)? 8 : 0));
+			if (_fhead_size < full) {
+				_fhead_need = full;
+				continue;
+			}
+			_ffin = (_fhead[0] & 0x80)? true : false;
+			_fopcode = _fhead[0] & 0x0f;
+			_fmasked = (_fhead[1] & 0x80)? true : false;
+			_fmask_pos = 0;
+			if (length == 126) {
+				_fremain = ((IUINT64)_fhead[2] << 8) | _fhead[3];
+			}
+			else if (length == 127) {
+				_fremain = 0;
+				for (int i = 0; i < 8; i++) {
+					_fremain = (_fremain << 8) | _fhead[2 + i];
+				}
+			}
+			else {
+				_fremain = (IUINT64)length;
+			}
+			if (_fmasked) {
+				memcpy(_fmask, _fhead + full - 4, 4);
+			}
+			bool valid = ((_fhead[0] & 0x70) == 0);
+			if (_fmasked != _server) valid = false;
+			if (_fopcode & 8) {
+				if (_fopcode > ASYNC_WS_PONG) valid = false;
+				if (_ffin == false || _fremain > 125) valid = false;
+			}
+			else if (_fopcode == ASYNC_WS_CONTINUE) {
+				if (_fragmented == false) valid = false;
+				_fragmented = !_ffin;
+			}
+			else if (_fopcode <= ASYNC_WS_BINARY) {
+				if (_fragmented) valid = false;
+				_fragmented = !_ffin;
+				_mopcode = _fopcode;
+			}
+			else {
+				valid = false;
+			}
+			if (_fremain >> 62) valid = false;
+			if (valid == false) {
+				Fail(ERR_PROTOCOL);
+				return false;
+			}
+			if ((_fopcode & 8) == 0 && _limit > 0 && 
+				(IUINT64)_message + _fremain > (IUINT64)_limit) {
+				Fail(ERR_TOO_LARGE);
+				return false;
+			}
+			_control.clear();
+		}
+		else {
+			long canread = size;
+			if ((IUINT64)canread > _fremain) canread = (long)_fremain;
+			if (_fmasked) {
+				Unmask(data, canread, _fmask, _fmask_pos);
+				_fmask_pos = (int)((_fmask_pos + canread) & 3);
+			}
+			if (_fopcode & 8) {
+				_control.append(data, canread);
+			}
+			else if (_closed == false) {
+				ims_write(&_input, data, canread);
+				_message += canread;
+			}
+			data += canread;
+			size -= canread;
+			_fremain -= (IUINT64)canread;
+		}
+		if (_fremain == 0) {
+			_fhead_size = 0;
+			_fhead_need = 2;
+			if (_fopcode & 8) {
+				if (Control() == false) return false;
+			}
+			else if (_ffin) {
+				if (_closed == false) {
+					long record[2];
+					record[0] = _message;
+					record[1] = _mopcode;
+					ims_write(&_bounds, record, sizeof(record));
+				}
+				_message = 0;
+			}
+		}
+	}
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// handle a complete control frame
+//---------------------------------------------------------------------
+bool AsyncWebSocket::Control()
+{
+	if (_fopcode == ASYNC_WS_PING) {
+		if (_closing == false && _closed == false) {
+			SendFrame(ASYNC_WS_PONG, true, _control.data(), (long)_control.size());
+		}
+	}
+	else if (_fopcode == ASYNC_WS_CLOSE) {
+		if (_control.size() == 1) {
+			Fail(ERR_PROTOCOL);
+			return false;
+		}
+		if (_closing == false) {
+			_closing = true;
+			SendFrame(ASYNC_WS_CLOSE, true, _control.data(), 
+					(_control.size() >= 2)? 2 : 0);
+		}
+		if (_closed == false) {
+			_closed = true;
+			NotifyEof(ASYNC_STREAM_INPUT);
+		}
+	}
+	_control.clear();
+	return true;
+}
+
+
+//---------------------------------------------------------------------
+// encode and send one frame, client frames are masked
+//---------------------------------------------------------------------
+int AsyncWebSocket::SendFrame(int opcode, bool fin, const void *ptr, long size)
+{
+	unsigned char head[14];
+	const void *vecptr[2];
+	long veclen[2];
+	int count = 0;
+	head[0] = (unsigned char)((fin? 0x80 : 0) | (opcode & 0x0f));
+	if (size < 126) {
+		head[1] = (unsigned char)size;
+		count = 2;
+	}
+	else if (size < 0x10000) {
+		head[1] = 126;
+		head[2] = (unsigned char)((size >> 8) & 0xff);
+		head[3] = (unsigned char)(size & 0xff);
+		count = 4;
+	}
+	else {
+		IUINT64 length = (IUINT64)size;
+		head[1] = 127;
+		for (int i = 0; i < 8; i++) {
+			head[9 - i] = (unsigned char)(length & 0xff);
+			length >>= 8;
+		}
+		count = 10;
+	}
+	vecptr[0] = head;
+	vecptr[1] = ptr;
+	veclen[1] = size;
+	if (_server == false) {
+		IUINT32 key = RANDOM_PCG_Next(&_random);
+		head[1] |= 0x80;
+		memcpy(head + count, &key, 4);
+		_wbuf.assign((const char*)ptr, (size_t)size);
+		if (size > 0) {
+			Unmask(&_wbuf[0], size, head + count, 0);
+		}
+		vecptr[1] = _wbuf.data();
+		count += 4;
+	}
+	veclen[0] = count;
+	long hr = async_stream_writev(GetUnderlying(), vecptr, veclen, 
+			(size > 0)? 2 : 1);
+	if (_server == false && _wbuf.size() > ASYNC_WS_CHUNK) {
+		std::string().swap(_wbuf);
+	}
+	return (hr < 0)? -1 : 0;
+}
+
+
+//---------------------------------------------------------------------
+// xor with the masking key, offset is the key position of data[0].
+// works on 16 or 8 bytes at a time, since the 4-byte key repeats
+// the wide pattern is built once and data alignment does not matter
+//---------------------------------------------------------------------
+void AsyncWebSocket::Unmask(char *data, long size, 
+		const unsigned char *key, int offset)
+{
+	unsigned char pattern[16];
+	long i = 0;
+	for (int k = 0; k < 16; k++) {
+		pattern[k] = key[(offset + k) & 3];
+	}
+#if defined(__SSE2__) || defined(_M_X64)
+	__m128i wide = _mm_loadu_si128((const __m128i*)pattern);
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+		_mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(x, wide));
+	}
+#endif
+	IUINT64 word;
+	memcpy(&word, pattern, 8);
+	for (; i + 8 <= size; i += 8) {
+		IUINT64 x;
+		memcpy(&x, data + i, 8);
+		x ^= word;
+		memcpy(data + i, &x, 8);
+	}
+	for (; i < size; i++) {
+		data[i] ^= pattern[i & 7];
+	}
+}
+
+
+//---------------------------------------------------------------------
+// Sec-WebSocket-Accept = base64(sha1(key + GUID))
+//---------------------------------------------------------------------
+std::string AsyncWebSocket::AcceptKey(const std::string &key)
+{
+	HASH_SHA1_CTX ctx;
+	unsigned char digest[20];
+	char text[40];
+	std::string source = key + ASYNC_WS_GUID;
+	HASH_SHA1_Init(&ctx);
+	HASH_SHA1_Update(&ctx, source.c_str(), (unsigned int)source.size());
+	HASH_SHA1_Final(&ctx, digest);
+	return std::string(text, (size_t)ibase64_encode(digest, 20, text));
+}
+
+
+
 
 
 
@@ -193,7 +193,14 @@ public:
 	inline int GetError() const { return _listener->error; }
 	inline int GetFamily() const { return _listener->family; }
 
-	// start listening
+	// max connections accepted per readiness, default 64
+	inline void SetBudget(int budget) { _listener->budget = budget; }
+
+	// cpu for ASYNC_LISTENER_INCOMING_CPU
+	inline void SetCpu(int cpu) { _listener->cpu = cpu; }
+
+	// start listening, flags: ASYNC_LISTENER_REUSEPORT, IPV6ONLY, 
+	// DEFER_ACCEPT, FASTOPEN and INCOMING_CPU
 	int Start(int flags, const sockaddr *addr, int addrlen);
 
 	// start listening
@@ -249,6 +256,10 @@ public:
 	// setup data callback
 	void SetReceiver(std::function<void(void *data, long size)> receiver);
 
+	// setup batch data callback, replaces the receiver above and gets 
+	// all complete frames of one read, see CAsyncSplit::batch
+	void SetBatchReceiver(std::function<void(void * const vecptr[], const long veclen[], int count)> receiver);
+
 	// write message
 	void Write(const void * const vecptr[], const long veclen[], int count);
 
@@ -264,12 +275,15 @@ public:
 private:
 	static void SplitCB(CAsyncSplit *split, int event);
 	static void SplitReceiver(CAsyncSplit *split, void *data, long size);
+	static void SplitBatch(CAsyncSplit *split, void * const vecptr[], const long veclen[], int count);
 
 	typedef std::function<void(int event)> Callback;
 	typedef std::function<void(void *data, long size)> Receiver;
+	typedef std::function<void(void * const vecptr[], const long veclen[], int count)> BatchReceiver;
 
 	std::shared_ptr<Callback> _cb_ptr = std::make_shared<Callback>();
 	std::shared_ptr<Receiver> _receiver_ptr = std::make_shared<Receiver>();
+	std::shared_ptr<BatchReceiver> _batch_ptr = std::make_shared<BatchReceiver>();
 
 	CAsyncSplit *_split = NULL;
 	CAsyncLoop *_loop = NULL;
@@ -374,6 +388,10 @@ public:
 	// setup callback
 	void SetCallback(std::function<void(int, int, int, const void *, int)> cb);
 
+	// setup batch callback, replaces the callback when set: every
+	// message drained in one wakeup is handed over in one call
+	void SetBatchCallback(std::function<void(const CAsyncMessageItem *items, int count)> cb);
+
 	// get internal msg object
 	inline CAsyncMessage *GetMsg() { return _msg; }
 	
@@ -395,11 +413,17 @@ public:
 	// post message
 	int Post(int mid, int wparam, int lparam, const std::string &text);
 
+	// post message and account it to the producer stats
+	int Post(CAsyncMessageProducer *producer, int mid, int wparam, int lparam, const void *ptr, int size);
+
 private:
 	static int MsgCB(CAsyncMessage *msg, int mid, IINT32 wparam, IINT32 lparam, const void *ptr, int size);
+	static void MsgBatch(CAsyncMessage *msg, const CAsyncMessageItem *items, int count);
 	typedef std::function<void(int, int, int, const void *, int)> Callback;
+	typedef std::function<void(const CAsyncMessageItem *, int)> BatchCallback;
 
 	std::shared_ptr<Callback> _cb_ptr = std::make_shared<Callback>();
+	std::shared_ptr<BatchCallback> _batch_ptr = std::make_shared<BatchCallback>();
 
 	CAsyncMessage *_msg = NULL;
 };
@@ -549,6 +573,150 @@ private:
 #define ASYNC_STREAM_NAME_BACKEND ASYNC_STREAM_NAME('B', 'A', 'C', 'K')
 
 
+//---------------------------------------------------------------------
+// AsyncWebSocket: RFC 6455 stream over an underlying CAsyncStream
+//
+// A backend that performs the HTTP upgrade handshake (server side via
+// Accept(), client side via Connect()) and then presents the message
+// payloads as a plain byte stream: Read() returns the payload bytes of
+// incoming data messages in order, Write() sends one data message
+// (split into continuation frames when it exceeds the fragment size).
+// ReadMessage() keeps the boundaries and the opcode of each message.
+// PING is answered automatically, PONG is discarded, a CLOSE frame is
+// echoed and reported as EOF. Extensions (permessage-deflate) are not
+// negotiated, frames with RSV bits set are rejected as errors.
+//
+//   AsyncWebSocket *ws = new AsyncWebSocket(loop);
+//   ws->Accept(tcp, true);
+//   stream.NewStream(ws->GetStream());
+//---------------------------------------------------------------------
+class AsyncWebSocket : public AsyncStreamBackend
+{
+public:
+	AsyncWebSocket(CAsyncLoop *loop);
+	AsyncWebSocket(AsyncLoop &loop);
+
+	// error codes reported by ASYNC_STREAM_EVT_ERROR
+	enum {
+		ERR_HANDSHAKE = -1,     // bad upgrade request or response
+		ERR_PROTOCOL = -2,      // malformed frame
+		ERR_TOO_LARGE = -3,     // message exceeds the size limit
+		ERR_UNDERLYING = -4,    // underlying stream error
+	};
+
+	// data message opcodes returned by ReadMessage
+	enum {
+		OP_TEXT = 1,
+		OP_BINARY = 2,
+	};
+
+	// server side: wait for the upgrade request on underlying
+	bool Accept(CAsyncStream *underlying, bool own);
+
+	// client side: send the upgrade request once underlying is
+	// established (immediately if it already is)
+	bool Connect(CAsyncStream *underlying, bool own, const char *host,
+			const char *path, const char *protocol = NULL);
+
+	// send data messages as TEXT (true) or BINARY (false, default)
+	void SetTextMode(bool text);
+
+	// split outgoing messages into frames of at most size bytes, 0 to disable
+	void SetFragment(long size);
+
+	// max incoming message size, exceeding it raises ERR_TOO_LARGE
+	void SetMaxMessage(long size);
+
+	// send a ping with up to 125 bytes of payload
+	int Ping(const void *data = NULL, int size = 0);
+
+	// start the closing handshake, peer CLOSE will be reported as EOF
+	int Shutdown(int code = 1000, const char *reason = NULL);
+
+	// read one complete data message (or what Read() left of it) and
+	// its opcode (OP_TEXT or OP_BINARY), returns the size or -1 if no
+	// message is complete yet. a hiwater set by WaterMark() must be
+	// above the largest message, or reading stops before it completes.
+	long ReadMessage(std::string &data, int &opcode);
+
+	// the path/protocol of the upgrade request (server side)
+	inline const std::string &GetPath() const { return _path; }
+	inline const std::string &GetProtocol() const { return _protocol; }
+
+protected:
+	virtual ~AsyncWebSocket();
+
+	virtual long Read(void *ptr, long size);
+	virtual long Write(const void *ptr, long size);
+	virtual long Peek(void *ptr, long size);
+	virtual void Enable(int event);
+	virtual void Disable(int event);
+	virtual long Remain() const;
+	virtual long Pending() const;
+	virtual void WaterMark(long hiwater, long lowater);
+	virtual long Option(int option, long value);
+
+	virtual void OnUnderlyingEvent(int event, int args);
+
+private:
+	void Fail(int error);
+	void Pump();
+	bool Handshake(char *data, long size);
+	bool HandshakeServer();
+	bool HandshakeClient();
+	void SendRequest();
+	bool Feed(char *data, long size);
+	bool Control();
+	int SendFrame(int opcode, bool fin, const void *ptr, long size);
+	void UpdateReading();
+	void Consume(long size);
+
+	static void Unmask(char *data, long size, const unsigned char *key, int offset);
+	static std::string AcceptKey(const std::string &key);
+
+private:
+	bool _server;
+	bool _requested;        // upgrade request sent (client side)
+	bool _upgraded;
+	bool _failed;
+	bool _pumping;
+	bool _blocked;          // underlying reading paused
+	bool _closing;          // CLOSE sent
+	bool _closed;           // CLOSE received
+	int _opcode;            // opcode for outgoing data messages
+	long _fragment;
+	long _limit;
+	long _hiwater;
+	std::string _host;
+	std::string _path;
+	std::string _protocol;
+	std::string _key;
+	std::string _header;    // handshake text
+	std::string _wbuf;      // masking buffer (client side)
+	std::string _control;   // payload of the current control frame
+	std::vector<char> _chunk;
+	IMSTREAM _input;
+	IMSTREAM _bounds;       // (size, opcode) of complete messages
+	long _consumed;         // bytes of the front message already read
+	int _mopcode;           // opcode of the incoming data message
+	unsigned char _fhead[14];
+	int _fhead_size;        // bytes of frame header received
+	int _fhead_need;        // bytes of frame header required
+	int _fopcode;           // opcode of the current frame
+	bool _ffin;
+	unsigned char _fmask[4];
+	bool _fmasked;
+	int _fmask_pos;
+	IUINT64 _fremain;       // payload bytes left in the current frame
+	long _message;          // payload size of the current message
+	bool _fragmented;       // inside a fragmented data message
+	RANDOM_PCG _random;
+};
+
+#define ASYNC_STREAM_NAME_WEBSOCKET ASYNC_STREAM_NAME('W', 'S', 'O', 'K')
+
+
+
 
 NAMESPACE_END(System);
 
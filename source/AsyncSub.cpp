@@ -59,11 +59,40 @@ AsyncTopic::AsyncTopic(AsyncTopic &&src)
 //---------------------------------------------------------------------
 // publish data to a topic
 //---------------------------------------------------------------------
-void AsyncTopic::Publish(int tid, IINT32 wparam, IINT32 lparam, const void *data, int size)
+int AsyncTopic::Publish(int tid, IINT32 wparam, IINT32 lparam, const void *data, int size)
 {
-	if (_topic) {
-		async_topic_publish(_topic, tid, wparam, lparam, data, size);
-	}
+	if (_topic == NULL) return -1;
+	return async_topic_publish(_topic, tid, wparam, lparam, data, size);
+}
+
+
+//---------------------------------------------------------------------
+// publish payload
+//---------------------------------------------------------------------
+int AsyncTopic::Publish(int tid, IINT32 wparam, IINT32 lparam, CAsyncPayload *payload)
+{
+	if (_topic == NULL) return -1;
+	return async_topic_publish_payload(_topic, tid, wparam, lparam, payload);
+}
+
+
+//---------------------------------------------------------------------
+// publish to a hierarchical name
+//---------------------------------------------------------------------
+int AsyncTopic::Publish(const char *name, IINT32 wparam, IINT32 lparam, const void *data, int size)
+{
+	if (_topic == NULL) return -1;
+	return async_topic_publish_name(_topic, name, wparam, lparam, data, size);
+}
+
+
+//---------------------------------------------------------------------
+// publish payload to a hierarchical name
+//---------------------------------------------------------------------
+int AsyncTopic::Publish(const char *name, IINT32 wparam, IINT32 lparam, CAsyncPayload *payload)
+{
+	if (_topic == NULL) return -1;
+	return async_topic_publish_name_payload(_topic, name, wparam, lparam, payload);
 }
 
 
@@ -147,6 +176,17 @@ void AsyncSubscribe::Register(AsyncTopic &topic, int tid)
 }
 
 
+//---------------------------------------------------------------------
+// Register to a hierarchical pattern
+//---------------------------------------------------------------------
+int AsyncSubscribe::Register(AsyncTopic &topic, const char *pattern)
+{
+	CAsyncSubscribe *sub = _sub_ptr.get();
+	assert(sub != NULL);
+	return async_sub_register_pattern(topic.GetTopic(), sub, pattern);
+}
+
+
 //---------------------------------------------------------------------
 // Unregister from a topic
 //---------------------------------------------------------------------
@@ -201,7 +241,8 @@ AsyncSignal::AsyncSignal(CAsyncLoop *loop)
 // move ctor
 //---------------------------------------------------------------------
 AsyncSignal::AsyncSignal(AsyncSignal &&src):
-	_callbacks(std::move(src._callbacks))
+	_callbacks(std::move(src._callbacks)),
+	_child(std::move(src._child))
 {
 	_signal = src._signal;
 	_signal->user = this;
@@ -233,7 +274,19 @@ void AsyncSignal::SignalCB(CAsyncSignal *signal, int signum)
 
 
 //---------------------------------------------------------------------
-// only one AsyncSignal can be started at the same time
+// child callback
+//---------------------------------------------------------------------
+void AsyncSignal::ChildCB(CAsyncSignal *signal, int pid, int status)
+{
+	AsyncSignal *self = (AsyncSignal*)signal->user;
+	if (self->_child != nullptr) {
+		self->_child(pid, status);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// start signal handling
 //---------------------------------------------------------------------
 bool AsyncSignal::Start()
 {
@@ -295,6 +348,17 @@ bool AsyncSignal::Ignore(int signum)
 }
 
 
+//---------------------------------------------------------------------
+// reap exited children on SIGCHLD
+//---------------------------------------------------------------------
+bool AsyncSignal::Reap(std::function<void(int pid, int status)> cb)
+{
+	_child = cb;
+	int hr = async_signal_reap(_signal, (cb == nullptr)? NULL : ChildCB);
+	return (hr == 0);
+}
+
+
 //=====================================================================
 // AsyncPoll - epoll like API for AsyncLoop
 //=====================================================================
@@ -339,7 +403,8 @@ AsyncPoll::AsyncPoll(AsyncLoop &loop): AsyncPoll(loop.GetLoop())
 // move ctor
 //---------------------------------------------------------------------
 AsyncPoll::AsyncPoll(AsyncPoll &&src)
-	: _loop(src._loop), _poll(src._poll), _cb_ptr(std::move(src._cb_ptr))
+	: _loop(src._loop), _poll(src._poll), _cb_ptr(std::move(src._cb_ptr)),
+	_batch_ptr(std::move(src._batch_ptr))
 {
 	if (_poll) {
 		_poll->user = this;
@@ -358,6 +423,19 @@ void AsyncPoll::SetCallback(std::function<void(int fd, int events, void *udata)>
 }
 
 
+//---------------------------------------------------------------------
+// setup batch callback
+//---------------------------------------------------------------------
+void AsyncPoll::SetBatchCallback(std::function<void(const CAsyncPollEvent *events, int count)> cb)
+{
+	bool enable = (cb != nullptr);
+	_batch_ptr = std::make_shared<BatchCallback>(std::move(cb));
+	if (_poll) {
+		async_poll_set_batch(_poll, enable? BatchCB : NULL);
+	}
+}
+
+
 //---------------------------------------------------------------------
 // internal callback
 //---------------------------------------------------------------------
@@ -371,6 +449,29 @@ void AsyncPoll::PollCB(CAsyncPoll *poll, int fd, int events, void *udata)
 }
 
 
+//---------------------------------------------------------------------
+// internal batch callback
+//---------------------------------------------------------------------
+void AsyncPoll::BatchCB(CAsyncPoll *poll, const CAsyncPollEvent *events, int count)
+{
+	AsyncPoll *self = (AsyncPoll*)poll->user;
+	if ((*self->_batch_ptr) != nullptr) {
+		auto ref_ptr = self->_batch_ptr;
+		try {
+			(*ref_ptr)(events, count);
+		}
+		catch (std::exception &e) {
+			async_loop_log(poll->loop, -1,
+				"AsyncPoll batch callback threw an exception: %s", e.what());
+		}
+		catch (...) {
+			async_loop_log(poll->loop, -1,
+				"AsyncPoll batch callback threw an unknown exception");
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // Add a file descriptor to poll for events (ASYNC_EVENT_READ/WRITE)
 //---------------------------------------------------------------------
@@ -38,8 +38,17 @@ public:
 	CAsyncTopic *GetTopic() { return _topic; }
 	const CAsyncTopic *GetTopic() const { return _topic; }
 
-	// publish data to a topic
-	void Publish(int tid, IINT32 wparam, IINT32 lparam, const void *data, int size);
+	// publish data to a topic, returns 0 for success, -1 for invalid size
+	int Publish(int tid, IINT32 wparam, IINT32 lparam, const void *data, int size);
+
+	// publish a refcounted payload without copy, caller keeps its reference
+	int Publish(int tid, IINT32 wparam, IINT32 lparam, CAsyncPayload *payload);
+
+	// publish to a hierarchical name like "feed.eu.fx"
+	int Publish(const char *name, IINT32 wparam, IINT32 lparam, const void *data, int size);
+
+	// publish a refcounted payload to a hierarchical name
+	int Publish(const char *name, IINT32 wparam, IINT32 lparam, CAsyncPayload *payload);
 
 private:
 	CAsyncTopic *_topic = NULL;
@@ -64,6 +73,10 @@ public:
 	// Register to a topic
 	void Register(AsyncTopic &topic, int tid);
 
+	// Register to a hierarchical pattern ("feed.eu.*", "feed.#"),
+	// returns 0 for success, -1 for invalid pattern
+	int Register(AsyncTopic &topic, const char *pattern);
+
 	// Unregister from a topic
 	void Deregister();
 
@@ -96,7 +109,7 @@ public:
 	CAsyncSignal *GetSignal() { return _signal; }
 	const CAsyncSignal *GetSignal() const { return _signal; }
 
-	// only one AsyncSignal can be started at the same time
+	// start signal handling (several loops can start with signalfd)
 	bool Start();
 
 	// stop signal handling
@@ -111,6 +124,9 @@ public:
 	// Ignore a signal
 	bool Ignore(int signum);
 
+	// reap exited children on SIGCHLD: cb(pid, status), nullptr to stop
+	bool Reap(std::function<void(int pid, int status)> cb);
+
 	// IsActive?
 	bool IsActive() const { return (_signal && _signal->active != 0); }
 
@@ -131,7 +147,9 @@ public:
 private:
 	typedef std::function<void(int signum)> Callback;
 	std::unordered_map<int, Callback> _callbacks;
+	std::function<void(int pid, int status)> _child;
 	static void SignalCB(CAsyncSignal *signal, int signum);
+	static void ChildCB(CAsyncSignal *signal, int pid, int status);
 	CAsyncSignal *_signal = NULL;
 };
 
@@ -159,6 +177,10 @@ public:
 	// setup callback function
 	void SetCallback(std::function<void(int fd, int events, void *udata)> cb);
 
+	// deliver the events of each iteration in one call, empty to
+	// switch back to SetCallback
+	void SetBatchCallback(std::function<void(const CAsyncPollEvent *events, int count)> cb);
+
 	// Add a file descriptor to poll for events (ASYNC_EVENT_READ/WRITE)
 	int AddFd(int fd, int events, void *udata);
 
@@ -170,12 +192,15 @@ public:
 
 private:
 	static void PollCB(CAsyncPoll *poll, int fd, int events, void *udata);
+	static void BatchCB(CAsyncPoll *poll, const CAsyncPollEvent *events, int count);
 
 private:
 	CAsyncLoop *_loop;
 	CAsyncPoll *_poll;
 	typedef std::function<void(int fd, int events, void *udata)> Callback;
+	typedef std::function<void(const CAsyncPollEvent *events, int count)> BatchCallback;
 	std::shared_ptr<Callback> _cb_ptr = std::make_shared<Callback>();
+	std::shared_ptr<BatchCallback> _batch_ptr = std::make_shared<BatchCallback>();
 };
 
 
@@ -9,7 +9,7 @@
 //   BIN/ARRAY/MAP) with 3-layer API (init / new / mutation)
 // - IRING / IMSTREAM: ring buffer and growable memory stream
 // - Integer codec (8~64 bit, LSB/MSB, varint), Base64/32/16
-// - String helpers, RC4, UTF conversion, incremental hash
+// - String helpers, RC4, LZ, UTF conversion, incremental hash
 //
 // For more information, please see the readme file.
 //
@@ -1618,7 +1618,10 @@ struct IMSPAGE
 	struct ILISTHEAD head;
 	iulong size;
 	iulong index;
-	IUINT8 data[2];
+	iulong capacity;
+	IUINT8 *data;
+	IMSSHARE *share;
+	IUINT8 buffer[2];
 };
 
 #define IMSPAGE_LRU_SIZE	2
@@ -1670,6 +1673,9 @@ static struct IMSPAGE *ims_page_new(struct IMSTREAM *s)
 	}
 
 	ilist_init(&page->head);
+	page->capacity = page->size;
+	page->data = page->buffer;
+	page->share = NULL;
 
 	return page;
 }
@@ -1677,7 +1683,11 @@ static struct IMSPAGE *ims_page_new(struct IMSTREAM *s)
 // free page into kmem-system or IMEMNODE
 static void ims_page_del(struct IMSTREAM *s, struct IMSPAGE *page)
 {
-	if (s->fixed_pages != NULL) {
+	if (page->share != NULL) {
+		ims_share_release(page->share);
+		ikmem_free(page);
+	}
+	else if (s->fixed_pages != NULL) {
 		assert(page->index != (iulong)0xfffffffful);
 		imnode_del(s->fixed_pages, page->index);
 	}	else {
@@ -1733,6 +1743,7 @@ static struct IMSPAGE *ims_page_cache_get(struct IMSTREAM *s)
 	page = ilist_entry(s->lru.next, struct IMSPAGE, head);
 	ilist_del(&page->head);
 	s->lrusize--;
+	page->size = page->capacity;
 
 	return page;
 }
@@ -1740,6 +1751,10 @@ static struct IMSPAGE *ims_page_cache_get(struct IMSTREAM *s)
 // give page back to lru cache
 static void ims_page_cache_release(struct IMSTREAM *s, struct IMSPAGE *page)
 {
+	if (page->share != NULL) {
+		ims_page_del(s, page);
+		return;
+	}
 	ilist_add_tail(&page->head, &s->lru);
 	s->lrusize++;
 	for (; s->lrusize > (IMSPAGE_LRU_SIZE << 1); ) {
@@ -1890,6 +1905,95 @@ ilong ims_flat(const struct IMSTREAM *s, void **pointer)
 	return s->pos_write - s->pos_read;
 }
 
+// get flat pointers of the first count pages (no drop)
+int ims_flatv(const struct IMSTREAM *s, void *ptrs[], ilong sizes[], 
+	int count)
+{
+	const struct ILISTHEAD *it;
+	iulong remain = s->size;
+	int n = 0;
+	for (it = s->head.next; it != &s->head && n < count && remain > 0; 
+			it = it->next) {
+		struct IMSPAGE *page = ilist_entry(it, struct IMSPAGE, head);
+		iulong start = (n == 0)? s->pos_read : 0;
+		iulong size = page->size - start;
+		if (size > remain) size = remain;
+		ptrs[n] = page->data + start;
+		sizes[n] = (ilong)size;
+		remain -= size;
+		n++;
+	}
+	return n;
+}
+
+// create a shared buffer with one reference
+IMSSHARE *ims_share_new(const void *ptr, ilong size)
+{
+	IMSSHARE *share;
+	size = (size < 0)? 0 : size;
+	share = (IMSSHARE*)ikmem_malloc(sizeof(IMSSHARE) + size + 1);
+	if (share == NULL) return NULL;
+	share->refcnt = 1;
+	share->size = size;
+	share->data = ((IUINT8*)share) + sizeof(IMSSHARE);
+	if (ptr != NULL && size > 0) {
+		memcpy(share->data, ptr, size);
+	}
+	return share;
+}
+
+// add a reference
+void ims_share_ref(IMSSHARE *share)
+{
+	assert(share->refcnt > 0);
+	share->refcnt++;
+}
+
+// drop a reference, the buffer is freed with the last one
+void ims_share_release(IMSSHARE *share)
+{
+	assert(share->refcnt > 0);
+	share->refcnt--;
+	if (share->refcnt == 0) {
+		ikmem_free(share);
+	}
+}
+
+// append a reference of share to the stream: a page header pointing
+// to the shared data is linked as the new tail. pages before the tail
+// are always full, so a partially written tail is trimmed to its data.
+ilong ims_write_share(struct IMSTREAM *s, IMSSHARE *share)
+{
+	struct IMSPAGE *page, *tail;
+	if (share->size <= 0) return 0;
+	page = (struct IMSPAGE*)ikmem_malloc(sizeof(struct IMSPAGE));
+	if (page == NULL) return -1;
+	if (s->size == 0) {
+		while (!ilist_is_empty(&s->head)) {
+			tail = ilist_entry(s->head.next, struct IMSPAGE, head);
+			ilist_del(&tail->head);
+			ims_page_cache_release(s, tail);
+		}
+		s->pos_read = 0;
+		s->pos_write = 0;
+	}
+	else {
+		tail = ilist_entry(s->head.prev, struct IMSPAGE, head);
+		tail->size = s->pos_write;
+	}
+	ilist_init(&page->head);
+	page->index = (iulong)0xfffffffful;
+	page->size = (iulong)share->size;
+	page->capacity = page->size;
+	page->data = share->data;
+	page->share = share;
+	ims_share_ref(share);
+	ilist_add_tail(&page->head, &s->head);
+	s->pos_write = page->size;
+	s->size += page->size;
+	return share->size;
+}
+
 // move data from source to destination
 ilong ims_move(struct IMSTREAM *dst, struct IMSTREAM *src, ilong size)
 {
@@ -1909,6 +2013,62 @@ ilong ims_move(struct IMSTREAM *dst, struct IMSTREAM *src, ilong size)
 	return total;
 }
 
+// move data from source to destination, relink pages when possible
+ilong ims_splice(struct IMSTREAM *dst, struct IMSTREAM *src, ilong size)
+{
+	ilong total = 0;
+	if (dst->fixed_pages != src->fixed_pages) {
+		return ims_move(dst, src, size);
+	}
+	while (size > 0 && src->size > 0) {
+		struct IMSPAGE *page, *tail = NULL;
+		ilong avail;
+		int last;
+		page = ilist_entry(src->head.next, struct IMSPAGE, head);
+		last = (page->head.next == &src->head)? 1 : 0;
+		avail = (last? src->pos_write : page->size) - src->pos_read;
+		if (dst->size == 0) {
+			// drained pages are recycled so a page can become the head
+			while (!ilist_is_empty(&dst->head)) {
+				tail = ilist_entry(dst->head.next, struct IMSPAGE, head);
+				ilist_del(&tail->head);
+				ims_page_cache_release(dst, tail);
+			}
+			dst->pos_read = 0;
+			dst->pos_write = 0;
+			tail = NULL;
+		}
+		else {
+			tail = ilist_entry(dst->head.prev, struct IMSPAGE, head);
+		}
+		if (avail > size || (tail != NULL && 
+			(dst->pos_write != tail->size || src->pos_read != 0))) {
+			// partial page or unaligned tail: copy
+			ilong canmove = (avail < size)? avail : size;
+			ims_write(dst, page->data + src->pos_read, canmove);
+			ims_drop(src, canmove);
+			total += canmove;
+			size -= canmove;
+			continue;
+		}
+		ilist_del(&page->head);
+		ilist_add_tail(&page->head, &dst->head);
+		if (tail == NULL) {
+			dst->pos_read = src->pos_read;
+		}
+		dst->pos_write = last? src->pos_write : page->size;
+		dst->size += avail;
+		src->size -= avail;
+		src->pos_read = 0;
+		if (last) {
+			src->pos_write = 0;
+		}
+		total += avail;
+		size -= avail;
+	}
+	return total;
+}
+
 
 
 //=====================================================================
@@ -2927,6 +3087,303 @@ void icrypt_rc4_crypt(unsigned char *box, int *x, int *y,
 }
 
 
+//=====================================================================
+// LZ
+//=====================================================================
+#define ILZ_HISTSIZE     (ILZ_WINDOW + ILZ_CHUNK)
+#define ILZ_WORKSIZE     (ILZ_CHUNK + (ILZ_CHUNK / 255) + 32)
+#define ILZ_HASH_SIZE    (1 << ILZ_HASH_BITS)
+#define ILZ_MINMATCH     4
+#define ILZ_LASTLITERALS 5
+#define ILZ_MFLIMIT      12
+#define ILZ_MAXOFFSET    0xffff
+
+static inline IUINT32 ilz_read32(const unsigned char *p) {
+	IUINT32 x;
+	memcpy(&x, p, 4);
+	return x;
+}
+
+static inline IUINT32 ilz_hash(IUINT32 x) {
+	return (x * 2654435761U) >> (32 - ILZ_HASH_BITS);
+}
+
+// init lz stream
+int ilz_init(struct ILZSTREAM *lz)
+{
+	lz->hist = (unsigned char*)ikmem_malloc(ILZ_HISTSIZE);
+	lz->work = NULL;
+	lz->table = NULL;
+	lz->hsize = 0;
+	if (lz->hist == NULL) return -1;
+	return 0;
+}
+
+// destroy lz stream
+void ilz_destroy(struct ILZSTREAM *lz)
+{
+	if (lz->hist) ikmem_free(lz->hist);
+	if (lz->work) ikmem_free(lz->work);
+	if (lz->table) ikmem_free(lz->table);
+	lz->hist = NULL;
+	lz->work = NULL;
+	lz->table = NULL;
+	lz->hsize = 0;
+}
+
+// reset dictionary
+void ilz_reset(struct ILZSTREAM *lz)
+{
+	lz->hsize = 0;
+	if (lz->table) {
+		memset(lz->table, 0xff, sizeof(IINT32) * ILZ_HASH_SIZE);
+	}
+}
+
+// max compressed size
+ilong ilz_bound(ilong size)
+{
+	return size + (size / ILZ_CHUNK + 1) * 8;
+}
+
+// make room for a new chunk, keep the last ILZ_WINDOW bytes
+static void ilz_slide(struct ILZSTREAM *lz, ilong need)
+{
+	ilong shift;
+	int i;
+	if (lz->hsize + need <= ILZ_HISTSIZE) return;
+	shift = lz->hsize - ILZ_WINDOW;
+	memmove(lz->hist, lz->hist + shift, ILZ_WINDOW);
+	lz->hsize = ILZ_WINDOW;
+	if (lz->table) {
+		for (i = 0; i < ILZ_HASH_SIZE; i++) {
+			IINT32 pos = lz->table[i] - (IINT32)shift;
+			lz->table[i] = (pos < 0)? -1 : pos;
+		}
+	}
+}
+
+// write sequence length extension
+static inline unsigned char *ilz_put_length(unsigned char *op, ilong len)
+{
+	for (; len >= 255; len -= 255) *op++ = 255;
+	*op++ = (unsigned char)len;
+	return op;
+}
+
+// encode hist[base, base + size) into sequences
+static ilong ilz_encode_chunk(struct ILZSTREAM *lz, ilong base, 
+	ilong size, unsigned char *dst)
+{
+	const unsigned char *h = lz->hist;
+	ilong ip = base, anchor = base, end = base + size;
+	ilong mflimit = end - ILZ_MFLIMIT;
+	ilong matchlimit = end - ILZ_LASTLITERALS;
+	unsigned char *op = dst;
+	ilong literals;
+	while (ip < mflimit) {
+		IUINT32 seq = ilz_read32(h + ip);
+		IUINT32 hv = ilz_hash(seq);
+		ilong ref = lz->table[hv];
+		ilong ml, offset;
+		unsigned char *token;
+		lz->table[hv] = (IINT32)ip;
+		if (ref < 0 || ip - ref > ILZ_MAXOFFSET || 
+			ilz_read32(h + ref) != seq) {
+			ip++;
+			continue;
+		}
+		while (ip > anchor && ref > 0 && h[ip - 1] == h[ref - 1]) {
+			ip--;
+			ref--;
+		}
+		ml = ILZ_MINMATCH;
+		while (ip + ml < matchlimit && h[ip + ml] == h[ref + ml]) ml++;
+		literals = ip - anchor;
+		offset = ip - ref;
+		token = op++;
+		*token = (unsigned char)(((literals < 15)? literals : 15) << 4);
+		if (literals >= 15) op = ilz_put_length(op, literals - 15);
+		memcpy(op, h + anchor, literals);
+		op += literals;
+		*op++ = (unsigned char)(offset & 0xff);
+		*op++ = (unsigned char)(offset >> 8);
+		ml -= ILZ_MINMATCH;
+		*token |= (unsigned char)((ml < 15)? ml : 15);
+		if (ml >= 15) op = ilz_put_length(op, ml - 15);
+		ip += ml + ILZ_MINMATCH;
+		anchor = ip;
+		if (ip - 2 > base) {
+			lz->table[ilz_hash(ilz_read32(h + ip - 2))] = (IINT32)(ip - 2);
+		}
+	}
+	literals = end - anchor;
+	*op++ = (unsigned char)(((literals < 15)? literals : 15) << 4);
+	if (literals >= 15) op = ilz_put_length(op, literals - 15);
+	memcpy(op, h + anchor, literals);
+	op += literals;
+	return (ilong)(op - dst);
+}
+
+// compress data
+ilong ilz_compress(struct ILZSTREAM *lz, const void *src, ilong size,
+	void *dst)
+{
+	const unsigned char *lptr = (const unsigned char*)src;
+	unsigned char *out = (unsigned char*)dst;
+	if (lz->table == NULL) {
+		lz->table = (IINT32*)ikmem_malloc(sizeof(IINT32) * ILZ_HASH_SIZE);
+		if (lz->table == NULL) return -1;
+		memset(lz->table, 0xff, sizeof(IINT32) * ILZ_HASH_SIZE);
+	}
+	if (lz->work == NULL) {
+		lz->work = (unsigned char*)ikmem_malloc(ILZ_WORKSIZE);
+		if (lz->work == NULL) return -1;
+	}
+	while (size > 0) {
+		ilong chunk = (size < ILZ_CHUNK)? size : ILZ_CHUNK;
+		ilong base, csize;
+		ilz_slide(lz, chunk);
+		base = lz->hsize;
+		memcpy(lz->hist + base, lptr, chunk);
+		lz->hsize += chunk;
+		csize = ilz_encode_chunk(lz, base, chunk, lz->work);
+		if (csize >= chunk) {
+			out = (unsigned char*)iencodeu((char*)out, 
+				(((IUINT64)chunk) << 1) | 1);
+			memcpy(out, lptr, chunk);
+			out += chunk;
+		}	else {
+			out = (unsigned char*)iencodeu((char*)out, 
+				((IUINT64)chunk) << 1);
+			out = (unsigned char*)iencodeu((char*)out, (IUINT64)csize);
+			memcpy(out, lz->work, csize);
+			out += csize;
+		}
+		lptr += chunk;
+		size -= chunk;
+	}
+	return (ilong)(out - (unsigned char*)dst);
+}
+
+// decode varint with boundary check, returns bytes used, 0 for short
+static int ilz_get_varint(const unsigned char *p, ilong size, ilong *x)
+{
+	IUINT32 value = 0;
+	int i;
+	for (i = 0; i < 4 && i < size; i++) {
+		value |= ((IUINT32)(p[i] & 0x7f)) << (i * 7);
+		if ((p[i] & 0x80) == 0) {
+			x[0] = (ilong)value;
+			return i + 1;
+		}
+	}
+	return (i >= 4)? -1 : 0;
+}
+
+// peek the first chunk
+ilong ilz_peek(const void *src, ilong size, ilong *rawsize)
+{
+	const unsigned char *p = (const unsigned char*)src;
+	ilong head, csize;
+	int n1, n2;
+	n1 = ilz_get_varint(p, size, &head);
+	if (n1 <= 0) return n1;
+	if ((head >> 1) > ILZ_CHUNK || (head >> 1) == 0) return -1;
+	if (rawsize) rawsize[0] = head >> 1;
+	if (head & 1) return n1 + (head >> 1);
+	n2 = ilz_get_varint(p + n1, size - n1, &csize);
+	if (n2 <= 0) return n2;
+	if (csize >= (head >> 1)) return -1;
+	return n1 + n2 + csize;
+}
+
+// decode sequences into hist[hsize, hsize + rawsize)
+static int ilz_decode_chunk(struct ILZSTREAM *lz, const unsigned char *ip,
+	ilong csize, ilong rawsize)
+{
+	const unsigned char *iend = ip + csize;
+	unsigned char *h = lz->hist;
+	unsigned char *op = h + lz->hsize;
+	unsigned char *oend = op + rawsize;
+	while (ip < iend) {
+		int token = *ip++;
+		ilong literals = token >> 4;
+		ilong ml, offset;
+		const unsigned char *ref;
+		if (literals == 15) {
+			int c;
+			do {
+				if (ip >= iend) return -1;
+				c = *ip++;
+				literals += c;
+			}	while (c == 255);
+		}
+		if (literals > iend - ip || literals > oend - op) return -1;
+		memcpy(op, ip, literals);
+		op += literals;
+		ip += literals;
+		if (op == oend) break;
+		if (iend - ip < 2) return -1;
+		offset = (ilong)ip[0] | ((ilong)ip[1] << 8);
+		ip += 2;
+		ml = token & 15;
+		if (ml == 15) {
+			int c;
+			do {
+				if (ip >= iend) return -1;
+				c = *ip++;
+				ml += c;
+			}	while (c == 255);
+		}
+		ml += ILZ_MINMATCH;
+		if (offset == 0 || offset > (ilong)(op - h)) return -1;
+		if (ml > oend - op) return -1;
+		ref = op - offset;
+		if (offset >= ml) {
+			memcpy(op, ref, ml);
+			op += ml;
+		}	else {
+			for (; ml > 0; ml--) *op++ = *ref++;
+		}
+	}
+	if (ip != iend || op != oend) return -1;
+	return 0;
+}
+
+// decompress data
+ilong ilz_decompress(struct ILZSTREAM *lz, const void *src, ilong size,
+	void *dst, ilong maxsize)
+{
+	const unsigned char *lptr = (const unsigned char*)src;
+	unsigned char *out = (unsigned char*)dst;
+	ilong total = 0;
+	while (size > 0) {
+		ilong rawsize = 0, head = 0, csize = 0;
+		ilong length = ilz_peek(lptr, size, &rawsize);
+		int n;
+		if (length <= 0 || length > size) return -1;
+		if (total + rawsize > maxsize) return -2;
+		ilz_slide(lz, rawsize);
+		n = ilz_get_varint(lptr, size, &head);
+		if (head & 1) {
+			memcpy(lz->hist + lz->hsize, lptr + n, rawsize);
+		}	else {
+			int k = ilz_get_varint(lptr + n, size - n, &csize);
+			if (ilz_decode_chunk(lz, lptr + n + k, csize, rawsize) != 0)
+				return -1;
+		}
+		memcpy(out, lz->hist + lz->hsize, rawsize);
+		lz->hsize += rawsize;
+		out += rawsize;
+		total += rawsize;
+		lptr += length;
+		size -= length;
+	}
+	return total;
+}
+
+
 //=====================================================================
 // UTF-8/16/32 conversion
 //=====================================================================
@@ -9,7 +9,7 @@
 //   BIN/ARRAY/MAP) with 3-layer API (init / new / mutation)
 // - IRING / IMSTREAM: ring buffer and growable memory stream
 // - Integer codec (8~64 bit, LSB/MSB, varint), Base64/32/16
-// - String helpers, RC4, UTF conversion, incremental hash
+// - String helpers, RC4, LZ, UTF conversion, incremental hash
 //
 // For more information, please see the readme file.
 //
@@ -584,6 +584,41 @@ ilong ims_flat(const struct IMSTREAM *s, void **pointer);
 // move data from source to destination
 ilong ims_move(struct IMSTREAM *dst, struct IMSTREAM *src, ilong size);
 
+// move data from source to destination, whole pages are relinked 
+// instead of copied when both streams share the same page allocator
+ilong ims_splice(struct IMSTREAM *dst, struct IMSTREAM *src, ilong size);
+
+// get flat pointers of the first count pages (no drop),
+// returns the number of pointers filled
+int ims_flatv(const struct IMSTREAM *s, void *ptrs[], ilong sizes[], 
+	int count);
+
+
+//---------------------------------------------------------------------
+// IMSSHARE: refcounted read-only buffer which can be appended to many
+// streams without copying. reference counting is not atomic, every
+// stream holding it must be used under the same lock as the owner.
+//---------------------------------------------------------------------
+typedef struct IMSSHARE
+{
+	ilong refcnt;
+	ilong size;
+	IUINT8 *data;
+}	IMSSHARE;
+
+// create a shared buffer with one reference, data is copied from ptr 
+// unless ptr is NULL (caller fills share->data)
+IMSSHARE *ims_share_new(const void *ptr, ilong size);
+
+// add a reference
+void ims_share_ref(IMSSHARE *share);
+
+// drop a reference, the buffer is freed with the last one
+void ims_share_release(IMSSHARE *share);
+
+// append a reference of share to the stream (no copy), returns size
+ilong ims_write_share(struct IMSTREAM *s, IMSSHARE *share);
+
 
 //=====================================================================
 // C-string enhancement (because some may not always be available)
@@ -703,6 +738,54 @@ void icrypt_rc4_crypt(unsigned char *box, int *x, int *y,
 	const unsigned char *src, unsigned char *dst, ilong size);
 
 
+//=====================================================================
+// LZ: fast LZ77 block compressor (LZ4 style sequences) with streaming
+// dictionary: each ILZSTREAM keeps the last ILZ_WINDOW bytes, so the
+// following blocks of the same connection can refer to earlier data.
+// Output is a list of chunks: varint(rawlen << 1 | stored), followed
+// by varint(compressed size) and sequences, or raw bytes if stored.
+//=====================================================================
+#define ILZ_WINDOW       0x10000   // dictionary size
+#define ILZ_CHUNK        0x10000   // max raw size of one chunk
+#define ILZ_HASH_BITS    12
+
+struct ILZSTREAM
+{
+	unsigned char *hist;       // dictionary + current chunk
+	unsigned char *work;       // encoding buffer, allocated on demand
+	IINT32 *table;             // hash table, allocated on demand
+	ilong hsize;               // bytes in hist
+};
+
+typedef struct ILZSTREAM ILZSTREAM;
+
+// init lz stream, returns 0 for success, -1 for out of memory
+int ilz_init(struct ILZSTREAM *lz);
+
+// destroy lz stream
+void ilz_destroy(struct ILZSTREAM *lz);
+
+// reset dictionary
+void ilz_reset(struct ILZSTREAM *lz);
+
+// max compressed size of size bytes input
+ilong ilz_bound(ilong size);
+
+// compress data into dst (at least ilz_bound(size) bytes),
+// returns compressed size, -1 for out of memory
+ilong ilz_compress(struct ILZSTREAM *lz, const void *src, ilong size,
+	void *dst);
+
+// decompress chunks in src, returns decompressed size, -1 for corrupt
+// data, -2 for dst too small (dictionary is undefined after error)
+ilong ilz_decompress(struct ILZSTREAM *lz, const void *src, ilong size,
+	void *dst, ilong maxsize);
+
+// peek the first chunk in src, returns total chunk size, 0 if header
+// is incomplete, -1 for corrupt data. raw size stored in rawsize
+ilong ilz_peek(const void *src, ilong size, ilong *rawsize);
+
+
 //=====================================================================
 // UTF-8/16/32 conversion
 //=====================================================================
@@ -4291,6 +4291,816 @@ int ib_json_encode_pretty(ib_string *out, const ib_object *obj, int indent)
 }
 
 
+//=====================================================================
+// HTTP Reader - incremental HTTP/1.1 message decoder
+//=====================================================================
+#define IB_HTTP_BODY_NONE     0
+#define IB_HTTP_BODY_LENGTH   1
+#define IB_HTTP_BODY_CHUNKED  2
+#define IB_HTTP_BODY_EOF      3
+
+//---------------------------------------------------------------------
+// ib_http_reader structure
+// two-phase processing like ib_resp_reader:
+// 1) scan: find the end of the header block, decide the body framing
+//    and strip chunk framing in place, so the body always becomes one
+//    contiguous region of the buffer
+// 2) build: wrap slices of the buffer into ib_objects (no copy)
+// all offsets below are relative to pos (start of current message),
+// so compaction in feed does not need to adjust them
+//---------------------------------------------------------------------
+struct ib_http_reader
+{
+	struct IVECTOR buffer;       /* input byte buffer */
+	long pos;                    /* start of the current message */
+	long scan_pos;               /* header scan progress */
+	long head_end;               /* end of header block, 0 if unknown */
+	long body_size;              /* body size (de-chunked so far) */
+	long chunk_pos;              /* next chunk header (chunked body) */
+	long msg_end;                /* end of message, 0 if incomplete */
+	int body_mode;               /* IB_HTTP_BODY_* */
+	int keepalive;               /* connection persists after message */
+	int fields;                  /* number of header fields */
+	int finished;                /* end of input was signalled */
+	int expect_head;             /* next response answers a HEAD */
+	long max_header;             /* max header block bytes, default 64KB */
+	long max_body;               /* max body bytes, default 256MB */
+	int max_fields;              /* max header fields, default 128 */
+	int error;                   /* error flag */
+};
+
+
+//---------------------------------------------------------------------
+// find "\r\n" in [start, end), returns position of '\r' or -1
+//---------------------------------------------------------------------
+static long _ib_http_find_crlf(const unsigned char *buf, long start, long end)
+{
+	const unsigned char *p = buf + start;
+	const unsigned char *e = buf + end;
+	while (p + 1 < e) {
+		p = (const unsigned char*)memchr(p, '\r', (size_t)(e - p - 1));
+		if (p == NULL) return -1;
+		if (p[1] == '\n') return (long)(p - buf);
+		p++;
+	}
+	return -1;
+}
+
+//---------------------------------------------------------------------
+// token characters (RFC 9110) for method and field names
+//---------------------------------------------------------------------
+static int _ib_http_tchar(int ch)
+{
+	if (ch >= 'a' && ch <= 'z') return 1;
+	if (ch >= 'A' && ch <= 'Z') return 1;
+	if (ch >= '0' && ch <= '9') return 1;
+	return (ch != 0 && strchr("!#$%&'*+-.^_`|~", ch) != NULL)? 1 : 0;
+}
+
+//---------------------------------------------------------------------
+// case insensitive compare of a slice with a lower case literal
+//---------------------------------------------------------------------
+static int _ib_http_equal(const unsigned char *p, long size, const char *s)
+{
+	long i;
+	for (i = 0; i < size; i++) {
+		int ch = p[i];
+		if (s[i] == 0) return 0;
+		if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+		if (ch != s[i]) return 0;
+	}
+	return (s[size] == 0)? 1 : 0;
+}
+
+//---------------------------------------------------------------------
+// check a comma separated field value contains token
+//---------------------------------------------------------------------
+static int _ib_http_token(const unsigned char *p, long size, const char *token)
+{
+	long i = 0;
+	while (i < size) {
+		long start, end;
+		while (i < size && (p[i] == ' ' || p[i] == '\t' || p[i] == ','))
+			i++;
+		start = i;
+		while (i < size && p[i] != ',') i++;
+		end = i;
+		while (end > start && (p[end - 1] == ' ' || p[end - 1] == '\t'))
+			end--;
+		if (end > start && _ib_http_equal(p + start, end - start, token))
+			return 1;
+	}
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// check a Transfer-Encoding value: returns how many times chunked is
+// listed, or -1 if any other coding appears (none is supported)
+//---------------------------------------------------------------------
+static int _ib_http_chunked(const unsigned char *p, long size)
+{
+	long i = 0;
+	int count = 0;
+	while (i < size) {
+		long start, end;
+		while (i < size && (p[i] == ' ' || p[i] == '\t' || p[i] == ','))
+			i++;
+		start = i;
+		while (i < size && p[i] != ',') i++;
+		end = i;
+		while (end > start && (p[end - 1] == ' ' || p[end - 1] == '\t'))
+			end--;
+		if (end == start) continue;
+		if (!_ib_http_equal(p + start, end - start, "chunked")) return -1;
+		count++;
+	}
+	return count;
+}
+
+//---------------------------------------------------------------------
+// parse "HTTP/1.x", returns minor version or -1
+//---------------------------------------------------------------------
+static int _ib_http_version(const unsigned char *p, long size)
+{
+	if (size != 8 || memcmp(p, "HTTP/1.", 7) != 0) return -1;
+	if (p[7] < '0' || p[7] > '9') return -1;
+	return p[7] - '0';
+}
+
+//---------------------------------------------------------------------
+// validate the header block [0, head_end) and decide body framing.
+// returns 0 on success, -1 on protocol error
+//---------------------------------------------------------------------
+static int _ib_http_head(ib_http_reader *reader, const unsigned char *buf)
+{
+	long end = reader->head_end - 2;
+	long line = _ib_http_find_crlf(buf, 0, end + 2);
+	long length = -1, p;
+	int response = 0, chunked = 0, status = 0, minor, i;
+
+	if (line <= 0) return -1;
+
+	if (line >= 5 && memcmp(buf, "HTTP/", 5) == 0) {
+		/* status-line: HTTP/1.x SP 3DIGIT [SP reason] */
+		response = 1;
+		if (line < 12 || buf[8] != ' ') return -1;
+		minor = _ib_http_version(buf, 8);
+		for (i = 9; i < 12; i++) {
+			if (buf[i] < '0' || buf[i] > '9') return -1;
+			status = status * 10 + (buf[i] - '0');
+		}
+		if (line > 12 && buf[12] != ' ') return -1;
+		for (i = 13; i < line; i++) {
+			if (buf[i] == '\r' || buf[i] == '\n' || buf[i] == 0) return -1;
+		}
+	}
+	else {
+		/* request-line: method SP target SP HTTP/1.x */
+		long s1, s2;
+		for (s1 = 0; s1 < line && _ib_http_tchar(buf[s1]); s1++);
+		if (s1 == 0 || s1 >= line || buf[s1] != ' ') return -1;
+		for (s2 = s1 + 1; s2 < line && buf[s2] > ' ' && buf[s2] < 127; s2++);
+		if (s2 == s1 + 1 || s2 >= line || buf[s2] != ' ') return -1;
+		minor = _ib_http_version(buf + s2 + 1, line - s2 - 1);
+	}
+
+	if (minor < 0) return -1;
+	reader->keepalive = (minor >= 1)? 1 : 0;
+	reader->fields = 0;
+
+	/* header fields */
+	for (p = line + 2; p < end; ) {
+		long next = _ib_http_find_crlf(buf, p, end + 2);
+		long colon, vs, ve, k;
+		for (colon = p; colon < next && _ib_http_tchar(buf[colon]); colon++);
+		if (colon == p || colon >= next || buf[colon] != ':') return -1;
+		if (++reader->fields > reader->max_fields) return -1;
+		for (k = colon + 1; k < next; k++) {
+			/* bare CR, LF or NUL inside a value: smuggling vector */
+			if (buf[k] == '\r' || buf[k] == '\n' || buf[k] == 0) return -1;
+		}
+		for (vs = colon + 1; vs < next && (buf[vs] == ' ' || buf[vs] == '\t'); vs++);
+		for (ve = next; ve > vs && (buf[ve - 1] == ' ' || buf[ve - 1] == '\t'); ve--);
+		if (_ib_http_equal(buf + p, colon - p, "content-length")) {
+			long value = 0;
+			if (ve == vs) return -1;
+			for (k = vs; k < ve; k++) {
+				if (buf[k] < '0' || buf[k] > '9') return -1;
+				if (value > (reader->max_body - (buf[k] - '0')) / 10) return -1;
+				value = value * 10 + (buf[k] - '0');
+			}
+			if (length >= 0 && length != value) return -1;
+			length = value;
+		}
+		else if (_ib_http_equal(buf + p, colon - p, "transfer-encoding")) {
+			/* chunked must be the final and only coding, once */
+			if (chunked || _ib_http_chunked(buf + vs, ve - vs) != 1)
+				return -1;
+			chunked = 1;
+		}
+		else if (_ib_http_equal(buf + p, colon - p, "connection")) {
+			if (_ib_http_token(buf + vs, ve - vs, "close"))
+				reader->keepalive = 0;
+			else if (_ib_http_token(buf + vs, ve - vs, "keep-alive"))
+				reader->keepalive = 1;
+		}
+		p = next + 2;
+	}
+
+	/* body framing (RFC 9112 section 6.3) */
+	if (chunked && length >= 0) return -1;
+	reader->body_size = 0;
+	reader->chunk_pos = reader->head_end;
+	if (response && status >= 200 && reader->expect_head) {
+		/* response to HEAD: headers describe a body that is not sent */
+		reader->expect_head = 0;
+		reader->body_mode = IB_HTTP_BODY_NONE;
+	}
+	else if (response && (status < 200 || status == 204 || status == 304)) {
+		reader->body_mode = IB_HTTP_BODY_NONE;
+	}
+	else if (chunked) {
+		reader->body_mode = IB_HTTP_BODY_CHUNKED;
+	}
+	else if (length >= 0) {
+		reader->body_mode = IB_HTTP_BODY_LENGTH;
+		reader->body_size = length;
+	}
+	else if (response) {
+		reader->body_mode = IB_HTTP_BODY_EOF;
+		reader->keepalive = 0;
+	}
+	else {
+		reader->body_mode = IB_HTTP_BODY_NONE;
+	}
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// incremental chunked body scan: each complete chunk is moved down
+// to the end of the body collected so far
+// returns: 1=complete, 0=need more data, -1=protocol error
+//---------------------------------------------------------------------
+static int _ib_http_chunks(ib_http_reader *reader, unsigned char *buf, 
+		long size)
+{
+	for (;;) {
+		long p = reader->chunk_pos;
+		long e = _ib_http_find_crlf(buf, p, size);
+		long length = 0, k;
+		if (e < 0) {
+			return (size - p > 1024)? -1 : 0;
+		}
+		/* chunk-size = 1*HEXDIG, then optional ";" chunk-ext */
+		for (k = p; k < e && buf[k] != ';'; k++) {
+			int ch = buf[k], x;
+			if (ch >= '0' && ch <= '9') x = ch - '0';
+			else if (ch >= 'a' && ch <= 'f') x = ch - 'a' + 10;
+			else if (ch >= 'A' && ch <= 'F') x = ch - 'A' + 10;
+			else return -1;
+			if (length > (reader->max_body - reader->body_size) / 16)
+				return -1;
+			length = length * 16 + x;
+		}
+		if (k == p) return -1;
+		for (; k < e; k++) {
+			if (buf[k] == '\r' || buf[k] == '\n' || buf[k] == 0) return -1;
+		}
+		if (reader->body_size + length > reader->max_body) return -1;
+		if (length == 0) {
+			/* last-chunk, then optional trailer fields up to CRLF */
+			long q = e + 2;
+			for (;;) {
+				long t = _ib_http_find_crlf(buf, q, size);
+				if (t < 0) {
+					return (size - q > reader->max_header)? -1 : 0;
+				}
+				if (t == q) {
+					reader->msg_end = q + 2;
+					return 1;
+				}
+				q = t + 2;
+			}
+		}
+		if (size < e + 2 + length + 2) return 0;
+		if (buf[e + 2 + length] != '\r' || buf[e + 3 + length] != '\n')
+			return -1;
+		memmove(buf + reader->head_end + reader->body_size, 
+				buf + e + 2, (size_t)length);
+		reader->body_size += length;
+		reader->chunk_pos = e + 2 + length + 2;
+	}
+}
+
+//---------------------------------------------------------------------
+// _ib_http_scan: find a complete message boundary
+// returns: 1=complete, 0=need more data, -1=protocol error
+//---------------------------------------------------------------------
+static int _ib_http_scan(ib_http_reader *reader)
+{
+	unsigned char *buf;
+	long size, end;
+
+	if (reader->msg_end > 0) return 1;
+
+	buf = iv_data(&reader->buffer) + reader->pos;
+	size = (long)iv_size(&reader->buffer) - reader->pos;
+
+	if (reader->head_end == 0) {
+		/* skip empty lines between pipelined messages */
+		while (size >= 2 && buf[0] == '\r' && buf[1] == '\n') {
+			reader->pos += 2;
+			buf += 2;
+			size -= 2;
+			reader->scan_pos = (reader->scan_pos > 2)? reader->scan_pos - 2 : 0;
+		}
+		end = _ib_http_find_crlf(buf, 
+				(reader->scan_pos > 3)? reader->scan_pos - 3 : 0, size);
+		while (end >= 0 && (end + 3 >= size || buf[end + 2] != '\r' ||
+					buf[end + 3] != '\n')) {
+			end = _ib_http_find_crlf(buf, end + 2, size);
+		}
+		if (end < 0) {
+			reader->scan_pos = size;
+			return (size > reader->max_header)? -1 : 0;
+		}
+		if (end + 4 > reader->max_header) return -1;
+		reader->head_end = end + 4;
+		if (_ib_http_head(reader, buf) != 0) return -1;
+	}
+
+	switch (reader->body_mode) {
+	case IB_HTTP_BODY_LENGTH:
+		if (size - reader->head_end < reader->body_size) return 0;
+		reader->msg_end = reader->head_end + reader->body_size;
+		break;
+	case IB_HTTP_BODY_CHUNKED:
+		return _ib_http_chunks(reader, buf, size);
+	case IB_HTTP_BODY_EOF:
+		if (size - reader->head_end > reader->max_body) return -1;
+		if (reader->finished == 0) return 0;
+		reader->body_size = size - reader->head_end;
+		reader->msg_end = size;
+		break;
+	default:
+		reader->msg_end = reader->head_end;
+		break;
+	}
+	return 1;
+}
+
+//---------------------------------------------------------------------
+// wrap a buffer slice into a STR/BIN object without copying
+//---------------------------------------------------------------------
+static ib_object *_ib_http_slice(struct IALLOCATOR *alloc, int type,
+		unsigned char *ptr, long size)
+{
+	ib_object *obj = ib_object_new_nil(alloc);
+	if (obj == NULL) return NULL;
+	obj->type = type;
+	obj->str = ptr;
+	obj->size = (int)size;
+	obj->capacity = (int)size;
+	return obj;
+}
+
+//---------------------------------------------------------------------
+// push a child into the message array, deletes it on failure
+//---------------------------------------------------------------------
+static int _ib_http_push(struct IALLOCATOR *alloc, ib_object *arr,
+		ib_object *item)
+{
+	if (item == NULL) return -1;
+	if (ib_object_array_push(alloc, arr, item) != 0) {
+		ib_object_delete(alloc, item);
+		return -1;
+	}
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// build the message object from the scanned region. start line parts
+// and header fields are NUL-terminated in place, field names are
+// lower-cased so they can be looked up with ib_object_map_get_str
+//---------------------------------------------------------------------
+static ib_object *_ib_http_build(ib_http_reader *reader, 
+		struct IALLOCATOR *alloc)
+{
+	unsigned char *buf = iv_data(&reader->buffer) + reader->pos;
+	long end = reader->head_end - 2;
+	long line = _ib_http_find_crlf(buf, 0, end + 2);
+	long s1, s2, p;
+	ib_object *obj, *map;
+
+	obj = ib_object_new_array(alloc, 5);
+	if (obj == NULL) return NULL;
+
+	/* start line: three parts, the reason phrase may contain spaces */
+	for (s1 = 0; buf[s1] != ' '; s1++);
+	for (s2 = s1 + 1; s2 < line && buf[s2] != ' '; s2++);
+	buf[s1] = 0;
+	buf[line] = 0;
+	if (s2 < line) buf[s2] = 0;
+	if (_ib_http_push(alloc, obj, 
+			_ib_http_slice(alloc, IB_OBJECT_STR, buf, s1)) != 0)
+		goto failed;
+	if (_ib_http_push(alloc, obj, _ib_http_slice(alloc, IB_OBJECT_STR,
+			buf + s1 + 1, s2 - s1 - 1)) != 0)
+		goto failed;
+	if (s2 < line) s2++;
+	if (_ib_http_push(alloc, obj, _ib_http_slice(alloc, IB_OBJECT_STR,
+			buf + s2, line - s2)) != 0)
+		goto failed;
+
+	/* header fields */
+	map = ib_object_new_map(alloc, reader->fields);
+	if (_ib_http_push(alloc, obj, map) != 0)
+		goto failed;
+	for (p = line + 2; p < end; ) {
+		long next = _ib_http_find_crlf(buf, p, end + 2);
+		long colon, vs, ve;
+		ib_object *key, *val;
+		for (colon = p; buf[colon] != ':'; colon++) {
+			if (buf[colon] >= 'A' && buf[colon] <= 'Z') 
+				buf[colon] += 'a' - 'A';
+		}
+		for (vs = colon + 1; vs < next && (buf[vs] == ' ' || buf[vs] == '\t'); vs++);
+		for (ve = next; ve > vs && (buf[ve - 1] == ' ' || buf[ve - 1] == '\t'); ve--);
+		buf[colon] = 0;
+		buf[ve] = 0;
+		key = _ib_http_slice(alloc, IB_OBJECT_STR, buf + p, colon - p);
+		val = _ib_http_slice(alloc, IB_OBJECT_STR, buf + vs, ve - vs);
+		if (key == NULL || val == NULL || 
+				ib_object_map_add(alloc, map, key, val) != 0) {
+			if (key) ib_object_delete(alloc, key);
+			if (val) ib_object_delete(alloc, val);
+			goto failed;
+		}
+		p = next + 2;
+	}
+
+	/* body: contiguous after chunk framing was removed by scan */
+	if (_ib_http_push(alloc, obj, _ib_http_slice(alloc, IB_OBJECT_BIN, 
+			buf + reader->head_end, reader->body_size)) != 0)
+		goto failed;
+
+	if (reader->keepalive == 0) {
+		obj->flags |= IB_OBJECT_FLAG_CLOSE;
+	}
+	return obj;
+
+failed:
+	ib_object_delete(alloc, obj);
+	return NULL;
+}
+
+
+//---------------------------------------------------------------------
+// HTTP Reader public API
+//---------------------------------------------------------------------
+
+//---------------------------------------------------------------------
+// create a new HTTP incremental decoder
+// defaults: max_header=64KB, max_body=256MB, max_fields=128
+//---------------------------------------------------------------------
+ib_http_reader *ib_http_reader_new(void)
+{
+	ib_http_reader *reader;
+	reader = (ib_http_reader *)ikmem_malloc(sizeof(ib_http_reader));
+	if (reader == NULL) return NULL;
+	iv_init(&reader->buffer, NULL);
+	reader->max_header = 64 * 1024L;
+	reader->max_body = 256 * 1024 * 1024L;
+	reader->max_fields = 128;
+	reader->pos = 0;
+	reader->finished = 0;
+	reader->expect_head = 0;
+	reader->error = 0;
+	reader->scan_pos = 0;
+	reader->head_end = 0;
+	reader->body_size = 0;
+	reader->chunk_pos = 0;
+	reader->msg_end = 0;
+	reader->body_mode = IB_HTTP_BODY_NONE;
+	reader->keepalive = 1;
+	reader->fields = 0;
+	return reader;
+}
+
+//---------------------------------------------------------------------
+// destroy HTTP decoder and free internal buffers
+//---------------------------------------------------------------------
+void ib_http_reader_delete(ib_http_reader *reader)
+{
+	if (reader != NULL) {
+		iv_destroy(&reader->buffer);
+		ikmem_free(reader);
+	}
+}
+
+//---------------------------------------------------------------------
+// append input data to the decoder buffer
+// compacts consumed bytes, which invalidates slices of earlier reads
+//---------------------------------------------------------------------
+int ib_http_reader_feed(ib_http_reader *reader, const void *data, long len)
+{
+	if (len <= 0) return 0;
+
+	if (reader->pos > 0) {
+		long remain = (long)iv_size(&reader->buffer) - reader->pos;
+		if (remain > 0) {
+			memmove(iv_data(&reader->buffer),
+					iv_data(&reader->buffer) + reader->pos,
+					(size_t)remain);
+		}
+		iv_resize(&reader->buffer, (size_t)remain);
+		reader->pos = 0;
+	}
+
+	return iv_push(&reader->buffer, data, (size_t)len);
+}
+
+//---------------------------------------------------------------------
+// try to read one complete message from the buffer
+// returns: 1=success (*result holds the object), 0=incomplete, -1=error
+//---------------------------------------------------------------------
+int ib_http_reader_read(ib_http_reader *reader,
+		ib_object **result, struct IALLOCATOR *alloc)
+{
+	int rc;
+
+	if (reader->error)
+		return -1;
+
+	rc = _ib_http_scan(reader);
+	if (rc == 0)
+		return 0;
+	if (rc < 0) {
+		reader->error = 1;
+		return -1;
+	}
+
+	*result = _ib_http_build(reader, alloc);
+	if (*result == NULL) {
+		reader->error = 1;
+		return -1;
+	}
+
+	/* advance to the next message, reset scan state */
+	reader->pos += reader->msg_end;
+	reader->scan_pos = 0;
+	reader->head_end = 0;
+	reader->body_size = 0;
+	reader->chunk_pos = 0;
+	reader->msg_end = 0;
+	reader->body_mode = IB_HTTP_BODY_NONE;
+
+	return 1;
+}
+
+//---------------------------------------------------------------------
+// reset decoder state, clear buffer and error flag
+//---------------------------------------------------------------------
+void ib_http_reader_clear(ib_http_reader *reader)
+{
+	iv_clear(&reader->buffer);
+	reader->pos = 0;
+	reader->scan_pos = 0;
+	reader->head_end = 0;
+	reader->body_size = 0;
+	reader->chunk_pos = 0;
+	reader->msg_end = 0;
+	reader->body_mode = IB_HTTP_BODY_NONE;
+	reader->finished = 0;
+	reader->expect_head = 0;
+	reader->error = 0;
+}
+
+//---------------------------------------------------------------------
+// signal end-of-input: completes a response delimited by close
+//---------------------------------------------------------------------
+void ib_http_reader_finish(ib_http_reader *reader)
+{
+	reader->finished = 1;
+}
+
+//---------------------------------------------------------------------
+// the next final response has no body (it answers a HEAD request)
+//---------------------------------------------------------------------
+void ib_http_reader_expect_head(ib_http_reader *reader)
+{
+	reader->expect_head = 1;
+}
+
+//---------------------------------------------------------------------
+// configure decoder safety limits
+//---------------------------------------------------------------------
+void ib_http_reader_set_limits(ib_http_reader *reader,
+		long max_header, long max_body, int max_fields)
+{
+	reader->max_header = max_header;
+	reader->max_body = max_body;
+	reader->max_fields = max_fields;
+}
+
+
+//=====================================================================
+// HTTP Writer - stateless HTTP/1.1 message serialization
+//=====================================================================
+
+//---------------------------------------------------------------------
+// reason phrases for common status codes
+//---------------------------------------------------------------------
+static const char *_ib_http_reason(int code)
+{
+	switch (code) {
+	case 100: return "Continue";
+	case 101: return "Switching Protocols";
+	case 200: return "OK";
+	case 201: return "Created";
+	case 202: return "Accepted";
+	case 204: return "No Content";
+	case 206: return "Partial Content";
+	case 301: return "Moved Permanently";
+	case 302: return "Found";
+	case 304: return "Not Modified";
+	case 400: return "Bad Request";
+	case 401: return "Unauthorized";
+	case 403: return "Forbidden";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 408: return "Request Timeout";
+	case 413: return "Content Too Large";
+	case 429: return "Too Many Requests";
+	case 500: return "Internal Server Error";
+	case 501: return "Not Implemented";
+	case 502: return "Bad Gateway";
+	case 503: return "Service Unavailable";
+	case 504: return "Gateway Timeout";
+	}
+	return "Unknown";
+}
+
+//---------------------------------------------------------------------
+// write request line: "METHOD target HTTP/1.1\r\n"
+//---------------------------------------------------------------------
+int ib_http_write_request(ib_string *out, const char *method, 
+		const char *target)
+{
+	ib_string_append(out, method);
+	ib_string_append_c(out, ' ');
+	ib_string_append(out, target);
+	ib_string_append_size(out, " HTTP/1.1\r\n", 11);
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// write status line: "HTTP/1.1 code reason\r\n"
+//---------------------------------------------------------------------
+int ib_http_write_status(ib_string *out, int code, const char *reason)
+{
+	char buf[32];
+	int n = illtoa((IINT64)code, buf, 10);
+	ib_string_append_size(out, "HTTP/1.1 ", 9);
+	ib_string_append_size(out, buf, n);
+	ib_string_append_c(out, ' ');
+	ib_string_append(out, (reason)? reason : _ib_http_reason(code));
+	ib_string_append_size(out, "\r\n", 2);
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// write header field: "name: value\r\n"
+//---------------------------------------------------------------------
+int ib_http_write_header(ib_string *out, const char *name, 
+		const char *value)
+{
+	ib_string_append(out, name);
+	ib_string_append_size(out, ": ", 2);
+	ib_string_append(out, value);
+	ib_string_append_size(out, "\r\n", 2);
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// write "Content-Length", end of header block and the body
+//---------------------------------------------------------------------
+int ib_http_write_body(ib_string *out, const void *data, long size)
+{
+	char buf[32];
+	int n = illtoa((IINT64)size, buf, 10);
+	ib_string_append_size(out, "Content-Length: ", 16);
+	ib_string_append_size(out, buf, n);
+	ib_string_append_size(out, "\r\n\r\n", 4);
+	if (size > 0) {
+		ib_string_append_size(out, (const char*)data, (int)size);
+	}
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// write one chunk of a chunked body, size 0 writes the last chunk
+// ("Transfer-Encoding: chunked" and the blank line are written by
+// the caller)
+//---------------------------------------------------------------------
+int ib_http_write_chunk(ib_string *out, const void *data, long size)
+{
+	char buf[32];
+	int n = illtoa((IINT64)size, buf, 16);
+	ib_string_append_size(out, buf, n);
+	ib_string_append_size(out, "\r\n", 2);
+	if (size > 0) {
+		ib_string_append_size(out, (const char*)data, (int)size);
+	}
+	ib_string_append_size(out, "\r\n", 2);
+	return 0;
+}
+
+//---------------------------------------------------------------------
+// append a STR/BIN/INT object as text
+//---------------------------------------------------------------------
+static int _ib_http_write_text(ib_string *out, const ib_object *obj)
+{
+	if (obj == NULL) return -1;
+	if (obj->type == IB_OBJECT_STR || obj->type == IB_OBJECT_BIN) {
+		ib_string_append_size(out, (const char*)obj->str, obj->size);
+		return 0;
+	}
+	if (obj->type == IB_OBJECT_INT) {
+		char buf[32];
+		int n = illtoa(obj->integer, buf, 10);
+		ib_string_append_size(out, buf, n);
+		return 0;
+	}
+	return -1;
+}
+
+//---------------------------------------------------------------------
+// status code of a response object, -1 for requests
+//---------------------------------------------------------------------
+static int _ib_http_status(const ib_object *obj)
+{
+	const ib_object *x = obj->element[0];
+	const ib_object *y = obj->element[1];
+	int status = 0, i;
+	if (x == NULL || x->type != IB_OBJECT_STR || x->size < 5 ||
+		memcmp(x->str, "HTTP/", 5) != 0)
+		return -1;
+	if (y == NULL) return -1;
+	if (y->type == IB_OBJECT_INT) return (int)y->integer;
+	if (y->type != IB_OBJECT_STR && y->type != IB_OBJECT_BIN) return -1;
+	for (i = 0; i < y->size && i < 3; i++) {
+		if (y->str[i] < '0' || y->str[i] > '9') return -1;
+		status = status * 10 + (y->str[i] - '0');
+	}
+	return status;
+}
+
+//---------------------------------------------------------------------
+// encode a message object (same layout as ib_http_reader_read) into
+// HTTP/1.1 text, Content-Length is generated from the body except for
+// 1xx/204/304 responses, which can not have one
+//---------------------------------------------------------------------
+int ib_http_encode(ib_string *out, const ib_object *obj)
+{
+	const ib_object *map = NULL;
+	const ib_object *body = NULL;
+	int i, status;
+	if (obj == NULL || obj->type != IB_OBJECT_ARRAY || obj->size < 3)
+		return -1;
+	status = _ib_http_status(obj);
+	for (i = 0; i < 3; i++) {
+		if (_ib_http_write_text(out, obj->element[i]) != 0) return -1;
+		ib_string_append_size(out, (i < 2)? " " : "\r\n", (i < 2)? 1 : 2);
+	}
+	if (obj->size > 3) map = obj->element[3];
+	if (obj->size > 4) body = obj->element[4];
+	if (map != NULL && map->type == IB_OBJECT_MAP) {
+		for (i = 0; i < map->size; i++) {
+			const ib_object *key = ib_object_map_key(map, i);
+			const ib_object *val = ib_object_map_val(map, i);
+			if (key == NULL || key->type != IB_OBJECT_STR) return -1;
+			if (_ib_http_equal(key->str, key->size, "content-length") ||
+				_ib_http_equal(key->str, key->size, "transfer-encoding"))
+				continue;
+			ib_string_append_size(out, (const char*)key->str, key->size);
+			ib_string_append_size(out, ": ", 2);
+			if (_ib_http_write_text(out, val) != 0) return -1;
+			ib_string_append_size(out, "\r\n", 2);
+		}
+	}
+	if (status >= 0 && (status < 200 || status == 204 || status == 304)) {
+		ib_string_append_size(out, "\r\n", 2);
+		return 0;
+	}
+	if (body != NULL && (body->type == IB_OBJECT_STR || 
+				body->type == IB_OBJECT_BIN)) {
+		return ib_http_write_body(out, body->str, body->size);
+	}
+	return ib_http_write_body(out, NULL, 0);
+}
+
+
 //=====================================================================
 // Object Enhancement
 //=====================================================================
@@ -546,6 +546,118 @@ int ib_json_decode(const char *input, size_t size,
 int ib_json_encode_pretty(ib_string *out, const ib_object *obj, int indent);
 
 
+//---------------------------------------------------------------------
+// ib_http_reader - incremental HTTP/1.1 message decoder
+//
+// Parses requests and responses (detected by the "HTTP/" prefix of
+// the start line) incrementally, with Content-Length, chunked and
+// close-delimited bodies. Pipelined messages are returned one by one.
+// Chunk framing is removed in place, so every part of the decoded
+// object is a slice into the reader buffer (no copy): the slices stay
+// valid until the next feed/clear/delete of the reader.
+//
+// Decoded ib_object layout (ARRAY of 5):
+//   request:  ["GET", "/path", "HTTP/1.1", {headers}, body]
+//   response: ["HTTP/1.1", "200", "OK", {headers}, body]
+//   headers:  MAP of STR -> STR in arrival order, names are lower-cased,
+//             duplicates are kept (use ib_object_map_get_str to find
+//             the first one)
+//   body:     BIN (size 0 when there is no body), not NUL-terminated
+//   IB_OBJECT_FLAG_CLOSE is set on the array when the connection
+//   will not be reused after this message (HTTP/1.0 without
+//   keep-alive, "Connection: close" or a close-delimited body).
+// Responses to HEAD requests can not be told apart from the bytes,
+// call ib_http_reader_expect_head before feeding such a response.
+//---------------------------------------------------------------------
+struct ib_http_reader;
+typedef struct ib_http_reader ib_http_reader;
+
+// HTTP message flag: connection closes after this message
+#define IB_OBJECT_FLAG_CLOSE    128
+
+// create a new HTTP incremental decoder.
+// default limits: max_header=64KB, max_body=256MB, max_fields=128.
+// returns NULL on allocation failure.
+ib_http_reader *ib_http_reader_new(void);
+
+// destroy the decoder and free all internal buffers.
+void ib_http_reader_delete(ib_http_reader *reader);
+
+// append raw data to the decoder's input buffer.
+// automatically compacts consumed bytes. returns 0 on success.
+int ib_http_reader_feed(ib_http_reader *reader, const void *data, long len);
+
+// try to read one complete HTTP message from the buffer.
+// returns:  1 = success (*result receives a new ib_object tree),
+//           0 = incomplete (need more data via feed),
+//          -1 = protocol error (decoder is poisoned, call clear to reset).
+// alloc: optional IALLOCATOR (e.g. zone allocator); NULL uses default.
+// caller owns *result and must call ib_object_delete() when done.
+int ib_http_reader_read(ib_http_reader *reader,
+        ib_object **result, struct IALLOCATOR *alloc);
+
+// reset the decoder: clear buffer, scan state and error flag.
+void ib_http_reader_clear(ib_http_reader *reader);
+
+// signal end-of-input: completes a response whose body is delimited
+// by connection close (no Content-Length, not chunked).
+void ib_http_reader_finish(ib_http_reader *reader);
+
+// the next final (non-1xx) response answers a HEAD request: it has
+// no body whatever Content-Length says. with pipelining, call it after
+// the responses to the requests sent before the HEAD have been read.
+void ib_http_reader_expect_head(ib_http_reader *reader);
+
+// configure safety limits to prevent resource exhaustion:
+//   max_header - max header block size in bytes (default 64KB)
+//   max_body   - max body size in bytes (default 256MB)
+//   max_fields - max header fields in a message (default 128)
+void ib_http_reader_set_limits(ib_http_reader *reader,
+        long max_header, long max_body, int max_fields);
+
+
+//---------------------------------------------------------------------
+// HTTP writer - stateless HTTP/1.1 serialization
+//
+// Example - a response with a fixed body:
+//   ib_http_write_status(out, 200, NULL);
+//   ib_http_write_header(out, "Content-Type", "text/plain");
+//   ib_http_write_body(out, "hello", 5);
+//
+// Example - a chunked response:
+//   ib_http_write_status(out, 200, NULL);
+//   ib_http_write_header(out, "Transfer-Encoding", "chunked");
+//   ib_string_append_size(out, "\r\n", 2);
+//   ib_http_write_chunk(out, data, size);   // repeated
+//   ib_http_write_chunk(out, NULL, 0);      // last chunk
+//---------------------------------------------------------------------
+
+// write request line "METHOD target HTTP/1.1\r\n"
+int ib_http_write_request(ib_string *out, const char *method, 
+        const char *target);
+
+// write status line "HTTP/1.1 code reason\r\n", reason NULL uses
+// the standard phrase of the code
+int ib_http_write_status(ib_string *out, int code, const char *reason);
+
+// write header field "name: value\r\n"
+int ib_http_write_header(ib_string *out, const char *name, 
+        const char *value);
+
+// write "Content-Length: size", the blank line and the body
+int ib_http_write_body(ib_string *out, const void *data, long size);
+
+// write one chunk "hex\r\ndata\r\n", size 0 writes the last chunk
+int ib_http_write_chunk(ib_string *out, const void *data, long size);
+
+// encode a message object with the layout produced by the reader.
+// Content-Length/Transfer-Encoding headers in the map are skipped
+// and Content-Length is generated from the body (element 4, optional),
+// 1xx/204/304 responses are written without Content-Length and body.
+// returns 0 on success, -1 on failure.
+int ib_http_encode(ib_string *out, const ib_object *obj);
+
+
 //---------------------------------------------------------------------
 // Object Enhancement
 //---------------------------------------------------------------------
@@ -28,6 +28,7 @@
 #include <unistd.h>
 #include <netinet/in.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 
 #ifndef __AVM3__
 #include <poll.h>
@@ -601,6 +602,34 @@ int iaccept(int sock, struct sockaddr *addr, int *addrlen)
 	return hr;
 }
 
+/* accept and set IACCEPT_NOBLOCK/IACCEPT_CLOEXEC flags */
+#if defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+#endif
+
+int iaccept4(int sock, struct sockaddr *addr, int *addrlen, int flags)
+{
+	int fd;
+#if defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+	socklen_t len = sizeof(struct sockaddr);
+	int mode = 0;
+	if (addrlen && addrlen[0] > 0) len = (socklen_t)addrlen[0];
+	if (flags & IACCEPT_NOBLOCK) mode |= SOCK_NONBLOCK;
+	if (flags & IACCEPT_CLOEXEC) mode |= SOCK_CLOEXEC;
+	fd = accept4(sock, addr, (addr)? &len : NULL, mode);
+	if (fd >= 0 || ierrno() != ENOSYS) {
+		if (addrlen && addr) addrlen[0] = (int)len;
+		return fd;
+	}
+#endif
+	fd = iaccept(sock, addr, addrlen);
+	if (fd >= 0) {
+		if (flags & IACCEPT_NOBLOCK) isocket_enable(fd, ISOCK_NOBLOCK);
+		if (flags & IACCEPT_CLOEXEC) isocket_enable(fd, ISOCK_CLOEXEC);
+	}
+	return fd;
+}
+
 /* get error number */
 int ierrno(void)
 {
@@ -619,6 +648,43 @@ long isend(int sock, const void *buf, long size, int mode)
 	return (long)send(sock, (char*)buf, size, mode);
 }
 
+/* send vector, at most ISENDV_MAX buffers are gathered in one call */
+long isendv(int sock, const void * const vecptr[], const long veclen[],
+	int count, int mode)
+{
+#if defined(_WIN32) && (!defined(_XBOX))
+	WSABUF bufs[ISENDV_MAX];
+	DWORD sent = 0;
+	int i;
+	if (count > ISENDV_MAX) count = ISENDV_MAX;
+	for (i = 0; i < count; i++) {
+		bufs[i].buf = (char*)vecptr[i];
+		bufs[i].len = (ULONG)veclen[i];
+	}
+	if (WSASend(sock, bufs, (DWORD)count, &sent, (DWORD)mode, 
+			NULL, NULL) != 0) {
+		return -1;
+	}
+	return (long)sent;
+#elif defined(__unix)
+	struct iovec iov[ISENDV_MAX];
+	struct msghdr msg;
+	int i;
+	if (count > ISENDV_MAX) count = ISENDV_MAX;
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = (void*)vecptr[i];
+		iov[i].iov_len = (size_t)veclen[i];
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	return (long)sendmsg(sock, &msg, mode);
+#else
+	if (count <= 0) return 0;
+	return isend(sock, vecptr[0], veclen[0], mode);
+#endif
+}
+
 /* receive data */
 long irecv(int sock, void *buf, long size, int mode)
 {
@@ -527,6 +527,74 @@ void ithread_once(int *control, void (*run_once)(void));
 #endif
 
 
+/*===================================================================*/
+/* Cross-Platform Atomic Interface                                   */
+/*===================================================================*/
+/* operands are 32-bit integers (IINT32/int), or pointers for the    */
+/* _PTR variants. ADD returns the previous value, CAS returns 1 when */
+/* the value was swapped. LOAD acquires and STORE releases.          */
+#ifndef IATOMIC_ADD
+
+#if defined(_MSC_VER) && (defined(WIN32) || defined(_WIN32))
+#define IATOMIC_ADD(p, v) \
+	InterlockedExchangeAdd((volatile LONG*)(p), (LONG)(v))
+#define IATOMIC_CAS(p, o, n) \
+	(InterlockedCompareExchange((volatile LONG*)(p), \
+	 (LONG)(n), (LONG)(o)) == (LONG)(o))
+#define IATOMIC_XCHG(p, v) \
+	InterlockedExchange((volatile LONG*)(p), (LONG)(v))
+#define IATOMIC_LOAD(p) \
+	InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define IATOMIC_STORE(p, v) \
+	((void)InterlockedExchange((volatile LONG*)(p), (LONG)(v)))
+#define IATOMIC_CAS_PTR(p, o, n) \
+	(InterlockedCompareExchangePointer((PVOID volatile*)(p), \
+	 (PVOID)(n), (PVOID)(o)) == (PVOID)(o))
+#define IATOMIC_XCHG_PTR(p, v) \
+	InterlockedExchangePointer((PVOID volatile*)(p), (PVOID)(v))
+#define IATOMIC_LOAD_PTR(p) \
+	InterlockedCompareExchangePointer((PVOID volatile*)(p), NULL, NULL)
+
+#elif defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || \
+	((__GNUC__ == 4) && (__GNUC_MINOR__ >= 7))))
+#define IATOMIC_ADD(p, v)        __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL)
+#define IATOMIC_CAS(p, o, n)     __sync_bool_compare_and_swap(p, o, n)
+#define IATOMIC_XCHG(p, v)       __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define IATOMIC_LOAD(p)          __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define IATOMIC_STORE(p, v)      __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define IATOMIC_CAS_PTR(p, o, n) __sync_bool_compare_and_swap(p, o, n)
+#define IATOMIC_XCHG_PTR(p, v)   __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define IATOMIC_LOAD_PTR(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+
+#elif defined(__GNUC__)
+#define IATOMIC_ADD(p, v)        __sync_fetch_and_add(p, v)
+#define IATOMIC_CAS(p, o, n)     __sync_bool_compare_and_swap(p, o, n)
+#define IATOMIC_XCHG(p, v)       __sync_lock_test_and_set(p, v)
+#define IATOMIC_LOAD(p)          __sync_fetch_and_add(p, 0)
+#define IATOMIC_STORE(p, v)      ((void)__sync_lock_test_and_set(p, v))
+#define IATOMIC_CAS_PTR(p, o, n) __sync_bool_compare_and_swap(p, o, n)
+#define IATOMIC_XCHG_PTR(p, v)   __sync_lock_test_and_set(p, v)
+#define IATOMIC_LOAD_PTR(p)      __sync_val_compare_and_swap(p, 0, 0)
+
+#else
+/* no threads: plain operations, like the IMUTEX fallback above */
+#define IATOMIC_ADD(p, v)        ((*(p) += (v)) - (v))
+#define IATOMIC_CAS(p, o, n)     ((*(p) == (o))? ((*(p) = (n)), 1) : 0)
+#define IATOMIC_XCHG(p, v)       iatomic_xchg_int((int*)(p), (int)(v))
+#define IATOMIC_LOAD(p)          (*(p))
+#define IATOMIC_STORE(p, v)      ((void)(*(p) = (v)))
+#define IATOMIC_CAS_PTR(p, o, n) IATOMIC_CAS(p, o, n)
+#define IATOMIC_XCHG_PTR(p, v)   iatomic_xchg_ptr((void**)(p), (void*)(v))
+#define IATOMIC_LOAD_PTR(p)      (*(p))
+static inline int iatomic_xchg_int(int *p, int v) {
+	int x = *p; *p = v; return x; }
+static inline void *iatomic_xchg_ptr(void **p, void *v) {
+	void *x = *p; *p = v; return x; }
+#endif
+
+#endif
+
+
 
 /*===================================================================*/
 /* Cross-Platform Socket Interface                                   */
@@ -553,12 +621,25 @@ int ilisten(int sock, int count);
 /* accept */
 int iaccept(int sock, struct sockaddr *addr, int *addrlen);
 
+/* accept and set ISOCK_NOBLOCK/ISOCK_CLOEXEC on the new socket, 
+ * in a single accept4 call where available */
+int iaccept4(int sock, struct sockaddr *addr, int *addrlen, int flags);
+
+#define IACCEPT_NOBLOCK  1
+#define IACCEPT_CLOEXEC  2
+
 /* get errno */
 int ierrno(void);
 
 /* send */
 long isend(int sock, const void *buf, long size, int mode);
 
+/* send vector, gathers at most ISENDV_MAX buffers in one call */
+long isendv(int sock, const void * const vecptr[], const long veclen[],
+	int count, int mode);
+
+#define ISENDV_MAX 64
+
 /* receive */
 long irecv(int sock, void *buf, long size, int mode);
 
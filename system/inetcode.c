@@ -852,6 +852,28 @@ long async_sock_send(CAsyncSock *asyncsock, const void *ptr, long size,
 	return async_sock_send_vector(asyncsock, vecptr, veclen, 1, mask);
 }
 
+// send a shared buffer as one packet without copying the payload,
+// only for sockets without rc4 (the bytes would differ per socket)
+long async_sock_send_share(CAsyncSock *asyncsock, IMSSHARE *share, 
+	int mask)
+{
+	unsigned char head[4];
+	int hdrlen;
+	assert(asyncsock);
+	if (asyncsock->rc4_send_x >= 0 && asyncsock->rc4_send_y >= 0) {
+		return -1;
+	}
+	hdrlen = async_sock_write_size(asyncsock, (long)share->size, mask, 
+			(char*)head);
+	if (hdrlen > 0) {
+		ims_write(&asyncsock->sendmsg, head, hdrlen);
+	}
+	if (ims_write_share(&asyncsock->sendmsg, share) < 0) {
+		return -2;
+	}
+	return (long)share->size;
+}
+
 // recv vector: returns packet size, -1 for not enough data, -2 for
 // buffer size too small, -3 for packet size error, -4 for size over limit,
 // returns packet size if ptr equals NULL.
@@ -989,6 +1011,10 @@ struct CAsyncCore
 #define ASYNC_CORE_FLAG_SENSITIVE   2
 #define ASYNC_CORE_FLAG_SHUTDOWN    4
 
+#ifndef ASYNC_CORE_SHARE_MIN
+#define ASYNC_CORE_SHARE_MIN        256   // smaller multicasts are copied
+#endif
+
 #define ASYNC_CORE_HID_SALT        ((1 << (31 - ASYNC_CORE_HID_BITS)) - 1)
 
 
@@ -1448,6 +1474,38 @@ static int async_core_msg_push(CAsyncCore *core, int event, long wparam,
 }
 
 
+//---------------------------------------------------------------------
+// drop queued connection events (NEW..DGRAM) of the given hid
+//---------------------------------------------------------------------
+static int async_core_msg_purge(CAsyncCore *core, long hid)
+{
+	struct IMSTREAM keep;
+	char head[14];
+	IUINT32 length;
+	IUINT16 event;
+	IINT32 wparam;
+	int count = 0;
+	if (core->nolock == 0) IMUTEX_LOCK(&core->xmsg);
+	ims_init(&keep, core->cache, 0, 0);
+	while (ims_peek(&core->msgs, head, 14) == 14) {
+		idecode32u_lsb(head, &length);
+		idecode16u_lsb(head + 4, &event);
+		idecode32i_lsb(head + 6, &wparam);
+		if (event <= ASYNC_CORE_EVT_DGRAM && (long)wparam == hid) {
+			ims_drop(&core->msgs, (ilong)length);
+			core->msgcnt--;
+			count++;
+		}	else {
+			ims_splice(&keep, &core->msgs, (ilong)length);
+		}
+	}
+	ims_splice(&core->msgs, &keep, ims_dsize(&keep));
+	ims_destroy(&keep);
+	if (core->nolock == 0) IMUTEX_UNLOCK(&core->xmsg);
+	return count;
+}
+
+
 //---------------------------------------------------------------------
 // get message
 //---------------------------------------------------------------------
@@ -2434,16 +2492,10 @@ int async_core_close(CAsyncCore *core, long hid, int code)
 
 
 // -------------------------------------------------------------------
-// send vector
+// flush and check the send buffer limit, close the hid when exceeded
 // -------------------------------------------------------------------
-static long _async_core_send_vector(CAsyncCore *core, long hid,
-	const void * const vecptr[],
-	const long veclen[], int count, int mask)
+static int _async_core_send_limit(CAsyncCore *core, CAsyncSock *sock)
 {
-	CAsyncSock *sock = async_core_node_get(core, hid);
-	long hr;
-	if (sock == NULL) return -100;
-	if (sock->closing) return -110;
 	if (sock->limited > 0 && sock->sendmsg.size > (iulong)sock->limited) {
 		if ((sock->flags & ASYNC_CORE_FLAG_SENSITIVE) == 0) {
 			if (sock->fd >= 0) {
@@ -2451,10 +2503,25 @@ static long _async_core_send_vector(CAsyncCore *core, long hid,
 			}
 		}
 		if (sock->sendmsg.size > (iulong)sock->limited) {
-			_async_core_close(core, hid, 2008);
-			return -200;
+			_async_core_close(core, sock->hid, 2008);
+			return -1;
 		}
 	}
+	return 0;
+}
+
+// -------------------------------------------------------------------
+// send vector
+// -------------------------------------------------------------------
+static long _async_core_send_vector(CAsyncCore *core, long hid,
+	const void * const vecptr[],
+	const long veclen[], int count, int mask)
+{
+	CAsyncSock *sock = async_core_node_get(core, hid);
+	long hr;
+	if (sock == NULL) return -100;
+	if (sock->closing) return -110;
+	if (_async_core_send_limit(core, sock) != 0) return -200;
 	hr = async_sock_send_vector(sock, vecptr, veclen, count, mask);
 	if (sock->sendmsg.size > 0 && sock->fd >= 0) {
 		if ((sock->mask & IPOLL_OUT) == 0) {
@@ -2466,15 +2533,14 @@ static long _async_core_send_vector(CAsyncCore *core, long hid,
 }
 
 // -------------------------------------------------------------------
-// send vector
+// send vector through the filter if installed
 // -------------------------------------------------------------------
-long async_core_send_vector(CAsyncCore *core, long hid,
+static long _async_core_send_filtered(CAsyncCore *core, long hid,
 	const void * const vecptr[],
 	const long veclen[], int count, int mask)
 {
 	CAsyncSock *sock = NULL;
 	long hr = -1;
-	ASYNC_CORE_CRITICAL_BEGIN(core);
 	sock = async_core_node_get(core, hid);
 	if (sock) {
 		if (sock->filter == NULL) {
@@ -2507,6 +2573,88 @@ long async_core_send_vector(CAsyncCore *core, long hid,
 			}
 		}
 	}
+	return hr;
+}
+
+// -------------------------------------------------------------------
+// send vector
+// -------------------------------------------------------------------
+long async_core_send_vector(CAsyncCore *core, long hid,
+	const void * const vecptr[],
+	const long veclen[], int count, int mask)
+{
+	long hr;
+	ASYNC_CORE_CRITICAL_BEGIN(core);
+	hr = _async_core_send_filtered(core, hid, vecptr, veclen, count, mask);
+	ASYNC_CORE_CRITICAL_END(core);
+	return hr;
+}
+
+// -------------------------------------------------------------------
+// queue a shared packet into the send buffer of hid
+// -------------------------------------------------------------------
+static long _async_core_send_share(CAsyncCore *core, long hid,
+	IMSSHARE *share, int mask)
+{
+	CAsyncSock *sock = async_core_node_get(core, hid);
+	long hr;
+	if (sock == NULL) return -100;
+	if (sock->closing) return -110;
+	if (_async_core_send_limit(core, sock) != 0) return -200;
+	hr = async_sock_send_share(sock, share, mask);
+	if (sock->sendmsg.size > 0 && sock->fd >= 0) {
+		if ((sock->mask & IPOLL_OUT) == 0) {
+			async_core_node_mask(core, sock, 
+				IPOLL_OUT, 0);
+		}
+	}
+	return hr;
+}
+
+// -------------------------------------------------------------------
+// send the same packet to many hids
+// -------------------------------------------------------------------
+long async_core_multicast(CAsyncCore *core, const long *hids, int count,
+	const void * const vecptr[], const long veclen[], int vcount, 
+	int mask)
+{
+	IMSSHARE *share = NULL;
+	long size = 0, hr = 0;
+	int i;
+	for (i = 0; i < vcount; i++) size += veclen[i];
+	ASYNC_CORE_CRITICAL_BEGIN(core);
+	for (i = 0; i < count; i++) {
+		CAsyncSock *sock = async_core_node_get(core, hids[i]);
+		int shared = 0;
+		long x;
+		if (sock == NULL) continue;
+		// filters and rc4 need the plain bytes of each socket
+		if (sock->filter == NULL && size >= ASYNC_CORE_SHARE_MIN &&
+			(sock->rc4_send_x < 0 || sock->rc4_send_y < 0)) {
+			if (share == NULL) {
+				share = ims_share_new(NULL, size);
+				if (share != NULL) {
+					IUINT8 *ptr = share->data;
+					int k;
+					for (k = 0; k < vcount; k++) {
+						if (vecptr[k]) memcpy(ptr, vecptr[k], veclen[k]);
+						ptr += veclen[k];
+					}
+				}
+			}
+			shared = (share != NULL)? 1 : 0;
+		}
+		if (shared) {
+			x = _async_core_send_share(core, hids[i], share, mask);
+		}	else {
+			x = _async_core_send_filtered(core, hids[i], vecptr, 
+					veclen, vcount, mask);
+		}
+		if (x >= 0) hr++;
+	}
+	if (share != NULL) {
+		ims_share_release(share);
+	}
 	ASYNC_CORE_CRITICAL_END(core);
 	return hr;
 }
@@ -2895,6 +3043,122 @@ int async_core_setting(CAsyncCore *core, int config, long value)
 	return hr;
 }
 
+//---------------------------------------------------------------------
+// compression filter: every packet is prefixed with one byte, 0 for
+// plain data (shorter than threshold) and 1 for ilz chunks. Each
+// direction keeps its own dictionary along the connection lifetime.
+//---------------------------------------------------------------------
+typedef struct
+{
+	ILZSTREAM encoder;
+	ILZSTREAM decoder;
+	struct IVECTOR buffer;
+	long threshold;
+}	CAsyncCompress;
+
+static int async_core_compress_filter(CAsyncCore *core, void *object, 
+	long hid, int cmd, const void *data, long size)
+{
+	CAsyncCompress *cc = (CAsyncCompress*)object;
+	const unsigned char *lptr = (const unsigned char*)data;
+	unsigned char *out;
+	CAsyncSock *sock;
+	long need, total, pos, hr;
+	switch (cmd) {
+	case ASYNC_CORE_FILTER_RELEASE:
+		ilz_destroy(&cc->encoder);
+		ilz_destroy(&cc->decoder);
+		iv_destroy(&cc->buffer);
+		ikmem_free(cc);
+		break;
+	case ASYNC_CORE_FILTER_WRITE:
+		need = (size < cc->threshold)? size + 1 : ilz_bound(size) + 1;
+		if (iv_resize(&cc->buffer, need) != 0) return -1000;
+		out = (unsigned char*)cc->buffer.data;
+		if (size < cc->threshold) {
+			out[0] = 0;
+			memcpy(out + 1, data, size);
+			hr = size;
+		}	else {
+			out[0] = 1;
+			hr = (long)ilz_compress(&cc->encoder, data, size, out + 1);
+			if (hr < 0) return -1000;
+		}
+		async_core_dispatch(core, hid, ASYNC_CORE_DISPATCH_SEND, 
+			out, hr + 1);
+		return size;
+	case ASYNC_CORE_FILTER_INPUT:
+		if (size < 1) break;
+		if (lptr[0] == 0) {
+			async_core_dispatch(core, hid, ASYNC_CORE_DISPATCH_PUSH,
+				lptr + 1, size - 1);
+			break;
+		}
+		sock = async_core_node_get(core, hid);
+		for (total = 0, pos = 1; pos < size; ) {
+			ilong raw = 0;
+			ilong length = ilz_peek(lptr + pos, size - pos, &raw);
+			if (length <= 0) break;
+			total += (long)raw;
+			pos += (long)length;
+		}
+		if (lptr[0] != 1 || pos != size || sock == NULL ||
+			total > sock->maxsize || 
+			iv_resize(&cc->buffer, total + 1) != 0) {
+			async_core_dispatch(core, hid, ASYNC_CORE_DISPATCH_CLOSE,
+				NULL, 2020);
+			break;
+		}
+		hr = (long)ilz_decompress(&cc->decoder, lptr + 1, size - 1,
+			cc->buffer.data, total);
+		if (hr != total) {
+			async_core_dispatch(core, hid, ASYNC_CORE_DISPATCH_CLOSE,
+				NULL, 2021);
+			break;
+		}
+		async_core_dispatch(core, hid, ASYNC_CORE_DISPATCH_PUSH,
+			cc->buffer.data, total);
+		break;
+	}
+	return 0;
+}
+
+// install or remove the compression filter
+static int async_core_compress_setup(CAsyncCore *core, CAsyncSock *sock,
+	long threshold)
+{
+	CAsyncFilter filter = ASYNC_CORE_FILTER(sock);
+	CAsyncCompress *cc;
+	if (threshold <= 0) {
+		if (filter != async_core_compress_filter) return -1;
+		if (core->dispatch) return -4;
+		_async_core_filter(core, sock->hid, NULL, NULL);
+		return 0;
+	}
+	if (filter == async_core_compress_filter) {
+		((CAsyncCompress*)sock->object)->threshold = threshold;
+		return 0;
+	}
+	if (filter != NULL) return -2;
+	if (sock->header >= ITMH_RAWDATA) return -3;
+	if (core->dispatch) return -4;
+	cc = (CAsyncCompress*)ikmem_malloc(sizeof(CAsyncCompress));
+	if (cc == NULL) return -5;
+	iv_init(&cc->buffer, NULL);
+	cc->threshold = threshold;
+	if (ilz_init(&cc->encoder) != 0) {
+		ikmem_free(cc);
+		return -5;
+	}
+	if (ilz_init(&cc->decoder) != 0) {
+		ilz_destroy(&cc->encoder);
+		ikmem_free(cc);
+		return -5;
+	}
+	_async_core_filter(core, sock->hid, async_core_compress_filter, cc);
+	return 0;
+}
+
 // set connection socket option
 static int _async_core_option(CAsyncCore *core, long hid, 
 	int opt, long value)
@@ -3069,6 +3333,9 @@ static int _async_core_option(CAsyncCore *core, long hid,
 			hr = -1;
 		}
 		break;
+	case ASYNC_CORE_OPTION_COMPRESS:
+		hr = async_core_compress_setup(core, sock, value);
+		break;
 	}
 	return hr;
 }
@@ -3290,6 +3557,241 @@ void async_core_install(CAsyncCore *core, CAsyncSocketInit proc, void *user)
 }
 
 
+//---------------------------------------------------------------------
+// connection migration
+//---------------------------------------------------------------------
+#define ASYNC_CORE_MIGRATE_MAGIC   0x4d434341   // 'ACCM'
+#define ASYNC_CORE_MIGRATE_HEAD    (23 * 4 + 512)
+
+// serialize stream content
+static char *async_core_migrate_stream(char *p, struct IMSTREAM *s)
+{
+	void *ptr;
+	long size;
+	while (s->size > 0) {
+		size = (long)ims_flat(s, &ptr);
+		if (size <= 0) break;
+		memcpy(p, ptr, size);
+		p += size;
+		ims_drop(s, size);
+	}
+	return p;
+}
+
+// export a live connection: fd, header, tag, buffers and rc4 state
+static long _async_core_detach(CAsyncCore *core, long hid, 
+	void *data, long size)
+{
+	CAsyncSock *sock;
+	long need;
+	char *p;
+	sock = async_core_node_get(core, hid);
+	if (sock == NULL) return -1;
+	if (sock->closing || sock->fd < 0) return -3;
+	if (sock->mode != ASYNC_CORE_NODE_IN &&
+		sock->mode != ASYNC_CORE_NODE_OUT &&
+		sock->mode != ASYNC_CORE_NODE_ASSIGN) 
+		return -4;
+	if (core->dispatch) return -5;
+	if (ASYNC_CORE_FILTER(sock) == async_core_compress_filter) return -6;
+	if (sock->sendmsg.size > 0 && sock->state == ASYNC_SOCK_STATE_ESTAB) {
+		async_sock_update(sock, 2);
+	}
+	need = ASYNC_CORE_MIGRATE_HEAD + (long)sock->sendmsg.size +
+		(long)sock->recvmsg.size + (long)sock->linemsg.size;
+	if (data == NULL) return need;
+	if (size < need) return -2;
+	if (sock->filter) {
+		CAsyncFilter filter = ASYNC_CORE_FILTER(sock);
+		filter(core, sock->object, sock->hid, 
+			ASYNC_CORE_FILTER_RELEASE, NULL, 0);
+		sock->filter = NULL;
+		sock->object = NULL;
+	}
+	p = (char*)data;
+	p = iencode32u_lsb(p, ASYNC_CORE_MIGRATE_MAGIC);
+	p = iencode32i_lsb(p, (IINT32)sock->fd);
+	p = iencode32i_lsb(p, (IINT32)sock->header);
+	p = iencode32i_lsb(p, (IINT32)sock->mode);
+	p = iencode32i_lsb(p, (IINT32)sock->state);
+	p = iencode32i_lsb(p, (IINT32)sock->ipv6);
+	p = iencode32i_lsb(p, (IINT32)sock->afunix);
+	p = iencode32i_lsb(p, (IINT32)sock->flags);
+	p = iencode32i_lsb(p, (IINT32)sock->protocol);
+	p = iencode32i_lsb(p, (IINT32)sock->tag);
+	p = iencode32i_lsb(p, (IINT32)sock->limited);
+	p = iencode32i_lsb(p, (IINT32)sock->maxsize);
+	p = iencode32i_lsb(p, (IINT32)sock->manual_hiwater);
+	p = iencode32i_lsb(p, (IINT32)sock->manual_lowater);
+	p = iencode32u_lsb(p, (IUINT32)sock->mark);
+	p = iencode32u_lsb(p, (IUINT32)sock->tos);
+	p = iencode32i_lsb(p, (IINT32)sock->rc4_send_x);
+	p = iencode32i_lsb(p, (IINT32)sock->rc4_send_y);
+	p = iencode32i_lsb(p, (IINT32)sock->rc4_recv_x);
+	p = iencode32i_lsb(p, (IINT32)sock->rc4_recv_y);
+	p = iencode32u_lsb(p, (IUINT32)sock->sendmsg.size);
+	p = iencode32u_lsb(p, (IUINT32)sock->recvmsg.size);
+	p = iencode32u_lsb(p, (IUINT32)sock->linemsg.size);
+	memcpy(p, sock->rc4_send_box, 256);
+	memcpy(p + 256, sock->rc4_recv_box, 256);
+	p += 512;
+	p = async_core_migrate_stream(p, &sock->sendmsg);
+	p = async_core_migrate_stream(p, &sock->recvmsg);
+	p = async_core_migrate_stream(p, &sock->linemsg);
+	assert((long)(p - (char*)data) == need);
+	if (async_event_is_active(&sock->event)) {
+		async_event_stop(core->loop, &sock->event);
+	}
+	sock->fd = -1;    // the descriptor is owned by the blob now
+	async_core_node_delete(core, hid);
+	async_core_msg_purge(core, hid);
+	return need;
+}
+
+// restore a connection exported by async_core_detach
+static long _async_core_adopt(CAsyncCore *core, const void *data, 
+	long size)
+{
+	const char *p = (const char*)data;
+	IUINT32 magic, sendsize, recvsize, linesize, mark, tos;
+	IINT32 fd, header, mode, state, ipv6, afunix, flags, protocol;
+	IINT32 tag, limited, maxsize, hiwater, lowater;
+	IINT32 sx, sy, rx, ry;
+	CAsyncSock *sock;
+	char name[256];
+	int namelen;
+	long hid;
+	if (data == NULL || size < ASYNC_CORE_MIGRATE_HEAD) return -1;
+	p = idecode32u_lsb(p, &magic);
+	if (magic != ASYNC_CORE_MIGRATE_MAGIC) return -1;
+	p = idecode32i_lsb(p, &fd);
+	p = idecode32i_lsb(p, &header);
+	p = idecode32i_lsb(p, &mode);
+	p = idecode32i_lsb(p, &state);
+	p = idecode32i_lsb(p, &ipv6);
+	p = idecode32i_lsb(p, &afunix);
+	p = idecode32i_lsb(p, &flags);
+	p = idecode32i_lsb(p, &protocol);
+	p = idecode32i_lsb(p, &tag);
+	p = idecode32i_lsb(p, &limited);
+	p = idecode32i_lsb(p, &maxsize);
+	p = idecode32i_lsb(p, &hiwater);
+	p = idecode32i_lsb(p, &lowater);
+	p = idecode32u_lsb(p, &mark);
+	p = idecode32u_lsb(p, &tos);
+	p = idecode32i_lsb(p, &sx);
+	p = idecode32i_lsb(p, &sy);
+	p = idecode32i_lsb(p, &rx);
+	p = idecode32i_lsb(p, &ry);
+	p = idecode32u_lsb(p, &sendsize);
+	p = idecode32u_lsb(p, &recvsize);
+	p = idecode32u_lsb(p, &linesize);
+	if (size < ASYNC_CORE_MIGRATE_HEAD + (long)sendsize + 
+		(long)recvsize + (long)linesize) 
+		return -1;
+	if (fd < 0) return -1;
+	hid = async_core_node_new(core);
+	if (hid < 0) return -2;
+	sock = async_core_node_get(core, hid);
+	if (sock == NULL) {
+		assert(sock);
+		abort();
+	}
+	sock->mark = 0;   // already applied by the original core
+	sock->tos = 0;
+	if (async_sock_assign(sock, fd, header, 
+			(state == ASYNC_SOCK_STATE_ESTAB)? 1 : 0) != 0) {
+		sock->fd = -1;    // leave the descriptor to the caller
+		async_core_node_delete(core, hid);
+		return -3;
+	}
+	sock->mode = mode;
+	sock->ipv6 = ipv6;
+	sock->afunix = afunix;
+	sock->flags = flags;
+	sock->tag = tag;
+	sock->limited = limited;
+	sock->maxsize = maxsize;
+	sock->manual_hiwater = hiwater;
+	sock->manual_lowater = lowater;
+	sock->mark = mark;
+	sock->tos = tos;
+	sock->rc4_send_x = sx;
+	sock->rc4_send_y = sy;
+	sock->rc4_recv_x = rx;
+	sock->rc4_recv_y = ry;
+	memcpy(sock->rc4_send_box, p, 256);
+	memcpy(sock->rc4_recv_box, p + 256, 256);
+	p += 512;
+	ims_write(&sock->sendmsg, p, sendsize);
+	p += sendsize;
+	ims_write(&sock->recvmsg, p, recvsize);
+	p += recvsize;
+	ims_write(&sock->linemsg, p, linesize);
+	p += linesize;
+
+	async_event_set(&sock->event, sock->fd, ASYNC_EVENT_WRITE);
+	async_event_start(core->loop, &sock->event);
+
+	if (sock->state == ASYNC_SOCK_STATE_CONNECTING) {
+		async_core_node_mask(core, sock, IPOLL_OUT | IPOLL_IN | IPOLL_ERR, 0);
+	}
+	else {
+		int enable = IPOLL_IN | IPOLL_ERR;
+		if (sock->header == ITMH_MANUAL) {
+			if ((long)sock->recvmsg.size >= sock->manual_hiwater) {
+				enable = 0;
+			}
+		}
+		if (sock->sendmsg.size > 0) enable |= IPOLL_OUT;
+		async_core_node_mask(core, sock, enable, 0);
+	}
+
+	namelen = (int)sizeof(name);
+	if (ipeername(sock->fd, (struct sockaddr*)name, &namelen) != 0) {
+		namelen = 0;
+	}
+
+	async_core_msg_push(core, ASYNC_CORE_EVT_NEW, hid, 
+		sock->tag, name, namelen);
+
+	if (protocol >= 0 && core->factory != NULL) {
+		_async_core_protocol(core, hid, protocol);
+	}
+
+	if (sock->header == ITMH_MANUAL && sock->recvmsg.size > 0) {
+		async_core_msg_push(core, ASYNC_CORE_EVT_DATA,
+			hid, sock->tag, core->buffer, 0);
+	}
+
+	return hid;
+}
+
+// export a live connection into data and remove it from this core
+// without closing the socket, returns blob size, or required size
+// if data is NULL, -1 for hid not exist, -2 for buffer too small, 
+// -3 for closing, -4 for listener or dgram, -5 inside a filter,
+// -6 for compression enabled (dictionaries can not be migrated).
+long async_core_detach(CAsyncCore *core, long hid, void *data, long size)
+{
+	long hr;
+	ASYNC_CORE_CRITICAL_BEGIN(core);
+	hr = _async_core_detach(core, hid, data, size);
+	ASYNC_CORE_CRITICAL_END(core);
+	return hr;
+}
+
+// resume a connection exported by async_core_detach, returns new hid
+long async_core_adopt(CAsyncCore *core, const void *data, long size)
+{
+	long hr;
+	ASYNC_CORE_CRITICAL_BEGIN(core);
+	hr = _async_core_adopt(core, data, size);
+	ASYNC_CORE_CRITICAL_END(core);
+	return hr;
+}
+
+
 
 //=====================================================================
 // PROXY
@@ -167,6 +167,10 @@ long async_sock_send_vector(CAsyncSock *asyncsock,
 	const void * const vecptr[],
 	const long veclen[], int count, int mask);
 
+// send a shared buffer as one packet without copying (no rc4)
+long async_sock_send_share(CAsyncSock *asyncsock, IMSSHARE *share, 
+	int mask);
+
 // recv vector: returns packet size, -1 for not enough data, -2 for
 // buffer size too small, -3 for packet size error, -4 for size over limit,
 // returns packet size if vecptr equals NULL.
@@ -277,6 +281,14 @@ long async_core_send_vector(CAsyncCore *core, long hid,
 	const void * const vecptr[],
 	const long veclen[], int count, int mask);
 
+// send the same packet to many hids: the payload is stored once in a
+// refcounted buffer referenced by every send queue instead of copied.
+// hids with rc4 or a filter, and packets below ASYNC_CORE_SHARE_MIN,
+// get their own copy. returns the number of hids queued to.
+long async_core_multicast(CAsyncCore *core, const long *hids, int count,
+	const void * const vecptr[], const long veclen[], int vcount, 
+	int mask);
+
 
 // new connection to the target address, returns hid
 long async_core_new_connect(CAsyncCore *core, const struct sockaddr *addr,
@@ -372,7 +384,15 @@ long async_core_node_prev(const CAsyncCore *core, long hid);
 #define ASYNC_CORE_OPTION_LOWATER       22
 #define ASYNC_CORE_OPTION_MARK          23
 #define ASYNC_CORE_OPTION_TOS           24
-
+#define ASYNC_CORE_OPTION_COMPRESS      25
+
+// ASYNC_CORE_OPTION_COMPRESS: install the built-in LZ filter when value
+// is above zero, packets shorter than value bytes are sent uncompressed,
+// zero to uninstall. Both ends must enable it at the same point of the
+// session (eg. right after the login reply) and use a packet header 
+// mode (not ITMH_RAWDATA/LINESPLIT/MANUAL). Fails if another filter or
+// protocol is installed, or when installing/uninstalling from inside a
+// filter callback (only the threshold can be changed there).
 // set connection socket option
 int async_core_option(CAsyncCore *core, long hid, int opt, long value);
 
@@ -466,6 +486,21 @@ typedef int (*CAsyncSocketInit)(void *user, int mode, int fd);
 // setup socket init hook
 void async_core_install(CAsyncCore *core, CAsyncSocketInit proc, void *user);
 
+// export a live connection (fd, header, tag, buffered data, rc4 state
+// and protocol id) into data and remove the hid without closing the 
+// socket, no ASYNC_CORE_EVT_CLOSE will be generated. Returns blob size,
+// or the required size if data is NULL, below zero for error.
+// Pending events of the hid still in the queue are discarded, drain
+// async_core_read() first if queued ASYNC_CORE_EVT_DATA still matters.
+// Filter objects are released, async_core_adopt() will create a new 
+// one from the factory of the target core if a protocol was set.
+long async_core_detach(CAsyncCore *core, long hid, void *data, long size);
+
+// resume a connection exported by async_core_detach() in this core,
+// ASYNC_CORE_EVT_NEW will be generated, returns the new hid. It can
+// be called from another thread, use async_core_notify() to wake up.
+long async_core_adopt(CAsyncCore *core, const void *data, long size);
+
 
 
 //=====================================================================
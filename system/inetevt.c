@@ -130,6 +130,8 @@ static int async_loop_fds_ensure(CAsyncLoop *loop, int fd);
 static int async_loop_pending_push(CAsyncLoop *loop, CAsyncEvent *evt, int);
 static int async_loop_pending_remove(CAsyncLoop *loop, CAsyncEvent *evt);
 static int async_loop_pending_dispatch(CAsyncLoop *loop);
+static void async_loop_hook_push(CAsyncLoop *loop, CAsyncEntry *entry, int);
+static int async_loop_hook_dispatch(CAsyncLoop *loop);
 static int async_loop_changes_push(CAsyncLoop *loop, int fd);
 static void async_loop_changes_commit(CAsyncLoop *loop);
 static int async_loop_dispatch_post(CAsyncLoop *loop);
@@ -212,6 +214,7 @@ CAsyncLoop* async_loop_new(void)
 	ilist_init(&loop->list_post);
 	ilist_init(&loop->list_idle);
 	ilist_init(&loop->list_once);
+	ilist_init(&loop->list_hook);
 
 	loop->xfd[0] = -1;
 	loop->xfd[1] = -1;
@@ -362,6 +365,10 @@ void async_loop_delete(CAsyncLoop *loop)
 				evt->active = 0;
 				evt->pending = -1;
 			}
+			if (entry->hook != NULL) {
+				entry->hook->count--;
+				entry->hook = NULL;
+			}
 			entry->fd = -1;
 			entry->mask = 0;
 			entry->dirty = 0;
@@ -386,6 +393,15 @@ void async_loop_delete(CAsyncLoop *loop)
 	// remove timers
 	itimer_mgr_destroy(&loop->timer_mgr);
 
+	// remove hooks with ready fds
+	while (!ilist_is_empty(&loop->list_hook)) {
+		ilist_head *it = loop->list_hook.next;
+		CAsyncHook *hook = ilist_entry(it, CAsyncHook, node);
+		ilist_del_init(&hook->node);
+		hook->active = 0;
+		hook->ready_index = 0;
+	}
+
 	// remove postpones
 	while (!ilist_is_empty(&loop->list_post)) {
 		ilist_head *it = loop->list_post.next;
@@ -570,6 +586,10 @@ static int async_loop_fds_resize(CAsyncLoop *loop, int newsize)
 			entry->mask = 0;
 			entry->dirty = 0;
 			ilist_init(&entry->watchers);
+			entry->hook = NULL;
+			entry->hook_mask = 0;
+			entry->ready = -1;
+			entry->udata = NULL;
 		}
 		loop->fds_size = newsize;
 	}
@@ -596,12 +616,20 @@ static int async_loop_fds_resize(CAsyncLoop *loop, int newsize)
 				if (!ilist_is_empty(&old[i].watchers)) {
 					ilist_replace(&old[i].watchers, &entry->watchers);
 				}
+				entry->hook = old[i].hook;
+				entry->hook_mask = old[i].hook_mask;
+				entry->ready = old[i].ready;
+				entry->udata = old[i].udata;
 			}
 			else {
 				entry->fd = i;
 				entry->mask = 0;
 				entry->dirty = 0;
 				ilist_init(&entry->watchers);
+				entry->hook = NULL;
+				entry->hook_mask = 0;
+				entry->ready = -1;
+				entry->udata = NULL;
 			}
 		}
 		ikmem_free(old);
@@ -722,6 +750,73 @@ static int async_loop_pending_dispatch(CAsyncLoop *loop)
 }
 
 
+//---------------------------------------------------------------------
+// queue a ready fd of a hook
+//---------------------------------------------------------------------
+static void async_loop_hook_push(CAsyncLoop *loop, CAsyncEntry *entry, 
+	int event)
+{
+	CAsyncHook *hook = entry->hook;
+	CAsyncReady *ready;
+	if (entry->ready >= 0) {
+		hook->ready[entry->ready].events |= event;
+		return;
+	}
+	if (hook->ready_index + 1 > hook->ready_size) {
+		int newsize = 64;
+		for (; newsize < hook->ready_index + 1; newsize *= 2);
+		if (iv_resize(&hook->v_ready, newsize * sizeof(CAsyncReady)) != 0) {
+			return;
+		}
+		hook->ready = (CAsyncReady*)hook->v_ready.data;
+		hook->ready_size = newsize;
+	}
+	ready = &hook->ready[hook->ready_index];
+	ready->fd = entry->fd;
+	ready->events = event;
+	ready->udata = entry->udata;
+	entry->ready = hook->ready_index++;
+	if (hook->active == 0) {
+		ilist_add_tail(&hook->node, &loop->list_hook);
+		hook->active = 1;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// hand the ready fds to each hook
+//---------------------------------------------------------------------
+static int async_loop_hook_dispatch(CAsyncLoop *loop)
+{
+	int count = 0;
+	while (!ilist_is_empty(&loop->list_hook)) {
+		ilist_head *it = loop->list_hook.next;
+		CAsyncHook *hook = ilist_entry(it, CAsyncHook, node);
+		int index, size = 0;
+		ilist_del_init(&hook->node);
+		hook->active = 0;
+		// drop fds detached after they were queued
+		for (index = 0; index < hook->ready_index; index++) {
+			CAsyncReady *ready = &hook->ready[index];
+			if (ready->fd < 0) continue;
+			loop->fds[ready->fd].ready = -1;
+			if (size < index) hook->ready[size] = *ready;
+			size++;
+		}
+		hook->ready_index = 0;
+		if (size > 0 && hook->callback) {
+			if (loop->logmask & ASYNC_LOOP_LOG_EVENT) {
+				async_loop_log(loop, ASYNC_LOOP_LOG_EVENT,
+					"[hook] active ptr=%p, count=%d", (void*)hook, size);
+			}
+			hook->callback(loop, hook, hook->ready, size);
+		}
+		count += size;
+	}
+	return count;
+}
+
+
 //---------------------------------------------------------------------
 // queue changes event
 //---------------------------------------------------------------------
@@ -787,6 +882,9 @@ static void async_loop_changes_commit(CAsyncLoop *loop)
 			CAsyncEvent *evt = ilist_entry(it, CAsyncEvent, node);
 			mask |= evt->mask;
 		}
+		if (entry->hook != NULL) {
+			mask |= entry->hook_mask;
+		}
 		// must reset poll events even if mask is not changed because 
 		// the fd may be closed by user, which removes it from epoll
 		// or kquene kernel object, and the previous entry->mask is
@@ -1132,6 +1230,9 @@ int async_loop_once(CAsyncLoop *loop, IINT32 millisec)
 					async_loop_pending_push(loop, evt, result);
 				}
 			}
+			if (entry->hook != NULL && (got & entry->hook_mask) != 0) {
+				async_loop_hook_push(loop, entry, got & entry->hook_mask);
+			}
 		}
 		idle = 0;
 	}
@@ -1151,6 +1252,7 @@ int async_loop_once(CAsyncLoop *loop, IINT32 millisec)
 
 	// dispatch I/O events
 	cc = async_loop_pending_dispatch(loop);
+	cc += async_loop_hook_dispatch(loop);
 
 	// schedule timers
 	itimer_mgr_run(&loop->timer_mgr, loop->current);
@@ -1754,6 +1856,157 @@ int async_event_active(const CAsyncEvent *evt)
 }
 
 
+//---------------------------------------------------------------------
+// initialize a hook
+//---------------------------------------------------------------------
+void async_hook_init(CAsyncHook *hook, void (*callback)(CAsyncLoop *loop,
+		CAsyncHook *hook, CAsyncReady *ready, int count))
+{
+	ilist_init(&hook->node);
+	hook->active = 0;
+	hook->count = 0;
+	hook->callback = callback;
+	hook->user = NULL;
+	hook->ready = NULL;
+	hook->ready_size = 0;
+	hook->ready_index = 0;
+	iv_init(&hook->v_ready, NULL);
+}
+
+
+//---------------------------------------------------------------------
+// release the ready array
+//---------------------------------------------------------------------
+void async_hook_destroy(CAsyncHook *hook)
+{
+	assert(hook->count == 0);
+	assert(hook->active == 0);
+	iv_destroy(&hook->v_ready);
+	hook->ready = NULL;
+	hook->ready_size = 0;
+	hook->ready_index = 0;
+}
+
+
+//---------------------------------------------------------------------
+// attach fd to the hook
+//---------------------------------------------------------------------
+int async_hook_add(CAsyncLoop *loop, CAsyncHook *hook, int fd, 
+		int mask, void *udata)
+{
+	CAsyncEntry *entry;
+	if (fd < 0 || fd == loop->xfd[ASYNC_LOOP_PIPE_READ] ||
+		fd == loop->xfd[ASYNC_LOOP_PIPE_WRITE] ||
+		fd == loop->xfd[ASYNC_LOOP_PIPE_TIMER]) {
+		return -2;
+	}
+	if (async_loop_fds_ensure(loop, fd) != 0) {
+		return -2;
+	}
+	entry = &loop->fds[fd];
+	if (entry->hook != NULL) {
+		return -1;
+	}
+	entry->hook = hook;
+	entry->hook_mask = mask & (ASYNC_EVENT_READ | ASYNC_EVENT_WRITE);
+	entry->ready = -1;
+	entry->udata = udata;
+	hook->count++;
+	if (entry->hook_mask != 0) {
+		async_loop_changes_push(loop, fd);
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// change the events of an attached fd
+//---------------------------------------------------------------------
+int async_hook_set(CAsyncLoop *loop, CAsyncHook *hook, int fd, int mask)
+{
+	CAsyncEntry *entry;
+	if (fd < 0 || fd >= loop->fds_size) {
+		return -1;
+	}
+	entry = &loop->fds[fd];
+	if (entry->hook != hook) {
+		return -1;
+	}
+	mask &= ASYNC_EVENT_READ | ASYNC_EVENT_WRITE;
+	if (entry->hook_mask != mask) {
+		entry->hook_mask = mask;
+		async_loop_changes_push(loop, fd);
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// detach fd from the hook
+//---------------------------------------------------------------------
+int async_hook_del(CAsyncLoop *loop, CAsyncHook *hook, int fd)
+{
+	CAsyncEntry *entry;
+	if (fd < 0 || fd >= loop->fds_size) {
+		return -1;
+	}
+	entry = &loop->fds[fd];
+	if (entry->hook != hook) {
+		return -1;
+	}
+	if (entry->ready >= 0) {
+		hook->ready[entry->ready].fd = -1;
+		entry->ready = -1;
+	}
+	entry->hook = NULL;
+	entry->udata = NULL;
+	hook->count--;
+	if (entry->hook_mask != 0) {
+		entry->hook_mask = 0;
+		async_loop_changes_push(loop, fd);
+#if !IENABLE_DEFERCMT
+		// ensure the fd is removed from poll device
+		async_loop_changes_commit(loop);
+#endif
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// returns the events of an attached fd, -1 if not attached
+//---------------------------------------------------------------------
+int async_hook_mask(const CAsyncLoop *loop, const CAsyncHook *hook, int fd)
+{
+	if (fd < 0 || fd >= loop->fds_size) {
+		return -1;
+	}
+	if (loop->fds[fd].hook != hook) {
+		return -1;
+	}
+	return loop->fds[fd].hook_mask;
+}
+
+
+//---------------------------------------------------------------------
+// detach every fd of the hook
+//---------------------------------------------------------------------
+void async_hook_clear(CAsyncLoop *loop, CAsyncHook *hook)
+{
+	int fd;
+	for (fd = 0; fd < loop->fds_size && hook->count > 0; fd++) {
+		if (loop->fds[fd].hook == hook) {
+			async_hook_del(loop, hook, fd);
+		}
+	}
+	if (hook->active) {
+		ilist_del_init(&hook->node);
+		hook->active = 0;
+	}
+	hook->ready_index = 0;
+}
+
+
 //---------------------------------------------------------------------
 // timer callback
 //---------------------------------------------------------------------
@@ -75,6 +75,7 @@ struct CAsyncSemaphore;
 struct CAsyncPostpone;
 struct CAsyncIdle;
 struct CAsyncOnce;
+struct CAsyncHook;
 
 typedef struct CAsyncLoop CAsyncLoop;
 typedef struct CAsyncEvent CAsyncEvent;
@@ -83,6 +84,7 @@ typedef struct CAsyncSemaphore CAsyncSemaphore;
 typedef struct CAsyncPostpone CAsyncPostpone;
 typedef struct CAsyncIdle CAsyncIdle;
 typedef struct CAsyncOnce CAsyncOnce;
+typedef struct CAsyncHook CAsyncHook;
 
 
 //---------------------------------------------------------------------
@@ -107,6 +109,10 @@ typedef struct CAsyncEntry {
 	int mask;
 	int dirty;
 	ilist_head watchers;
+	struct CAsyncHook *hook;     // attached hook, NULL for none
+	int hook_mask;               // events watched by the hook
+	int ready;                   // index in hook->ready, -1 for none
+	void *udata;                 // user data of the hook
 }   CAsyncEntry;
 
 
@@ -179,6 +185,30 @@ struct CAsyncOnce {
 };
 
 
+//---------------------------------------------------------------------
+// CAsyncHook - fds attached to the fd table without a CAsyncEvent
+// each, the ready ones of an iteration are handed over in one call
+//---------------------------------------------------------------------
+typedef struct CAsyncReady {
+	int fd;
+	int events;
+	void *udata;
+}   CAsyncReady;
+
+struct CAsyncHook {
+	ilist_head node;
+	int active;                  // queued in loop->list_hook
+	int count;                   // number of attached fds
+	void (*callback)(CAsyncLoop *loop, CAsyncHook *hook, 
+		CAsyncReady *ready, int count);
+	void *user;
+	CAsyncReady *ready;          // ready fds of this iteration
+	int ready_size;              // size of ready array
+	int ready_index;             // index of ready fds
+	struct IVECTOR v_ready;      // ready fds vector
+};
+
+
 //---------------------------------------------------------------------
 // CAsyncLoop - centralized event manager and dispatcher
 //---------------------------------------------------------------------
@@ -224,6 +254,7 @@ struct CAsyncLoop {
 	ilist_head list_post;          // postpone list
 	ilist_head list_idle;          // idle list
 	ilist_head list_once;          // once list
+	ilist_head list_hook;          // hooks with ready fds
 	struct IVECTOR v_pending;      // pending events vector
 	struct IVECTOR v_changes;      // changes vector
 	struct IVECTOR v_queue;        // queue vector for pending events
@@ -344,6 +375,37 @@ int async_event_stop(CAsyncLoop *loop, CAsyncEvent *evt);
 int async_event_active(const CAsyncEvent *evt);
 
 
+//---------------------------------------------------------------------
+// CAsyncHook - fd-table hook for many fds
+//---------------------------------------------------------------------
+
+// initialize a hook, the callback receives the ready fds of each
+// iteration after the CAsyncEvent callbacks. an fd removed inside 
+// the callback can still appear later in the same array.
+void async_hook_init(CAsyncHook *hook, void (*callback)(CAsyncLoop *loop,
+		CAsyncHook *hook, CAsyncReady *ready, int count));
+
+// release the ready array, call it after async_hook_clear()
+void async_hook_destroy(CAsyncHook *hook);
+
+// attach fd with events (ASYNC_EVENT_READ/WRITE), returns 0 for 
+// success, -1 if fd is attached to a hook already, -2 for bad fd
+int async_hook_add(CAsyncLoop *loop, CAsyncHook *hook, int fd, 
+		int mask, void *udata);
+
+// change the events of an attached fd, returns -1 if not attached
+int async_hook_set(CAsyncLoop *loop, CAsyncHook *hook, int fd, int mask);
+
+// detach fd, returns -1 if it is not attached to this hook
+int async_hook_del(CAsyncLoop *loop, CAsyncHook *hook, int fd);
+
+// returns the events of an attached fd, -1 if not attached
+int async_hook_mask(const CAsyncLoop *loop, const CAsyncHook *hook, int fd);
+
+// detach every fd of the hook
+void async_hook_clear(CAsyncLoop *loop, CAsyncHook *hook);
+
+
 //---------------------------------------------------------------------
 // CAsyncTimer
 //---------------------------------------------------------------------
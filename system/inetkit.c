@@ -15,6 +15,10 @@
 #include "inetevt.h"
 #include "inetkit.h"
 
+#if defined(__unix) && !defined(__AVM3__)
+#include <netinet/tcp.h>
+#endif
+
 
 //=====================================================================
 // CAsyncStream
@@ -47,6 +51,10 @@ void async_stream_zero(CAsyncStream *stream)
 	stream->pending = NULL;
 	stream->watermark = NULL;
 	stream->option = NULL;
+	stream->readv = NULL;
+	stream->writev = NULL;
+	stream->borrow = NULL;
+	stream->consume = NULL;
 }
 
 // release and close stream
@@ -73,6 +81,64 @@ long async_stream_peek(CAsyncStream *stream, void *ptr, long size)
 	return _async_stream_peek(stream, ptr, size);
 }
 
+// scatter read into count buffers, falls back to read() per buffer
+long async_stream_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count)
+{
+	long total = 0;
+	int i;
+	if (stream->readv) {
+		return _async_stream_readv(stream, vecptr, veclen, count);
+	}
+	for (i = 0; i < count; i++) {
+		long hr;
+		if (veclen[i] <= 0) continue;
+		hr = _async_stream_read(stream, vecptr[i], veclen[i]);
+		if (hr < 0) return (total > 0)? total : hr;
+		total += hr;
+		if (hr < veclen[i]) break;
+	}
+	return total;
+}
+
+// gather write from count buffers, falls back to write() per buffer
+long async_stream_writev(CAsyncStream *stream, const void * const vecptr[],
+		const long veclen[], int count)
+{
+	long total = 0;
+	int i;
+	if (stream->writev) {
+		return _async_stream_writev(stream, vecptr, veclen, count);
+	}
+	for (i = 0; i < count; i++) {
+		long hr;
+		if (veclen[i] <= 0) continue;
+		hr = _async_stream_write(stream, vecptr[i], veclen[i]);
+		if (hr < 0) return (total > 0)? total : hr;
+		total += hr;
+	}
+	return total;
+}
+
+// borrow the first contiguous span of the input buffer
+long async_stream_borrow(CAsyncStream *stream, const void **ptr)
+{
+	if (stream->borrow) {
+		return _async_stream_borrow(stream, ptr);
+	}
+	*ptr = NULL;
+	return -1; // not supported
+}
+
+// drop size bytes from the input buffer after borrowing
+long async_stream_consume(CAsyncStream *stream, long size)
+{
+	if (stream->consume) {
+		return _async_stream_consume(stream, size);
+	}
+	return -1; // not supported
+}
+
 // enable ASYNC_EVENT_READ/WRITE
 void async_stream_enable(CAsyncStream *stream, int event) 
 {
@@ -178,6 +244,12 @@ static long async_pair_remain(const CAsyncStream *stream);
 static long async_pair_pending(const CAsyncStream *stream);
 static void async_pair_watermark(CAsyncStream *stream, long high, long low);
 static long async_pair_option(CAsyncStream *stream, int option, long value);
+static long async_pair_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count);
+static long async_pair_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count);
+static long async_pair_borrow(CAsyncStream *stream, const void **ptr);
+static long async_pair_consume(CAsyncStream *stream, long size);
 
 static void async_pair_postpone(CAsyncLoop *loop, CAsyncPostpone *postpone);
 static void async_pair_check(CAsyncStream *stream, int direction);
@@ -223,6 +295,10 @@ static CAsyncStream *async_pair_new(CAsyncLoop *loop)
 	stream->pending = async_pair_pending;
 	stream->watermark = async_pair_watermark;
 	stream->option = async_pair_option;
+	stream->readv = async_pair_readv;
+	stream->writev = async_pair_writev;
+	stream->borrow = async_pair_borrow;
+	stream->consume = async_pair_consume;
 	return stream;
 }
 
@@ -288,8 +364,9 @@ static long async_pair_move(CAsyncStream *stream)
 			if (size <= 0) {
 				return 0; // no data to move
 			}
-			// move data from partner's sendbuf to recvbuf
-			size = (long)ims_move(&pair->recvbuf, &partner_pair->sendbuf, size);
+			// hand pages over from partner's sendbuf to recvbuf
+			size = (long)ims_splice(&pair->recvbuf, 
+					&partner_pair->sendbuf, size);
 			return size;
 		}
 	}
@@ -432,6 +509,81 @@ static long async_pair_peek(CAsyncStream *stream, void *ptr, long size)
 }
 
 
+//---------------------------------------------------------------------
+// pair scatter read, checks the partner once for all buffers
+//---------------------------------------------------------------------
+static long async_pair_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count)
+{
+	CAsyncPair *pair = async_stream_upcast(stream, CAsyncPair, stream);
+	long total = 0;
+	int i;
+	if (pair->recvbuf.size == 0 && pair->partner == NULL) {
+		return -1; // no partner and no buffered data
+	}
+	for (i = 0; i < count && pair->recvbuf.size > 0; i++) {
+		if (veclen[i] > 0) {
+			total += (long)ims_read(&pair->recvbuf, vecptr[i], veclen[i]);
+		}
+	}
+	if (total > 0 && pair->partner != NULL) {
+		async_pair_check(stream, ASYNC_STREAM_INPUT);
+	}
+	return total;
+}
+
+
+//---------------------------------------------------------------------
+// pair gather write, moves to the partner once for all buffers
+//---------------------------------------------------------------------
+static long async_pair_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count)
+{
+	CAsyncPair *pair = async_stream_upcast(stream, CAsyncPair, stream);
+	long total = 0;
+	int i;
+	if (pair->partner == NULL) {
+		return -1; // no partner
+	}
+	for (i = 0; i < count; i++) {
+		if (veclen[i] > 0) {
+			total += (long)ims_write(&pair->sendbuf, vecptr[i], veclen[i]);
+		}
+	}
+	if (total > 0) {
+		async_pair_check(stream, ASYNC_STREAM_OUTPUT);
+	}
+	return total;
+}
+
+
+//---------------------------------------------------------------------
+// pair borrow: first page of recvbuf
+//---------------------------------------------------------------------
+static long async_pair_borrow(CAsyncStream *stream, const void **ptr)
+{
+	CAsyncPair *pair = async_stream_upcast(stream, CAsyncPair, stream);
+	void *p = NULL;
+	long hr = (long)ims_flat(&pair->recvbuf, &p);
+	*ptr = p;
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// pair consume: drop borrowed data
+//---------------------------------------------------------------------
+static long async_pair_consume(CAsyncStream *stream, long size)
+{
+	CAsyncPair *pair = async_stream_upcast(stream, CAsyncPair, stream);
+	long hr = (long)ims_drop(&pair->recvbuf, size);
+	if (hr > 0 && pair->partner != NULL) {
+		async_pair_check(stream, ASYNC_STREAM_INPUT);
+	}
+	return hr;
+}
+
+
 //---------------------------------------------------------------------
 // enable: ASYNC_EVENT_READ/WRITE
 //---------------------------------------------------------------------
@@ -564,6 +716,417 @@ CAsyncStream *async_stream_pair_partner(CAsyncStream *stream)
 }
 
 
+//=====================================================================
+// Cross-Loop Pair Stream
+//=====================================================================
+typedef struct _CAsyncCrossLink {
+	IMUTEX_TYPE lock;
+	int refcnt;
+	int closed[2];
+	long consumed[2];          // bytes written by side i and pulled
+	struct IMSTREAM chan[2];   // data flowing to side i
+	CAsyncSemaphore sem[2];    // wakes side i in its own loop
+}	CAsyncCrossLink;
+
+typedef struct _CAsyncCross {
+	CAsyncStream stream;
+	CAsyncCrossLink *link;
+	int side;
+	int busy;
+	int closing;
+	int estab;
+	struct IMSTREAM sendbuf;
+	struct IMSTREAM recvbuf;
+}	CAsyncCross;
+
+
+//---------------------------------------------------------------------
+// cross pair internal
+//---------------------------------------------------------------------
+static void async_cross_close(CAsyncStream *stream);
+static long async_cross_read(CAsyncStream *stream, void *ptr, long size);
+static long async_cross_write(CAsyncStream *stream, const void *ptr, long size);
+static long async_cross_peek(CAsyncStream *stream, void *ptr, long size);
+static void async_cross_enable(CAsyncStream *stream, int event);
+static void async_cross_disable(CAsyncStream *stream, int event);
+static long async_cross_remain(const CAsyncStream *stream);
+static long async_cross_pending(const CAsyncStream *stream);
+static void async_cross_watermark(CAsyncStream *stream, long high, long low);
+static long async_cross_borrow(CAsyncStream *stream, const void **ptr);
+static long async_cross_consume(CAsyncStream *stream, long size);
+
+static void async_cross_sem(CAsyncLoop *loop, CAsyncSemaphore *sem);
+static void async_cross_flush(CAsyncStream *stream);
+static long async_cross_pull(CAsyncStream *stream);
+
+
+//---------------------------------------------------------------------
+// create one side of a cross pair
+//---------------------------------------------------------------------
+static CAsyncStream *async_cross_new(CAsyncLoop *loop, 
+		CAsyncCrossLink *link, int side)
+{
+	CAsyncCross *cross = (CAsyncCross*)ikmem_malloc(sizeof(CAsyncCross));
+	CAsyncStream *stream;
+	if (cross == NULL) {
+		return NULL;
+	}
+	stream = &(cross->stream);
+	async_stream_zero(stream);
+	stream->name = ASYNC_STREAM_NAME_CROSS;
+	stream->instance = cross;
+	stream->loop = loop;
+	stream->direction = ASYNC_STREAM_BOTH;
+	stream->state = ASYNC_STREAM_ESTAB;
+	stream->enabled = ASYNC_EVENT_WRITE;
+	cross->link = link;
+	cross->side = side;
+	cross->busy = 0;
+	cross->closing = 0;
+	cross->estab = 0;
+	// pages are handed over to the other loop, so they must not come 
+	// from the per-loop memnode
+	ims_init(&cross->sendbuf, NULL, 0, 0);
+	ims_init(&cross->recvbuf, NULL, 0, 0);
+	link->sem[side].user = stream;
+	stream->close = async_cross_close;
+	stream->read = async_cross_read;
+	stream->write = async_cross_write;
+	stream->peek = async_cross_peek;
+	stream->enable = async_cross_enable;
+	stream->disable = async_cross_disable;
+	stream->remain = async_cross_remain;
+	stream->pending = async_cross_pending;
+	stream->watermark = async_cross_watermark;
+	stream->borrow = async_cross_borrow;
+	stream->consume = async_cross_consume;
+	return stream;
+}
+
+
+//---------------------------------------------------------------------
+// close one side, the link is freed with the last side
+//---------------------------------------------------------------------
+static void async_cross_close(CAsyncStream *stream)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	CAsyncCrossLink *link = cross->link;
+	int me = cross->side;
+	int last = 0;
+	if (cross->busy) {
+		cross->closing = 1;
+		return;
+	}
+	async_sem_stop(stream->loop, &link->sem[me]);
+	IMUTEX_LOCK(&link->lock);
+	link->closed[me] = 1;
+	if (link->closed[1 - me] == 0) {
+		async_sem_post(&link->sem[1 - me]);
+	}
+	link->refcnt--;
+	last = (link->refcnt == 0)? 1 : 0;
+	IMUTEX_UNLOCK(&link->lock);
+	if (last) {
+		ims_destroy(&link->chan[0]);
+		ims_destroy(&link->chan[1]);
+		async_sem_destroy(&link->sem[0]);
+		async_sem_destroy(&link->sem[1]);
+		IMUTEX_DESTROY(&link->lock);
+		ikmem_free(link);
+	}
+	ims_destroy(&cross->sendbuf);
+	ims_destroy(&cross->recvbuf);
+	stream->instance = NULL;
+	async_stream_zero(stream);
+	ikmem_free(cross);
+}
+
+
+//---------------------------------------------------------------------
+// hand sendbuf pages over to the other side
+//---------------------------------------------------------------------
+static void async_cross_flush(CAsyncStream *stream)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	CAsyncCrossLink *link = cross->link;
+	int peer = 1 - cross->side;
+	if ((stream->enabled & ASYNC_EVENT_WRITE) == 0) return;
+	if (cross->sendbuf.size == 0) return;
+	IMUTEX_LOCK(&link->lock);
+	if (link->closed[peer] == 0) {
+		ims_splice(&link->chan[peer], &cross->sendbuf, 
+				(ilong)cross->sendbuf.size);
+		async_sem_post(&link->sem[peer]);
+	}
+	IMUTEX_UNLOCK(&link->lock);
+}
+
+
+//---------------------------------------------------------------------
+// take pages from the channel into recvbuf, limited by hiwater
+//---------------------------------------------------------------------
+static long async_cross_pull(CAsyncStream *stream)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	CAsyncCrossLink *link = cross->link;
+	int me = cross->side;
+	long size, moved = 0;
+	if ((stream->enabled & ASYNC_EVENT_READ) == 0) {
+		return 0;
+	}
+	IMUTEX_LOCK(&link->lock);
+	size = (long)link->chan[me].size;
+	if (stream->hiwater > 0) {
+		long avail = stream->hiwater - (long)cross->recvbuf.size;
+		if (size > avail) size = avail;
+	}
+	if (size > 0) {
+		moved = (long)ims_splice(&cross->recvbuf, &link->chan[me], size);
+		link->consumed[1 - me] += moved;
+		if (link->closed[1 - me] == 0) {
+			async_sem_post(&link->sem[1 - me]);
+		}
+	}
+	IMUTEX_UNLOCK(&link->lock);
+	return moved;
+}
+
+
+//---------------------------------------------------------------------
+// semaphore callback, runs in the loop owning this side
+//---------------------------------------------------------------------
+static void async_cross_sem(CAsyncLoop *loop, CAsyncSemaphore *sem)
+{
+	CAsyncStream *stream = (CAsyncStream*)sem->user;
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	CAsyncCrossLink *link = cross->link;
+	int me = cross->side;
+	long moved, consumed, remain;
+	int peer_closed;
+	(void)loop;
+	cross->busy = 1;
+	if (cross->estab == 0) {
+		cross->estab = 1;
+		if (stream->callback) {
+			stream->callback(stream, ASYNC_STREAM_EVT_ESTAB, 0);
+		}
+	}
+	moved = (cross->closing)? 0 : async_cross_pull(stream);
+	if (moved > 0 && cross->closing == 0 && stream->callback) {
+		stream->callback(stream, ASYNC_STREAM_EVT_READING, (int)moved);
+	}
+	IMUTEX_LOCK(&link->lock);
+	consumed = link->consumed[me];
+	link->consumed[me] = 0;
+	peer_closed = link->closed[1 - me];
+	remain = (long)link->chan[me].size;
+	IMUTEX_UNLOCK(&link->lock);
+	if (consumed > 0 && cross->closing == 0 && stream->callback) {
+		stream->callback(stream, ASYNC_STREAM_EVT_WRITING, (int)consumed);
+	}
+	if (peer_closed && remain == 0 && stream->state != ASYNC_STREAM_CLOSED) {
+		stream->eof = ASYNC_STREAM_BOTH;
+		stream->direction = 0;
+		stream->state = ASYNC_STREAM_CLOSED;
+		if (cross->closing == 0 && stream->callback) {
+			stream->callback(stream, ASYNC_STREAM_EVT_EOF, 0);
+		}
+	}
+	cross->busy = 0;
+	if (cross->closing) {
+		async_cross_close(stream);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// read from recvbuf, wake self to pull more from the channel
+//---------------------------------------------------------------------
+static long async_cross_read(CAsyncStream *stream, void *ptr, long size)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	long hr = (long)ims_read(&cross->recvbuf, ptr, size);
+	if (hr == 0 && stream->state == ASYNC_STREAM_CLOSED) {
+		return -1; // peer closed and no buffered data
+	}
+	if (hr > 0) {
+		async_sem_post(&cross->link->sem[cross->side]);
+	}
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// write into sendbuf and hand it over
+//---------------------------------------------------------------------
+static long async_cross_write(CAsyncStream *stream, const void *ptr, long size)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	long hr;
+	if (stream->state == ASYNC_STREAM_CLOSED) {
+		return -1;
+	}
+	hr = (long)ims_write(&cross->sendbuf, ptr, size);
+	async_cross_flush(stream);
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// peek recvbuf
+//---------------------------------------------------------------------
+static long async_cross_peek(CAsyncStream *stream, void *ptr, long size)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	return (long)ims_peek(&cross->recvbuf, ptr, size);
+}
+
+
+//---------------------------------------------------------------------
+// borrow the first page of recvbuf
+//---------------------------------------------------------------------
+static long async_cross_borrow(CAsyncStream *stream, const void **ptr)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	void *p = NULL;
+	long hr = (long)ims_flat(&cross->recvbuf, &p);
+	*ptr = p;
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// drop borrowed data
+//---------------------------------------------------------------------
+static long async_cross_consume(CAsyncStream *stream, long size)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	long hr = (long)ims_drop(&cross->recvbuf, size);
+	if (hr > 0) {
+		async_sem_post(&cross->link->sem[cross->side]);
+	}
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// enable: ASYNC_EVENT_READ/WRITE
+//---------------------------------------------------------------------
+static void async_cross_enable(CAsyncStream *stream, int event)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	if (event & ASYNC_EVENT_READ) {
+		if ((stream->enabled & ASYNC_EVENT_READ) == 0) {
+			stream->enabled |= ASYNC_EVENT_READ;
+			async_sem_post(&cross->link->sem[cross->side]);
+		}
+	}
+	if (event & ASYNC_EVENT_WRITE) {
+		if ((stream->enabled & ASYNC_EVENT_WRITE) == 0) {
+			stream->enabled |= ASYNC_EVENT_WRITE;
+			async_cross_flush(stream);
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// disable: ASYNC_EVENT_READ/WRITE
+//---------------------------------------------------------------------
+static void async_cross_disable(CAsyncStream *stream, int event)
+{
+	stream->enabled &= ~(event & (ASYNC_EVENT_READ | ASYNC_EVENT_WRITE));
+}
+
+
+//---------------------------------------------------------------------
+// remain: bytes in recvbuf
+//---------------------------------------------------------------------
+static long async_cross_remain(const CAsyncStream *stream)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	return (long)cross->recvbuf.size;
+}
+
+
+//---------------------------------------------------------------------
+// pending: bytes not yet pulled by the other side
+//---------------------------------------------------------------------
+static long async_cross_pending(const CAsyncStream *stream)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	CAsyncCrossLink *link = cross->link;
+	long size;
+	IMUTEX_LOCK(&link->lock);
+	size = (long)link->chan[1 - cross->side].size;
+	IMUTEX_UNLOCK(&link->lock);
+	return size + (long)cross->sendbuf.size;
+}
+
+
+//---------------------------------------------------------------------
+// set input watermark
+//---------------------------------------------------------------------
+static void async_cross_watermark(CAsyncStream *stream, long high, long low)
+{
+	CAsyncCross *cross = async_stream_upcast(stream, CAsyncCross, stream);
+	if (high >= 0 && stream->hiwater != high) {
+		stream->hiwater = high;
+		async_sem_post(&cross->link->sem[cross->side]);
+	}
+	if (low >= 0) {
+		stream->lowater = low;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// create a pair whose two sides live in different loops
+//---------------------------------------------------------------------
+int async_stream_pair_cross(CAsyncLoop *loop1, CAsyncLoop *loop2,
+		CAsyncStream *pair[2])
+{
+	CAsyncCrossLink *link;
+	CAsyncStream *s1, *s2;
+	int i;
+	link = (CAsyncCrossLink*)ikmem_malloc(sizeof(CAsyncCrossLink));
+	if (link == NULL) {
+		return -1;
+	}
+	IMUTEX_INIT(&link->lock);
+	link->refcnt = 2;
+	for (i = 0; i < 2; i++) {
+		link->closed[i] = 0;
+		link->consumed[i] = 0;
+		ims_init(&link->chan[i], NULL, 0, 0);
+		async_sem_init(&link->sem[i], async_cross_sem);
+	}
+	s1 = async_cross_new(loop1, link, 0);
+	s2 = async_cross_new(loop2, link, 1);
+	if (s1 == NULL || s2 == NULL) {
+		if (s1) ikmem_free(async_stream_upcast(s1, CAsyncCross, stream));
+		if (s2) ikmem_free(async_stream_upcast(s2, CAsyncCross, stream));
+		for (i = 0; i < 2; i++) {
+			ims_destroy(&link->chan[i]);
+			async_sem_destroy(&link->sem[i]);
+		}
+		IMUTEX_DESTROY(&link->lock);
+		ikmem_free(link);
+		return -1;
+	}
+	async_sem_start(loop1, &link->sem[0]);
+	async_sem_start(loop2, &link->sem[1]);
+	// ESTAB is delivered by the first semaphore callback
+	async_sem_post(&link->sem[0]);
+	async_sem_post(&link->sem[1]);
+	if (pair) {
+		pair[0] = s1;
+		pair[1] = s2;
+	}
+	return 0;
+}
+
+
 
 //=====================================================================
 // CAsyncTcp
@@ -586,6 +1149,9 @@ typedef struct _CAsyncTcp {
 	CAsyncTimer evt_timer;
 }	CAsyncTcp;
 
+// maximum pages gathered into one send
+#define ASYNC_TCP_IOV_MAX 16
+
 
 //---------------------------------------------------------------------
 // internal
@@ -605,6 +1171,12 @@ static long async_tcp_remain(const CAsyncStream *stream);
 static long async_tcp_pending(const CAsyncStream *stream);
 static void async_tcp_watermark(CAsyncStream *stream, long high, long low);
 static long async_tcp_option(CAsyncStream *stream, int option, long value);
+static long async_tcp_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count);
+static long async_tcp_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count);
+static long async_tcp_borrow(CAsyncStream *stream, const void **ptr);
+static long async_tcp_consume(CAsyncStream *stream, long size);
 static void async_tcp_check(CAsyncStream *stream);
 static void async_tcp_error_shutdown(CAsyncStream *stream);
 
@@ -665,6 +1237,10 @@ static CAsyncStream *async_tcp_new(CAsyncLoop *loop,
 	stream->pending = async_tcp_pending;
 	stream->watermark = async_tcp_watermark;
 	stream->option = async_tcp_option;
+	stream->readv = async_tcp_readv;
+	stream->writev = async_tcp_writev;
+	stream->borrow = async_tcp_borrow;
+	stream->consume = async_tcp_consume;
 
 	return stream;
 }
@@ -985,11 +1561,24 @@ long async_tcp_try_writing(CAsyncStream *stream)
 	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
 	ilong total = 0;
 	while (tcp->sendbuf.size > 0) {
-		void *ptr = NULL;
-		long retval;
-		long size = (long)ims_flat(&tcp->sendbuf, &ptr);
+		void *ptrs[ASYNC_TCP_IOV_MAX];
+		ilong sizes[ASYNC_TCP_IOV_MAX];
+		long lens[ASYNC_TCP_IOV_MAX];
+		long retval, size = 0;
+		int count, i;
+		count = ims_flatv(&tcp->sendbuf, ptrs, sizes, ASYNC_TCP_IOV_MAX);
+		for (i = 0; i < count; i++) {
+			lens[i] = (long)sizes[i];
+			size += lens[i];
+		}
 		if (size <= 0) break;
-		retval = isend(tcp->fd, ptr, size, 0);
+		if (count == 1) {
+			retval = isend(tcp->fd, ptrs[0], size, 0);
+		}
+		else {
+			retval = isendv(tcp->fd, (const void * const *)ptrs, 
+					lens, count, 0);
+		}
 		if (retval == 0) break;
 		else if (retval < 0) {
 			retval = ierrno();
@@ -1121,10 +1710,9 @@ static void async_tcp_evt_timer(CAsyncLoop *loop, CAsyncTimer *timer)
 //---------------------------------------------------------------------
 // read data from recv buffer
 //---------------------------------------------------------------------
-long async_tcp_read(CAsyncStream *stream, void *ptr, long size)
+static void async_tcp_rearm(CAsyncStream *stream)
 {
 	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
-	long retval = (long)ims_read(&tcp->recvbuf, ptr, size);
 	if (stream->enabled & ASYNC_EVENT_READ) {
 		if ((stream->hiwater <= 0) || 
 			(stream->hiwater > 0 && (int)tcp->recvbuf.size < stream->hiwater)) {
@@ -1137,6 +1725,57 @@ long async_tcp_read(CAsyncStream *stream, void *ptr, long size)
 			}
 		}
 	}
+}
+
+long async_tcp_read(CAsyncStream *stream, void *ptr, long size)
+{
+	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
+	long retval = (long)ims_read(&tcp->recvbuf, ptr, size);
+	async_tcp_rearm(stream);
+	return retval;
+}
+
+
+//---------------------------------------------------------------------
+// scatter read from recv buffer
+//---------------------------------------------------------------------
+static long async_tcp_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count)
+{
+	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
+	long total = 0;
+	int i;
+	for (i = 0; i < count && tcp->recvbuf.size > 0; i++) {
+		if (veclen[i] > 0) {
+			total += (long)ims_read(&tcp->recvbuf, vecptr[i], veclen[i]);
+		}
+	}
+	async_tcp_rearm(stream);
+	return total;
+}
+
+
+//---------------------------------------------------------------------
+// borrow the first page of recv buffer
+//---------------------------------------------------------------------
+static long async_tcp_borrow(CAsyncStream *stream, const void **ptr)
+{
+	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
+	void *p = NULL;
+	long hr = (long)ims_flat(&tcp->recvbuf, &p);
+	*ptr = p;
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// drop borrowed data from recv buffer
+//---------------------------------------------------------------------
+static long async_tcp_consume(CAsyncStream *stream, long size)
+{
+	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
+	long retval = (long)ims_drop(&tcp->recvbuf, size);
+	async_tcp_rearm(stream);
 	return retval;
 }
 
@@ -1144,7 +1783,7 @@ long async_tcp_read(CAsyncStream *stream, void *ptr, long size)
 //---------------------------------------------------------------------
 // write data into send buffer
 //---------------------------------------------------------------------
-long async_tcp_write(CAsyncStream *stream, const void *ptr, long size)
+static long async_tcp_append(CAsyncStream *stream, const void *ptr, long size)
 {
 	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
 	long total = 0;
@@ -1165,6 +1804,12 @@ long async_tcp_write(CAsyncStream *stream, const void *ptr, long size)
 			total += need;
 		}
 	}
+	return total;
+}
+
+static void async_tcp_kick(CAsyncStream *stream)
+{
+	CAsyncTcp *tcp = async_stream_upcast(stream, CAsyncTcp, stream);
 	if (tcp->sendbuf.size > 0 && stream->state == ASYNC_STREAM_ESTAB) {
 		// during CONNECTING data is only buffered, evt_write will be
 		// started by async_tcp_evt_connect once the socket is ready
@@ -1178,6 +1823,30 @@ long async_tcp_write(CAsyncStream *stream, const void *ptr, long size)
 			}
 		}
 	}
+}
+
+long async_tcp_write(CAsyncStream *stream, const void *ptr, long size)
+{
+	long total = async_tcp_append(stream, ptr, size);
+	async_tcp_kick(stream);
+	return total;
+}
+
+
+//---------------------------------------------------------------------
+// gather write into send buffer, starts the write event once
+//---------------------------------------------------------------------
+static long async_tcp_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count)
+{
+	long total = 0;
+	int i;
+	for (i = 0; i < count; i++) {
+		if (veclen[i] > 0) {
+			total += async_tcp_append(stream, vecptr[i], veclen[i]);
+		}
+	}
+	async_tcp_kick(stream);
 	return total;
 }
 
@@ -1392,6 +2061,36 @@ long async_stream_pass_peek(CAsyncStream *stream, void *ptr, long size)
 	return _async_stream_peek(stream->underlying, ptr, size);
 }
 
+long async_stream_pass_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count)
+{
+	assert(stream != NULL);
+	assert(stream->underlying != NULL);
+	return async_stream_readv(stream->underlying, vecptr, veclen, count);
+}
+
+long async_stream_pass_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count)
+{
+	assert(stream != NULL);
+	assert(stream->underlying != NULL);
+	return async_stream_writev(stream->underlying, vecptr, veclen, count);
+}
+
+long async_stream_pass_borrow(CAsyncStream *stream, const void **ptr)
+{
+	assert(stream != NULL);
+	assert(stream->underlying != NULL);
+	return async_stream_borrow(stream->underlying, ptr);
+}
+
+long async_stream_pass_consume(CAsyncStream *stream, long size)
+{
+	assert(stream != NULL);
+	assert(stream->underlying != NULL);
+	return async_stream_consume(stream->underlying, size);
+}
+
 void async_stream_pass_enable(CAsyncStream *stream, int event)
 {
 	assert(stream != NULL);
@@ -1574,6 +2273,14 @@ static long async_filter_remain(const CAsyncStream *stream);
 static long async_filter_pending(const CAsyncStream *stream);
 static void async_filter_watermark(CAsyncStream *stream, long high, long low);
 static long async_filter_option(CAsyncStream *stream, int option, long value);
+static long async_filter_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count);
+static long async_filter_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count);
+static long async_filter_borrow(CAsyncStream *stream, const void **ptr);
+static long async_filter_consume(CAsyncStream *stream, long size);
+static long async_filter_consumed(CAsyncStream *stream, long hr);
+static long async_filter_produced(CAsyncStream *stream, long hr);
 
 static void async_filter_destroy(CAsyncFilter *filter);
 static void async_filter_notify(CAsyncFilter *filter, int event, int args);
@@ -1904,6 +2611,58 @@ static long async_filter_read(CAsyncStream *stream, void *ptr, long size)
 {
 	CAsyncFilter *filter = async_stream_upcast(stream, CAsyncFilter, stream);
 	long hr = (long)ims_read(&filter->recvbuf, ptr, size);
+	return async_filter_consumed(stream, hr);
+}
+
+
+//---------------------------------------------------------------------
+// scatter read: return filtered data from recvbuf
+//---------------------------------------------------------------------
+static long async_filter_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count)
+{
+	CAsyncFilter *filter = async_stream_upcast(stream, CAsyncFilter, stream);
+	long hr = 0;
+	int i;
+	for (i = 0; i < count && filter->recvbuf.size > 0; i++) {
+		if (veclen[i] > 0) {
+			hr += (long)ims_read(&filter->recvbuf, vecptr[i], veclen[i]);
+		}
+	}
+	return async_filter_consumed(stream, hr);
+}
+
+
+//---------------------------------------------------------------------
+// borrow: first page of filtered recvbuf
+//---------------------------------------------------------------------
+static long async_filter_borrow(CAsyncStream *stream, const void **ptr)
+{
+	CAsyncFilter *filter = async_stream_upcast(stream, CAsyncFilter, stream);
+	void *p = NULL;
+	long hr = (long)ims_flat(&filter->recvbuf, &p);
+	*ptr = p;
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// consume: drop borrowed data from recvbuf
+//---------------------------------------------------------------------
+static long async_filter_consume(CAsyncStream *stream, long size)
+{
+	CAsyncFilter *filter = async_stream_upcast(stream, CAsyncFilter, stream);
+	long hr = (long)ims_drop(&filter->recvbuf, size);
+	return async_filter_consumed(stream, hr);
+}
+
+
+//---------------------------------------------------------------------
+// after reading hr bytes: resume the underlying if below watermark
+//---------------------------------------------------------------------
+static long async_filter_consumed(CAsyncStream *stream, long hr)
+{
+	CAsyncFilter *filter = async_stream_upcast(stream, CAsyncFilter, stream);
 	if (hr > 0 && (stream->enabled & ASYNC_EVENT_READ)) {
 		if (stream->hiwater <= 0 || 
 			(long)filter->recvbuf.size < stream->hiwater) {
@@ -1939,6 +2698,36 @@ static long async_filter_write(CAsyncStream *stream, const void *ptr, long size)
 	if (filter->closing) return -1;
 	if (filter->out_finished) return -1;
 	hr = (long)ims_write(&filter->sendbuf, ptr, size);
+	return async_filter_produced(stream, hr);
+}
+
+
+//---------------------------------------------------------------------
+// gather write: put raw data into sendbuf, out_filter runs once
+//---------------------------------------------------------------------
+static long async_filter_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count)
+{
+	CAsyncFilter *filter = async_stream_upcast(stream, CAsyncFilter, stream);
+	long hr = 0;
+	int i;
+	if (filter->closing) return -1;
+	if (filter->out_finished) return -1;
+	for (i = 0; i < count; i++) {
+		if (veclen[i] > 0 && vecptr[i] != NULL) {
+			hr += (long)ims_write(&filter->sendbuf, vecptr[i], veclen[i]);
+		}
+	}
+	return async_filter_produced(stream, hr);
+}
+
+
+//---------------------------------------------------------------------
+// after writing hr bytes: trigger out_filter
+//---------------------------------------------------------------------
+static long async_filter_produced(CAsyncStream *stream, long hr)
+{
+	CAsyncFilter *filter = async_stream_upcast(stream, CAsyncFilter, stream);
 	if (hr > 0 && stream->state == ASYNC_STREAM_ESTAB) {
 		filter->busy++;
 		async_filter_run_out(filter, ASYNC_FILTER_NORMAL);
@@ -2148,6 +2937,10 @@ CAsyncStream *async_stream_filter_new(CAsyncLoop *loop,
 	stream->pending = async_filter_pending;
 	stream->watermark = async_filter_watermark;
 	stream->option = async_filter_option;
+	stream->readv = async_filter_readv;
+	stream->writev = async_filter_writev;
+	stream->borrow = async_filter_borrow;
+	stream->consume = async_filter_consume;
 	// underlying already established: deliver ESTAB to the user
 	if (underlying->state == ASYNC_STREAM_ESTAB) {
 		filter->estab_notified = 1;
@@ -2183,21 +2976,140 @@ int async_stream_filter_flush(CAsyncStream *stream, int mode)
 	if (mode == ASYNC_FILTER_FINISH) {
 		filter->out_finished = 1;
 	}
-	return (stream->error != 0)? -1 : 0;
+	return (stream->error != 0)? -1 : 0;
+}
+
+
+//---------------------------------------------------------------------
+// get the ctx pointer passed to async_stream_filter_new
+//---------------------------------------------------------------------
+void *async_stream_filter_get_ctx(const CAsyncStream *stream)
+{
+	CAsyncFilter *filter;
+	if (stream == NULL || stream->name != ASYNC_STREAM_NAME_FILTER) {
+		return NULL;
+	}
+	filter = async_stream_upcast(stream, CAsyncFilter, stream);
+	return filter->ctx;
+}
+
+
+//---------------------------------------------------------------------
+// LZ compression filter
+//---------------------------------------------------------------------
+typedef struct
+{
+	ILZSTREAM encoder;          // dictionary for output
+	ILZSTREAM decoder;          // dictionary for input
+	char *buffer;               // ILZ_CHUNK plain + bound compressed
+}	CAsyncStreamLz;
+
+#define ASYNC_STREAM_LZ_BUFSIZE (ILZ_CHUNK + ILZ_CHUNK + 64)
+
+
+//---------------------------------------------------------------------
+// output: compress the user data into chunks
+//---------------------------------------------------------------------
+static int async_stream_lz_out(CAsyncStream *stream,
+	struct IMSTREAM *src, struct IMSTREAM *dst, int mode, void *ctx)
+{
+	CAsyncStreamLz *lz = (CAsyncStreamLz*)ctx;
+	char *plain = lz->buffer;
+	char *packed = lz->buffer + ILZ_CHUNK;
+	(void)stream;
+	(void)mode;
+	while (src->size > 0) {
+		long size = (long)ims_read(src, plain, ILZ_CHUNK);
+		long hr = (long)ilz_compress(&lz->encoder, plain, size, packed);
+		if (hr < 0) return ASYNC_FILTER_ERROR;
+		ims_write(dst, packed, hr);
+	}
+	return ASYNC_FILTER_OK;
+}
+
+
+//---------------------------------------------------------------------
+// input: decompress complete chunks, keep the partial one in src
+//---------------------------------------------------------------------
+static int async_stream_lz_in(CAsyncStream *stream,
+	struct IMSTREAM *src, struct IMSTREAM *dst, int mode, void *ctx)
+{
+	CAsyncStreamLz *lz = (CAsyncStreamLz*)ctx;
+	char *plain = lz->buffer;
+	char *packed = lz->buffer + ILZ_CHUNK;
+	int hr = ASYNC_FILTER_NEED_MORE;
+	(void)stream;
+	while (src->size > 0) {
+		ilong rawsize = 0, length, size;
+		char head[8];
+		size = (ilong)ims_peek(src, head, 8);
+		length = ilz_peek(head, size, &rawsize);
+		if (length < 0) return ASYNC_FILTER_ERROR;
+		if (length == 0 || length > (ilong)src->size) break;
+		ims_read(src, packed, length);
+		size = ilz_decompress(&lz->decoder, packed, length, 
+				plain, ILZ_CHUNK);
+		if (size != rawsize) return ASYNC_FILTER_ERROR;
+		ims_write(dst, plain, size);
+		hr = ASYNC_FILTER_OK;
+	}
+	if (mode == ASYNC_FILTER_FINISH && src->size > 0) {
+		return ASYNC_FILTER_ERROR;     // truncated chunk
+	}
+	return hr;
 }
 
 
 //---------------------------------------------------------------------
-// get the ctx pointer passed to async_stream_filter_new
+// release context
 //---------------------------------------------------------------------
-void *async_stream_filter_get_ctx(const CAsyncStream *stream)
+static void async_stream_lz_free(void *ctx)
 {
-	CAsyncFilter *filter;
-	if (stream == NULL || stream->name != ASYNC_STREAM_NAME_FILTER) {
+	CAsyncStreamLz *lz = (CAsyncStreamLz*)ctx;
+	ilz_destroy(&lz->encoder);
+	ilz_destroy(&lz->decoder);
+	if (lz->buffer) ikmem_free(lz->buffer);
+	ikmem_free(lz);
+}
+
+
+//---------------------------------------------------------------------
+// create a LZ compression stream on top of an underlying stream
+//---------------------------------------------------------------------
+CAsyncStream *async_stream_lz_new(CAsyncLoop *loop,
+	CAsyncStream *underlying, int close_on_free,
+	void (*callback)(CAsyncStream *stream, int event, int args))
+{
+	CAsyncStreamLz *lz;
+	CAsyncStream *stream;
+	lz = (CAsyncStreamLz*)ikmem_malloc(sizeof(CAsyncStreamLz));
+	if (lz == NULL) {
 		return NULL;
 	}
-	filter = async_stream_upcast(stream, CAsyncFilter, stream);
-	return filter->ctx;
+	lz->buffer = (char*)ikmem_malloc(ASYNC_STREAM_LZ_BUFSIZE);
+	if (lz->buffer == NULL) {
+		ikmem_free(lz);
+		return NULL;
+	}
+	if (ilz_init(&lz->encoder) != 0) {
+		ikmem_free(lz->buffer);
+		ikmem_free(lz);
+		return NULL;
+	}
+	if (ilz_init(&lz->decoder) != 0) {
+		ilz_destroy(&lz->encoder);
+		ikmem_free(lz->buffer);
+		ikmem_free(lz);
+		return NULL;
+	}
+	stream = async_stream_filter_new(loop, underlying,
+			async_stream_lz_in, async_stream_lz_out, 
+			close_on_free, lz, async_stream_lz_free, callback);
+	if (stream == NULL) {
+		async_stream_lz_free(lz);
+		return NULL;
+	}
+	return stream;
 }
 
 
@@ -2209,28 +3121,54 @@ void *async_stream_filter_get_ctx(const CAsyncStream *stream)
 void async_listener_evt_read(CAsyncLoop *loop, CAsyncEvent *evt, int mask)
 {
 	CAsyncListener *listener = (CAsyncListener*)evt->user;
-	isockaddr_union addr;
-	int addrlen = sizeof(addr);
-	int fd;
+	int budget = (listener->budget > 0)? listener->budget : 1;
 	(void)loop;
 	(void)mask;
 
-	memset(&addr, 0, sizeof(addr));
+	listener->busy = 1;
 
-	fd = iaccept(listener->fd, &addr.address, &addrlen);
+	// drain the backlog up to budget connections per readiness
+	for (; budget > 0 && listener->fd >= 0; budget--) {
+		isockaddr_union addr;
+		int addrlen = sizeof(addr);
+		int fd;
 
-	if (fd < 0) {
-		int error = ierrno();
-		if (error != IEAGAIN && error != 0) {
-			if (listener->errorcb) {
-				listener->errorcb(listener, error);
+		memset(&addr, 0, sizeof(addr));
+
+		fd = iaccept4(listener->fd, &addr.address, &addrlen, 
+				IACCEPT_CLOEXEC);
+
+		if (fd < 0) {
+			int error = ierrno();
+		#ifdef EINTR
+			if (error == EINTR) continue;
+		#endif
+			if (error != IEAGAIN && error != 0) {
+				if (listener->errorcb) {
+					listener->errorcb(listener, error);
+				}
 			}
+			break;
+		}
+
+		if (listener->callback) {
+			listener->callback(listener, fd, &addr.address, addrlen);
+		}
+
+		if (listener->releasing) {
+			break;
+		}
+
+		// paused by the callback: leave the rest in the backlog
+		if (async_event_is_active(&listener->evt_read) == 0) {
+			break;
 		}
-		return;
 	}
 
-	if (listener->callback) {
-		listener->callback(listener, fd, &addr.address, addrlen);
+	listener->busy = 0;
+
+	if (listener->releasing) {
+		async_listener_delete(listener);
 	}
 }
 
@@ -2254,6 +3192,10 @@ CAsyncListener *async_listener_new(CAsyncLoop *loop,
 	listener->callback = callback;
 	listener->errorcb = NULL;
 	listener->user = NULL;
+	listener->budget = ASYNC_LISTENER_BUDGET;
+	listener->cpu = -1;
+	listener->busy = 0;
+	listener->releasing = 0;
 
 	async_event_init(&listener->evt_read, async_listener_evt_read, -1, 
 			ASYNC_EVENT_READ);
@@ -2276,6 +3218,12 @@ void async_listener_delete(CAsyncListener *listener)
 	listener->callback = NULL;
 	listener->errorcb = NULL;
 
+	// deleted inside the callback: freed after the accept loop
+	if (listener->busy) {
+		listener->releasing = 1;
+		return;
+	}
+
 	ikmem_free(listener);
 }
 
@@ -2360,12 +3308,36 @@ int async_listener_start(CAsyncListener *listener, int backlog,
 		return -2;
 	}
 
+#if defined(SO_INCOMING_CPU)
+	if ((flags & ASYNC_LISTENER_INCOMING_CPU) && listener->cpu >= 0) {
+		int cpu = listener->cpu;
+		isetsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, 
+				(const char*)&cpu, sizeof(cpu));
+	}
+#endif
+
+#if defined(TCP_DEFER_ACCEPT)
+	if (flags & ASYNC_LISTENER_DEFER_ACCEPT) {
+		int secs = ASYNC_LISTENER_DEFER_SECS;
+		isetsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, 
+				(const char*)&secs, sizeof(secs));
+	}
+#endif
+
 	if (listen(fd, backlog) != 0) {
 		listener->error = ierrno();
 		iclose(fd);
 		return -3;
 	}
 
+#if defined(TCP_FASTOPEN)
+	if (flags & ASYNC_LISTENER_FASTOPEN) {
+		int qlen = ASYNC_LISTENER_FASTOPEN_QLEN;
+		isetsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, 
+				(const char*)&qlen, sizeof(qlen));
+	}
+#endif
+
 	isocket_enable(fd, ISOCK_NOBLOCK);
 
 	listener->fd = fd;
@@ -2379,6 +3351,32 @@ int async_listener_start(CAsyncListener *listener, int backlog,
 }
 
 
+//---------------------------------------------------------------------
+// start a SO_REUSEPORT listener set
+//---------------------------------------------------------------------
+int async_listener_shard(CAsyncListener *listeners[], int count, 
+		int backlog, int flags, const struct sockaddr *addr, int addrlen)
+{
+	int i, j;
+	for (i = 0; i < count; i++) {
+		CAsyncListener *listener = listeners[i];
+		int hr;
+		if ((flags & ASYNC_LISTENER_INCOMING_CPU) && listener->cpu < 0) {
+			listener->cpu = i;
+		}
+		hr = async_listener_start(listener, backlog, 
+				flags | ASYNC_LISTENER_REUSEPORT, addr, addrlen);
+		if (hr != 0) {
+			for (j = 0; j < i; j++) {
+				async_listener_stop(listeners[j]);
+			}
+			return hr;
+		}
+	}
+	return 0;
+}
+
+
 //---------------------------------------------------------------------
 // stop listening
 //---------------------------------------------------------------------
@@ -2426,6 +3424,11 @@ static const int async_split_head_len[15] =
 static const int async_split_head_inc[15] = 
 	{ 0, 0, 0, 0, 0, 0, 2, 2, 4, 4, 1, 1, 0, 0, 0 };
 
+/* vectors gathered with the header in one write */
+#define ASYNC_SPLIT_IOV_MAX 15
+
+static long async_split_hdr_decode(int header, const void *ptr);
+
 
 //---------------------------------------------------------------------
 // read size from header, return 0 on not enough data
@@ -2434,16 +3437,11 @@ long async_split_hdr_peek(CAsyncStream *stream, int header, int *hdrsize)
 {
 	unsigned char dsize[4];
 	long len;
-	IUINT8 len8;
-	IUINT16 len16;
-	IUINT32 len32;
 	int hdrlen;
-	int hdrinc;
 
 	assert(stream);
 
 	hdrlen = async_split_head_len[header];
-	hdrinc = async_split_head_inc[header];
 
 	if (header == ASYNC_SPLIT_PRIMITIVE) {
 		len = (long)_async_stream_remain(stream);
@@ -2454,7 +3452,27 @@ long async_split_hdr_peek(CAsyncStream *stream, int header, int *hdrsize)
 
 	len = (long)_async_stream_peek(stream, dsize, hdrlen);
 	if (len < (long)hdrlen) return 0;
-	
+
+	len = async_split_hdr_decode(header, dsize);
+
+	if (hdrsize) *hdrsize = hdrlen;
+
+	return len;
+}
+
+
+//---------------------------------------------------------------------
+// decode packet size (header included) from raw header bytes
+//---------------------------------------------------------------------
+static long async_split_hdr_decode(int header, const void *ptr)
+{
+	const char *dsize = (const char*)ptr;
+	long len = 0;
+	IUINT8 len8;
+	IUINT16 len16;
+	IUINT32 len32;
+	int hdrinc = async_split_head_inc[header];
+
 	if (header <= ASYNC_SPLIT_EBYTEMSB) {
 		header = (header < ASYNC_SPLIT_EWORDLSB)?  header : 
 			(header - ASYNC_SPLIT_EWORDLSB);
@@ -2497,25 +3515,20 @@ long async_split_hdr_peek(CAsyncStream *stream, int header, int *hdrsize)
 
 	len += (long)hdrinc;
 
-	if (hdrsize) *hdrsize = hdrlen;
-
 	return len;
 }
 
 
 //---------------------------------------------------------------------
-// push header before writing data
+// encode header into out, returns header length
 //---------------------------------------------------------------------
-void async_split_hdr_push(CAsyncStream *stream, int header, long size)
+static int async_split_hdr_encode(int header, long size, char *out)
 {
 	IUINT32 len;
 	int hdrlen;
 	int hdrinc;
-	char out[4];
 
-	assert(stream);
-
-	if (header >= ASYNC_SPLIT_PRIMITIVE) return;
+	if (header >= ASYNC_SPLIT_PRIMITIVE) return 0;
 
 	hdrlen = async_split_head_len[header];
 	hdrinc = async_split_head_inc[header];
@@ -2549,7 +3562,22 @@ void async_split_hdr_push(CAsyncStream *stream, int header, long size)
 		iencode32u_lsb((char*)out, (IUINT32)len);
 	}
 
-	_async_stream_write(stream, out, hdrlen);
+	return hdrlen;
+}
+
+
+//---------------------------------------------------------------------
+// push header before writing data
+//---------------------------------------------------------------------
+void async_split_hdr_push(CAsyncStream *stream, int header, long size)
+{
+	char out[4];
+	int hdrlen;
+	assert(stream);
+	hdrlen = async_split_hdr_encode(header, size, out);
+	if (hdrlen > 0) {
+		_async_stream_write(stream, out, hdrlen);
+	}
 }
 
 
@@ -2560,22 +3588,30 @@ static long async_split_try_reading(CAsyncSplit *split, char *data, long maxsize
 {
 	long size, hr;
 	char header[8];
+	const void *borrowed;
 	int hdrlen;
 	if (split->header <= ASYNC_SPLIT_DWORDMASK) {
 		size = async_split_hdr_peek(split->stream, split->header, &hdrlen);
 		if (size <= 0) return -1;
 		if (_async_stream_remain(split->stream) < size) return -1;
-		hr = _async_stream_read(split->stream, header, hdrlen);
-		assert(hr == hdrlen);
-		size -= hdrlen;
-		if (size > maxsize) {
+		if (size - hdrlen > maxsize) {
 			split->error = 1;
 			if (split->loop->logmask & ASYNC_LOOP_LOG_SPLIT) {
 				async_loop_log(split->loop, ASYNC_LOOP_LOG_SPLIT,
-					"[split] error: packet size too large %ld", size);
+					"[split] error: packet size too large %ld", 
+					size - hdrlen);
 			}
 			return -1;
 		}
+		// whole packet in one page: copy the body once and skip header
+		if (async_stream_borrow(split->stream, &borrowed) >= size) {
+			memcpy(data, (const char*)borrowed + hdrlen, size - hdrlen);
+			_async_stream_consume(split->stream, size);
+			return size - hdrlen;
+		}
+		hr = _async_stream_read(split->stream, header, hdrlen);
+		assert(hr == hdrlen);
+		size -= hdrlen;
 		hr = _async_stream_read(split->stream, data, size);
 		assert(hr == size);
 		return size;
@@ -2591,8 +3627,11 @@ static long async_split_try_reading(CAsyncSplit *split, char *data, long maxsize
 	}
 	else {
 		char *cache = split->loop->cache;
+		int direct = (async_stream_borrow(split->stream, &borrowed) >= 0);
 		size = 0;
-		while (1) {
+		// streams without borrow support are copied into linesplit,
+		// otherwise lines are scanned in the stream buffer directly
+		while (direct == 0) {
 			long remain = _async_stream_remain(split->stream);
 			if (remain <= 0) break;
 			if (remain > ASYNC_LOOP_BUFFER_SIZE) remain = ASYNC_LOOP_BUFFER_SIZE;
@@ -2602,11 +3641,20 @@ static long async_split_try_reading(CAsyncSplit *split, char *data, long maxsize
 		}
 		while (1) {
 			void *buffer;
-			char *ptr;
-			long canread = (long)ims_flat(&split->linesplit, &buffer);
+			const char *ptr;
+			long canread;
 			long i, pos = -1;
+			int borrowing = 0;
+			if (direct == 0 || split->linesplit.size > 0) {
+				canread = (long)ims_flat(&split->linesplit, &buffer);
+				ptr = (const char*)buffer;
+			}
+			else {
+				canread = _async_stream_borrow(split->stream, &borrowed);
+				ptr = (const char*)borrowed;
+				borrowing = 1;
+			}
 			if (canread <= 0) break;
-			ptr = (char*)buffer;
 			for (i = 0; i < canread; i++) {
 				if (ptr[i] == '\n') {
 					pos = i;
@@ -2626,11 +3674,20 @@ static long async_split_try_reading(CAsyncSplit *split, char *data, long maxsize
 					return -1;
 				}
 				ims_write(&split->linecache, ptr, canread);
-				ims_drop(&split->linesplit, canread);
+				if (borrowing) _async_stream_consume(split->stream, canread);
+				else ims_drop(&split->linesplit, canread);
+			}
+			else if (ims_dsize(&split->linecache) == 0 && pos < maxsize) {
+				// the whole line is in one page: copy it out once
+				memcpy(data, ptr, pos + 1);
+				if (borrowing) _async_stream_consume(split->stream, pos + 1);
+				else ims_drop(&split->linesplit, pos + 1);
+				return pos + 1;
 			}
 			else {
 				ims_write(&split->linecache, ptr, pos + 1);
-				ims_drop(&split->linesplit, pos + 1);
+				if (borrowing) _async_stream_consume(split->stream, pos + 1);
+				else ims_drop(&split->linesplit, pos + 1);
 				size = (long)ims_dsize(&split->linecache);
 				if (size > maxsize) {
 					split->error = 1;
@@ -2651,6 +3708,96 @@ static long async_split_try_reading(CAsyncSplit *split, char *data, long maxsize
 }
 
 
+//---------------------------------------------------------------------
+// scan complete frames in a flat span, returns the number of frames
+// and stores the bytes they occupy (headers included) in *used.
+// header decoding is scalar: each offset depends on the previous
+// length, so the frames can not be decoded in parallel. line mode
+// relies on memchr, which the C library already vectorizes.
+//---------------------------------------------------------------------
+static int async_split_scan(CAsyncSplit *split, const char *ptr, long size,
+		void *vecptr[], long veclen[], int count, long *used)
+{
+	int header = split->header;
+	long pos = 0;
+	int n = 0;
+	if (header <= ASYNC_SPLIT_DWORDMASK) {
+		int hdrlen = async_split_head_len[header];
+		while (n < count && size - pos >= hdrlen) {
+			long len = async_split_hdr_decode(header, ptr + pos);
+			if (len < hdrlen || len > size - pos) break;
+			if (len - hdrlen > ASYNC_LOOP_BUFFER_SIZE) break;
+			vecptr[n] = (void*)(ptr + pos + hdrlen);
+			veclen[n] = len - hdrlen;
+			pos += len;
+			n++;
+		}
+	}
+	else if (header == ASYNC_SPLIT_LINESPLIT) {
+		while (n < count && pos < size) {
+			const char *end = (const char*)memchr(ptr + pos, '\n', 
+					(size_t)(size - pos));
+			long len;
+			if (end == NULL) break;
+			len = (long)(end - (ptr + pos)) + 1;
+			if (len > ASYNC_LOOP_BUFFER_SIZE) break;
+			vecptr[n] = (void*)(ptr + pos);
+			veclen[n] = len;
+			pos += len;
+			n++;
+		}
+	}
+	else if (size > 0) {
+		vecptr[0] = (void*)ptr;
+		veclen[0] = (size > 16384)? 16384 : size;
+		pos = veclen[0];
+		n = 1;
+	}
+	*used = pos;
+	return n;
+}
+
+
+//---------------------------------------------------------------------
+// deliver frames to split->batch
+//---------------------------------------------------------------------
+static void async_split_read_batch(CAsyncSplit *split)
+{
+	while (split->releasing == 0 && split->error == 0) {
+		void *vecptr[ASYNC_SPLIT_BATCH_MAX];
+		long veclen[ASYNC_SPLIT_BATCH_MAX];
+		const void *borrowed = NULL;
+		long avail, used = 0;
+		int count = 0;
+		avail = async_stream_borrow(split->stream, &borrowed);
+		if (avail > 0 && ims_dsize(&split->linecache) == 0 &&
+			ims_dsize(&split->linesplit) == 0) {
+			count = async_split_scan(split, (const char*)borrowed, avail,
+					vecptr, veclen, ASYNC_SPLIT_BATCH_MAX, &used);
+		}
+		if (count == 0) {
+			// frame crosses a page or the stream can not lend: copy it
+			char *data = split->loop->cache;
+			long size = async_split_try_reading(split, data, 
+					ASYNC_LOOP_BUFFER_SIZE);
+			if (size < 0) break;
+			vecptr[0] = data;
+			veclen[0] = size;
+			count = 1;
+		}
+		split->busy = 1;
+		split->batch(split, vecptr, veclen, count);
+		split->busy = 0;
+		if (used > 0) {
+			_async_stream_consume(split->stream, used);
+		}
+		if (((split->stream->enabled) & ASYNC_EVENT_READ) == 0) {
+			break;
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // callback for stream
 //---------------------------------------------------------------------
@@ -2664,7 +3811,10 @@ static void async_split_callback(CAsyncStream *stream, int event, int args)
 		split->callback(split, event);
 		split->busy = 0;
 	}
-	if (event & ASYNC_STREAM_EVT_READING) {
+	if ((event & ASYNC_STREAM_EVT_READING) && split->batch) {
+		async_split_read_batch(split);
+	}
+	else if (event & ASYNC_STREAM_EVT_READING) {
 		char *data = split->loop->cache;
 		while (split->releasing == 0 && split->error == 0) {
 			long size = async_split_try_reading(split, data, ASYNC_LOOP_BUFFER_SIZE);
@@ -2779,6 +3929,9 @@ void async_split_delete(CAsyncSplit *split)
 void async_split_write_vector(CAsyncSplit *split,
 		const void * const vecptr[], const long veclen[], int count)
 {
+	const void *ptrs[ASYNC_SPLIT_IOV_MAX + 1];
+	long lens[ASYNC_SPLIT_IOV_MAX + 1];
+	char head[4];
 	int i;
 	assert(split);
 	assert(split->stream);
@@ -2787,15 +3940,22 @@ void async_split_write_vector(CAsyncSplit *split,
 		for (i = 0; i < count; i++) {
 			totlen += veclen[i];
 		}
-		async_split_hdr_push(split->stream, split->header, totlen);
+		if (count > ASYNC_SPLIT_IOV_MAX) {
+			async_split_hdr_push(split->stream, split->header, totlen);
+			async_stream_writev(split->stream, vecptr, veclen, count);
+			return;
+		}
+		// header and body go out in a single gather write
+		lens[0] = async_split_hdr_encode(split->header, totlen, head);
+		ptrs[0] = head;
 		for (i = 0; i < count; i++) {
-			_async_stream_write(split->stream, vecptr[i], veclen[i]);
+			ptrs[i + 1] = vecptr[i];
+			lens[i + 1] = veclen[i];
 		}
+		async_stream_writev(split->stream, ptrs, lens, count + 1);
 	}
 	else {
-		for (i = 0; i < count; i++) {
-			_async_stream_write(split->stream, vecptr[i], veclen[i]);
-		}
+		async_stream_writev(split->stream, vecptr, veclen, count);
 	}
 }
 
@@ -2808,8 +3968,14 @@ void async_split_write(CAsyncSplit *split, const void *ptr, long size)
 	assert(split);
 	assert(split->stream);
 	if (split->header <= ASYNC_SPLIT_DWORDMASK) {
-		async_split_hdr_push(split->stream, split->header, size);
-		_async_stream_write(split->stream, ptr, size);
+		const void *ptrs[2];
+		long lens[2];
+		char head[4];
+		lens[0] = async_split_hdr_encode(split->header, size, head);
+		ptrs[0] = head;
+		ptrs[1] = ptr;
+		lens[1] = size;
+		async_stream_writev(split->stream, ptrs, lens, 2);
 	}
 	else {
 		_async_stream_write(split->stream, ptr, size);
@@ -3175,6 +4341,20 @@ int async_udp_recvfrom(CAsyncUdp *udp, void *ptr, long size,
 //=====================================================================
 static void async_msg_evt_sem(CAsyncLoop *loop, CAsyncSemaphore *sem);
 
+// ring slot: sequence == position when free for the producer that
+// reserves position, position + 1 once published for the loop. 
+// when size >= ASYNC_MSG_SLOT_DATA the body is in msg->bodies.
+struct CAsyncMessageSlot {
+	volatile IINT32 sequence;
+	int mid;
+	IINT32 wparam;
+	IINT32 lparam;
+	int size;
+	char data[ASYNC_MSG_SLOT_DATA];
+};
+
+#define ASYNC_MSG_RING_MASK   (ASYNC_MSG_RING_SIZE - 1)
+
 
 //---------------------------------------------------------------------
 // create a new message
@@ -3184,25 +4364,44 @@ CAsyncMessage *async_msg_new(CAsyncLoop *loop,
 		IINT32 wparam, IINT32 lparam, const void *ptr, int size))
 {
 	CAsyncMessage *msg;
+	int i;
 
 	msg = (CAsyncMessage*)ikmem_malloc(sizeof(CAsyncMessage));
 	assert(msg != NULL);
 
+	msg->ring = (struct CAsyncMessageSlot*)ikmem_malloc(
+			sizeof(struct CAsyncMessageSlot) * ASYNC_MSG_RING_SIZE);
+	msg->items = (CAsyncMessageItem*)ikmem_malloc(
+			sizeof(CAsyncMessageItem) * ASYNC_MSG_RING_SIZE);
+	assert(msg->ring != NULL && msg->items != NULL);
+
+	for (i = 0; i < ASYNC_MSG_RING_SIZE; i++) {
+		msg->ring[i].sequence = (IINT32)i;
+	}
+
 	msg->loop = loop;
 	msg->callback = callback;
+	msg->batch = NULL;
 	msg->signaled = 0;
 	msg->user = NULL;
 	msg->active = 0;
 	msg->busy = 0;
 	msg->releasing = 0;
+	msg->tail = 0;
+	msg->head = 0;
+	msg->overflow = 0;
 
 	ims_init(&msg->queue, NULL, 4096, 4096);
+	ims_init(&msg->bodies, NULL, 4096, 4096);
+	ims_init(&msg->drain, NULL, 4096, 4096);
 	async_sem_init(&msg->evt_sem, async_msg_evt_sem);
 	msg->evt_sem.user = msg;
 
 	msg->num_sem_post = 0;
 	msg->num_msg_post = 0;
+	msg->num_ring_post = 0;
 	msg->num_msg_read = 0;
+	msg->num_batches = 0;
 
 	IMUTEX_INIT(&msg->lock);
 
@@ -3229,10 +4428,16 @@ void async_msg_delete(CAsyncMessage *msg)
 	}
 	IMUTEX_LOCK(&msg->lock);
 	ims_destroy(&msg->queue);
+	ims_destroy(&msg->bodies);
+	ims_destroy(&msg->drain);
 	msg->signaled = 0;
 	IMUTEX_UNLOCK(&msg->lock);
 	IMUTEX_DESTROY(&msg->lock);
 	async_sem_destroy(&msg->evt_sem);
+	ikmem_free(msg->ring);
+	ikmem_free(msg->items);
+	msg->ring = NULL;
+	msg->items = NULL;
 	msg->user = NULL;
 	msg->releasing = 0;
 	ikmem_free(msg);
@@ -3249,14 +4454,16 @@ int async_msg_start(CAsyncMessage *msg)
 		return -1;
 	}
 	assert(msg->active == 0);
-	IMUTEX_LOCK(&msg->lock);
-	msg->signaled = 0;
-	IMUTEX_UNLOCK(&msg->lock);
+	IATOMIC_STORE(&msg->signaled, 0);
 	cc = async_sem_start(msg->loop, &msg->evt_sem);
 	if (cc == 0) {
-		IMUTEX_LOCK(&msg->lock);
-		msg->active = 1;
-		IMUTEX_UNLOCK(&msg->lock);
+		IATOMIC_STORE(&msg->active, 1);
+		// messages left from a previous start
+		if (msg->head != IATOMIC_LOAD(&msg->tail) || 
+				IATOMIC_LOAD(&msg->overflow) > 0) {
+			IATOMIC_STORE(&msg->signaled, 1);
+			async_sem_post(&msg->evt_sem);
+		}
 	}
 	return cc;
 }
@@ -3274,43 +4481,239 @@ int async_msg_stop(CAsyncMessage *msg)
 	assert(msg->active != 0);
 	cc = async_sem_stop(msg->loop, &msg->evt_sem);
 	if (cc == 0) {
-		IMUTEX_LOCK(&msg->lock);
-		msg->active = 0;
-		IMUTEX_UNLOCK(&msg->lock);
+		IATOMIC_STORE(&msg->active, 0);
 	}
 	return cc;
 }
 
 
+//---------------------------------------------------------------------
+// reserve and fill a ring slot, returns 0 when the ring is full.
+// large messages are pushed with msg->lock held, so their slots and
+// bodies are in the same order.
+//---------------------------------------------------------------------
+static int async_msg_ring_push(CAsyncMessage *msg, int mid, 
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
+{
+	struct CAsyncMessageSlot *slot;
+	IINT32 pos = IATOMIC_LOAD(&msg->tail);
+	while (1) {
+		IINT32 seq, diff;
+		slot = &msg->ring[pos & ASYNC_MSG_RING_MASK];
+		seq = IATOMIC_LOAD(&slot->sequence);
+		diff = (IINT32)((IUINT32)seq - (IUINT32)pos);
+		if (diff == 0) {
+			if (IATOMIC_CAS(&msg->tail, pos, (IINT32)((IUINT32)pos + 1))) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			return 0;
+		}
+		pos = IATOMIC_LOAD(&msg->tail);
+	}
+	slot->mid = mid;
+	slot->wparam = wparam;
+	slot->lparam = lparam;
+	slot->size = size;
+	if (size >= ASYNC_MSG_SLOT_DATA) {
+		ims_write(&msg->bodies, ptr, size);
+	}
+	else {
+		if (size > 0) {
+			memcpy(slot->data, ptr, size);
+		}
+		slot->data[size] = '\0';
+	}
+	IATOMIC_STORE(&slot->sequence, (IINT32)((IUINT32)pos + 1));
+	return 1;
+}
+
+
 //---------------------------------------------------------------------
 // post message from another thread
 //---------------------------------------------------------------------
 int async_msg_post(CAsyncMessage *msg, int mid, 
 	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
 {
-	int signaled = 0;
-	int active = 0;
-	if (size + 16 >= ASYNC_LOOP_BUFFER_SIZE) {
+	return async_msg_post_from(msg, NULL, mid, wparam, lparam, ptr, size);
+}
+
+
+//---------------------------------------------------------------------
+// post message and account it to the producer
+//---------------------------------------------------------------------
+int async_msg_post_from(CAsyncMessage *msg, CAsyncMessageProducer *producer,
+	int mid, IINT32 wparam, IINT32 lparam, const void *ptr, int size)
+{
+	int inring = 0;
+	int active = IATOMIC_LOAD(&msg->active);
+	if (size < 0 || size + 16 >= ASYNC_LOOP_BUFFER_SIZE || active == 0) {
+		if (producer) producer->num_failed++;
 		return -1;
 	}
-	IMUTEX_LOCK(&msg->lock);
-	active = msg->active;
-	if (active) {
-		iposix_msg_push(&msg->queue, mid, wparam, lparam, ptr, size);
-		signaled = msg->signaled;
-		msg->signaled = 1;
-		msg->num_msg_post++;
-		if (signaled == 0) {
-			msg->num_sem_post++;
+	// the ring is skipped while the overflow holds messages, so a
+	// producer never overtakes its own messages queued there
+	if (size < ASYNC_MSG_SLOT_DATA) {
+		if (IATOMIC_LOAD(&msg->overflow) == 0) {
+			inring = async_msg_ring_push(msg, mid, wparam, 
+					lparam, ptr, size);
 		}
 	}
-	IMUTEX_UNLOCK(&msg->lock);
-	if (signaled == 0) {
-		if (active) {
-			async_sem_post(&msg->evt_sem);
+	if (inring == 0) {
+		IMUTEX_LOCK(&msg->lock);
+		if (size >= ASYNC_MSG_SLOT_DATA) {
+			if (IATOMIC_LOAD(&msg->overflow) == 0) {
+				inring = async_msg_ring_push(msg, mid, wparam, 
+						lparam, ptr, size);
+			}
+		}
+		if (inring == 0) {
+			iposix_msg_push(&msg->queue, mid, wparam, lparam, ptr, size);
+			IATOMIC_ADD(&msg->overflow, 1);
+			msg->num_msg_post++;
+		}
+		IMUTEX_UNLOCK(&msg->lock);
+	}
+	if (producer) {
+		producer->num_post++;
+		producer->num_bytes += size;
+		if (inring == 0) {
+			producer->num_overflow++;
+		}	else {
+			producer->num_ring++;
+			if (size >= ASYNC_MSG_SLOT_DATA) producer->num_large++;
+		}
+	}
+	if (IATOMIC_XCHG(&msg->signaled, 1) == 0) {
+		if (producer) producer->num_sem_post++;
+		IMUTEX_LOCK(&msg->lock);
+		msg->num_sem_post++;
+		IMUTEX_UNLOCK(&msg->lock);
+		async_sem_post(&msg->evt_sem);
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// hand a batch to the batch callback or one by one to callback
+//---------------------------------------------------------------------
+static void async_msg_deliver(CAsyncMessage *msg, int count)
+{
+	msg->num_msg_read += count;
+	msg->num_batches++;
+	if (msg->batch) {
+		msg->batch(msg, msg->items, count);
+	}
+	else if (msg->callback) {
+		int i;
+		for (i = 0; i < count && msg->releasing == 0; i++) {
+			const CAsyncMessageItem *item = &msg->items[i];
+			msg->callback(msg, item->mid, item->wparam, item->lparam,
+					item->ptr, item->size);
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// deliver every published ring slot, then release them
+//---------------------------------------------------------------------
+static int async_msg_ring_drain(CAsyncMessage *msg)
+{
+	char *cache = msg->loop->cache;
+	IINT32 pos = msg->head;
+	int count = 0, used = 0, i;
+	while (count < ASYNC_MSG_RING_SIZE) {
+		struct CAsyncMessageSlot *slot;
+		CAsyncMessageItem *item = &msg->items[count];
+		slot = &msg->ring[pos & ASYNC_MSG_RING_MASK];
+		if (IATOMIC_LOAD(&slot->sequence) != (IINT32)((IUINT32)pos + 1)) {
+			break;
+		}
+		item->mid = slot->mid;
+		item->wparam = slot->wparam;
+		item->lparam = slot->lparam;
+		item->size = slot->size;
+		item->ptr = slot->data;
+		if (slot->size >= ASYNC_MSG_SLOT_DATA) {
+			// body from the side stream into the loop cache
+			if (used + slot->size + 1 > ASYNC_LOOP_BUFFER_SIZE) {
+				break;
+			}
+			IMUTEX_LOCK(&msg->lock);
+			ims_read(&msg->bodies, cache + used, slot->size);
+			IMUTEX_UNLOCK(&msg->lock);
+			cache[used + slot->size] = '\0';
+			item->ptr = cache + used;
+			used += slot->size + 1;
 		}
+		pos = (IINT32)((IUINT32)pos + 1);
+		count++;
 	}
-	return active? 0 : -1;
+	if (count == 0) {
+		return 0;
+	}
+	// ring producers take no lock, their posts are counted here
+	IMUTEX_LOCK(&msg->lock);
+	msg->num_msg_post += count;
+	msg->num_ring_post += count;
+	IMUTEX_UNLOCK(&msg->lock);
+	async_msg_deliver(msg, count);
+	for (i = 0; i < count; i++) {
+		IUINT32 next = (IUINT32)msg->head + ASYNC_MSG_RING_SIZE;
+		struct CAsyncMessageSlot *slot;
+		slot = &msg->ring[msg->head & ASYNC_MSG_RING_MASK];
+		IATOMIC_STORE(&slot->sequence, (IINT32)next);
+		msg->head = (IINT32)((IUINT32)msg->head + 1);
+	}
+	return count;
+}
+
+
+//---------------------------------------------------------------------
+// take the whole overflow stream over: pages are relinked in O(1) per
+// page, and producers can use the ring again right away
+//---------------------------------------------------------------------
+static void async_msg_overflow_take(CAsyncMessage *msg)
+{
+	IMUTEX_LOCK(&msg->lock);
+	ims_splice(&msg->drain, &msg->queue, msg->queue.size);
+	IATOMIC_STORE(&msg->overflow, 0);
+	IMUTEX_UNLOCK(&msg->lock);
+}
+
+
+//---------------------------------------------------------------------
+// deliver taken overflow messages, as many as fit in the loop cache
+//---------------------------------------------------------------------
+static int async_msg_overflow_drain(CAsyncMessage *msg)
+{
+	char *cache = msg->loop->cache;
+	int count = 0, pos = 0;
+	while (count < ASYNC_MSG_RING_SIZE) {
+		CAsyncMessageItem *item = &msg->items[count];
+		IINT32 mid = 0, wparam = 0, lparam = 0, size;
+		size = iposix_msg_read(&msg->drain, &mid, &wparam, &lparam, 
+				NULL, 0);
+		if (size < 0) break;
+		if (pos + size + 1 > ASYNC_LOOP_BUFFER_SIZE) break;
+		iposix_msg_read(&msg->drain, &mid, &wparam, &lparam, 
+				cache + pos, size);
+		cache[pos + size] = '\0';
+		item->mid = (int)mid;
+		item->wparam = wparam;
+		item->lparam = lparam;
+		item->size = (int)size;
+		item->ptr = cache + pos;
+		pos += size + 1;
+		count++;
+	}
+	if (count > 0) {
+		async_msg_deliver(msg, count);
+	}
+	return count;
 }
 
 
@@ -3320,25 +4723,27 @@ int async_msg_post(CAsyncMessage *msg, int mid,
 static void async_msg_evt_sem(CAsyncLoop *loop, CAsyncSemaphore *sem)
 {
 	CAsyncMessage *msg = (CAsyncMessage*)sem->user;
-	char *data = loop->cache;
-	int size;
+	(void)loop;
 	msg->busy = 1;
-	while (1) {
-		IINT32 wparam = 0, lparam = 0, mid = 0;
-		if (msg->releasing) break;
-		IMUTEX_LOCK(&msg->lock);
-		msg->signaled = 0;
-		size = iposix_msg_read(&msg->queue, &mid, &wparam, &lparam, data, 
-				ASYNC_LOOP_BUFFER_SIZE);
-		IMUTEX_UNLOCK(&msg->lock);
-		if (size < 0) break;
-		if (size < ASYNC_LOOP_BUFFER_SIZE) {
-			data[size] = '\0';
+	while (msg->releasing == 0) {
+		int count;
+		IATOMIC_XCHG(&msg->signaled, 0);
+		// taken overflow is older than anything in the ring now
+		if (msg->drain.size > 0) {
+			async_msg_overflow_drain(msg);
+			continue;
 		}
-		msg->num_msg_read++;
-		if (msg->callback) {
-			msg->callback(msg, (int)mid, wparam, lparam, data, size);
+		count = async_msg_ring_drain(msg);
+		if (msg->releasing) break;
+		// the overflow only holds messages posted after the ring ones,
+		// and a reserved slot not yet published signals again
+		if (msg->head == IATOMIC_LOAD(&msg->tail)) {
+			if (IATOMIC_LOAD(&msg->overflow) > 0) {
+				async_msg_overflow_take(msg);
+				count++;
+			}
 		}
+		if (count == 0) break;
 	}
 	msg->busy = 0;
 	if (msg->releasing) {
@@ -3348,4 +4753,3 @@ static void async_msg_evt_sem(CAsyncLoop *loop, CAsyncSemaphore *sem)
 }
 
 
-
@@ -27,12 +27,17 @@ struct CAsyncListener;
 struct CAsyncSplit;
 struct CAsyncUdp;
 struct CAsyncMessage;
+struct CAsyncMessageItem;
+struct CAsyncMessageSlot;
+struct CAsyncMessageProducer;
 
 typedef struct CAsyncStream CAsyncStream;
 typedef struct CAsyncListener CAsyncListener;
 typedef struct CAsyncSplit CAsyncSplit;
 typedef struct CAsyncUdp CAsyncUdp;
 typedef struct CAsyncMessage CAsyncMessage;
+typedef struct CAsyncMessageItem CAsyncMessageItem;
+typedef struct CAsyncMessageProducer CAsyncMessageProducer;
 
 #define ASYNC_LOOP_LOG_STREAM      ASYNC_LOOP_LOG_CUSTOMIZE(0)
 #define ASYNC_LOOP_LOG_TCP         ASYNC_LOOP_LOG_CUSTOMIZE(1)
@@ -72,6 +77,12 @@ struct CAsyncStream {
 	long (*pending)(const CAsyncStream *self);
 	void (*watermark)(CAsyncStream *self, long hiwater, long lowater);
 	long (*option)(CAsyncStream *self, int option, long value);
+	long (*readv)(CAsyncStream *self, void * const vecptr[], 
+			const long veclen[], int count);
+	long (*writev)(CAsyncStream *self, const void * const vecptr[], 
+			const long veclen[], int count);
+	long (*borrow)(CAsyncStream *self, const void **ptr);
+	long (*consume)(CAsyncStream *self, long size);
 };
 
 
@@ -96,6 +107,10 @@ struct CAsyncStream {
 #define _async_stream_pending(s)          (s)->pending(s)
 #define _async_stream_watermark(s, h, l)  (s)->watermark(s, h, l)
 #define _async_stream_option(s, o, v)     (s)->option(s, o, v)
+#define _async_stream_readv(s, p, l, c)   (s)->readv(s, p, l, c)
+#define _async_stream_writev(s, p, l, c)  (s)->writev(s, p, l, c)
+#define _async_stream_borrow(s, p)        (s)->borrow(s, p)
+#define _async_stream_consume(s, n)       (s)->consume(s, n)
 
 #define async_stream_private(s, type) ((type*)((s)->instance))
 #define async_stream_upcast(s, type, member) IB_ENTRY(s, type, member)
@@ -141,6 +156,22 @@ long async_stream_write(CAsyncStream *stream, const void *ptr, long size);
 // peek data from input buffer without removing them
 long async_stream_peek(CAsyncStream *stream, void *ptr, long size);
 
+// scatter read into count buffers, falls back to read() per buffer
+long async_stream_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count);
+
+// gather write from count buffers, falls back to write() per buffer
+long async_stream_writev(CAsyncStream *stream, const void * const vecptr[],
+		const long veclen[], int count);
+
+// borrow the first contiguous span of the input buffer without copying,
+// returns its size (may be less than remain), -1 if not supported.
+// the pointer stays valid until the next read/consume/close.
+long async_stream_borrow(CAsyncStream *stream, const void **ptr);
+
+// drop size bytes from the input buffer after borrowing
+long async_stream_consume(CAsyncStream *stream, long size);
+
 // enable ASYNC_EVENT_READ/WRITE
 void async_stream_enable(CAsyncStream *stream, int event);
 
@@ -175,6 +206,15 @@ int async_stream_pair_new(CAsyncLoop *loop, CAsyncStream *pair[2]);
 // get partner stream
 CAsyncStream *async_stream_pair_partner(CAsyncStream *stream);
 
+#define ASYNC_STREAM_NAME_CROSS ASYNC_STREAM_NAME('X', 'P', 'A', 'R')
+
+// create a paired stream across two loops (one per thread), written 
+// pages are handed over under a lock and the reader is woken by a 
+// semaphore. call it before loop2 runs in its own thread; each side 
+// must then only be used and closed from the thread of its own loop.
+int async_stream_pair_cross(CAsyncLoop *loop1, CAsyncLoop *loop2,
+		CAsyncStream *pair[2]);
+
 
 //---------------------------------------------------------------------
 // TCP Stream
@@ -217,6 +257,12 @@ long async_stream_pass_remain(const CAsyncStream *stream);
 long async_stream_pass_pending(const CAsyncStream *stream);
 void async_stream_pass_watermark(CAsyncStream *stream, long high, long low);
 long async_stream_pass_option(CAsyncStream *stream, int option, long value);
+long async_stream_pass_readv(CAsyncStream *stream, void * const vecptr[], 
+		const long veclen[], int count);
+long async_stream_pass_writev(CAsyncStream *stream, 
+		const void * const vecptr[], const long veclen[], int count);
+long async_stream_pass_borrow(CAsyncStream *stream, const void **ptr);
+long async_stream_pass_consume(CAsyncStream *stream, long size);
 
 
 //---------------------------------------------------------------------
@@ -307,6 +353,14 @@ int async_stream_filter_flush(CAsyncStream *stream, int mode);
 // returns NULL if the stream is not a filter stream
 void *async_stream_filter_get_ctx(const CAsyncStream *stream);
 
+// create a filter stream which compresses the output and decompresses
+// the input with the built-in ilz codec (see imemdata.h), each way has
+// its own streaming dictionary. Both ends must wrap their streams,
+// which is usually agreed during the handshake. Returns NULL on error.
+CAsyncStream *async_stream_lz_new(CAsyncLoop *loop,
+	CAsyncStream *underlying, int close_on_free,
+	void (*callback)(CAsyncStream *stream, int event, int args));
+
 
 //=====================================================================
 // CAsyncListener
@@ -315,6 +369,10 @@ struct CAsyncListener {
 	int fd;
 	int error;
 	int family;
+	int budget;     // max accepts per readiness callback
+	int cpu;        // SO_INCOMING_CPU, below zero means not set
+	int busy;
+	int releasing;
 	void *user;
 	CAsyncLoop *loop;
 	CAsyncEvent evt_read;
@@ -338,11 +396,25 @@ void async_listener_delete(CAsyncListener *listener);
 
 #define ASYNC_LISTENER_REUSEPORT    0x01
 #define ASYNC_LISTENER_IPV6ONLY     0x02
+#define ASYNC_LISTENER_DEFER_ACCEPT 0x04   // TCP_DEFER_ACCEPT (linux)
+#define ASYNC_LISTENER_FASTOPEN     0x08   // TCP_FASTOPEN
+#define ASYNC_LISTENER_INCOMING_CPU 0x10   // SO_INCOMING_CPU = listener->cpu
+
+#define ASYNC_LISTENER_BUDGET       64     // default listener->budget
+#define ASYNC_LISTENER_DEFER_SECS   1
+#define ASYNC_LISTENER_FASTOPEN_QLEN 256
 
 // start listening on the socket
 int async_listener_start(CAsyncListener *listener, int backlog, 
 		int flags, const struct sockaddr *addr, int addrlen);
 
+// start a SO_REUSEPORT listener set on the same address, normally one 
+// listener per loop. with ASYNC_LISTENER_INCOMING_CPU, listener i 
+// gets cpu i unless its cpu field is already set. returns 0 or the 
+// error of the first listener failed (all listeners are stopped).
+int async_listener_shard(CAsyncListener *listeners[], int count, 
+		int backlog, int flags, const struct sockaddr *addr, int addrlen);
+
 // stop listening
 void async_listener_stop(CAsyncListener *listener);
 
@@ -370,8 +442,17 @@ struct CAsyncSplit {
 	struct IMSTREAM linecache;
 	void (*callback)(CAsyncSplit *split, int event);
 	void (*receiver)(CAsyncSplit *split, void *data, long size);
+	void (*batch)(CAsyncSplit *split, void * const vecptr[], 
+			const long veclen[], int count);
 };
 
+// when split->batch is set it replaces receiver: every complete frame 
+// found in one page of the stream buffer is handed over in one call 
+// (at most ASYNC_SPLIT_BATCH_MAX). the views point into the stream 
+// buffer and are only valid during the call, they are not '\0' 
+// terminated, and the underlying stream must not be read inside.
+#define ASYNC_SPLIT_BATCH_MAX     64
+
 
 #define ASYNC_SPLIT_WORDLSB       0   // header: 2 bytes LSB
 #define ASYNC_SPLIT_WORDMSB       1   // header: 2 bytes MSB
@@ -496,21 +577,68 @@ int async_udp_recvfrom(CAsyncUdp *udp, void *ptr, long size,
 //---------------------------------------------------------------------
 // CAsyncMessage - receive messages from another thread
 //---------------------------------------------------------------------
+#ifndef ASYNC_MSG_RING_SIZE
+#define ASYNC_MSG_RING_SIZE       1024    // ring slots, power of 2
+#endif
+
+#ifndef ASYNC_MSG_SLOT_DATA
+#define ASYNC_MSG_SLOT_DATA       112     // inline bytes of a slot
+#endif
+
+// messages go through a bounded lock-free ring of fixed slots, those
+// of ASYNC_MSG_SLOT_DATA bytes or more keep their body in a locked side
+// stream. when the ring is full, messages go to the locked overflow
+// stream until the loop takes it over. messages of one producer are 
+// delivered in posting order.
 struct CAsyncMessage {
 	CAsyncLoop *loop;
 	CAsyncSemaphore evt_sem;
 	void *user;
-	int signaled;
+	volatile int signaled;
 	int busy;
 	int releasing;
 	volatile int active;
-	IINT64 num_sem_post;
-	IINT64 num_msg_post;
+	IINT64 num_sem_post;      // wakeups issued
+	IINT64 num_msg_post;      // all posts, ring ones counted when read
+	IINT64 num_ring_post;     // posts through the ring
 	IINT64 num_msg_read;
+	IINT64 num_batches;
 	IMUTEX_TYPE lock;
 	struct IMSTREAM queue;
+	struct IMSTREAM bodies;
+	struct IMSTREAM drain;    // overflow taken by the loop
+	struct CAsyncMessageSlot *ring;
+	volatile IINT32 tail;     // next slot reserved by producers
+	IINT32 head;              // next slot read by the loop
+	volatile IINT32 overflow; // messages in the overflow stream
+	CAsyncMessageItem *items;
 	int (*callback)(CAsyncMessage *message, int mid, 
 		IINT32 wparam, IINT32 lparam, const void *ptr, int size);
+	void (*batch)(CAsyncMessage *message, 
+		const CAsyncMessageItem *items, int count);
+};
+
+// when msg->batch is set it replaces callback: every message drained
+// in one wakeup is handed over in one call (at most ASYNC_MSG_RING_SIZE
+// per call). ptr is '\0' terminated and only valid during the call.
+struct CAsyncMessageItem {
+	int mid;
+	IINT32 wparam;
+	IINT32 lparam;
+	int size;
+	const void *ptr;
+};
+
+// statistics of one producer, owned and updated by the producer 
+// thread only, so they are never contended
+struct CAsyncMessageProducer {
+	IINT64 num_post;          // accepted messages
+	IINT64 num_ring;          // posted through the ring
+	IINT64 num_large;         // ring messages with body in side stream
+	IINT64 num_overflow;      // posted through the overflow stream
+	IINT64 num_sem_post;      // wakeups issued
+	IINT64 num_failed;        // rejected: inactive or too large
+	IINT64 num_bytes;         // accepted payload bytes
 };
 
 
@@ -536,6 +664,10 @@ int async_msg_stop(CAsyncMessage *msg);
 int async_msg_post(CAsyncMessage *msg, int mid, 
 	IINT32 wparam, IINT32 lparam, const void *ptr, int size);
 
+// post message and account it to the producer stats (can be NULL)
+int async_msg_post_from(CAsyncMessage *msg, CAsyncMessageProducer *producer,
+	int mid, IINT32 wparam, IINT32 lparam, const void *ptr, int size);
+
 
 
 #ifdef __cplusplus
@@ -8,9 +8,11 @@
 //=====================================================================
 #include "inetcode.h"
 #include "inetnot.h"
+#include "iposix.h"
 
 #include <time.h>
 #include <stdarg.h>
+#include <limits.h>
 
 
 //=====================================================================
@@ -46,10 +48,35 @@ struct CAsyncNode
 	int state;		// 0: unlogin 1: logined
 	int sid;		// server id
 	int rtt;
+	int srtt;		// smoothed rtt (EWMA 1/8), -1 for unknown
 	int ipv6;
 	int afunix;
+	int slot;		// pool slot, 0 for the primary link
+	long pair;		// AF_UNIX listener paired with a tcp listener
+	int batch_count;	// number of sub-messages in batch
 	IINT64 ts_ping;
 	IINT64 ts_idle;
+	struct ILISTHEAD node_batch;	// linked in notify->batch when pending
+	struct IVECTOR batch;	// pending batch frame
+};
+
+
+//---------------------------------------------------------------------
+// CAsyncGroup: service group
+//---------------------------------------------------------------------
+struct CAsyncPoint
+{
+	IUINT32 point;		// position on the hash ring
+	int sid;
+};
+
+struct CAsyncGroup
+{
+	int policy;			// ASYNC_NOTIFY_GROUP_*
+	int count;
+	int *sids;
+	struct CAsyncPoint *ring;	// consistent hash ring
+	int ring_size;
 };
 
 
@@ -61,19 +88,31 @@ struct CAsyncNotify
 	struct IMEMNODE *cache;		// cache for msg stream buffer
 	struct ILISTHEAD ping;		// ping queue
 	struct ILISTHEAD idle;		// idle queue
+	struct ILISTHEAD batch;		// nodes with pending batch
 	struct IVECTOR *vector;		// buffer for data
+	struct IVECTOR mcast;		// hids collected by multicast
 	struct CAsyncNode *nodes;	// hid -> nodes look-up table
 	struct ib_hash_map sid2hid_in;	// sid -> hid look-up table
 	struct ib_hash_map sid2hid_out;	// out sid -> hid
+	struct ib_hash_map sid2pool_in;	// (sid, slot) -> hid for slot > 0
+	struct ib_hash_map sid2pool_out;	// (sid, slot) -> hid for slot > 0
 	struct ib_hash_map sid2addr;	// sid -> addr (value: isockaddr_union*)
 	struct ib_hash_map allowip;		// ip white list (key: ib_string*)
 	struct ib_hash_map sidblack;	// black list 
+	struct ib_hash_map sidlocal;	// sids whose AF_UNIX path failed
+	struct ib_hash_map groups;		// group id -> CAsyncGroup*
 	IUINT32 current;			// current millisec
 	ib_string *token;			// authentication token
+	ib_string *local;			// AF_UNIX path prefix for same-host peers
 	IINT64 seconds;				// seconds since UTC 1970.1.1 00:00:00
 	IINT64 lastsec;				// variable to trigger timer
 	long msgcnt;				// message count
 	long maxsize;				// max data buffer size
+	long batch_limit;			// max batch frame size, 0 to disable
+	int pool_size;				// links per remote sid
+	IUINT32 seed;				// random seed for group picking
+	int prewarm;				// max connecting links, 0 for lazy mode
+	int prewarm_dirty;			// need to check missing links
 	int use_allow_table;		// whether enable 
 	int count_node;				// node count
 	int count_in;				// incoming node count
@@ -86,6 +125,9 @@ struct CAsyncNotify
 	void *user;					// log user data
 	long *sid2hid;				// fast look-up table for sids below 0x8000
 	void (*writelog)(const char *text, void *user);
+	CAsyncNotify_Receiver receiver;	// direct event delivery
+	void *receiver_user;		// user data for receiver
+	int dispatching;			// inside async_notify_wait on loop thread
 	IMUTEX_TYPE lock;			// internal lock
 	CAsyncCore *core;			// AsyncCore object
 	struct CAsyncConfig cfg;	// configuration
@@ -99,13 +141,20 @@ struct CAsyncNotify
 #define ASYNC_NOTIFY_MSG_PING		0x6804	// (millisec)
 #define ASYNC_NOTIFY_MSG_PACK		0x6805	// (millisec)
 #define ASYNC_NOTIFY_MSG_ERROR		0x6806
+#define ASYNC_NOTIFY_MSG_BATCH		0x6807	// (cmd, size, data) * n
+
+#define ASYNC_NOTIFY_POOL_MAX		16
 
 #define ASYNC_NOTIFY_STATE_CONNECTING	0
 #define ASYNC_NOTIFY_STATE_ESTAB		1
 #define ASYNC_NOTIFY_STATE_LOGINED		2
 #define ASYNC_NOTIFY_STATE_ERROR		3
 
+#define ASYNC_NOTIFY_GROUP_VNODES	64	// ring points per sid
+#define ASYNC_NOTIFY_GROUP_RETRY	8	// failover attempts
+
 typedef struct CAsyncNode CAsyncNode;
+typedef struct CAsyncGroup CAsyncGroup;
 typedef struct CAsyncConfig CAsyncConfig;
 
 //---------------------------------------------------------------------
@@ -126,6 +175,8 @@ static void async_notify_on_data(CAsyncNotify *notify, long hid, long tag,
 
 static void async_notify_on_timer(CAsyncNotify *notify);
 
+static void async_notify_local_fail(CAsyncNotify *notify, int sid);
+
 static int async_notify_firewall(const struct sockaddr *remote, int len,
 	CAsyncCore *core, long listenhid, void *user);
 
@@ -133,11 +184,21 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node);
 static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node);
 static void async_notify_cmd_data(CAsyncNotify *notify, CAsyncNode *node,
 	char *data, long length);
+static void async_notify_cmd_batch(CAsyncNotify *notify, CAsyncNode *node,
+	char *data, long length);
+
+static void async_notify_batch_flush_all(CAsyncNotify *notify);
 
 void async_notify_hash(const void *in, size_t len, char *out);
 
 static const char *async_notify_epname(char *p, const void *ep, int len);
 
+static void async_notify_local_remove(CAsyncNotify *notify, CAsyncNode *node);
+
+static void async_notify_group_delete(void *group);
+
+static void async_notify_prewarm(CAsyncNotify *notify);
+
 static void async_notify_config_load(CAsyncNotify *notify, int profile);
 
 static void async_notify_log(CAsyncNotify *notify, int, const char *, ...);
@@ -162,10 +223,16 @@ static CAsyncNode *async_notify_node_new(CAsyncNotify *notify, long hid)
 	node->state = 0;
 	node->sid = -1;
 	node->rtt = -1;
+	node->srtt = -1;
 	node->ipv6 = 0;
 	node->afunix = 0;
+	node->slot = 0;
+	node->pair = -1;
+	node->batch_count = 0;
 	ilist_init(&node->node_ping);
 	ilist_init(&node->node_idle);
+	ilist_init(&node->node_batch);
+	iv_init(&node->batch, NULL);
 	node->ts_ping = notify->seconds;
 	node->ts_idle = notify->seconds;
 	notify->count_node++;
@@ -186,6 +253,11 @@ static int async_notify_node_del(CAsyncNotify *notify, long hid)
 	if (!ilist_is_empty(&node->node_idle)) {
 		ilist_del_init(&node->node_idle);
 	}
+	if (!ilist_is_empty(&node->node_batch)) {
+		ilist_del_init(&node->node_batch);
+	}
+	iv_destroy(&node->batch);
+	node->batch_count = 0;
 	notify->count_node--;
 	return 0;
 }
@@ -291,6 +363,43 @@ static void async_notify_set(CAsyncNotify *self, int mode, int sid, long hid)
 	}
 }
 
+// get hid of a pooled link: slot 0 is the primary link
+static long async_notify_pool_get(CAsyncNotify *self, int mode, int sid,
+	int slot)
+{
+	struct ib_hash_map *map;
+	struct ib_hash_entry *e;
+	ilong key;
+	if (slot <= 0) return async_notify_get(self, mode, sid);
+	if (sid < 0) return -1;
+	map = (mode == ASYNC_CORE_NODE_IN)? 
+		&self->sid2pool_in : &self->sid2pool_out;
+	key = (ilong)sid * ASYNC_NOTIFY_POOL_MAX + slot;
+	e = ib_map_find_int(map, key);
+	if (e) return (long)(ilong)e->value;
+	return -1;
+}
+
+// set hid of a pooled link: -1 to delete
+static void async_notify_pool_set(CAsyncNotify *self, int mode, int sid,
+	int slot, long hid)
+{
+	struct ib_hash_map *map;
+	ilong key;
+	if (slot <= 0) {
+		async_notify_set(self, mode, sid, hid);
+		return;
+	}
+	map = (mode == ASYNC_CORE_NODE_IN)? 
+		&self->sid2pool_in : &self->sid2pool_out;
+	key = (ilong)sid * ASYNC_NOTIFY_POOL_MAX + slot;
+	if (hid < 0) {
+		ib_map_remove(map, (void*)key);
+	}	else {
+		ib_map_set(map, (void*)key, (void*)(ilong)hid);
+	}
+}
+
 // set into sid blacklist
 static void async_notify_black_set(CAsyncNotify *notify, int sid, int mode)
 {
@@ -380,6 +489,11 @@ CAsyncNotify* async_notify_new(CAsyncLoop *loop, int serverid)
 	}
 
 	notify->maxsize = 0;
+	notify->batch_limit = 0;
+	notify->pool_size = 1;
+	notify->seed = (IUINT32)iclock();
+	notify->prewarm = 0;
+	notify->prewarm_dirty = 0;
 	ims_init(&notify->msgs, notify->cache, 0, 0);
 
 	if (async_notify_data_resize(notify, 0x200000) != 0) {
@@ -405,18 +519,26 @@ CAsyncNotify* async_notify_new(CAsyncLoop *loop, int serverid)
 	
 	ilist_init(&notify->ping);
 	ilist_init(&notify->idle);
+	ilist_init(&notify->batch);
+	iv_init(&notify->mcast, NULL);
 	notify->token = ib_string_new();
+	notify->local = ib_string_new();
 
 	IMUTEX_INIT(&notify->lock);
 
 	ib_map_init(&notify->sid2hid_in, ib_hash_func_int, ib_hash_compare_int);
 	ib_map_init(&notify->sid2hid_out, ib_hash_func_int, ib_hash_compare_int);
+	ib_map_init(&notify->sid2pool_in, ib_hash_func_int, ib_hash_compare_int);
+	ib_map_init(&notify->sid2pool_out, ib_hash_func_int, ib_hash_compare_int);
 	ib_map_init(&notify->sid2addr, ib_hash_func_int, ib_hash_compare_int);
 	notify->sid2addr.value_destroy = (void (*)(void*))ikmem_free;
 	ib_map_init(&notify->allowip, ib_hash_func_str, ib_hash_compare_str);
 	notify->allowip.key_copy = ib_hash_str_copy;
 	notify->allowip.key_destroy = ib_hash_str_destroy;
 	ib_map_init(&notify->sidblack, ib_hash_func_int, ib_hash_compare_int);
+	ib_map_init(&notify->sidlocal, ib_hash_func_int, ib_hash_compare_int);
+	ib_map_init(&notify->groups, ib_hash_func_int, ib_hash_compare_int);
+	notify->groups.value_destroy = async_notify_group_delete;
 	notify->sid2hid = (long*)ikmem_malloc(sizeof(long) * 0x10000);
 
 	if (notify->nodes == NULL ||
@@ -434,6 +556,9 @@ CAsyncNotify* async_notify_new(CAsyncLoop *loop, int serverid)
 
 	notify->user = NULL;
 	notify->writelog = NULL;
+	notify->receiver = NULL;
+	notify->receiver_user = NULL;
+	notify->dispatching = 0;
 	notify->logmask = 0;
 
 	notify->cfg.timeout_idle_kill = -1;
@@ -468,21 +593,46 @@ void async_notify_delete(CAsyncNotify *notify)
 		notify->token = NULL;
 	}
 
+	if (notify->nodes) {
+		int i;
+		for (i = 0; i < 0x10000; i++) {
+			CAsyncNode *node = &notify->nodes[i];
+			if (node->hid >= 0 && node->mode == ASYNC_CORE_NODE_LISTEN) {
+				async_notify_local_remove(notify, node);
+			}
+		}
+	}
+
+	if (notify->local) {
+		ib_string_delete(notify->local);
+		notify->local = NULL;
+	}
+
 	if (notify->core) {
 		async_core_delete(notify->core);
 		notify->core = NULL;
 	}
 	
 	if (notify->nodes) {
+		int i;
+		for (i = 0; i < 0x10000; i++) {
+			if (notify->nodes[i].hid >= 0) {
+				iv_destroy(&notify->nodes[i].batch);
+			}
+		}
 		ikmem_free(notify->nodes);
 		notify->nodes = NULL;
 	}
 
 	ib_map_destroy(&notify->allowip);
 	ib_map_destroy(&notify->sidblack);
+	ib_map_destroy(&notify->sidlocal);
+	ib_map_destroy(&notify->groups);
 	ib_map_destroy(&notify->sid2addr);
 	ib_map_destroy(&notify->sid2hid_in);
 	ib_map_destroy(&notify->sid2hid_out);
+	ib_map_destroy(&notify->sid2pool_in);
+	ib_map_destroy(&notify->sid2pool_out);
 
 	if (notify->sid2hid) {
 		ikmem_free(notify->sid2hid);
@@ -499,6 +649,8 @@ void async_notify_delete(CAsyncNotify *notify)
 		notify->vector = NULL;
 	}
 
+	iv_destroy(&notify->mcast);
+
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 	IMUTEX_DESTROY(&notify->lock);
 
@@ -637,11 +789,13 @@ void async_notify_sid_add(CAsyncNotify *notify, int sid,
 	char epname[128];
 	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
 	if (size <= 0) size = sizeof(struct sockaddr_in);
+	if (size > (int)sizeof(isockaddr_union)) size = sizeof(isockaddr_union);
 	addr = (isockaddr_union*)ikmem_malloc(sizeof(isockaddr_union));
 	memset(addr, 0, sizeof(isockaddr_union));
 	memcpy(addr, remote, size);
 	ib_map_set(&notify->sid2addr, (void*)(ilong)sid, addr);
 	async_notify_black_set(notify, sid, 0);
+	notify->prewarm_dirty = 1;
 	async_notify_epname(epname, remote, size);
 	async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
 		"server add: sid=%d address=%s", sid, epname);
@@ -670,7 +824,13 @@ static int async_notify_sid_get(CAsyncNotify *notify, int sid,
 	addr = (isockaddr_union*)e->value;
 	if (addr->address.sa_family == AF_INET6) {
 		addrlen = sizeof(struct sockaddr_in6);
-	}	else {
+	}
+#ifdef AF_UNIX
+	else if (addr->address.sa_family == AF_UNIX) {
+		addrlen = ISOCKADDR_UN_SIZE;
+	}
+#endif
+	else {
 		addrlen = sizeof(struct sockaddr_in);
 	}
 	if (size <= 0) size = sizeof(struct sockaddr_in);
@@ -726,6 +886,18 @@ static int async_notify_msg_push(CAsyncNotify *notify, int event,
 	iencode16u_lsb(head + 4, (unsigned short)event);
 	iencode32i_lsb(head + 6, wparam);
 	iencode32i_lsb(head + 10, lparam);
+	if (notify->receiver && notify->dispatching) {
+		CAsyncNotify_Receiver receiver = notify->receiver;
+		// deliver directly, data is only valid during the callback.
+		// events raised by other threads while the lock is released
+		// are queued and delivered by async_notify_msg_drain.
+		notify->dispatching = 0;
+		ASYNC_NOTIFY_CRITICAL_END(notify);
+		receiver(notify->receiver_user, event, wparam, lparam, data, size);
+		ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+		notify->dispatching = 1;
+		return 0;
+	}
 	ims_write(&notify->msgs, head, 14);
 	ims_write(&notify->msgs, data, size);
 	notify->msgcnt++;
@@ -763,6 +935,26 @@ static long async_notify_msg_read(CAsyncNotify *notify, int *event,
 	return length;
 }
 
+// deliver queued events to the receiver, called on the loop thread
+static void async_notify_msg_drain(CAsyncNotify *notify)
+{
+	while (notify->receiver && ims_dsize(&notify->msgs) > 0) {
+		CAsyncNotify_Receiver receiver = notify->receiver;
+		int event;
+		long wparam, lparam, hr;
+		hr = async_notify_msg_read(notify, NULL, NULL, NULL, NULL, 0);
+		if (hr < 0) break;
+		if (async_notify_data_resize(notify, hr + 1) != 0) break;
+		hr = async_notify_msg_read(notify, &event, &wparam, &lparam,
+			notify->data, notify->maxsize);
+		if (hr < 0) break;
+		ASYNC_NOTIFY_CRITICAL_END(notify);
+		receiver(notify->receiver_user, event, wparam, lparam, 
+			notify->data, hr);
+		ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+	}
+}
+
 
 //---------------------------------------------------------------------
 // wait events
@@ -773,6 +965,14 @@ void async_notify_wait(CAsyncNotify *notify, IUINT32 millisec)
 
 	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
 
+	// dial missing links in eager mode
+	if (notify->prewarm > 0 && notify->prewarm_dirty) {
+		async_notify_prewarm(notify);
+	}
+
+	// messages batched since last iteration go out before blocking
+	async_notify_batch_flush_all(notify);
+
 	async_core_wait(notify->core, millisec);
 
 	itimeofday(&seconds, NULL);
@@ -780,6 +980,11 @@ void async_notify_wait(CAsyncNotify *notify, IUINT32 millisec)
 	notify->current = iclock();
 	notify->seconds = seconds;
 
+	// events queued by other threads since the last iteration
+	async_notify_msg_drain(notify);
+
+	notify->dispatching = 1;
+
 	while (1) {
 		int event;
 		long wparam, lparam, hr;
@@ -823,6 +1028,11 @@ void async_notify_wait(CAsyncNotify *notify, IUINT32 millisec)
 		async_notify_on_timer(notify);
 	}
 
+	notify->dispatching = 0;
+
+	// events raised by async_notify_send inside the callbacks
+	async_notify_msg_drain(notify);
+
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 }
 
@@ -886,6 +1096,13 @@ static void async_notify_hid_init(CAsyncNotify *notify, long hid)
 //---------------------------------------------------------------------
 static const char *async_notify_epname(char *p, const void *ep, int len)
 {
+#ifdef AF_UNIX
+	if (len > 0 && ((const struct sockaddr*)ep)->sa_family == AF_UNIX) {
+		const char *path = isockaddr_afunix_get((const isockaddr_union*)ep);
+		sprintf(p, "unix:%.100s", (len > 2)? path : "");
+		return p;
+	}
+#endif
 	if (len <= 0 || len == sizeof(struct sockaddr_in)) {
 		struct sockaddr_in *addr = NULL;
 		unsigned char *bytes;
@@ -1003,9 +1220,14 @@ static void async_notify_on_leave(CAsyncNotify *notify, long hid, long tag,
 
 	if (node->mode == ASYNC_CORE_NODE_OUT) {
 		if (node->sid >= 0) {
-			async_notify_set(notify, ASYNC_CORE_NODE_OUT, node->sid, -1);
+			async_notify_pool_set(notify, ASYNC_CORE_NODE_OUT, node->sid,
+					node->slot, -1);
 		}
-		if (node->state != ASYNC_NOTIFY_STATE_LOGINED) {
+		if (node->state != ASYNC_NOTIFY_STATE_LOGINED && node->afunix) {
+			// AF_UNIX path failed, next connect goes through tcp
+			async_notify_local_fail(notify, node->sid);
+		}
+		else if (node->state != ASYNC_NOTIFY_STATE_LOGINED) {
 			async_notify_black_set(notify, node->sid, 1);
 			if (notify->logmask & ASYNC_NOTIFY_LOG_WARNING) {
 				async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
@@ -1015,8 +1237,10 @@ static void async_notify_on_leave(CAsyncNotify *notify, long hid, long tag,
 		}
 		name = "connection-out";
 		notify->count_out--;
+		notify->prewarm_dirty = 1;
 		if (notify->evtmask & ASYNC_NOTIFY_EVT_CLOSED_OUT) {
-			if (node->state == ASYNC_NOTIFY_STATE_LOGINED) {
+			if (node->state == ASYNC_NOTIFY_STATE_LOGINED && 
+				node->slot == 0) {
 				async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_CLOSED_OUT,
 					node->sid, node->hid, cc, sizeof(IUINT32) * 2);
 			}
@@ -1024,12 +1248,14 @@ static void async_notify_on_leave(CAsyncNotify *notify, long hid, long tag,
 	}
 	else if (node->mode == ASYNC_CORE_NODE_IN) {
 		if (node->sid >= 0) {
-			async_notify_set(notify, ASYNC_CORE_NODE_IN, node->sid, -1);
+			async_notify_pool_set(notify, ASYNC_CORE_NODE_IN, node->sid,
+					node->slot, -1);
 		}
 		name = "connection-in";
 		notify->count_in--;
 		if (notify->evtmask & ASYNC_NOTIFY_EVT_CLOSED_IN) {
-			if (node->state == ASYNC_NOTIFY_STATE_LOGINED) {
+			if (node->state == ASYNC_NOTIFY_STATE_LOGINED &&
+				node->slot == 0) {
 				async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_CLOSED_IN,
 					node->sid, node->hid, cc, sizeof(IUINT32) * 2);
 			}
@@ -1104,6 +1330,10 @@ static void async_notify_on_data(CAsyncNotify *notify, long hid, long tag,
 		async_notify_cmd_data(notify, node, data, length);
 		break;
 
+	case ASYNC_NOTIFY_MSG_BATCH:
+		async_notify_cmd_batch(notify, node, data, length);
+		break;
+
 	case ASYNC_NOTIFY_MSG_PING:
 		async_notify_header_write(data, ASYNC_NOTIFY_MSG_PACK, 0);
 		async_core_send(notify->core, hid, data, 8);
@@ -1112,6 +1342,9 @@ static void async_notify_on_data(CAsyncNotify *notify, long hid, long tag,
 	case ASYNC_NOTIFY_MSG_PACK: 
 		idecode32u_lsb(data + 4, &ts);
 		node->rtt = (int)itimediff(notify->current, ts);
+		if (node->rtt < 0) node->rtt = 0;
+		if (node->srtt < 0) node->srtt = node->rtt;
+		else node->srtt = (node->srtt * 7 + node->rtt) / 8;
 		break;
 
 	case ASYNC_NOTIFY_MSG_ERROR: 
@@ -1137,8 +1370,9 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 	IINT64 seconds;
 	long hid = node->hid;
 	long hid2 = -1;
-	int size;
+	int size, slot;
 
+	async_notify_header_read(data, NULL, &slot);
 	idecode32u_lsb(data + 4, &sid1);
 	idecode32u_lsb(data + 8, &sid2);
 	async_notify_decode_64(data + 12, &ts);
@@ -1169,6 +1403,14 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 			"[WARNING] error login for hid=%lx: state error", hid);
 		return;
 	}
+	if (slot >= ASYNC_NOTIFY_POOL_MAX) {
+		async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGINACK, 6);
+		async_core_send(notify->core, hid, data, 4);
+		async_core_close(notify->core, hid, 8006);
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
+			"[WARNING] error login for hid=%lx: bad slot %d", hid, slot);
+		return;
+	}
 	if ((int)sid2 != notify->sid) {
 		async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGINACK, 3);
 		async_core_send(notify->core, hid, data, 4);
@@ -1205,7 +1447,7 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 		}
 	}
 
-	hid2 = async_notify_get(notify, ASYNC_CORE_NODE_IN, sid1);
+	hid2 = async_notify_pool_get(notify, ASYNC_CORE_NODE_IN, sid1, slot);
 
 	// already an existent connection for remote server
 	if (hid2 >= 0) {
@@ -1216,27 +1458,29 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 		async_core_close(notify->core, hid2, 8010);
 		node2->sid = -1;
 		node2->state = ASYNC_NOTIFY_STATE_ERROR;
-		async_notify_set(notify, ASYNC_CORE_NODE_IN, sid1, -1);
+		async_notify_pool_set(notify, ASYNC_CORE_NODE_IN, sid1, slot, -1);
 		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
-			"[WARNING] login conflict: hid=%lx to hid=%lx sid=%d", 
-			hid, hid2, sid1);
+			"[WARNING] login conflict: hid=%lx to hid=%lx sid=%d slot=%d", 
+			hid, hid2, sid1, slot);
 	}
 
 	node->sid = sid1;
+	node->slot = slot;
 	node->state = ASYNC_NOTIFY_STATE_LOGINED;
-	async_notify_set(notify, ASYNC_CORE_NODE_IN, sid1, hid);
+	async_notify_pool_set(notify, ASYNC_CORE_NODE_IN, sid1, slot, hid);
 
 	// send back login ack
 	async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGINACK, 0);
 	async_core_send(notify->core, hid, data, 4);
 
-	if (notify->evtmask & ASYNC_NOTIFY_EVT_NEW_IN) {
+	if ((notify->evtmask & ASYNC_NOTIFY_EVT_NEW_IN) && slot == 0) {
 		async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_NEW_IN,
 			sid1, hid, "", 0);
 	}
 
 	async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
-		"login from remote successful: hid=%lx sid=%d", hid, sid1);
+		"login from remote successful: hid=%lx sid=%d slot=%d", 
+		hid, sid1, slot);
 }
 
 static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node)
@@ -1258,8 +1502,9 @@ static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node)
 	}
 	node->state = ASYNC_NOTIFY_STATE_LOGINED;
 	async_notify_black_set(notify, node->sid, 0);
+	notify->prewarm_dirty = 1;
 
-	if (notify->evtmask & ASYNC_NOTIFY_EVT_NEW_OUT) {
+	if ((notify->evtmask & ASYNC_NOTIFY_EVT_NEW_OUT) && node->slot == 0) {
 		async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_NEW_OUT,
 			node->sid, node->hid, "", 0);
 	}
@@ -1289,6 +1534,201 @@ static void async_notify_cmd_data(CAsyncNotify *notify, CAsyncNode *node,
 		cmd, data + 4, length - 4);
 }
 
+// invoked when received a batch frame: split it into data events
+static void async_notify_cmd_batch(CAsyncNotify *notify, CAsyncNode *node,
+	char *data, long length)
+{
+	long pos = 4;
+
+	if (node->state != ASYNC_NOTIFY_STATE_LOGINED) {
+		async_core_close(notify->core, node->hid, 8200);
+		if (notify->logmask & ASYNC_NOTIFY_LOG_WARNING) {
+			async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING, 
+			"[WARNING] can not receive batch for hid=%lx sid=%d",
+			node->hid, node->sid);
+		}
+		return;
+	}
+
+	while (pos < length) {
+		unsigned short cmd;
+		IUINT32 size;
+		if (length - pos < 6) break;
+		idecode16u_lsb(data + pos, &cmd);
+		idecode32u_lsb(data + pos + 2, &size);
+		pos += 6;
+		if ((IUINT32)(length - pos) < size) break;
+		async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_DATA, node->sid,
+			cmd, data + pos, (long)size);
+		pos += (long)size;
+	}
+
+	if (pos != length) {
+		async_core_close(notify->core, node->hid, 8201);
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING, 
+			"[WARNING] corrupted batch for hid=%lx sid=%d",
+			node->hid, node->sid);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// same-host peers: a tcp listener on port N is paired with an AF_UNIX
+// listener on "<prefix>N", connecting to a loopback sid uses the path
+//---------------------------------------------------------------------
+
+// make AF_UNIX address for a local port, returns -1 if disabled
+static int async_notify_local_addr(CAsyncNotify *notify, int port,
+	isockaddr_union *addr)
+{
+	char path[128];
+	int size = ib_string_size(notify->local);
+	if (size <= 0 || size + 12 > (int)sizeof(path)) return -1;
+	if (port <= 0) return -2;
+#ifdef AF_UNIX
+	memcpy(path, ib_string_ptr(notify->local), size);
+	sprintf(path + size, "%d", port);
+	isockaddr_afunix_set(addr, path);
+	return 0;
+#else
+	return -3;
+#endif
+}
+
+// returns tcp port if remote is loopback, otherwise returns zero
+static int async_notify_local_port(const struct sockaddr *remote)
+{
+	if (remote->sa_family == AF_INET) {
+		const struct sockaddr_in *in4 = (const struct sockaddr_in*)remote;
+		const unsigned char *ip = (const unsigned char*)&in4->sin_addr.s_addr;
+		if (ip[0] == 127) return ntohs(in4->sin_port);
+	}
+#ifdef AF_INET6
+	else if (remote->sa_family == AF_INET6) {
+		static const unsigned char lo[16] = {
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+		const struct sockaddr_in6 *in6 = (const struct sockaddr_in6*)remote;
+		if (memcmp(&in6->sin6_addr, lo, 16) == 0) {
+			return ntohs(in6->sin6_port);
+		}
+	}
+#endif
+	return 0;
+}
+
+// probe an AF_UNIX path: returns 1 if something is listening on it
+static int async_notify_local_live(const isockaddr_union *local)
+{
+	int fd, hr, code;
+#ifdef AF_UNIX
+	fd = isocket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return 0;
+	isocket_enable(fd, ISOCK_NOBLOCK);
+	hr = iconnect(fd, &local->address, ISOCKADDR_UN_SIZE);
+	code = (hr == 0)? 0 : ierrno();
+	iclose(fd);
+	if (hr == 0 || code == IEAGAIN || code == IEINPROGRESS) return 1;
+#else
+	(void)local; (void)fd; (void)hr; (void)code;
+#endif
+	return 0;
+}
+
+// AF_UNIX path of the sid failed, use tcp for retry_seconds
+static void async_notify_local_fail(CAsyncNotify *notify, int sid)
+{
+	ib_map_set(&notify->sidlocal, (void*)(ilong)sid,
+			(void*)(ilong)notify->seconds);
+	if (notify->logmask & ASYNC_NOTIFY_LOG_WARNING) {
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
+			"[WARNING] local path failed sid=%d, fall back to tcp", sid);
+	}
+}
+
+// whether AF_UNIX path of the sid failed recently
+static int async_notify_local_check(CAsyncNotify *notify, int sid)
+{
+	struct ib_hash_entry *e;
+	long seconds;
+	e = ib_map_find_int(&notify->sidlocal, (ilong)sid);
+	if (e == NULL) return 0;
+	seconds = (long)(ilong)e->value;
+	if (notify->seconds - seconds <= notify->cfg.retry_seconds) {
+		return 1;
+	}
+	ib_map_remove(&notify->sidlocal, (void*)(ilong)sid);
+	return 0;
+}
+
+// create AF_UNIX listener paired with the tcp listener
+static void async_notify_listen_local(CAsyncNotify *notify, CAsyncNode *node)
+{
+	isockaddr_union local;
+	CAsyncNode *pair;
+	const char *path;
+	long hid;
+	if (async_notify_local_addr(notify, node->state, &local) != 0) return;
+	path = isockaddr_afunix_get(&local);
+	// only unlink a stale file, never steal a live listener's path
+	if (iposix_path_exists(path)) {
+		if (async_notify_local_live(&local)) {
+			async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
+				"[WARNING] local path %s is in use, skip it", path);
+			return;
+		}
+		remove(path);
+	}
+	hid = async_core_new_listen(notify->core, &local.address,
+			ISOCKADDR_UN_SIZE, 2);
+	if (hid < 0) {
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
+			"[WARNING] failed to create local listener on %s", path);
+		return;
+	}
+	pair = async_notify_node_new(notify, hid);
+	if (pair == NULL) {
+		async_core_close(notify->core, hid, 0);
+		return;
+	}
+	pair->mode = ASYNC_CORE_NODE_LISTEN;
+	pair->sid = -1;
+	pair->state = node->state;
+	pair->afunix = 1;
+	node->pair = hid;
+	async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
+		"create local listener hid=%lx on %s", hid, path);
+}
+
+// close the paired AF_UNIX listener and remove its file
+static void async_notify_local_remove(CAsyncNotify *notify, CAsyncNode *node)
+{
+	isockaddr_union local;
+	CAsyncNode *pair;
+	if (node->pair < 0) return;
+	pair = async_notify_node_get(notify, node->pair);
+	if (pair != NULL) {
+		async_core_close(notify->core, pair->hid, 0);
+	}
+	node->pair = -1;
+	if (async_notify_local_addr(notify, node->state, &local) == 0) {
+		remove(isockaddr_afunix_get(&local));
+	}
+}
+
+//---------------------------------------------------------------------
+// set AF_UNIX path prefix for same-host peers, NULL to disable
+//---------------------------------------------------------------------
+void async_notify_local(CAsyncNotify *notify, const char *prefix)
+{
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+	if (prefix == NULL) {
+		ib_string_clear(notify->local);
+	}	else {
+		ib_string_assign(notify->local, prefix);
+	}
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+}
+
 
 //---------------------------------------------------------------------
 // new listen: return id(-1 error, -2 port conflict), flags&1(reuse)
@@ -1347,6 +1787,9 @@ long async_notify_listen(CAsyncNotify *notify, const struct sockaddr *addr,
 				async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
 				"create new listener hid=%lx on port=%d", hid, port);
 			}
+			if (node->afunix == 0 && ib_string_size(notify->local) > 0) {
+				async_notify_listen_local(notify, node);
+			}
 		}
 	}	else {
 		hr = hid;	// error
@@ -1386,6 +1829,7 @@ int async_notify_remove(CAsyncNotify *notify, long listenid, int code)
 		if (node->mode != ASYNC_CORE_NODE_LISTEN) {
 			hr = -2;
 		}	else {
+			async_notify_local_remove(notify, node);
 			async_core_close(notify->core, listenid, code);
 			hr = 0;
 		}
@@ -1423,21 +1867,25 @@ int async_notify_get_port(CAsyncNotify *notify, long listenid)
 
 
 //---------------------------------------------------------------------
-// send message to server
+// get or create the link of given pool slot to server
 //---------------------------------------------------------------------
-static long async_notify_get_connection(CAsyncNotify *notify, int sid)
+static long async_notify_get_connection(CAsyncNotify *notify, int sid,
+	int slot)
 {
 	CAsyncNode *node;
 	char *data;
 	char remote[128];
 	char signature[64];
+	char login[256];
 	struct sockaddr *rmt = (struct sockaddr*)remote;
 	long hid, hr;
 	IINT64 seconds;
 	int keysize;
+	int afunix = 0;
+	isockaddr_union local;
 
 	// get connection
-	hid = async_notify_get(notify, ASYNC_CORE_NODE_OUT, sid);
+	hid = async_notify_pool_get(notify, ASYNC_CORE_NODE_OUT, sid, slot);
 	// check if there is an existent connection
 	if (hid >= 0) return hid;
 
@@ -1451,6 +1899,18 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 		return -1;
 	}
 
+	// same-host peer: use its AF_UNIX listener when exists, unless
+	// the path failed recently, then retry through tcp instead
+	if (ib_string_size(notify->local) > 0) {
+		int port = async_notify_local_port(rmt);
+		if (port > 0 && async_notify_local_addr(notify, port, &local) == 0) {
+			if (iposix_path_exists(isockaddr_afunix_get(&local)) &&
+				async_notify_local_check(notify, sid) == 0) {
+				afunix = 1;
+			}
+		}
+	}
+
 	// check if in the black list
 	if (async_notify_black_check(notify, sid) != 0) {
 		if (notify->logmask & ASYNC_NOTIFY_LOG_WARNING) {
@@ -1461,7 +1921,17 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	}
 
 	// create connection
-	hid = async_core_new_connect(notify->core, rmt, hr, 2);
+	if (afunix) {
+		hid = async_core_new_connect(notify->core, &local.address,
+				ISOCKADDR_UN_SIZE, 2);
+		if (hid < 0) {
+			async_notify_local_fail(notify, sid);
+			afunix = 0;
+		}
+	}
+	if (afunix == 0) {
+		hid = async_core_new_connect(notify->core, rmt, hr, 2);
+	}
 	if (hid < 0) {
 		if (notify->logmask & ASYNC_NOTIFY_LOG_ERROR) {
 			async_notify_log(notify, ASYNC_NOTIFY_LOG_ERROR,
@@ -1484,8 +1954,10 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	async_notify_hid_init(notify, hid);
 
 	node->sid = sid;
+	node->slot = slot;
 	node->mode = ASYNC_CORE_NODE_OUT;
 	node->state = ASYNC_NOTIFY_STATE_CONNECTING;
+	node->afunix = afunix;
 
 	// queue into ping & idle
 	ilist_add_tail(&node->node_ping, &notify->ping);
@@ -1494,11 +1966,21 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	node->ts_ping = notify->seconds;
 
 	// add sid2hid map
-	async_notify_set(notify, ASYNC_CORE_NODE_OUT, sid, hid);
+	async_notify_pool_set(notify, ASYNC_CORE_NODE_OUT, sid, slot, hid);
 	
-	// build login message: (selfid, remoteid, ts, sign)
-	data = notify->data;
-	async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGIN, 0);
+	// build login message: (selfid, remoteid, ts, sign), cmd is slot.
+	// notify->data may hold a frame borrowed by the receiver callback
+	keysize = ib_string_size(notify->token);
+	data = login;
+	if (20 + keysize > (int)sizeof(login)) {
+		data = (char*)ikmem_malloc(20 + keysize);
+		if (data == NULL) {
+			async_core_close(notify->core, hid, 8007);
+			return -5;
+		}
+	}
+
+	async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGIN, slot);
 
 	iencode32u_lsb(data + 4, (IUINT32)notify->sid);
 	iencode32u_lsb(data + 8, (IUINT32)sid);
@@ -1506,7 +1988,6 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	itimeofday(&seconds, NULL);
 	async_notify_encode_64(data + 12, (IINT64)seconds);
 
-	keysize = ib_string_size(notify->token);
 	memcpy(data + 20, ib_string_ptr(notify->token), keysize);
 
 	// calculate hash signature
@@ -1517,6 +1998,11 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	// post login message
 	async_core_send(notify->core, hid, data, 20 + 32);
 
+	if (data != login) {
+		ikmem_free(data);
+		data = login;
+	}
+
 	// post ping message: (millisec)
 	async_notify_header_write(data, ASYNC_NOTIFY_MSG_PING, 0);
 	iencode32u_lsb(data + 4, notify->current);
@@ -1524,39 +2010,151 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 
 	if (notify->logmask & ASYNC_NOTIFY_LOG_INFO) {
 		async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
-			"create new connection hid=%lx to sid=%d", hid, sid);
+			"create new connection hid=%lx to sid=%d slot=%d", 
+			hid, sid, slot);
 	}
 
 	return hid;
 }
 
+// pick a link for cmd: messages of the same cmd keep their order
+static long async_notify_get_link(CAsyncNotify *notify, int sid, int cmd)
+{
+	int slot = 0;
+	if (notify->pool_size > 1) {
+		slot = (cmd & 0xffff) % notify->pool_size;
+	}
+	return async_notify_get_connection(notify, sid, slot);
+}
+
+
 //---------------------------------------------------------------------
-// send message to server
+// message batching: (cmd, size, data) records after a 4 bytes header
 //---------------------------------------------------------------------
-int async_notify_send(CAsyncNotify *notify, int sid, short cmd, 
-	const void *data, long size)
+
+// send the pending batch of the node
+static long async_notify_batch_flush(CAsyncNotify *notify, CAsyncNode *node)
 {
-	int hr = 0;
-	long hid = 0, x = 0;
+	struct IVECTOR *v = &node->batch;
+	char *ptr = (char*)v->data;
+	long hr = 0;
+	if (node->batch_count == 1) {
+		unsigned short cmd;
+		IUINT32 size;
+		idecode16u_lsb(ptr + 4, &cmd);
+		idecode32u_lsb(ptr + 6, &size);
+		// a single message goes out as a plain data frame
+		async_notify_header_write(ptr + 6, ASYNC_NOTIFY_MSG_DATA, cmd);
+		hr = async_core_send(notify->core, node->hid, ptr + 6, 
+				4 + (long)size);
+	}
+	else if (node->batch_count > 1) {
+		int count = (node->batch_count < 0xffff)? node->batch_count : 0xffff;
+		async_notify_header_write(ptr, ASYNC_NOTIFY_MSG_BATCH, count);
+		hr = async_core_send(notify->core, node->hid, ptr, (long)v->size);
+	}
+	if (hr < 0 && (notify->logmask & ASYNC_NOTIFY_LOG_ERROR)) {
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_ERROR,
+			"[ERROR] batch send failed hid=%lx sid=%d count=%d: %ld",
+			node->hid, node->sid, node->batch_count, hr);
+	}
+	node->batch_count = 0;
+	iv_resize(v, 0);
+	if ((long)v->capacity > notify->batch_limit * 2) {
+		iv_capacity(v, 0);
+	}
+	if (!ilist_is_empty(&node->node_batch)) {
+		ilist_del_init(&node->node_batch);
+	}
+	return hr;
+}
 
-	if (cmd < 0) return -5;
-	if (sid == notify->sid) return -6;
+// send all pending batches
+static void async_notify_batch_flush_all(CAsyncNotify *notify)
+{
+	while (!ilist_is_empty(&notify->batch)) {
+		CAsyncNode *node = ilist_entry(notify->batch.next, 
+				CAsyncNode, node_batch);
+		async_notify_batch_flush(notify, node);
+	}
+}
+
+// append message into the pending batch of the node
+static long async_notify_batch_push(CAsyncNotify *notify, CAsyncNode *node,
+	int cmd, const void *data, long size)
+{
+	struct IVECTOR *v = &node->batch;
+	size_t pos = v->size;
+	char *ptr;
+	if (pos > 4 && (long)(pos + 6 + size) > notify->batch_limit) {
+		async_notify_batch_flush(notify, node);
+		pos = 0;
+	}
+	if (pos == 0) pos = 4;
+	if (iv_resize(v, pos + 6 + size) != 0) return -1;
+	ptr = (char*)v->data + pos;
+	ptr = iencode16u_lsb(ptr, (unsigned short)(cmd & 0xffff));
+	ptr = iencode32u_lsb(ptr, (IUINT32)size);
+	if (size > 0) memcpy(ptr, data, size);
+	node->batch_count++;
+	if (ilist_is_empty(&node->node_batch)) {
+		// first pending batch: make the waiting loop come back to flush
+		if (ilist_is_empty(&notify->batch)) {
+			async_core_notify(notify->core);
+		}
+		ilist_add_tail(&node->node_batch, &notify->batch);
+	}
+	return 0;
+}
 
+//---------------------------------------------------------------------
+// flush batched messages
+//---------------------------------------------------------------------
+void async_notify_flush(CAsyncNotify *notify)
+{
 	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
-	
+	async_notify_batch_flush_all(notify);
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+}
+
+//---------------------------------------------------------------------
+// send an encoded data frame (head is the 4 bytes header) to server,
+// if defer is not NULL, the hid is appended there instead of sending
+//---------------------------------------------------------------------
+static int async_notify_send_frame(CAsyncNotify *notify, int sid, int cmd,
+	const char *head, const void *data, long size, struct IVECTOR *defer)
+{
+	int hr = 0;
+	long hid = 0, x = 0;
+
 	// get or create an connection 
-	hid = async_notify_get_connection(notify, sid);
+	hid = async_notify_get_link(notify, sid, cmd);
+
+	// queue into batch, large messages flush the batch and go directly
+	if (hid >= 0 && notify->batch_limit > 0) {
+		CAsyncNode *node = async_notify_node_get(notify, hid);
+		if (size + 10 < notify->batch_limit) {
+			x = async_notify_batch_push(notify, node, cmd, data, size);
+			if (x < 0) hr = -7;
+			async_notify_node_active(notify, hid, 1);
+			return hr;
+		}
+		if (node->batch_count > 0) {
+			async_notify_batch_flush(notify, node);
+		}
+	}
 
 	// check if connection for remote server exists
-	if (hid >= 0) {	
+	if (hid >= 0 && defer != NULL) {
+		if (iv_obj_push(defer, long, &hid) != 0) hr = -7;
+	}
+	else if (hid >= 0) {	
 		const void *vecptr[2];
 		long veclen[2];
-		char *head = notify->data;
 		vecptr[0] = head;
 		vecptr[1] = data;
 		veclen[0] = 4;
 		veclen[1] = size;
-		async_notify_header_write(head, ASYNC_NOTIFY_MSG_DATA, cmd);
 		x = async_core_send_vector(notify->core, hid, vecptr, veclen, 2, 0);
 		if (x < 0) hr = -1000 + x;
 		// update idle time
@@ -1565,26 +2163,461 @@ int async_notify_send(CAsyncNotify *notify, int sid, short cmd,
 		if (notify->evtmask & ASYNC_NOTIFY_EVT_ERROR) {
 			const char *msg = "can not get connection for this sid";
 			async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_ERROR,
-				-1, hr, msg, (int)strlen(msg));
+				sid, hid, msg, (int)strlen(msg));
 		}
 		hr = hid;
 	}
 
+	return hr;
+}
+
+//---------------------------------------------------------------------
+// send message to server
+//---------------------------------------------------------------------
+int async_notify_send(CAsyncNotify *notify, int sid, short cmd, 
+	const void *data, long size)
+{
+	char head[4];
+	int hr = 0;
+
+	if (cmd < 0) return -5;
+	if (sid == notify->sid) return -6;
+
+	async_notify_header_write(head, ASYNC_NOTIFY_MSG_DATA, cmd);
+
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+	hr = async_notify_send_frame(notify, sid, cmd, head, data, size, NULL);
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 
 	return hr;
 }
 
+//---------------------------------------------------------------------
+// send the same message to multiple servers, returns the number of
+// sids the message has been queued to, or -5 for invalid cmd. frames
+// not batched are handed to async_core_multicast at once, which builds
+// the frame a single time and queues references to it on every link.
+//---------------------------------------------------------------------
+int async_notify_multicast(CAsyncNotify *notify, const int *sids, int count,
+	short cmd, const void *data, long size)
+{
+	char head[4];
+	int i, n, hr = 0;
+
+	if (cmd < 0) return -5;
+
+	// header is encoded once and shared with every destination
+	async_notify_header_write(head, ASYNC_NOTIFY_MSG_DATA, cmd);
+
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+
+	iv_obj_resize(&notify->mcast, long, 0);
+
+	for (i = 0; i < count; i++) {
+		if (sids[i] == notify->sid) continue;
+		if (async_notify_send_frame(notify, sids[i], cmd, 
+					head, data, size, &notify->mcast) == 0) {
+			hr++;
+		}
+	}
+
+	n = (int)iv_obj_size(&notify->mcast, long);
+
+	if (n > 0) {
+		long *hids = iv_entry(&notify->mcast, long);
+		const void *vecptr[2];
+		long veclen[2], x;
+		vecptr[0] = head;
+		vecptr[1] = data;
+		veclen[0] = 4;
+		veclen[1] = size;
+		x = async_core_multicast(notify->core, hids, n, 
+				vecptr, veclen, 2, 0);
+		hr -= n - (int)x;
+		for (i = 0; i < n; i++) {
+			async_notify_node_active(notify, hids[i], 1);
+		}
+	}
+
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+
+	return hr;
+}
+
+//---------------------------------------------------------------------
+// eager mode: keep a logged in link for every sid in the table
+//---------------------------------------------------------------------
+
+// returns 1 if the primary link to sid is logged in
+static int async_notify_sid_ready(CAsyncNotify *notify, int sid)
+{
+	long hid = async_notify_get(notify, ASYNC_CORE_NODE_OUT, sid);
+	CAsyncNode *node;
+	if (hid < 0) return 0;
+	node = async_notify_node_get(notify, hid);
+	if (node == NULL) return 0;
+	return (node->state == ASYNC_NOTIFY_STATE_LOGINED)? 1 : 0;
+}
+
+// dial missing links, at most notify->prewarm links connect in parallel
+static void async_notify_prewarm(CAsyncNotify *notify)
+{
+	struct ib_hash_entry *e;
+	int connecting = 0, slot;
+
+	notify->prewarm_dirty = 0;
+
+	for (e = ib_map_first(&notify->sid2addr); e != NULL;
+		e = ib_map_next(&notify->sid2addr, e)) {
+		int sid = (int)(ilong)ib_hash_key(e);
+		for (slot = 0; slot < notify->pool_size; slot++) {
+			long hid = async_notify_pool_get(notify, ASYNC_CORE_NODE_OUT,
+					sid, slot);
+			CAsyncNode *node;
+			if (hid < 0) continue;
+			node = async_notify_node_get(notify, hid);
+			if (node && node->state != ASYNC_NOTIFY_STATE_LOGINED) {
+				connecting++;
+			}
+		}
+	}
+
+	for (e = ib_map_first(&notify->sid2addr); e != NULL;
+		e = ib_map_next(&notify->sid2addr, e)) {
+		int sid = (int)(ilong)ib_hash_key(e);
+		if (sid == notify->sid) continue;
+		if (async_notify_black_check(notify, sid) != 0) continue;
+		for (slot = 0; slot < notify->pool_size; slot++) {
+			if (async_notify_pool_get(notify, ASYNC_CORE_NODE_OUT,
+					sid, slot) >= 0) {
+				continue;
+			}
+			if (connecting >= notify->prewarm) {
+				// continue when some of them finished
+				notify->prewarm_dirty = 1;
+				return;
+			}
+			if (async_notify_get_connection(notify, sid, slot) >= 0) {
+				connecting++;
+			}
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// service groups
+//---------------------------------------------------------------------
+static void async_notify_group_delete(void *ptr)
+{
+	CAsyncGroup *group = (CAsyncGroup*)ptr;
+	if (group->sids) ikmem_free(group->sids);
+	if (group->ring) ikmem_free(group->ring);
+	ikmem_free(group);
+}
+
+// integer mixer (murmur3 finalizer)
+static inline IUINT32 async_notify_group_hash(IUINT32 x)
+{
+	x ^= x >> 16;
+	x *= 0x85ebca6bul;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35ul;
+	x ^= x >> 16;
+	return x;
+}
+
+static int async_notify_group_compare(const void *a, const void *b)
+{
+	IUINT32 x = ((const struct CAsyncPoint*)a)->point;
+	IUINT32 y = ((const struct CAsyncPoint*)b)->point;
+	if (x < y) return -1;
+	if (x > y) return 1;
+	return ((const struct CAsyncPoint*)a)->sid - 
+		((const struct CAsyncPoint*)b)->sid;
+}
+
+// create or update service group, count <= 0 to remove
+int async_notify_group_set(CAsyncNotify *notify, int gid, int policy,
+	const int *sids, int count)
+{
+	CAsyncGroup *group;
+	int i, j, k;
+
+	if (count <= 0) {
+		ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+		ib_map_remove(&notify->groups, (void*)(ilong)gid);
+		ASYNC_NOTIFY_CRITICAL_END(notify);
+		return 0;
+	}
+
+	if (policy < 0 || policy > ASYNC_NOTIFY_GROUP_HASH) return -1;
+
+	group = (CAsyncGroup*)ikmem_malloc(sizeof(CAsyncGroup));
+	if (group == NULL) return -2;
+
+	group->policy = policy;
+	group->count = count;
+	group->ring = NULL;
+	group->ring_size = 0;
+	group->sids = (int*)ikmem_malloc(sizeof(int) * count);
+
+	if (group->sids == NULL) {
+		async_notify_group_delete(group);
+		return -2;
+	}
+
+	memcpy(group->sids, sids, sizeof(int) * count);
+
+	if (policy == ASYNC_NOTIFY_GROUP_HASH) {
+		group->ring_size = count * ASYNC_NOTIFY_GROUP_VNODES;
+		group->ring = (struct CAsyncPoint*)
+			ikmem_malloc(sizeof(struct CAsyncPoint) * group->ring_size);
+		if (group->ring == NULL) {
+			async_notify_group_delete(group);
+			return -2;
+		}
+		for (i = 0, k = 0; i < count; i++) {
+			IUINT32 h = async_notify_group_hash((IUINT32)sids[i]);
+			for (j = 0; j < ASYNC_NOTIFY_GROUP_VNODES; j++, k++) {
+				h = async_notify_group_hash(h + (IUINT32)j);
+				group->ring[k].point = h;
+				group->ring[k].sid = sids[i];
+			}
+		}
+		qsort(group->ring, group->ring_size, sizeof(struct CAsyncPoint),
+			async_notify_group_compare);
+	}
+
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+	ib_map_set(&notify->groups, (void*)(ilong)gid, group);
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+
+	return 0;
+}
+
+// returns 1 if the sid can take traffic, with ready set the primary
+// link must also be logged in
+static int async_notify_group_usable(CAsyncNotify *notify, int sid,
+	const int *skip, int nskip, int ready)
+{
+	int i;
+	if (sid == notify->sid) return 0;
+	for (i = 0; i < nskip; i++) {
+		if (skip[i] == sid) return 0;
+	}
+	if (ib_map_find_int(&notify->sid2addr, (ilong)sid) == NULL) return 0;
+	if (async_notify_black_check(notify, sid) != 0) return 0;
+	if (ready) {
+		long hid = async_notify_get(notify, ASYNC_CORE_NODE_OUT, sid);
+		CAsyncNode *node = (hid < 0)? NULL : 
+			async_notify_node_get(notify, hid);
+		if (node == NULL) return 0;
+		if (node->state != ASYNC_NOTIFY_STATE_LOGINED) return 0;
+	}
+	return 1;
+}
+
+// smoothed rtt of the primary link, LONG_MAX if missing or unsampled
+static long async_notify_group_rtt(CAsyncNotify *notify, int sid)
+{
+	long hid = async_notify_get(notify, ASYNC_CORE_NODE_OUT, sid);
+	CAsyncNode *node;
+	if (hid < 0) return LONG_MAX;
+	node = async_notify_node_get(notify, hid);
+	if (node == NULL || node->srtt < 0) return LONG_MAX;
+	return node->srtt;
+}
+
+// bytes queued but not sent yet on all links of the sid
+static long async_notify_group_load(CAsyncNotify *notify, int sid)
+{
+	long size = 0;
+	int slot;
+	for (slot = 0; slot < notify->pool_size; slot++) {
+		long hid = async_notify_pool_get(notify, ASYNC_CORE_NODE_OUT, 
+				sid, slot);
+		CAsyncNode *node;
+		if (hid < 0) continue;
+		node = async_notify_node_get(notify, hid);
+		if (node) size += (long)node->batch.size;
+		size += async_core_pending(notify->core, hid);
+	}
+	return size;
+}
+
+// returns 1 if sid x should be preferred over sid y
+static int async_notify_group_better(CAsyncNotify *notify, int policy,
+	int x, int y)
+{
+	long a, b;
+	if (policy == ASYNC_NOTIFY_GROUP_RTT) {
+		a = async_notify_group_rtt(notify, x);
+		b = async_notify_group_rtt(notify, y);
+		if (a != b) return (a < b)? 1 : 0;
+		a = async_notify_group_load(notify, x);
+		b = async_notify_group_load(notify, y);
+	}	else {
+		a = async_notify_group_load(notify, x);
+		b = async_notify_group_load(notify, y);
+		if (a != b) return (a < b)? 1 : 0;
+		a = async_notify_group_rtt(notify, x);
+		b = async_notify_group_rtt(notify, y);
+	}
+	return (a < b)? 1 : 0;
+}
+
+// pick a usable sid from the group, returns -1 for none
+static int async_notify_group_select(CAsyncNotify *notify, 
+	CAsyncGroup *group, IUINT32 key, const int *skip, int nskip,
+	int ready)
+{
+	int i, n, sid = -1;
+	if (group->policy == ASYNC_NOTIFY_GROUP_HASH) {
+		IUINT32 h = async_notify_group_hash(key);
+		int low = 0, high = group->ring_size;
+		// first point >= h, wraps around to the beginning
+		while (low < high) {
+			int mid = (low + high) >> 1;
+			if (group->ring[mid].point < h) low = mid + 1;
+			else high = mid;
+		}
+		for (i = 0; i < group->ring_size; i++) {
+			int x = group->ring[(low + i) % group->ring_size].sid;
+			if (async_notify_group_usable(notify, x, skip, nskip, ready)) {
+				return x;
+			}
+		}
+		return -1;
+	}
+	if (group->policy == ASYNC_NOTIFY_GROUP_P2C) {
+		int choice[2];
+		for (n = 0; n < 2; n++) {
+			int start;
+			notify->seed = notify->seed * 1103515245ul + 12345ul;
+			start = (int)((notify->seed >> 8) % (IUINT32)group->count);
+			choice[n] = -1;
+			for (i = 0; i < group->count; i++) {
+				int x = group->sids[(start + i) % group->count];
+				if (n == 1 && x == choice[0] && group->count > 1) continue;
+				if (async_notify_group_usable(notify, x, skip, nskip, 
+						ready)) {
+					choice[n] = x;
+					break;
+				}
+			}
+		}
+		if (choice[0] < 0) return -1;
+		if (choice[1] < 0 || choice[1] == choice[0]) return choice[0];
+		if (async_notify_group_better(notify, ASYNC_NOTIFY_GROUP_LEAST,
+				choice[1], choice[0])) {
+			return choice[1];
+		}
+		return choice[0];
+	}
+	for (i = 0; i < group->count; i++) {
+		int x = group->sids[i];
+		if (async_notify_group_usable(notify, x, skip, nskip, ready) == 0) {
+			continue;
+		}
+		if (sid < 0 || async_notify_group_better(notify, group->policy,
+				x, sid)) {
+			sid = x;
+		}
+	}
+	return sid;
+}
+
+// prefer sids with a logged in link, only when none of them is usable
+// fall back to the others, so that the first send can connect
+static int async_notify_group_choose(CAsyncNotify *notify, 
+	CAsyncGroup *group, IUINT32 key, const int *skip, int nskip)
+{
+	int sid = async_notify_group_select(notify, group, key, 
+			skip, nskip, 1);
+	if (sid < 0) {
+		sid = async_notify_group_select(notify, group, key, 
+				skip, nskip, 0);
+	}
+	return sid;
+}
+
+// pick a sid from the group, returns -1 for group not find, -2 for none
+int async_notify_group_pick(CAsyncNotify *notify, int gid, IUINT32 key)
+{
+	struct ib_hash_entry *e;
+	int sid = -1;
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+	e = ib_map_find_int(&notify->groups, (ilong)gid);
+	if (e != NULL) {
+		sid = async_notify_group_choose(notify, (CAsyncGroup*)e->value,
+				key, NULL, 0);
+		if (sid < 0) sid = -2;
+	}
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+	return sid;
+}
+
+// send message to a sid picked from the group, fails over to the next
+// choice if the link can not be used. returns the sid or negative error
+int async_notify_send_group(CAsyncNotify *notify, int gid, IUINT32 key,
+	short cmd, const void *data, long size)
+{
+	int skip[ASYNC_NOTIFY_GROUP_RETRY];
+	struct ib_hash_entry *e;
+	CAsyncGroup *group;
+	char head[4];
+	int nskip = 0, hr = -2;
+
+	if (cmd < 0) return -5;
+
+	async_notify_header_write(head, ASYNC_NOTIFY_MSG_DATA, cmd);
+
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+
+	e = ib_map_find_int(&notify->groups, (ilong)gid);
+
+	if (e == NULL) {
+		ASYNC_NOTIFY_CRITICAL_END(notify);
+		return -1;
+	}
+
+	group = (CAsyncGroup*)e->value;
+
+	while (nskip < ASYNC_NOTIFY_GROUP_RETRY) {
+		int sid = async_notify_group_choose(notify, group, key, skip, nskip);
+		if (sid < 0) break;
+		if (async_notify_send_frame(notify, sid, cmd, head, 
+				data, size, NULL) == 0) {
+			hr = sid;
+			break;
+		}
+		if (notify->logmask & ASYNC_NOTIFY_LOG_WARNING) {
+			async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
+				"[WARNING] group %d failover from sid=%d", gid, sid);
+		}
+		skip[nskip++] = sid;
+	}
+
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+
+	return hr;
+}
+
+
 //---------------------------------------------------------------------
 // close server connection
 //---------------------------------------------------------------------
 int async_notify_close(CAsyncNotify *notify, int sid, int mode, int code)
 {
 	long hid = -1;
+	int slot;
 	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
-	hid = async_notify_get(notify, mode, sid);
-	if (hid >= 0) {
-		async_core_close(notify->core, hid, code);
+	for (slot = 0; slot < ASYNC_NOTIFY_POOL_MAX; slot++) {
+		hid = async_notify_pool_get(notify, mode, sid, slot);
+		if (hid >= 0) {
+			async_core_close(notify->core, hid, code);
+		}
 	}
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 	return 0;
@@ -1615,7 +2648,11 @@ static void async_notify_on_timer(CAsyncNotify *notify)
 			}
 		}
 	}
-	if (notify->cfg.timeout_idle_kill > 0) {
+	// links are kept in eager mode, missing ones are retried
+	if (notify->prewarm > 0) {
+		notify->prewarm_dirty = 1;
+	}
+	else if (notify->cfg.timeout_idle_kill > 0) {
 		while (1) {
 			long x;
 			node = async_notify_node_first(notify, 1);
@@ -1724,6 +2761,47 @@ int async_notify_option(CAsyncNotify *notify, int type, long value)
 	case ASYNC_NOTIFY_OPT_GET_IN_COUNT:
 		hr = notify->count_in;
 		break;
+
+	case ASYNC_NOTIFY_OPT_BATCH_SIZE:
+		if (value <= 0) {
+			async_notify_batch_flush_all(notify);
+			notify->batch_limit = 0;
+		}	else {
+			notify->batch_limit = (value < 64)? 64 : value;
+		}
+		hr = 0;
+		break;
+
+	case ASYNC_NOTIFY_OPT_PREWARM:
+		notify->prewarm = (value < 0)? 0 : (int)value;
+		notify->prewarm_dirty = 1;
+		hr = 0;
+		break;
+
+	case ASYNC_NOTIFY_OPT_GET_READY:
+		if (value >= 0) {
+			hr = 0;
+			if ((int)value != notify->sid) {
+				hr = async_notify_sid_ready(notify, (int)value);
+			}
+		}	else {
+			struct ib_hash_entry *e;
+			hr = 0;
+			for (e = ib_map_first(&notify->sid2addr); e != NULL;
+				e = ib_map_next(&notify->sid2addr, e)) {
+				int sid = (int)(ilong)ib_hash_key(e);
+				if (sid == notify->sid) continue;
+				hr += async_notify_sid_ready(notify, sid);
+			}
+		}
+		break;
+
+	case ASYNC_NOTIFY_OPT_POOL_SIZE:
+		if (value >= 1 && value <= ASYNC_NOTIFY_POOL_MAX) {
+			notify->pool_size = (int)value;
+			hr = 0;
+		}
+		break;
 	}
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 	return hr;
@@ -1799,6 +2877,16 @@ void *async_notify_user(CAsyncNotify *notify, void *user)
 	return old;
 }
 
+// set receiver callback, NULL to restore the event queue
+void async_notify_set_receiver(CAsyncNotify *notify, 
+	CAsyncNotify_Receiver receiver, void *user)
+{
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+	notify->receiver = receiver;
+	notify->receiver_user = user;
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+}
+
 
 //---------------------------------------------------------------------
 // hash
@@ -1936,6 +3024,3 @@ void async_notify_log_stdout(const char *text, void *user)
 	printf("[%s] %s\n", timetxt, text);
 	fflush(stdout);
 }
-
-
-
@@ -61,6 +61,16 @@ long async_notify_read(CAsyncNotify *notify, int *event, long *wparam,
 long async_notify_listen(CAsyncNotify *notify, const struct sockaddr *addr,
 	int addrlen, int flag);
 
+// set AF_UNIX path prefix for same-host peers (NULL to disable, default):
+// each tcp listener created afterwards also listens on "<prefix><port>",
+// and sids added with a loopback address connect through that path when
+// it exists. login and events are the same as tcp. a path which fails
+// before login falls back to tcp for retry_seconds; an existing file is
+// only unlinked when nothing is listening on it. AF_UNIX stands in for
+// a shared-memory ring + eventfd: the core has no shm transport, and a
+// unix socket keeps the stream framing and the whole core code path.
+void async_notify_local(CAsyncNotify *notify, const char *prefix);
+
 // remove listening port
 int async_notify_remove(CAsyncNotify *notify, long listenid, int code);
 
@@ -72,7 +82,42 @@ void async_notify_change(CAsyncNotify *notify, int new_server_id);
 int async_notify_send(CAsyncNotify *notify, int sid, short cmd, 
 	const void *data, long size);
 
-// close server connection
+// send the same message to multiple servers, returns the number of
+// sids the message has been queued to, or -5 for invalid cmd. the frame
+// is encoded once and the send buffers of all links reference the same
+// refcounted copy (see async_core_multicast), messages queued into a
+// batch (ASYNC_NOTIFY_OPT_BATCH_SIZE) are still copied into it.
+int async_notify_multicast(CAsyncNotify *notify, const int *sids, int count,
+	short cmd, const void *data, long size);
+
+// service group policies
+#define ASYNC_NOTIFY_GROUP_RTT		0	// lowest smoothed ping rtt
+#define ASYNC_NOTIFY_GROUP_LEAST	1	// least bytes waiting to be sent
+#define ASYNC_NOTIFY_GROUP_P2C		2	// power of two random choices
+#define ASYNC_NOTIFY_GROUP_HASH		3	// consistent hashing on key
+
+// create or update a service group of sids, count <= 0 to remove.
+// rtt is refreshed by pings (ASYNC_NOTIFY_OPT_TIMEOUT_PING), sids that
+// are unknown or in the retry black list are skipped. sids with a logged
+// in link are preferred, a sid without one is only chosen when no other
+// is usable; sids not pinged yet rank last under ASYNC_NOTIFY_GROUP_RTT.
+int async_notify_group_set(CAsyncNotify *notify, int group, int policy,
+	const int *sids, int count);
+
+// pick a sid from the group, returns -1 for group not find, -2 for none
+int async_notify_group_pick(CAsyncNotify *notify, int group, IUINT32 key);
+
+// send message to a sid picked from the group (key is only used by
+// ASYNC_NOTIFY_GROUP_HASH), fails over to the next choice on error.
+// returns the sid, -1 for group not find, -2 for no usable sid
+int async_notify_send_group(CAsyncNotify *notify, int group, IUINT32 key,
+	short cmd, const void *data, long size);
+
+// flush messages queued by ASYNC_NOTIFY_OPT_BATCH_SIZE, it is also
+// called automatically at the beginning of each async_notify_wait
+void async_notify_flush(CAsyncNotify *notify);
+
+// close server connection (all pooled links of the sid)
 int async_notify_close(CAsyncNotify *notify, int sid, int mode, int code);
 
 // get listening port
@@ -121,6 +166,26 @@ void async_notify_sid_clear(CAsyncNotify *notify);
 #define ASYNC_NOTIFY_OPT_GET_PING			12
 #define ASYNC_NOTIFY_OPT_GET_OUT_COUNT		13
 #define ASYNC_NOTIFY_OPT_GET_IN_COUNT		14
+#define ASYNC_NOTIFY_OPT_BATCH_SIZE			15
+#define ASYNC_NOTIFY_OPT_POOL_SIZE			16
+#define ASYNC_NOTIFY_OPT_PREWARM			17
+#define ASYNC_NOTIFY_OPT_GET_READY			18
+
+// ASYNC_NOTIFY_OPT_BATCH_SIZE: value is the max frame size (0 to disable,
+// default). messages to the same link are queued and sent as one frame
+// when async_notify_wait/flush is called, every peer must support it.
+// ASYNC_NOTIFY_OPT_POOL_SIZE: links per remote sid (1-16, default 1),
+// messages are spread by cmd, so ordering is kept only for the same cmd.
+// protocol: the cmd field of the LOGIN frame carries the pool slot (old
+// versions always send 0, the primary link). a peer without pooling
+// takes every slot as the primary link and closes the previous one, so
+// all peers must support it before the pool size goes above 1.
+// ASYNC_NOTIFY_OPT_PREWARM: value is the max number of links connecting
+// in parallel (0 for lazy connecting, default). links to every sid in
+// the sid table are dialed in advance, retried and never idle killed.
+// ASYNC_NOTIFY_OPT_GET_READY: returns 1 if the link to sid (value) has
+// logged in, or the number of such sids in the table when value < 0.
+// the local sid is never counted as a ready peer.
 
 #define ASYNC_NOTIFY_LOG_INFO		1
 #define ASYNC_NOTIFY_LOG_REJECT		2
@@ -146,6 +211,23 @@ void *async_notify_install(CAsyncNotify *notify, CAsyncNotify_WriteLog func);
 void *async_notify_user(CAsyncNotify *notify, void *user);
 
 
+// receiver callback: data points into the decoded frame and is only
+// valid until the callback returns (don't free or keep it).
+typedef void (*CAsyncNotify_Receiver)(void *user, int event, long wparam,
+	long lparam, const void *data, long size);
+
+// deliver events to the receiver inside async_notify_wait instead of the
+// event queue read by async_notify_read, NULL to restore. the receiver
+// only runs on the thread calling async_notify_wait: events raised on
+// other threads (eg. ERROR from async_notify_send) or by the callback
+// itself are queued and delivered before async_notify_wait returns or
+// on its next call. the internal lock is released during the callback,
+// so it can call async_notify_send and other threads may run between
+// two events, but it must not call async_notify_wait.
+void async_notify_set_receiver(CAsyncNotify *notify, 
+	CAsyncNotify_Receiver receiver, void *user);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "inetsub.h"
 #include "imembase.h"
@@ -25,6 +26,38 @@ typedef struct CAsyncTopicRoot {
 	ilist_head head;
 }	CAsyncTopicRoot;
 
+// queued message: followed by the NUL-terminated name (namelen + 1
+// bytes) when tid < 0, then a NUL-terminated copy of the data
+// (size + 1 bytes) when payload is NULL
+typedef struct CAsyncTopicRecord {
+	int tid;
+	int namelen;
+	IINT32 wparam;
+	IINT32 lparam;
+	int size;
+	CAsyncPayload *payload;
+}	CAsyncTopicRecord;
+
+// trie node of hierarchical patterns, one level per segment
+struct CAsyncTopicNode {
+	struct CAsyncTopicNode *parent;
+	struct CAsyncTopicNode *star;     // "*" child
+	struct CAsyncTopicNode *hash;     // trailing "#" child
+	struct ib_hash_map children;      // segment -> node
+	ib_string *segment;
+	ib_string *pattern;               // full pattern of this node
+	ilist_head head;                  // subscribers ending here
+	int literal;                      // path has a literal '*' or '#'
+};
+
+typedef struct CAsyncTopicNode CAsyncTopicNode;
+
+// cached subscriber set of a concrete name
+typedef struct CAsyncTopicRoute {
+	ib_string *name;
+	ib_array *subs;
+}	CAsyncTopicRoute;
+
 
 //---------------------------------------------------------------------
 // internal functions
@@ -33,6 +66,9 @@ static void async_topic_postpone(CAsyncLoop *loop, CAsyncPostpone *post);
 static void async_topic_root_del(CAsyncTopic *topic, CAsyncTopicRoot *root);
 static CAsyncTopicRoot *async_topic_root_get(CAsyncTopic *topic, int tid);
 static CAsyncTopicRoot *async_topic_root_ensure(CAsyncTopic *topic, int tid);
+static void async_topic_clear(CAsyncTopic *topic);
+static void async_topic_node_free(CAsyncTopicNode *node);
+static void async_topic_route_free(void *route);
 
 
 //---------------------------------------------------------------------
@@ -52,6 +88,11 @@ CAsyncTopic *async_topic_new(CAsyncLoop *loop)
 	topic->pendings = ib_array_new(NULL);
 	ib_fastbin_init(&topic->allocator, sizeof(CAsyncTopicRoot));
 	ib_map_init(&topic->hash_map, ib_hash_func_int, ib_hash_compare_int);
+	ib_map_init(&topic->routes, ib_hash_func_str, ib_hash_compare_str);
+	topic->routes.value_destroy = async_topic_route_free;
+	topic->patterns = NULL;
+	topic->scratch = ib_string_new();
+	topic->name = NULL;
 	return topic;
 }
 
@@ -74,7 +115,17 @@ void async_topic_delete(CAsyncTopic *topic)
 		if (entry == NULL) break;
 		async_topic_root_del(topic, (CAsyncTopicRoot*)entry->value);
 	}
+	if (topic->patterns) {
+		async_topic_node_free(topic->patterns);
+		topic->patterns = NULL;
+	}
+	ib_map_destroy(&topic->routes);
+	async_topic_clear(topic);
 	ims_destroy(&topic->queue);
+	if (topic->scratch) {
+		ib_string_delete(topic->scratch);
+		topic->scratch = NULL;
+	}
 	if (topic->pendings) {
 		ib_array_delete(topic->pendings);
 		topic->pendings = NULL;
@@ -86,36 +137,78 @@ void async_topic_delete(CAsyncTopic *topic)
 
 
 //---------------------------------------------------------------------
-// 
+// find the cached subscriber set of a concrete name, build it by
+// walking the pattern trie on a miss
 //---------------------------------------------------------------------
-static void async_topic_dispatch(CAsyncTopic *topic, int tid, 
+static CAsyncTopicRoute *async_topic_route_get(CAsyncTopic *topic, 
+	const char *name);
+
+
+//---------------------------------------------------------------------
+// invoke subscribers collected in topic->pendings
+//---------------------------------------------------------------------
+static void async_topic_invoke(CAsyncTopic *topic, 
 	IINT32 wparam, IINT32 lparam, const void *data, int size)
 {
-	CAsyncTopicRoot *root = async_topic_root_get(topic, tid);
-	if (root != NULL) {
+	int index, count = (int)ib_array_size(topic->pendings);
+	for (index = 0; index < count; index++) {
+		CAsyncSubscribe *sub = NULL;
+		sub = (CAsyncSubscribe*)ib_array_index(topic->pendings, index);
+		if (sub == NULL) continue;
+		assert(sub->topic == topic);
+		sub->pending = -1;
+		if (sub->callback) {
+			int hr = sub->callback(sub, wparam, lparam, data, size);
+			if (hr != 0) {
+				break;
+			}
+		}
+	}
+	// subscribers skipped by an early break are still marked
+	for (; index < count; index++) {
+		CAsyncSubscribe *sub = NULL;
+		sub = (CAsyncSubscribe*)ib_array_index(topic->pendings, index);
+		if (sub != NULL) sub->pending = -1;
+	}
+	ib_array_clear(topic->pendings);
+}
+
+
+//---------------------------------------------------------------------
+// dispatch to a tid, or to the subscribers of name when tid < 0
+//---------------------------------------------------------------------
+static void async_topic_dispatch(CAsyncTopic *topic, int tid, 
+	const char *name, IINT32 wparam, IINT32 lparam, 
+	const void *data, int size)
+{
+	ib_array_clear(topic->pendings);
+	if (tid >= 0) {
+		CAsyncTopicRoot *root = async_topic_root_get(topic, tid);
 		ilist_head *it;
-		int index = 0, count = 0;
-		ib_array_clear(topic->pendings);
+		int count = 0;
+		if (root == NULL) return;
 		for (it = root->head.next; it != &root->head; it = it->next) {
 			CAsyncSubscribe *sub = NULL;
 			sub = ilist_entry(it, CAsyncSubscribe, node);
 			sub->pending = count++;
 			ib_array_push(topic->pendings, sub);
 		}
+	}
+	else {
+		CAsyncTopicRoute *route = async_topic_route_get(topic, name);
+		int index, count;
+		if (route == NULL) return;
+		count = (int)ib_array_size(route->subs);
 		for (index = 0; index < count; index++) {
 			CAsyncSubscribe *sub = NULL;
-			sub = (CAsyncSubscribe*)ib_array_index(topic->pendings, index);
-			if (sub == NULL) continue;
-			assert(sub->topic == topic);
-			sub->pending = -1;
-			if (sub->callback) {
-				int hr = sub->callback(sub, wparam, lparam, data, size);
-				if (hr != 0) {
-					break;
-				}
-			}
+			sub = (CAsyncSubscribe*)ib_array_index(route->subs, index);
+			sub->pending = index;
+			ib_array_push(topic->pendings, sub);
 		}
 	}
+	topic->name = name;
+	async_topic_invoke(topic, wparam, lparam, data, size);
+	topic->name = NULL;
 }
 
 
@@ -125,15 +218,64 @@ static void async_topic_dispatch(CAsyncTopic *topic, int tid,
 static void async_topic_postpone(CAsyncLoop *loop, CAsyncPostpone *post)
 {
 	CAsyncTopic *topic = (CAsyncTopic*)post->user;
-	char *data = loop->cache;
 	topic->busy = 1;
 	while (topic->releasing == 0) {
-		IINT32 tid = 0, wparam = 0, lparam = 0, size = 0;
-		size = iposix_msg_read(&topic->queue, &tid, &wparam, &lparam, data,
-				ASYNC_LOOP_BUFFER_SIZE);
-		if (size < 0) break;
-		data[size] = '\0';   // ensure null-termination
-		async_topic_dispatch(topic, (int)tid, wparam, lparam, data, size);
+		CAsyncTopicRecord record;
+		ilong total, extra;
+		const char *name = NULL;
+		void *ptr = NULL;
+		if (ims_peek(&topic->queue, &record, sizeof(record)) < 
+				(ilong)sizeof(record)) {
+			break;
+		}
+		extra = (record.tid < 0)? (ilong)record.namelen + 1 : 0;
+		total = (ilong)sizeof(record) + extra;
+		if (record.payload == NULL) {
+			total += record.size + 1;
+		}
+		if (ims_flat(&topic->queue, &ptr) >= total) {
+			// borrow the queue page: publishing from callbacks only
+			// appends to the queue, the page stays in place
+			const char *data = (char*)ptr + sizeof(record) + extra;
+			if (extra > 0) {
+				name = (const char*)ptr + sizeof(record);
+			}
+			if (record.payload != NULL) {
+				data = record.payload->data;
+			}
+			async_topic_dispatch(topic, record.tid, name, record.wparam, 
+					record.lparam, data, record.size);
+			ims_drop(&topic->queue, total);
+			async_payload_unref(record.payload);
+			continue;
+		}
+		ims_drop(&topic->queue, sizeof(record));
+		if (extra > 0) {
+			ib_string_resize(topic->scratch, (int)extra);
+			ims_read(&topic->queue, topic->scratch->ptr, extra);
+			name = topic->scratch->ptr;
+		}
+		if (record.payload != NULL) {
+			async_topic_dispatch(topic, record.tid, name, record.wparam, 
+					record.lparam, record.payload->data, record.size);
+			async_payload_unref(record.payload);
+		}
+		else {
+			char *data = loop->cache;
+			if (record.size >= ASYNC_LOOP_BUFFER_SIZE) {
+				data = (char*)ikmem_malloc(record.size + 1);
+				if (data == NULL) {
+					ims_drop(&topic->queue, record.size + 1);
+					continue;
+				}
+			}
+			ims_read(&topic->queue, data, record.size + 1);
+			async_topic_dispatch(topic, record.tid, name, record.wparam, 
+					record.lparam, data, record.size);
+			if (data != loop->cache) {
+				ikmem_free(data);
+			}
+		}
 	}
 	topic->busy = 0;
 	if (topic->releasing) {
@@ -142,6 +284,28 @@ static void async_topic_postpone(CAsyncLoop *loop, CAsyncPostpone *post)
 }
 
 
+//---------------------------------------------------------------------
+// drop queued messages
+//---------------------------------------------------------------------
+static void async_topic_clear(CAsyncTopic *topic)
+{
+	CAsyncTopicRecord record;
+	while (ims_peek(&topic->queue, &record, sizeof(record)) == 
+			(ilong)sizeof(record)) {
+		ims_drop(&topic->queue, sizeof(record));
+		if (record.tid < 0) {
+			ims_drop(&topic->queue, record.namelen + 1);
+		}
+		if (record.payload != NULL) {
+			async_payload_unref(record.payload);
+		}
+		else {
+			ims_drop(&topic->queue, record.size + 1);
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // remove root
 //---------------------------------------------------------------------
@@ -191,19 +355,430 @@ static CAsyncTopicRoot *async_topic_root_ensure(CAsyncTopic *topic, int tid)
 }
 
 
+//---------------------------------------------------------------------
+// schedule dispatching after this iteration
+//---------------------------------------------------------------------
+static void async_topic_wakeup(CAsyncTopic *topic)
+{
+	if (topic->busy == 0) {
+		if (async_post_is_active(&topic->evt_postpone) == 0) {
+			async_post_start(topic->loop, &topic->evt_postpone);
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // publish a message
 //---------------------------------------------------------------------
-void async_topic_publish(CAsyncTopic *topic, int tid, 
+int async_topic_publish(CAsyncTopic *topic, int tid, 
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
+{
+	CAsyncTopicRecord record;
+	if (size < 0 || (ptr == NULL && size > 0)) {
+		return -1;
+	}
+	if (tid < 0) {
+		return -1;
+	}
+	record.tid = tid;
+	record.namelen = 0;
+	record.wparam = wparam;
+	record.lparam = lparam;
+	record.size = size;
+	record.payload = NULL;
+	ims_write(&topic->queue, &record, sizeof(record));
+	ims_write(&topic->queue, ptr, size);
+	ims_write(&topic->queue, "", 1);
+	async_topic_wakeup(topic);
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// publish a refcounted payload
+//---------------------------------------------------------------------
+int async_topic_publish_payload(CAsyncTopic *topic, int tid, 
+	IINT32 wparam, IINT32 lparam, CAsyncPayload *payload)
+{
+	CAsyncTopicRecord record;
+	if (payload == NULL || tid < 0) {
+		return -1;
+	}
+	record.tid = tid;
+	record.namelen = 0;
+	record.wparam = wparam;
+	record.lparam = lparam;
+	record.size = payload->size;
+	record.payload = async_payload_ref(payload);
+	ims_write(&topic->queue, &record, sizeof(record));
+	async_topic_wakeup(topic);
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// queue a message for a hierarchical name
+//---------------------------------------------------------------------
+static int async_topic_push_name(CAsyncTopic *topic, const char *name,
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size,
+	CAsyncPayload *payload)
+{
+	CAsyncTopicRecord record;
+	if (name == NULL) {
+		return -1;
+	}
+	record.tid = -1;
+	record.namelen = (int)strlen(name);
+	record.wparam = wparam;
+	record.lparam = lparam;
+	record.size = size;
+	record.payload = payload;
+	ims_write(&topic->queue, &record, sizeof(record));
+	ims_write(&topic->queue, name, record.namelen + 1);
+	if (payload == NULL) {
+		ims_write(&topic->queue, ptr, size);
+		ims_write(&topic->queue, "", 1);
+	}
+	async_topic_wakeup(topic);
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// publish to a hierarchical name
+//---------------------------------------------------------------------
+int async_topic_publish_name(CAsyncTopic *topic, const char *name,
 	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
 {
-	if (size <= ASYNC_LOOP_BUFFER_SIZE) {
-		iposix_msg_push(&topic->queue, tid, wparam, lparam, ptr, size);
-		if (topic->busy == 0) {
-			if (async_post_is_active(&topic->evt_postpone) == 0) {
-				async_post_start(topic->loop, &topic->evt_postpone);
+	if (size < 0 || (ptr == NULL && size > 0)) {
+		return -1;
+	}
+	return async_topic_push_name(topic, name, wparam, lparam, 
+			ptr, size, NULL);
+}
+
+
+//---------------------------------------------------------------------
+// publish a refcounted payload to a hierarchical name
+//---------------------------------------------------------------------
+int async_topic_publish_name_payload(CAsyncTopic *topic, const char *name,
+	IINT32 wparam, IINT32 lparam, CAsyncPayload *payload)
+{
+	if (payload == NULL || name == NULL) {
+		return -1;
+	}
+	return async_topic_push_name(topic, name, wparam, lparam, 
+			NULL, payload->size, async_payload_ref(payload));
+}
+
+
+//---------------------------------------------------------------------
+// test a pattern against a concrete name
+//---------------------------------------------------------------------
+int async_topic_match(const char *pattern, const char *name)
+{
+	if (pattern == NULL || name == NULL) {
+		return 0;
+	}
+	while (1) {
+		const char *pe = strchr(pattern, '.');
+		const char *ne;
+		int plen = (pe)? (int)(pe - pattern) : (int)strlen(pattern);
+		int nlen;
+		if (pe == NULL && plen == 1 && pattern[0] == '#') {
+			return 1;
+		}
+		if (name == NULL) {
+			return 0;
+		}
+		ne = strchr(name, '.');
+		nlen = (ne)? (int)(ne - name) : (int)strlen(name);
+		if (plen != 1 || pattern[0] != '*') {
+			if (plen != nlen || memcmp(pattern, name, plen) != 0) {
+				return 0;
+			}
+		}
+		name = (ne)? ne + 1 : NULL;
+		if (pe == NULL) {
+			return (name == NULL)? 1 : 0;
+		}
+		pattern = pe + 1;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// new trie node
+//---------------------------------------------------------------------
+static CAsyncTopicNode *async_topic_node_new(CAsyncTopicNode *parent,
+	const char *segment, int size)
+{
+	CAsyncTopicNode *node;
+	node = (CAsyncTopicNode*)ikmem_malloc(sizeof(CAsyncTopicNode));
+	if (node == NULL) return NULL;
+	node->parent = parent;
+	node->star = NULL;
+	node->hash = NULL;
+	ib_map_init(&node->children, ib_hash_func_str, ib_hash_compare_str);
+	node->segment = ib_string_new_size(segment, size);
+	node->pattern = ib_string_new();
+	if (parent != NULL && parent->parent != NULL) {
+		ib_string_assign_size(node->pattern, parent->pattern->ptr, 
+				parent->pattern->size);
+		ib_string_append_c(node->pattern, '.');
+	}
+	ib_string_append_size(node->pattern, segment, size);
+	ilist_init(&node->head);
+	node->literal = (parent != NULL)? parent->literal : 0;
+	return node;
+}
+
+
+//---------------------------------------------------------------------
+// free a trie node and its children, detaching their subscribers
+//---------------------------------------------------------------------
+static void async_topic_node_free(CAsyncTopicNode *node)
+{
+	struct ib_hash_entry *entry;
+	while (!ilist_is_empty(&node->head)) {
+		CAsyncSubscribe *sub;
+		sub = ilist_entry(node->head.next, CAsyncSubscribe, node);
+		ilist_del_init(&sub->node);
+		sub->pending = -1;
+		sub->topic = NULL;
+		sub->pattern = NULL;
+	}
+	ib_map_foreach(entry, &node->children) {
+		async_topic_node_free((CAsyncTopicNode*)entry->value);
+	}
+	if (node->star) async_topic_node_free(node->star);
+	if (node->hash) async_topic_node_free(node->hash);
+	ib_map_destroy(&node->children);
+	ib_string_delete(node->segment);
+	ib_string_delete(node->pattern);
+	ikmem_free(node);
+}
+
+
+//---------------------------------------------------------------------
+// ensure the trie path of a pattern, NULL for invalid pattern. when
+// literal is set, '*' and '#' segments are plain names.
+//---------------------------------------------------------------------
+static CAsyncTopicNode *async_topic_node_ensure(CAsyncTopic *topic,
+	const char *pattern, int literal)
+{
+	CAsyncTopicNode *node;
+	const char *p = (literal)? NULL : strchr(pattern, '#');
+	for (; p != NULL; p = strchr(p + 1, '#')) {
+		if (p > pattern && p[-1] != '.') continue;
+		if (p[1] == '.') return NULL;    // '#' must be the last segment
+	}
+	if (topic->patterns == NULL) {
+		topic->patterns = async_topic_node_new(NULL, "", 0);
+		if (topic->patterns == NULL) return NULL;
+	}
+	node = topic->patterns;
+	while (1) {
+		const char *end = strchr(pattern, '.');
+		int size = (end)? (int)(end - pattern) : (int)strlen(pattern);
+		CAsyncTopicNode **slot = NULL;
+		CAsyncTopicNode *child = NULL;
+		if (literal == 0 && size == 1 && pattern[0] == '*') {
+			slot = &node->star;
+		}
+		else if (literal == 0 && size == 1 && pattern[0] == '#') {
+			if (end != NULL) return NULL;
+			slot = &node->hash;
+		}
+		if (slot != NULL) {
+			if (*slot == NULL) {
+				*slot = async_topic_node_new(node, pattern, size);
+			}
+			child = *slot;
+		}
+		else {
+			ib_string key;
+			struct ib_hash_entry *entry;
+			key.ptr = (char*)pattern;
+			key.size = size;
+			entry = ib_map_find_str(&node->children, &key);
+			if (entry != NULL) {
+				child = (CAsyncTopicNode*)entry->value;
+			}
+			else {
+				child = async_topic_node_new(node, pattern, size);
+				if (child == NULL) return NULL;
+				if (size == 1 && (pattern[0] == '*' || pattern[0] == '#')) {
+					child->literal = 1;
+				}
+				ib_map_set(&node->children, child->segment, child);
 			}
 		}
+		if (child == NULL) return NULL;
+		node = child;
+		if (end == NULL) break;
+		pattern = end + 1;
+	}
+	return node;
+}
+
+
+//---------------------------------------------------------------------
+// test the subscribers ending at node against a concrete name
+//---------------------------------------------------------------------
+static int async_topic_node_match(CAsyncTopicNode *node, const char *name)
+{
+	if (node->literal) {
+		return (strcmp(node->pattern->ptr, name) == 0)? 1 : 0;
+	}
+	return async_topic_match(node->pattern->ptr, name);
+}
+
+
+//---------------------------------------------------------------------
+// remove empty trie nodes from node up to the root
+//---------------------------------------------------------------------
+static void async_topic_node_prune(CAsyncTopic *topic, CAsyncTopicNode *node)
+{
+	(void)topic;
+	while (node->parent != NULL) {
+		CAsyncTopicNode *parent = node->parent;
+		if (!ilist_is_empty(&node->head)) break;
+		if (node->star || node->hash) break;
+		if (ib_map_count(&node->children) > 0) break;
+		if (parent->star == node) parent->star = NULL;
+		else if (parent->hash == node) parent->hash = NULL;
+		else ib_map_remove(&parent->children, node->segment);
+		async_topic_node_free(node);
+		node = parent;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// collect subscribers of the rest of a name, NULL when consumed
+//---------------------------------------------------------------------
+static void async_topic_node_collect(CAsyncTopicNode *node, 
+	const char *name, ib_array *subs)
+{
+	ilist_head *it;
+	const char *end;
+	if (node->hash != NULL) {
+		ilist_head *head = &node->hash->head;
+		for (it = head->next; it != head; it = it->next) {
+			ib_array_push(subs, ilist_entry(it, CAsyncSubscribe, node));
+		}
+	}
+	if (name == NULL) {
+		for (it = node->head.next; it != &node->head; it = it->next) {
+			ib_array_push(subs, ilist_entry(it, CAsyncSubscribe, node));
+		}
+		return;
+	}
+	end = strchr(name, '.');
+	if (ib_map_count(&node->children) > 0) {
+		struct ib_hash_entry *entry;
+		ib_string key;
+		key.ptr = (char*)name;
+		key.size = (end)? (int)(end - name) : (int)strlen(name);
+		entry = ib_map_find_str(&node->children, &key);
+		if (entry != NULL) {
+			async_topic_node_collect((CAsyncTopicNode*)entry->value,
+					(end)? end + 1 : NULL, subs);
+		}
+	}
+	if (node->star != NULL) {
+		async_topic_node_collect(node->star, (end)? end + 1 : NULL, subs);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// release a cached route
+//---------------------------------------------------------------------
+static void async_topic_route_free(void *ptr)
+{
+	CAsyncTopicRoute *route = (CAsyncTopicRoute*)ptr;
+	ib_string_delete(route->name);
+	ib_array_delete(route->subs);
+	ikmem_free(route);
+}
+
+
+//---------------------------------------------------------------------
+// cached subscriber set of a concrete name
+//---------------------------------------------------------------------
+static CAsyncTopicRoute *async_topic_route_get(CAsyncTopic *topic, 
+	const char *name)
+{
+	CAsyncTopicRoute *route;
+	struct ib_hash_entry *entry;
+	ib_string key;
+	key.ptr = (char*)name;
+	key.size = (int)strlen(name);
+	entry = ib_map_find_str(&topic->routes, &key);
+	if (entry != NULL) {
+		return (CAsyncTopicRoute*)entry->value;
+	}
+	if (topic->patterns == NULL) {
+		return NULL;
+	}
+	if (ib_map_count(&topic->routes) >= ASYNC_TOPIC_ROUTE_LIMIT) {
+		ib_map_clear(&topic->routes);
+	}
+	route = (CAsyncTopicRoute*)ikmem_malloc(sizeof(CAsyncTopicRoute));
+	if (route == NULL) return NULL;
+	route->name = ib_string_new_size(name, key.size);
+	route->subs = ib_array_new(NULL);
+	async_topic_node_collect(topic->patterns, name, route->subs);
+	ib_map_set(&topic->routes, route->name, route);
+	return route;
+}
+
+
+//---------------------------------------------------------------------
+// allocate a payload
+//---------------------------------------------------------------------
+CAsyncPayload *async_payload_new(const void *ptr, int size)
+{
+	CAsyncPayload *payload;
+	if (size < 0) return NULL;
+	payload = (CAsyncPayload*)ikmem_malloc(sizeof(CAsyncPayload) + size + 1);
+	if (payload == NULL) return NULL;
+	payload->refcnt = 1;
+	payload->size = size;
+	payload->data = (char*)(payload + 1);
+	if (ptr != NULL && size > 0) {
+		memcpy(payload->data, ptr, size);
+	}
+	payload->data[size] = '\0';
+	return payload;
+}
+
+
+//---------------------------------------------------------------------
+// add a reference
+//---------------------------------------------------------------------
+CAsyncPayload *async_payload_ref(CAsyncPayload *payload)
+{
+	assert(payload != NULL);
+	IATOMIC_ADD(&payload->refcnt, 1);
+	return payload;
+}
+
+
+//---------------------------------------------------------------------
+// drop a reference
+//---------------------------------------------------------------------
+void async_payload_unref(CAsyncPayload *payload)
+{
+	int count;
+	if (payload == NULL) return;
+	count = IATOMIC_ADD(&payload->refcnt, -1);
+	assert(count > 0);
+	if (count == 1) {
+		ikmem_free(payload);
 	}
 }
 
@@ -218,6 +793,7 @@ void async_sub_init(CAsyncSubscribe *sub, int (*callback)
 	assert(sub != NULL);
 	sub->topic = NULL;
 	sub->tid = -1;
+	sub->pattern = NULL;
 	sub->callback = callback;
 	sub->pending = -1;
 	sub->user = NULL;
@@ -246,815 +822,3378 @@ void async_sub_register(CAsyncTopic *topic, CAsyncSubscribe *sub, int tid)
 
 
 //---------------------------------------------------------------------
-// unregister a subscriber from a topic
+// register a subscriber on the trie, literal for an exact name
 //---------------------------------------------------------------------
-void async_sub_deregister(CAsyncSubscribe *sub)
+static int async_sub_register_node(CAsyncTopic *topic, 
+	CAsyncSubscribe *sub, const char *pattern, int literal)
 {
+	CAsyncTopicNode *node;
+	struct ib_hash_entry *entry;
 	if (sub->topic != NULL) {
-		CAsyncTopic *topic = sub->topic;
-		CAsyncTopicRoot *root = async_topic_root_get(topic, sub->tid);
-		if (sub->pending >= 0) {
-			ib_array_ptr(topic->pendings)[sub->pending] = NULL;
-			sub->pending = -1; // mark as removed
-		}
-		if (root != NULL) {
-			ilist_del_init(&sub->node);
-			sub->pending = -1;
-			sub->topic = NULL;
-			sub->tid = -1;
-			if (ilist_is_empty(&root->head)) {
-				async_topic_root_del(topic, root);
-			}
+		async_sub_deregister(sub);
+	}
+	if (pattern == NULL) {
+		return -1;
+	}
+	node = async_topic_node_ensure(topic, pattern, literal);
+	if (node == NULL) {
+		return -1;
+	}
+	ilist_add_tail(&sub->node, &node->head);
+	sub->tid = -1;
+	sub->pattern = node;
+	sub->topic = topic;
+	// extend the cached routes this pattern covers
+	ib_map_foreach(entry, &topic->routes) {
+		CAsyncTopicRoute *route = (CAsyncTopicRoute*)entry->value;
+		if (async_topic_node_match(node, route->name->ptr)) {
+			ib_array_push(route->subs, sub);
 		}
 	}
+	return 0;
 }
 
 
+//---------------------------------------------------------------------
+// register a subscriber to a hierarchical pattern
+//---------------------------------------------------------------------
+int async_sub_register_pattern(CAsyncTopic *topic, CAsyncSubscribe *sub,
+	const char *pattern)
+{
+	return async_sub_register_node(topic, sub, pattern, 0);
+}
 
-//=====================================================================
-// CAsyncSignal
-//=====================================================================
-
-// current active signal
-static volatile CAsyncSignal *async_signal_current = NULL;
 
-// event handler
-void async_signal_handler(int signum) 
+//---------------------------------------------------------------------
+// register a subscriber to an exact hierarchical name
+//---------------------------------------------------------------------
+int async_sub_register_name(CAsyncTopic *topic, CAsyncSubscribe *sub,
+	const char *name)
 {
-	CAsyncSignal *sig = (CAsyncSignal*)async_signal_current;
-	int retval;
-	if (sig == NULL) return;
-	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) return;
-	if (sig->signaled[signum] != 0) return;
-	if (sig->fd_writer < 0) return;
-#ifdef __unix
-	retval = write(sig->fd_writer, &signum, sizeof(int));
-#else
-	retval = isend(sig->fd_writer, &signum, sizeof(int), 0);
-#endif
-	if (retval == (int)sizeof(int)) {
-		sig->signaled[signum] = 1;
-	}
+	return async_sub_register_node(topic, sub, name, 1);
 }
 
-// reading event
-void async_signal_reading(CAsyncLoop *loop, CAsyncEvent *event, int evt) 
+
+//---------------------------------------------------------------------
+// remove a pattern subscriber from the trie and cached routes
+//---------------------------------------------------------------------
+static void async_sub_deregister_pattern(CAsyncSubscribe *sub)
 {
-	CAsyncSignal *sig = (CAsyncSignal*)event->user;
-	int signum = -1;
-	int retval = 0;
-	(void)loop;
-	(void)evt;
-	if (sig == NULL || sig->fd_reader < 0) return;
-#ifdef __unix
-	retval = read(sig->fd_reader, &signum, sizeof(int));
-#else
-	retval = irecv(sig->fd_reader, &signum, sizeof(int), 0);
-#endif
-	if (retval != (int)sizeof(int)) return;
-	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) return;
-	sig->signaled[signum] = 0; // reset the signaled state
-	if (sig->callback) {
-		sig->callback(sig, signum);
+	CAsyncTopic *topic = sub->topic;
+	CAsyncTopicNode *node = sub->pattern;
+	struct ib_hash_entry *entry;
+	ib_map_foreach(entry, &topic->routes) {
+		CAsyncTopicRoute *route = (CAsyncTopicRoute*)entry->value;
+		if (async_topic_node_match(node, route->name->ptr)) {
+			void **items = ib_array_ptr(route->subs);
+			size_t index, count = ib_array_size(route->subs);
+			for (index = 0; index < count; index++) {
+				if (items[index] == (void*)sub) {
+					ib_array_remove(route->subs, index);
+					break;
+				}
+			}
+		}
 	}
+	ilist_del_init(&sub->node);
+	sub->pending = -1;
+	sub->topic = NULL;
+	sub->pattern = NULL;
+	async_topic_node_prune(topic, node);
 }
 
-// create a new signal object
-CAsyncSignal *async_signal_new(CAsyncLoop *loop, 
-	void (*callback)(CAsyncSignal *signal, int signum))
+
+//---------------------------------------------------------------------
+// unregister a subscriber from a topic
+//---------------------------------------------------------------------
+void async_sub_deregister(CAsyncSubscribe *sub)
 {
-	CAsyncSignal *sig;
-	int i, fds[2];
-	sig = (CAsyncSignal*)ikmem_malloc(sizeof(CAsyncSignal));
-	if (sig == NULL) return NULL;
-	sig->loop = loop;
-	sig->callback = callback;
-	sig->user = NULL;
-	sig->active = 0;
-	for (i = 0; i < CASYNC_SIGNAL_MAX; i++) {
-		sig->installed[i] = 0;
-		sig->signaled[i] = 0;
-	}
-	sig->fd_reader = -1;
-	sig->fd_writer = -1;
-	async_event_init(&sig->evt_read, async_signal_reading, -1, 0);
-	sig->evt_read.user = sig;
-#ifdef __unix
-	int retval = pipe(fds);
-	if (fds[0] >= 0 && retval >= 0) {
-		isocket_enable(fds[0], ISOCK_CLOEXEC);
-		isocket_enable(fds[1], ISOCK_CLOEXEC);
-	}
-#else
-	if (isocket_pair(fds, 1) != 0) {
-		int ok = 0, i;
-		for (i = 0; i < 15; i++) {
-			isleep(10);
-			if (isocket_pair(fds, 1) == 0) {
-				ok = 1;
-				break;
-			}
+	if (sub->topic != NULL) {
+		CAsyncTopic *topic = sub->topic;
+		CAsyncTopicRoot *root = NULL;
+		if (sub->pending >= 0) {
+			ib_array_ptr(topic->pendings)[sub->pending] = NULL;
+			sub->pending = -1; // mark as removed
 		}
-		if (ok == 0) {
-			fds[0] = -1;
-			fds[1] = -1;
+		if (sub->pattern != NULL) {
+			async_sub_deregister_pattern(sub);
+			return;
+		}
+		root = async_topic_root_get(topic, sub->tid);
+		if (root != NULL) {
+			ilist_del_init(&sub->node);
+			sub->pending = -1;
+			sub->topic = NULL;
+			sub->tid = -1;
+			if (ilist_is_empty(&root->head)) {
+				async_topic_root_del(topic, root);
+			}
 		}
 	}
-	if (fds[0] >= 0) {
-		isocket_disable(fds[0], ISOCK_NOBLOCK);
-		isocket_disable(fds[1], ISOCK_NOBLOCK);
-	}
-#endif
-	sig->fd_reader = fds[0];
-	sig->fd_writer = fds[1];
-	async_event_set(&sig->evt_read, sig->fd_reader, ASYNC_EVENT_READ);
-	return sig;
 }
 
 
-// delete signal object
-void async_signal_delete(CAsyncSignal *sig)
+
+//=====================================================================
+// CAsyncBus
+//=====================================================================
+
+// message in a port inbox: nodes of one publish live in the same block
+// as the payload and the name, each node holds a payload reference
+typedef struct CAsyncBusMessage {
+	struct CAsyncBusMessage *next;
+	int tid;
+	IINT32 wparam;
+	IINT32 lparam;
+	CAsyncPayload *payload;
+	const char *name;     // NULL when tid >= 0
+}	CAsyncBusMessage;
+
+// immutable array of ports, shared by publishers with a refcount
+typedef struct CAsyncBusSnapshot {
+	struct CAsyncBusSnapshot *next;   // link in bus->retired
+	int refcnt;
+	int count;
+	CAsyncBusPort *ports[1];
+}	CAsyncBusSnapshot;
+
+static void async_bus_port_evt_sem(CAsyncLoop *loop, CAsyncSemaphore *sem);
+
+
+//---------------------------------------------------------------------
+// build a snapshot of bus->ports, called with the lock held
+//---------------------------------------------------------------------
+static CAsyncBusSnapshot *async_bus_snapshot_new(CAsyncBus *bus)
 {
-	assert(sig);
-	if (sig->active) {
-		async_signal_stop(sig);
+	CAsyncBusSnapshot *snap;
+	ilist_head *it;
+	int count = 0;
+	snap = (CAsyncBusSnapshot*)ikmem_malloc(sizeof(CAsyncBusSnapshot) +
+			sizeof(CAsyncBusPort*) * bus->count);
+	if (snap == NULL) return NULL;
+	for (it = bus->ports.next; it != &bus->ports; it = it->next) {
+		snap->ports[count++] = ilist_entry(it, CAsyncBusPort, node);
 	}
-	if (async_event_is_active(&sig->evt_read)) {
-		async_event_stop(sig->loop, &sig->evt_read);
-	}
-	if (sig->fd_reader >= 0) {
-		iclose(sig->fd_reader);
-		sig->fd_reader = -1;
+	snap->next = NULL;
+	snap->refcnt = 1;
+	snap->count = count;
+	return snap;
+}
+
+
+//---------------------------------------------------------------------
+// port list changed: retire the current snapshot and build a new one,
+// called with the lock held. a failed build leaves NULL, the next
+// publisher retries it.
+//---------------------------------------------------------------------
+static void async_bus_snapshot_swap(CAsyncBus *bus)
+{
+	CAsyncBusSnapshot *old = (CAsyncBusSnapshot*)bus->snapshot;
+	if (old != NULL) {
+		old->next = (CAsyncBusSnapshot*)bus->retired;
+		bus->retired = old;
 	}
-	if (sig->fd_writer >= 0) {
-		iclose(sig->fd_writer);
-		sig->fd_writer = -1;
+	bus->snapshot = async_bus_snapshot_new(bus);
+}
+
+
+//---------------------------------------------------------------------
+// free retired snapshots no publisher holds any more, called with the
+// lock held, returns how many are still in use
+//---------------------------------------------------------------------
+static int async_bus_snapshot_reclaim(CAsyncBus *bus)
+{
+	CAsyncBusSnapshot **link = (CAsyncBusSnapshot**)&bus->retired;
+	int inuse = 0;
+	while (link[0] != NULL) {
+		CAsyncBusSnapshot *snap = link[0];
+		if (IATOMIC_LOAD(&snap->refcnt) > 1) {
+			link = &snap->next;
+			inuse++;
+			continue;
+		}
+		link[0] = snap->next;
+		ikmem_free(snap);
 	}
-	sig->loop = NULL;
-	sig->user = NULL;
-	sig->callback = NULL;
-	ikmem_free(sig);
+	return inuse;
 }
 
 
-// start wating system signals, only one CAsyncSignal
-// can be started at the same time.
-int async_signal_start(CAsyncSignal *sig)
+//---------------------------------------------------------------------
+// get the current snapshot with a reference, NULL if out of memory
+//---------------------------------------------------------------------
+static CAsyncBusSnapshot *async_bus_snapshot_get(CAsyncBus *bus)
 {
-	int i;
-	if (async_signal_current != NULL) {
-		// another signal is already active
-		return -1;
+	CAsyncBusSnapshot *snap;
+	IMUTEX_LOCK(&bus->lock);
+	if (bus->snapshot == NULL) {
+		bus->snapshot = async_bus_snapshot_new(bus);
 	}
-	if (sig->active) {
-		// already started
-		return -2;
+	snap = (CAsyncBusSnapshot*)bus->snapshot;
+	if (snap != NULL) {
+		IATOMIC_ADD(&snap->refcnt, 1);
 	}
-	async_signal_current = sig;
-	for (i = 0; i < CASYNC_SIGNAL_MAX; i++) {
-		if (sig->installed[i] == 1) {
-			signal(i, async_signal_handler);
-		}
-		else if (sig->installed[i] == 2) {
-			signal(i, SIG_IGN);
-		}
+	IMUTEX_UNLOCK(&bus->lock);
+	return snap;
+}
+
+
+//---------------------------------------------------------------------
+// drop a reference got from async_bus_snapshot_get, the last one is
+// always kept by the bus (current or retired)
+//---------------------------------------------------------------------
+static void async_bus_snapshot_put(CAsyncBusSnapshot *snap)
+{
+	int count = IATOMIC_ADD(&snap->refcnt, -1);
+	assert(count > 1);
+	(void)count;
+}
+
+
+//---------------------------------------------------------------------
+// create a new bus
+//---------------------------------------------------------------------
+CAsyncBus *async_bus_new(void)
+{
+	CAsyncBus *bus = (CAsyncBus*)ikmem_malloc(sizeof(CAsyncBus));
+	if (bus == NULL) return NULL;
+	IMUTEX_INIT(&bus->lock);
+	ilist_init(&bus->ports);
+	bus->count = 0;
+	bus->snapshot = NULL;
+	bus->retired = NULL;
+	return bus;
+}
+
+
+//---------------------------------------------------------------------
+// delete a bus
+//---------------------------------------------------------------------
+void async_bus_delete(CAsyncBus *bus)
+{
+	assert(bus != NULL);
+	assert(ilist_is_empty(&bus->ports));
+	async_bus_snapshot_reclaim(bus);
+	assert(bus->retired == NULL);
+	if (bus->snapshot != NULL) {
+		ikmem_free(bus->snapshot);
 	}
-	if (async_event_is_active(&sig->evt_read)) {
-		async_event_stop(sig->loop, &sig->evt_read);
+	IMUTEX_DESTROY(&bus->lock);
+	ikmem_free(bus);
+}
+
+
+//---------------------------------------------------------------------
+// push a message into the inbox, wake the loop up when it was empty
+//---------------------------------------------------------------------
+static void async_bus_port_push(CAsyncBusPort *port, CAsyncBusMessage *msg)
+{
+	void *head;
+	do {
+		head = IATOMIC_LOAD_PTR(&port->inbox);
+		msg->next = (CAsyncBusMessage*)head;
+	}	while (!IATOMIC_CAS_PTR(&port->inbox, head, msg));
+	if (head == NULL) {
+		async_sem_post(&port->evt_sem);
 	}
-	async_event_start(sig->loop, &sig->evt_read);
-	sig->active = 1;
-	return 0;
 }
 
-// stop from the system signal interface
-int async_signal_stop(CAsyncSignal *sig)
+
+//---------------------------------------------------------------------
+// deliver a message to every port of the snapshot: one block holds
+// the nodes, the payload and the name, freed with the last payload
+// reference (nodes and topic records)
+//---------------------------------------------------------------------
+static int async_bus_dispatch(CAsyncBus *bus, int tid, const char *name,
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
 {
+	CAsyncBusSnapshot *snap;
+	CAsyncBusMessage *nodes;
+	CAsyncPayload *payload;
+	size_t head, need;
+	int namelen = (name)? (int)strlen(name) : 0;
 	int i;
-	if (async_signal_current != sig) {
-		// not the current signal
+	if (size < 0 || (ptr == NULL && size > 0)) {
 		return -1;
 	}
-	if (sig->active == 0) {
-		// not started
+	snap = async_bus_snapshot_get(bus);
+	if (snap == NULL) {
 		return -2;
 	}
-	if (async_event_is_active(&sig->evt_read)) {
-		async_event_stop(sig->loop, &sig->evt_read);
+	if (snap->count == 0) {
+		async_bus_snapshot_put(snap);
+		return 0;
 	}
-	for (i = 0; i < CASYNC_SIGNAL_MAX; i++) {
-		if (sig->installed[i]) {
-			signal(i, SIG_DFL);
-		}
+	head = sizeof(CAsyncPayload) + size + 1 + ((name)? namelen + 1 : 0);
+	head = (head + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	need = head + sizeof(CAsyncBusMessage) * snap->count;
+	payload = (CAsyncPayload*)ikmem_malloc(need);
+	if (payload == NULL) {
+		async_bus_snapshot_put(snap);
+		return -2;
 	}
-	async_signal_current = NULL;
-	sig->active = 0;
-	return 0;
-}
-
-// install a system signal
-int async_signal_install(CAsyncSignal *sig, int signum)
-{
-	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) {
-		return -1;
+	payload->refcnt = snap->count;
+	payload->size = size;
+	payload->data = (char*)(payload + 1);
+	if (size > 0) {
+		memcpy(payload->data, ptr, size);
 	}
-	if (sig->active == 0) {
-		sig->installed[signum] = 1;
+	payload->data[size] = '\0';
+	if (name) {
+		memcpy(payload->data + size + 1, name, namelen + 1);
 	}
-	else {
-		sig->installed[signum] = 1;
-		signal(signum, async_signal_handler);
+	nodes = (CAsyncBusMessage*)(((char*)payload) + head);
+	for (i = 0; i < snap->count; i++) {
+		CAsyncBusMessage *msg = &nodes[i];
+		msg->tid = tid;
+		msg->wparam = wparam;
+		msg->lparam = lparam;
+		msg->payload = payload;
+		msg->name = (name)? payload->data + size + 1 : NULL;
+		async_bus_port_push(snap->ports[i], msg);
 	}
+	async_bus_snapshot_put(snap);
 	return 0;
 }
 
-// ignore a system signal
-int async_signal_ignore(CAsyncSignal *sig, int signum)
+
+//---------------------------------------------------------------------
+// publish a message to every port
+//---------------------------------------------------------------------
+int async_bus_publish(CAsyncBus *bus, int tid, 
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
 {
-	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) {
+	if (tid < 0) {
 		return -1;
 	}
-	if (sig->active == 0) {
-		sig->installed[signum] = 2;
-	}
-	else {
-		sig->installed[signum] = 2;
-		signal(signum, SIG_IGN);
-	}
-	return 0;
+	return async_bus_dispatch(bus, tid, NULL, wparam, lparam, ptr, size);
 }
 
-// remove a system signal
-int async_signal_remove(CAsyncSignal *sig, int signum)
+
+//---------------------------------------------------------------------
+// publish to a hierarchical name on every port
+//---------------------------------------------------------------------
+int async_bus_publish_name(CAsyncBus *bus, const char *name,
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
 {
-	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) {
+	if (name == NULL) {
 		return -1;
 	}
-	if (sig->active == 0) {
-		sig->installed[signum] = 0;
-	}
-	else {
-		sig->installed[signum] = 0;
-		signal(signum, SIG_DFL);
-	}
-	return 0;
+	return async_bus_dispatch(bus, -1, name, wparam, lparam, ptr, size);
 }
 
 
 //---------------------------------------------------------------------
-// easy default
+// take the whole inbox in publish order
 //---------------------------------------------------------------------
-static CAsyncSignal *_async_signal_default = NULL;
-
-// default handler for _async_signal_default
-static void async_signal_default_handler(CAsyncSignal *signal, int signum)
+static CAsyncBusMessage *async_bus_port_take(CAsyncBusPort *port)
 {
-	if (signum == SIGINT || signum == SIGTERM) {
-		async_loop_exit(signal->loop);
-	}
-#ifdef SIGQUIT
-	else if (signum == SIGQUIT) {
-		async_loop_exit(signal->loop);
+	CAsyncBusMessage *msg, *list = NULL;
+	msg = (CAsyncBusMessage*)IATOMIC_XCHG_PTR(&port->inbox, NULL);
+	while (msg != NULL) {
+		CAsyncBusMessage *next = msg->next;
+		msg->next = list;
+		list = msg;
+		msg = next;
 	}
-#endif
+	return list;
 }
 
-// for atexit
-static void async_signal_cleanup(void)
+
+//---------------------------------------------------------------------
+// create a port of the bus for the loop
+//---------------------------------------------------------------------
+CAsyncBusPort *async_bus_port_new(CAsyncBus *bus, CAsyncLoop *loop)
 {
-	if (_async_signal_default) {
-		if (_async_signal_default->active) {
-			async_signal_stop(_async_signal_default);
-		}
-		async_signal_delete(_async_signal_default);
-		_async_signal_default = NULL;
+	CAsyncBusPort *port;
+	port = (CAsyncBusPort*)ikmem_malloc(sizeof(CAsyncBusPort));
+	if (port == NULL) return NULL;
+	port->topic = async_topic_new(loop);
+	if (port->topic == NULL) {
+		ikmem_free(port);
+		return NULL;
 	}
+	port->bus = bus;
+	port->loop = loop;
+	port->inbox = NULL;
+	port->user = NULL;
+	port->num_batches = 0;
+	port->num_messages = 0;
+	async_sem_init(&port->evt_sem, async_bus_port_evt_sem);
+	port->evt_sem.user = port;
+	async_sem_start(loop, &port->evt_sem);
+	IMUTEX_LOCK(&bus->lock);
+	ilist_add_tail(&port->node, &bus->ports);
+	bus->count++;
+	async_bus_snapshot_swap(bus);
+	async_bus_snapshot_reclaim(bus);
+	IMUTEX_UNLOCK(&bus->lock);
+	return port;
 }
 
-// install default handler for a CAsyncLoop
-int async_signal_default(CAsyncLoop *loop)
+
+//---------------------------------------------------------------------
+// delete the port
+//---------------------------------------------------------------------
+void async_bus_port_delete(CAsyncBusPort *port)
 {
-	static int inited = 0;
-	if (inited == 0) {
-		atexit(async_signal_cleanup);
-		inited = 1;
+	CAsyncBus *bus = port->bus;
+	CAsyncBusMessage *msg;
+	int inuse;
+	IMUTEX_LOCK(&bus->lock);
+	ilist_del_init(&port->node);
+	bus->count--;
+	async_bus_snapshot_swap(bus);
+	inuse = async_bus_snapshot_reclaim(bus);
+	IMUTEX_UNLOCK(&bus->lock);
+	// publishers holding a retired snapshot may still push to the port
+	while (inuse > 0) {
+		isleep(0);
+		IMUTEX_LOCK(&bus->lock);
+		inuse = async_bus_snapshot_reclaim(bus);
+		IMUTEX_UNLOCK(&bus->lock);
 	}
-	if (_async_signal_default != NULL) {
-		if (_async_signal_default->active) {
-			async_signal_stop(_async_signal_default);
-		}
-		async_signal_delete(_async_signal_default);
-		_async_signal_default = NULL;
+	// no publisher can reach the port any more
+	if (async_sem_is_active(&port->evt_sem)) {
+		async_sem_stop(port->loop, &port->evt_sem);
 	}
-	if (loop != NULL) {
-		CAsyncSignal *signal = async_signal_new(loop, 
-				async_signal_default_handler);
-		if (signal == NULL) {
-			return -1;
-		}
-		async_signal_install(signal, SIGINT);
-		async_signal_install(signal, SIGTERM);
-	#ifdef SIGQUIT
-		async_signal_install(signal, SIGQUIT);
-	#endif
-	#ifdef __unix
-		async_signal_ignore(signal, SIGPIPE);
-	#endif
-		async_signal_start(signal);
-		_async_signal_default = signal;
+	async_sem_destroy(&port->evt_sem);
+	msg = async_bus_port_take(port);
+	while (msg != NULL) {
+		CAsyncBusMessage *next = msg->next;
+		async_payload_unref(msg->payload);
+		msg = next;
 	}
-	return 0;
+	async_topic_delete(port->topic);
+	ikmem_free(port);
 }
 
 
-//=====================================================================
-// CAsyncCodec - protocol codec for CAsyncStream
-//=====================================================================
-
 //---------------------------------------------------------------------
-// apply pending zonebuf resize (called after zone_clear when zone is empty)
+// drain the inbox into the local topic, which dispatches the batch
+// after this iteration
 //---------------------------------------------------------------------
-static void async_codec_apply_zone_resize(CAsyncCodec *codec)
+static void async_bus_port_evt_sem(CAsyncLoop *loop, CAsyncSemaphore *sem)
 {
-	size_t new_size = codec->pending_resize;
-	codec->pending_resize = 0;
-
-	ib_zone_destroy(&codec->zone);
-	if (codec->zonebuf) {
-		ikmem_free(codec->zonebuf);
-		codec->zonebuf = NULL;
-		codec->zonebuf_size = 0;
+	CAsyncBusPort *port = (CAsyncBusPort*)sem->user;
+	CAsyncBusMessage *msg = async_bus_port_take(port);
+	(void)loop;
+	if (msg != NULL) {
+		port->num_batches++;
 	}
-
-	if (new_size > 0) {
-		codec->zonebuf = ikmem_malloc(new_size);
-		if (codec->zonebuf) {
-			codec->zonebuf_size = new_size;
+	while (msg != NULL) {
+		CAsyncBusMessage *next = msg->next;
+		if (msg->tid >= 0) {
+			async_topic_publish_payload(port->topic, msg->tid, 
+					msg->wparam, msg->lparam, msg->payload);
 		}
 		else {
-			codec->zonebuf_size = 0;
+			async_topic_publish_name_payload(port->topic, 
+					msg->name, msg->wparam, msg->lparam, 
+					msg->payload);
 		}
+		async_payload_unref(msg->payload);
+		port->num_messages++;
+		msg = next;
 	}
-
-	ib_zone_init(&codec->zone, codec->zonebuf,
-			(size_t)codec->zonebuf_size, &codec->alloc);
-	ib_zone_setup(&codec->zone, &codec->alloc);
 }
 
 
-//---------------------------------------------------------------------
-// internal: dispatch decoded objects to receiver
-//---------------------------------------------------------------------
-static void async_codec_dispatch_reading(CAsyncCodec *codec)
-{
-	ib_object *obj = NULL;
-	int rc;
-
-	while (codec->releasing == 0 && codec->error == 0) {
-		rc = 0;
-		obj = NULL;
-
-		switch (codec->codec) {
-		case ASYNC_CODEC_RESP:
-			rc = ib_resp_reader_read(
-					(ib_resp_reader*)codec->reader, &obj, &codec->alloc);
-			break;
-		case ASYNC_CODEC_MSGPACK:
-			rc = ib_msgpack_reader_read(
-					(ib_msgpack_reader*)codec->reader, &obj, &codec->alloc);
-			break;
-		case ASYNC_CODEC_JSON:
-			rc = ib_json_reader_read(
-					(ib_json_reader*)codec->reader, &obj, &codec->alloc);
-			break;
-		default:
-			return;
-		}
-
-		if (rc == 0) break;       // incomplete, need more data
-		if (rc < 0) {              // protocol error
-			codec->error = 1;
-			codec->busy = 1;
-			if (codec->callback)
-				codec->callback(codec, ASYNC_CODEC_EVT_ERROR);
-			codec->busy = 0;
-			if (codec->releasing) {
-				async_codec_delete(codec);
-			}
-			return;
-		}
 
-		// rc == 1: decoded successfully
-		codec->busy = 1;
-		if (codec->receiver)
-			codec->receiver(codec, obj);
-		codec->busy = 0;
+//=====================================================================
+// CAsyncSignal
+//=====================================================================
 
-		// release decoded object and reclaim zone
-		ib_zone_clear(&codec->zone);
+#if ASYNC_SIGNAL_SIGNALFD
+#include <sys/signalfd.h>
+#include <pthread.h>
+#endif
 
-		// user called delete in receiver?
-		if (codec->releasing) {
-			async_codec_delete(codec);
-			return;
-		}
+#ifdef __unix
+#include <sys/wait.h>
+#endif
 
-		// apply pending zonebuf resize now that zone is empty
-		if (codec->pending_resize > 0) {
-			async_codec_apply_zone_resize(codec);
-		}
+// current active signal (handler backend)
+static volatile CAsyncSignal *async_signal_current = NULL;
 
-		// check if stream read is still enabled
-		if ((codec->stream->enabled & ASYNC_EVENT_READ) == 0) {
-			break;
-		}
+// queue signum to the reader end, coalesced until it's dispatched
+static void async_signal_notify(CAsyncSignal *sig, int signum)
+{
+	int retval;
+	if (sig->fd_writer < 0) return;
+	if (IATOMIC_XCHG(&sig->signaled[signum], 1) != 0) return;
+#ifdef __unix
+	retval = write(sig->fd_writer, &signum, sizeof(int));
+#else
+	retval = isend(sig->fd_writer, &signum, sizeof(int), 0);
+#endif
+	if (retval != (int)sizeof(int)) {
+		IATOMIC_STORE(&sig->signaled[signum], 0);
 	}
 }
 
+// event handler
+void async_signal_handler(int signum) 
+{
+	CAsyncSignal *sig = (CAsyncSignal*)async_signal_current;
+	if (sig == NULL) return;
+	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) return;
+	async_signal_notify(sig, signum);
+}
+
 
+#if ASYNC_SIGNAL_SIGNALFD
 //---------------------------------------------------------------------
-// stream event callback
+// signalfd backend: one signalfd shared by every started object, the
+// loop that wins the read fans siginfo out to all subscribers.
 //---------------------------------------------------------------------
-static void async_codec_callback(CAsyncStream *stream, int event, int args)
-{
-	CAsyncCodec *codec = (CAsyncCodec*)stream->user;
-	(void)args;
-
-	if (codec == NULL) return;
+static pthread_mutex_t async_signal_lock = PTHREAD_MUTEX_INITIALIZER;
+static ilist_head async_signal_list = ILIST_HEAD_INIT(async_signal_list);
+static sigset_t async_signal_mask;
+static int async_signal_sfd = -1;
 
-	// state event callback (ESTAB/EOF etc)
-	if (codec->callback) {
-		codec->busy = 1;
-		codec->callback(codec, event);
-		codec->busy = 0;
-		if (codec->releasing) {
-			async_codec_delete(codec);
-			return;
+// rebuild the signalfd mask from started objects, must hold the lock
+static int async_signal_update(void)
+{
+	sigset_t mask, gone;
+	ilist_head *it;
+	int i, changed = 0;
+	sigemptyset(&mask);
+	sigemptyset(&gone);
+	for (it = async_signal_list.next; it != &async_signal_list; ) {
+		CAsyncSignal *sig = ilist_entry(it, CAsyncSignal, node);
+		it = it->next;
+		for (i = 1; i < CASYNC_SIGNAL_MAX && i < NSIG; i++) {
+			if (sig->installed[i] == 1 && i != SIGKILL && i != SIGSTOP) {
+				sigaddset(&mask, i);
+			}
+		}
+	}
+	if (async_signal_sfd < 0) {
+		sigemptyset(&async_signal_mask);
+	}
+	for (i = 1; i < CASYNC_SIGNAL_MAX && i < NSIG; i++) {
+		int x = sigismember(&async_signal_mask, i);
+		int y = sigismember(&mask, i);
+		if (x == 1 && y != 1) {
+			sigaddset(&gone, i);
+			changed = 1;
 		}
+		else if (x != 1 && y == 1) {
+			changed = 1;
+		}
+	}
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	if (async_signal_sfd < 0) {
+		int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (fd < 0) return -1;
+		async_signal_sfd = fd;
 	}
+	else if (changed) {
+		if (signalfd(async_signal_sfd, &mask, 0) < 0) return -2;
+	}
+	pthread_sigmask(SIG_UNBLOCK, &gone, NULL);
+	async_signal_mask = mask;
+	return 0;
+}
 
-	// data arrived
-	if (event & ASYNC_STREAM_EVT_READING) {
-		char *data = codec->loop->cache;
-		long size = async_stream_read(stream, data, ASYNC_LOOP_BUFFER_SIZE);
-		if (size > 0) {
-			switch (codec->codec) {
-			case ASYNC_CODEC_RESP:
-				ib_resp_reader_feed(
-						(ib_resp_reader*)codec->reader, data, size);
-				break;
-			case ASYNC_CODEC_MSGPACK:
-				ib_msgpack_reader_feed(
-						(ib_msgpack_reader*)codec->reader, data, size);
-				break;
-			case ASYNC_CODEC_JSON:
-				ib_json_reader_feed(
-						(ib_json_reader*)codec->reader, data, size);
-				break;
+// drain the shared signalfd in batches
+static void async_signal_draining(CAsyncLoop *loop, CAsyncEvent *event, 
+	int evt)
+{
+	CAsyncSignal *sig = (CAsyncSignal*)event->user;
+	struct signalfd_siginfo info[ASYNC_SIGNAL_BATCH];
+	(void)loop;
+	(void)evt;
+	while (1) {
+		ilist_head *it;
+		int count, i;
+		long hr = (long)read(event->fd, info, sizeof(info));
+		if (hr < (long)sizeof(info[0])) break;	// another loop took them
+		count = (int)(hr / sizeof(info[0]));
+		pthread_mutex_lock(&async_signal_lock);
+		for (i = 0; i < count; i++) {
+			int signum = (int)info[i].ssi_signo;
+			if (signum <= 0 || signum >= CASYNC_SIGNAL_MAX) continue;
+			for (it = async_signal_list.next; it != &async_signal_list; ) {
+				CAsyncSignal *s = ilist_entry(it, CAsyncSignal, node);
+				it = it->next;
+				if (s->installed[signum] == 1) {
+					async_signal_notify(s, signum);
+				}
 			}
 		}
-		async_codec_dispatch_reading(codec);
+		pthread_mutex_unlock(&async_signal_lock);
+		sig->num_signals += count;
+		if (count < ASYNC_SIGNAL_BATCH) break;
 	}
 }
 
+// join the started list and watch the shared signalfd
+static int async_signal_attach(CAsyncSignal *sig)
+{
+	int hr;
+	pthread_mutex_lock(&async_signal_lock);
+	ilist_add_tail(&sig->node, &async_signal_list);
+	hr = async_signal_update();
+	if (hr != 0) {
+		ilist_del_init(&sig->node);
+		if (ilist_is_empty(&async_signal_list) && async_signal_sfd >= 0) {
+			close(async_signal_sfd);
+			async_signal_sfd = -1;
+		}
+		pthread_mutex_unlock(&async_signal_lock);
+		return -3;
+	}
+	async_event_set(&sig->evt_signal, async_signal_sfd, ASYNC_EVENT_READ);
+	async_event_start(sig->loop, &sig->evt_signal);
+	pthread_mutex_unlock(&async_signal_lock);
+	return 0;
+}
 
-//---------------------------------------------------------------------
-// create a new codec
-//---------------------------------------------------------------------
-CAsyncCodec *async_codec_new(CAsyncStream *stream, int codec_type,
-		int borrow,
-		void (*callback)(CAsyncCodec *codec, int event),
-		void (*receiver)(CAsyncCodec *codec, const ib_object *obj))
+// leave the started list, the last one closes the signalfd
+static void async_signal_detach(CAsyncSignal *sig)
 {
-	CAsyncCodec *codec;
+	pthread_mutex_lock(&async_signal_lock);
+	if (async_event_is_active(&sig->evt_signal)) {
+		async_event_stop(sig->loop, &sig->evt_signal);
+	}
+	ilist_del_init(&sig->node);
+	if (ilist_is_empty(&async_signal_list)) {
+		sigset_t mask = async_signal_mask;
+		if (async_signal_sfd >= 0) {
+			close(async_signal_sfd);
+			async_signal_sfd = -1;
+		}
+		sigemptyset(&async_signal_mask);
+		pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+	}
+	else {
+		async_signal_update();
+	}
+	pthread_mutex_unlock(&async_signal_lock);
+}
 
-	assert(stream);
-	assert(stream->loop);
+// apply installed[] changes of a started object
+static void async_signal_refresh(CAsyncSignal *sig)
+{
+	(void)sig;
+	pthread_mutex_lock(&async_signal_lock);
+	async_signal_update();
+	pthread_mutex_unlock(&async_signal_lock);
+}
+#endif
 
-	codec = (CAsyncCodec*)ikmem_malloc(sizeof(CAsyncCodec));
-	if (codec == NULL) return NULL;
 
-	memset(codec, 0, sizeof(CAsyncCodec));
+// children are collected for child() or CAsyncProcess
+#define async_signal_reaping_on(sig) \
+	((sig)->child != NULL || (sig)->processes != NULL)
 
-	codec->loop = stream->loop;
-	codec->stream = stream;
-	codec->borrow = borrow;
-	codec->codec = codec_type;
-	codec->callback = callback;
-	codec->receiver = receiver;
+static void async_process_exited(CAsyncProcess *proc, int status);
 
-	// allocate zonebuf
-	codec->zonebuf = ikmem_malloc(ASYNC_CODEC_ZONE_SIZE);
-	if (codec->zonebuf == NULL) {
-		ikmem_free(codec);
-		return NULL;
+// max pids collected per pass over the registered processes
+#ifndef ASYNC_SIGNAL_REAP_BATCH
+#define ASYNC_SIGNAL_REAP_BATCH   64
+#endif
+
+// collect exited children: every child when child() is set, otherwise
+// the registered processes only
+static void async_signal_reaping(CAsyncSignal *sig)
+{
+#ifdef __unix
+	while (sig->child != NULL && sig->releasing == 0) {
+		CAsyncProcess *proc = NULL;
+		int status = 0;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+		if (pid < 0 && errno == EINTR) continue;
+		if (pid <= 0) break;
+		sig->num_reaped++;
+		if (sig->processes != NULL) {
+			void *key = (void*)((size_t)pid);
+			proc = (CAsyncProcess*)ib_map_get(sig->processes, key);
+			if (proc != NULL) {
+				ib_map_remove(sig->processes, key);
+			}
+		}
+		if (proc != NULL) {
+			async_process_exited(proc, status);
+		}
+		else if (sig->child != NULL) {
+			sig->child(sig, (int)pid, status);
+		}
 	}
-	codec->zonebuf_size = ASYNC_CODEC_ZONE_SIZE;
+	while (sig->child == NULL && sig->processes != NULL && 
+			sig->releasing == 0) {
+		int pids[ASYNC_SIGNAL_REAP_BATCH];
+		int states[ASYNC_SIGNAL_REAP_BATCH];
+		struct ib_hash_entry *entry;
+		int count = 0, i;
+		// the map can change in exit callbacks, collect pids first
+		ib_map_foreach(entry, sig->processes) {
+			CAsyncProcess *proc = (CAsyncProcess*)entry->value;
+			int status = 0;
+			pid_t pid = waitpid((pid_t)proc->pid, &status, WNOHANG);
+			while (pid < 0 && errno == EINTR) {
+				pid = waitpid((pid_t)proc->pid, &status, WNOHANG);
+			}
+			if (pid <= 0) continue;
+			pids[count] = (int)pid;
+			states[count] = status;
+			if (++count >= ASYNC_SIGNAL_REAP_BATCH) break;
+		}
+		if (count == 0) break;
+		sig->num_reaped += count;
+		for (i = 0; i < count && sig->releasing == 0; i++) {
+			void *key = (void*)((size_t)pids[i]);
+			CAsyncProcess *proc = NULL;
+			if (sig->processes != NULL) {
+				proc = (CAsyncProcess*)ib_map_get(sig->processes, key);
+			}
+			if (proc != NULL) {
+				ib_map_remove(sig->processes, key);
+				async_process_exited(proc, states[i]);
+			}
+		}
+	}
+#else
+	(void)sig;
+#endif
+}
 
-	// init zone with static page
+static void async_signal_release(CAsyncSignal *sig);
+
+// reading event
+void async_signal_reading(CAsyncLoop *loop, CAsyncEvent *event, int evt) 
+{
+	CAsyncSignal *sig = (CAsyncSignal*)event->user;
+	int signums[64];
+	int retval = 0, count, i;
+	(void)loop;
+	(void)evt;
+	if (sig == NULL || sig->fd_reader < 0) return;
+#ifdef __unix
+	retval = read(sig->fd_reader, signums, sizeof(signums));
+#else
+	retval = irecv(sig->fd_reader, signums, sizeof(int), 0);
+#endif
+	if (retval < (int)sizeof(int)) return;
+	count = retval / (int)sizeof(int);
+	sig->busy++;
+	for (i = 0; i < count && sig->releasing == 0; i++) {
+		int signum = signums[i];
+		if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) continue;
+		IATOMIC_STORE(&sig->signaled[signum], 0); // reset the signaled state
+	#ifdef SIGCHLD
+		if (signum == SIGCHLD && async_signal_reaping_on(sig)) {
+			async_signal_reaping(sig);
+			continue;
+		}
+	#endif
+		if (sig->callback) {
+			sig->callback(sig, signum);
+		}
+	}
+	sig->busy--;
+	if (sig->busy == 0 && sig->releasing) {
+		async_signal_release(sig);
+	}
+}
+
+// create a new signal object
+CAsyncSignal *async_signal_new(CAsyncLoop *loop, 
+	void (*callback)(CAsyncSignal *signal, int signum))
+{
+	CAsyncSignal *sig;
+	int i, fds[2];
+	sig = (CAsyncSignal*)ikmem_malloc(sizeof(CAsyncSignal));
+	if (sig == NULL) return NULL;
+	sig->loop = loop;
+	sig->callback = callback;
+	sig->child = NULL;
+	sig->user = NULL;
+	sig->active = 0;
+	sig->busy = 0;
+	sig->releasing = 0;
+	sig->num_signals = 0;
+	sig->num_reaped = 0;
+	sig->processes = NULL;
+	ilist_init(&sig->node);
+	for (i = 0; i < CASYNC_SIGNAL_MAX; i++) {
+		sig->installed[i] = 0;
+		sig->signaled[i] = 0;
+	}
+	sig->fd_reader = -1;
+	sig->fd_writer = -1;
+	async_event_init(&sig->evt_read, async_signal_reading, -1, 0);
+	sig->evt_read.user = sig;
+#if ASYNC_SIGNAL_SIGNALFD
+	async_event_init(&sig->evt_signal, async_signal_draining, -1, 0);
+#else
+	async_event_init(&sig->evt_signal, NULL, -1, 0);
+#endif
+	sig->evt_signal.user = sig;
+#ifdef __unix
+	int retval = pipe(fds);
+	if (retval < 0) {
+		fds[0] = -1;
+		fds[1] = -1;
+	}
+	else if (fds[0] >= 0) {
+		isocket_enable(fds[0], ISOCK_CLOEXEC);
+		isocket_enable(fds[1], ISOCK_CLOEXEC);
+		isocket_enable(fds[0], ISOCK_NOBLOCK);
+		isocket_enable(fds[1], ISOCK_NOBLOCK);
+	}
+#else
+	if (isocket_pair(fds, 1) != 0) {
+		int ok = 0, i;
+		for (i = 0; i < 15; i++) {
+			isleep(10);
+			if (isocket_pair(fds, 1) == 0) {
+				ok = 1;
+				break;
+			}
+		}
+		if (ok == 0) {
+			fds[0] = -1;
+			fds[1] = -1;
+		}
+	}
+	if (fds[0] >= 0) {
+		isocket_disable(fds[0], ISOCK_NOBLOCK);
+		isocket_disable(fds[1], ISOCK_NOBLOCK);
+	}
+#endif
+	sig->fd_reader = fds[0];
+	sig->fd_writer = fds[1];
+	async_event_set(&sig->evt_read, sig->fd_reader, ASYNC_EVENT_READ);
+	return sig;
+}
+
+
+// delete signal object
+void async_signal_delete(CAsyncSignal *sig)
+{
+	assert(sig);
+	if (sig->active) {
+		async_signal_stop(sig);
+	}
+	if (sig->busy > 0) {
+		sig->releasing = 1;
+		return;
+	}
+	async_signal_release(sig);
+}
+
+
+// free the object once no callback is running
+static void async_signal_release(CAsyncSignal *sig)
+{
+	if (async_event_is_active(&sig->evt_read)) {
+		async_event_stop(sig->loop, &sig->evt_read);
+	}
+	if (sig->fd_reader >= 0) {
+		iclose(sig->fd_reader);
+		sig->fd_reader = -1;
+	}
+	if (sig->fd_writer >= 0) {
+		iclose(sig->fd_writer);
+		sig->fd_writer = -1;
+	}
+	if (sig->processes != NULL) {
+		struct ib_hash_entry *entry = ib_map_first(sig->processes);
+		for (; entry; entry = ib_map_next(sig->processes, entry)) {
+			CAsyncProcess *proc = (CAsyncProcess*)ib_hash_value(entry);
+			proc->reaper = NULL;
+		}
+		ib_map_destroy(sig->processes);
+		ikmem_free(sig->processes);
+		sig->processes = NULL;
+	}
+	sig->loop = NULL;
+	sig->user = NULL;
+	sig->callback = NULL;
+	ikmem_free(sig);
+}
+
+
+// start wating system signals
+int async_signal_start(CAsyncSignal *sig)
+{
+	int i;
+#if ASYNC_SIGNAL_SIGNALFD
+	if (sig->active) {
+		// already started
+		return -2;
+	}
+	if (async_signal_attach(sig) != 0) {
+		// can't create the signalfd
+		return -3;
+	}
+#else
+	if (async_signal_current != NULL) {
+		// another signal is already active
+		return -1;
+	}
+	if (sig->active) {
+		// already started
+		return -2;
+	}
+	async_signal_current = sig;
+#endif
+	for (i = 0; i < CASYNC_SIGNAL_MAX; i++) {
+		if (sig->installed[i] == 1) {
+		#if !ASYNC_SIGNAL_SIGNALFD
+			signal(i, async_signal_handler);
+		#endif
+		}
+		else if (sig->installed[i] == 2) {
+			signal(i, SIG_IGN);
+		}
+	}
+	if (async_event_is_active(&sig->evt_read)) {
+		async_event_stop(sig->loop, &sig->evt_read);
+	}
+	async_event_start(sig->loop, &sig->evt_read);
+	sig->active = 1;
+#ifdef SIGCHLD
+	if (async_signal_reaping_on(sig)) {
+		// children may have exited before the signal was routed here
+		async_signal_notify(sig, SIGCHLD);
+	}
+#endif
+	return 0;
+}
+
+// stop from the system signal interface
+int async_signal_stop(CAsyncSignal *sig)
+{
+	int i;
+#if ASYNC_SIGNAL_SIGNALFD
+	if (sig->active == 0) {
+		// not started
+		return -2;
+	}
+	async_signal_detach(sig);
+#else
+	if (async_signal_current != sig) {
+		// not the current signal
+		return -1;
+	}
+	if (sig->active == 0) {
+		// not started
+		return -2;
+	}
+#endif
+	if (async_event_is_active(&sig->evt_read)) {
+		async_event_stop(sig->loop, &sig->evt_read);
+	}
+	for (i = 0; i < CASYNC_SIGNAL_MAX; i++) {
+	#if ASYNC_SIGNAL_SIGNALFD
+		if (sig->installed[i] == 2) {
+			signal(i, SIG_DFL);
+		}
+	#else
+		if (sig->installed[i]) {
+			signal(i, SIG_DFL);
+		}
+	#endif
+	}
+	async_signal_current = NULL;
+	sig->active = 0;
+	return 0;
+}
+
+// install a system signal
+int async_signal_install(CAsyncSignal *sig, int signum)
+{
+	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) {
+		return -1;
+	}
+	if (sig->active == 0) {
+		sig->installed[signum] = 1;
+	}
+	else {
+		int previous = sig->installed[signum];
+		sig->installed[signum] = 1;
+	#if ASYNC_SIGNAL_SIGNALFD
+		if (previous == 2) signal(signum, SIG_DFL);
+		async_signal_refresh(sig);
+	#else
+		(void)previous;
+		signal(signum, async_signal_handler);
+	#endif
+	}
+	return 0;
+}
+
+// ignore a system signal
+int async_signal_ignore(CAsyncSignal *sig, int signum)
+{
+	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) {
+		return -1;
+	}
+	if (sig->active == 0) {
+		sig->installed[signum] = 2;
+	}
+	else {
+		int previous = sig->installed[signum];
+		sig->installed[signum] = 2;
+		signal(signum, SIG_IGN);
+	#if ASYNC_SIGNAL_SIGNALFD
+		if (previous == 1) async_signal_refresh(sig);
+	#else
+		(void)previous;
+	#endif
+	}
+	return 0;
+}
+
+// remove a system signal
+int async_signal_remove(CAsyncSignal *sig, int signum)
+{
+	if (signum < 0 || signum >= CASYNC_SIGNAL_MAX) {
+		return -1;
+	}
+	if (sig->active == 0) {
+		sig->installed[signum] = 0;
+	}
+	else {
+		int previous = sig->installed[signum];
+		sig->installed[signum] = 0;
+	#if ASYNC_SIGNAL_SIGNALFD
+		if (previous == 2) signal(signum, SIG_DFL);
+		if (previous == 1) async_signal_refresh(sig);
+	#else
+		(void)previous;
+		signal(signum, SIG_DFL);
+	#endif
+	}
+	return 0;
+}
+
+
+// reap exited children on SIGCHLD
+int async_signal_reap(CAsyncSignal *sig, 
+	void (*child)(CAsyncSignal *signal, int pid, int status))
+{
+#ifdef SIGCHLD
+	sig->child = child;
+	if (child == NULL) {
+		return 0;
+	}
+	if (sig->installed[SIGCHLD] != 1) {
+		async_signal_install(sig, SIGCHLD);
+	}
+	if (sig->active) {
+		async_signal_notify(sig, SIGCHLD);
+	}
+	return 0;
+#else
+	(void)sig;
+	(void)child;
+	return -1;
+#endif
+}
+
+
+//---------------------------------------------------------------------
+// easy default
+//---------------------------------------------------------------------
+static CAsyncSignal *_async_signal_default = NULL;
+
+// default handler for _async_signal_default
+static void async_signal_default_handler(CAsyncSignal *signal, int signum)
+{
+	if (signum == SIGINT || signum == SIGTERM) {
+		async_loop_exit(signal->loop);
+	}
+#ifdef SIGQUIT
+	else if (signum == SIGQUIT) {
+		async_loop_exit(signal->loop);
+	}
+#endif
+}
+
+// for atexit
+static void async_signal_cleanup(void)
+{
+	if (_async_signal_default) {
+		if (_async_signal_default->active) {
+			async_signal_stop(_async_signal_default);
+		}
+		async_signal_delete(_async_signal_default);
+		_async_signal_default = NULL;
+	}
+}
+
+// install default handler for a CAsyncLoop
+int async_signal_default(CAsyncLoop *loop)
+{
+	static int inited = 0;
+	if (inited == 0) {
+		atexit(async_signal_cleanup);
+		inited = 1;
+	}
+	if (_async_signal_default != NULL) {
+		if (_async_signal_default->active) {
+			async_signal_stop(_async_signal_default);
+		}
+		async_signal_delete(_async_signal_default);
+		_async_signal_default = NULL;
+	}
+	if (loop != NULL) {
+		CAsyncSignal *signal = async_signal_new(loop, 
+				async_signal_default_handler);
+		if (signal == NULL) {
+			return -1;
+		}
+		async_signal_install(signal, SIGINT);
+		async_signal_install(signal, SIGTERM);
+	#ifdef SIGQUIT
+		async_signal_install(signal, SIGQUIT);
+	#endif
+	#ifdef __unix
+		async_signal_ignore(signal, SIGPIPE);
+	#endif
+		async_signal_start(signal);
+		_async_signal_default = signal;
+	}
+	return 0;
+}
+
+
+//=====================================================================
+// CAsyncProcess
+//=====================================================================
+#ifdef __unix
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+extern char **environ;
+#endif
+
+// create a process object
+CAsyncProcess *async_process_new(CAsyncSignal *reaper,
+	void (*callback)(CAsyncProcess *proc, int status))
+{
+	CAsyncProcess *proc;
+	if (reaper == NULL) return NULL;
+	proc = (CAsyncProcess*)ikmem_malloc(sizeof(CAsyncProcess));
+	if (proc == NULL) return NULL;
+	proc->loop = reaper->loop;
+	proc->reaper = reaper;
+	proc->input = NULL;
+	proc->output = NULL;
+	proc->error = NULL;
+	proc->callback = callback;
+	proc->user = NULL;
+	proc->pid = -1;
+	proc->status = 0;
+	proc->exited = 0;
+	proc->busy = 0;
+	proc->releasing = 0;
+#ifdef SIGCHLD
+	// route SIGCHLD before any child can exit
+	if (reaper->installed[SIGCHLD] != 1) {
+		async_signal_install(reaper, SIGCHLD);
+	}
+#endif
+	return proc;
+}
+
+// delete process object and close its streams
+void async_process_delete(CAsyncProcess *proc)
+{
+	assert(proc);
+	if (proc->reaper != NULL && proc->reaper->processes != NULL) {
+		if (proc->pid > 0 && proc->exited == 0) {
+			void *key = (void*)((size_t)proc->pid);
+			ib_map_remove(proc->reaper->processes, key);
+		}
+	}
+	proc->reaper = NULL;
+	if (proc->input) {
+		async_stream_close(proc->input);
+		proc->input = NULL;
+	}
+	if (proc->output) {
+		async_stream_close(proc->output);
+		proc->output = NULL;
+	}
+	if (proc->error) {
+		async_stream_close(proc->error);
+		proc->error = NULL;
+	}
+	proc->callback = NULL;
+	if (proc->busy > 0) {
+		proc->releasing = 1;
+		return;
+	}
+	ikmem_free(proc);
+}
+
+// called by the reaper after waitpid() collected the child
+static void async_process_exited(CAsyncProcess *proc, int status)
+{
+	proc->exited = 1;
+	proc->status = status;
+	proc->busy++;
+	if (proc->callback) {
+		proc->callback(proc, status);
+	}
+	proc->busy--;
+	if (proc->busy == 0 && proc->releasing) {
+		ikmem_free(proc);
+	}
+}
+
+// spawn file with argv and envp
+int async_process_spawn(CAsyncProcess *proc, const char *file,
+	char * const argv[], char * const envp[], int flags,
+	void (*callback)(CAsyncStream *stream, int event, int args))
+{
+#ifdef __unix
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	CAsyncStream *streams[3];
+	int fds[3][2], i, hr, type = SOCK_STREAM;
+	short spawnflags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	sigset_t mask;
+	pid_t pid;
+	if (proc->pid >= 0 || proc->reaper == NULL) {
+		return -1;
+	}
+#ifdef SOCK_CLOEXEC
+	type |= SOCK_CLOEXEC;
+#endif
+	for (i = 0; i < 3; i++) {
+		fds[i][0] = -1;
+		fds[i][1] = -1;
+	}
+	// socket pairs rather than pipes: tcp streams use recv/send
+	for (i = 0; i < 3; i++) {
+		if ((flags & (1 << i)) == 0) continue;
+		if (i == 2 && (flags & ASYNC_PROCESS_MERGE)) continue;
+		if (socketpair(AF_UNIX, type, 0, fds[i]) != 0) {
+			for (; i >= 0; i--) {
+				if (fds[i][0] >= 0) close(fds[i][0]);
+				if (fds[i][1] >= 0) close(fds[i][1]);
+			}
+			return -2;
+		}
+		isocket_enable(fds[i][0], ISOCK_CLOEXEC);
+		isocket_enable(fds[i][1], ISOCK_CLOEXEC);
+	}
+	posix_spawn_file_actions_init(&actions);
+	for (i = 0; i < 3; i++) {
+		int fd = fds[i][1];
+		if (i == 2 && (flags & ASYNC_PROCESS_MERGE)) {
+			fd = fds[1][1];
+		}
+		if (fd >= 0) {
+			posix_spawn_file_actions_adddup2(&actions, fd, i);
+		}
+		else if (flags & ASYNC_PROCESS_NULL) {
+			posix_spawn_file_actions_addopen(&actions, i, "/dev/null",
+				(i == 0)? O_RDONLY : O_WRONLY, 0);
+		}
+	}
+	// the loop thread may block signals for signalfd, and ignore
+	// SIGPIPE: the child starts with an empty mask and defaults.
+	posix_spawnattr_init(&attr);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigfillset(&mask);
+	sigdelset(&mask, SIGKILL);
+	sigdelset(&mask, SIGSTOP);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+	if (flags & ASYNC_PROCESS_GROUP) {
+		spawnflags |= POSIX_SPAWN_SETPGROUP;
+		posix_spawnattr_setpgroup(&attr, 0);
+	}
+	posix_spawnattr_setflags(&attr, spawnflags);
+	hr = posix_spawnp(&pid, file, &actions, &attr, argv,
+			(envp != NULL)? envp : environ);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	for (i = 0; i < 3; i++) {
+		if (fds[i][1] >= 0) close(fds[i][1]);
+	}
+	if (hr != 0) {
+		for (i = 0; i < 3; i++) {
+			if (fds[i][0] >= 0) close(fds[i][0]);
+		}
+		return -3;
+	}
+	proc->pid = (int)pid;
+	proc->exited = 0;
+	if (proc->reaper->processes == NULL) {
+		struct ib_hash_map *map = (struct ib_hash_map*)
+			ikmem_malloc(sizeof(struct ib_hash_map));
+		assert(map);
+		ib_map_init(map, ib_hash_func_int, ib_hash_compare_int);
+		proc->reaper->processes = map;
+	}
+	ib_map_set(proc->reaper->processes, (void*)((size_t)pid), proc);
+	for (i = 0; i < 3; i++) {
+		streams[i] = NULL;
+		if (fds[i][0] < 0) continue;
+		streams[i] = async_stream_tcp_assign(proc->loop, callback, 
+				fds[i][0], 1);
+		if (streams[i] == NULL) {
+			close(fds[i][0]);
+			continue;
+		}
+		streams[i]->user = proc;
+	}
+	proc->input = streams[0];
+	proc->output = streams[1];
+	proc->error = streams[2];
+	return 0;
+#else
+	(void)proc;
+	(void)file;
+	(void)argv;
+	(void)envp;
+	(void)flags;
+	(void)callback;
+	return -3;
+#endif
+}
+
+// flush pending input then close it
+void async_process_close_input(CAsyncProcess *proc, int timeout_ms)
+{
+	if (proc->input != NULL) {
+		async_stream_graceful(proc->input, timeout_ms);
+		proc->input = NULL;
+	}
+}
+
+// send a signal to a running child
+int async_process_kill(CAsyncProcess *proc, int signum)
+{
+#ifdef __unix
+	if (proc->pid <= 0 || proc->exited) {
+		return -1;
+	}
+	if (kill((pid_t)proc->pid, signum) != 0) {
+		return -2;
+	}
+	return 0;
+#else
+	(void)proc;
+	(void)signum;
+	return -1;
+#endif
+}
+
+
+//=====================================================================
+// CAsyncCodec - protocol codec for CAsyncStream
+//=====================================================================
+
+// pending_resize value that frees the static page
+#define ASYNC_CODEC_ZONE_DROP   ((size_t)-1)
+
+//---------------------------------------------------------------------
+// apply pending zonebuf resize (called after zone_clear when zone is empty)
+//---------------------------------------------------------------------
+static void async_codec_apply_zone_resize(CAsyncCodec *codec)
+{
+	size_t new_size = codec->pending_resize;
+	codec->pending_resize = 0;
+
+	if (new_size == ASYNC_CODEC_ZONE_DROP) {
+		new_size = 0;
+	}
+
+	ib_zone_destroy(&codec->zone);
+	if (codec->zonebuf) {
+		ikmem_free(codec->zonebuf);
+		codec->zonebuf = NULL;
+		codec->zonebuf_size = 0;
+	}
+
+	if (new_size > 0) {
+		codec->zonebuf = ikmem_malloc(new_size);
+		if (codec->zonebuf) {
+			codec->zonebuf_size = new_size;
+		}
+		else {
+			codec->zonebuf_size = 0;
+		}
+	}
+
+	ib_zone_init(&codec->zone, codec->zonebuf,
+			(size_t)codec->zonebuf_size, NULL);
+	ib_zone_setup(&codec->zone, &codec->alloc);
+	codec->num_resizes++;
+}
+
+
+//---------------------------------------------------------------------
+// learn the decoded size of a message before zone_clear: the mark 
+// jumps to a larger message at once and decays by 1/64 per message,
+// the zonebuf grows when a message spilled into dynamic pages and 
+// shrinks when the mark falls to a quarter of it
+//---------------------------------------------------------------------
+static void async_codec_zone_learn(CAsyncCodec *codec)
+{
+	size_t used = codec->zone.used;
+	size_t need;
+	codec->num_decoded++;
+	if (codec->zone.pages != NULL) {
+		codec->num_overflows++;
+	}
+	if (used >= codec->zone_peak) {
+		codec->zone_peak = used;
+	}	else {
+		codec->zone_peak -= (codec->zone_peak - used) >> 6;
+	}
+	if (codec->zone_limit == 0 || codec->pending_resize > 0) {
+		return;
+	}
+	used = codec->zone_peak + (codec->zone_peak >> 2);
+	for (need = 1024; need < used && need < codec->zone_limit; ) {
+		need <<= 1;
+	}
+	if (need > codec->zone_limit) need = codec->zone_limit;
+	if (need < codec->zone_base) need = codec->zone_base;
+	if (codec->zone.pages != NULL) {
+		if (need > codec->zonebuf_size) {
+			codec->pending_resize = need;
+		}
+	}
+	else if (need * 4 <= codec->zonebuf_size && 
+			codec->zonebuf_size > codec->zone_base) {
+		codec->pending_resize = need;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// internal: dispatch decoded objects to receiver
+// returns -1 if the codec was deleted inside receiver/callback
+//---------------------------------------------------------------------
+static int async_codec_dispatch_reading(CAsyncCodec *codec)
+{
+	ib_object *obj = NULL;
+	int rc;
+
+	while (codec->releasing == 0 && codec->error == 0) {
+		rc = 0;
+		obj = NULL;
+
+		switch (codec->codec) {
+		case ASYNC_CODEC_RESP:
+			rc = ib_resp_reader_read(
+					(ib_resp_reader*)codec->reader, &obj, &codec->alloc);
+			break;
+		case ASYNC_CODEC_MSGPACK:
+			rc = ib_msgpack_reader_read(
+					(ib_msgpack_reader*)codec->reader, &obj, &codec->alloc);
+			break;
+		case ASYNC_CODEC_JSON:
+			rc = ib_json_reader_read(
+					(ib_json_reader*)codec->reader, &obj, &codec->alloc);
+			break;
+		case ASYNC_CODEC_HTTP:
+			rc = ib_http_reader_read(
+					(ib_http_reader*)codec->reader, &obj, &codec->alloc);
+			break;
+		default:
+			return 0;
+		}
+
+		if (rc == 0) break;       // incomplete, need more data
+		if (rc < 0) {              // protocol error
+			codec->error = 1;
+			codec->busy = 1;
+			if (codec->callback)
+				codec->callback(codec, ASYNC_CODEC_EVT_ERROR);
+			codec->busy = 0;
+			if (codec->releasing) {
+				async_codec_delete(codec);
+				return -1;
+			}
+			return 0;
+		}
+
+		// rc == 1: decoded successfully
+		codec->busy = 1;
+		if (codec->receiver)
+			codec->receiver(codec, obj);
+		codec->busy = 0;
+
+		// release decoded object and reclaim zone
+		async_codec_zone_learn(codec);
+		ib_zone_clear(&codec->zone);
+
+		// user called delete in receiver?
+		if (codec->releasing) {
+			async_codec_delete(codec);
+			return -1;
+		}
+
+		// apply pending zonebuf resize now that zone is empty
+		if (codec->pending_resize > 0) {
+			async_codec_apply_zone_resize(codec);
+		}
+
+		// check if stream read is still enabled
+		if ((codec->stream->enabled & ASYNC_EVENT_READ) == 0) {
+			break;
+		}
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// feed raw bytes into the reader
+//---------------------------------------------------------------------
+static void async_codec_feed(CAsyncCodec *codec, const void *data, long size)
+{
+	switch (codec->codec) {
+	case ASYNC_CODEC_RESP:
+		ib_resp_reader_feed((ib_resp_reader*)codec->reader, data, size);
+		break;
+	case ASYNC_CODEC_MSGPACK:
+		ib_msgpack_reader_feed((ib_msgpack_reader*)codec->reader, data, size);
+		break;
+	case ASYNC_CODEC_JSON:
+		ib_json_reader_feed((ib_json_reader*)codec->reader, data, size);
+		break;
+	case ASYNC_CODEC_HTTP:
+		ib_http_reader_feed((ib_http_reader*)codec->reader, data, size);
+		break;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// feed the reader straight from the stream buffer when the stream
+// supports borrowing, otherwise copy via cache
+//---------------------------------------------------------------------
+static void async_codec_pull(CAsyncCodec *codec)
+{
+	CAsyncStream *stream = codec->stream;
+	const void *data = NULL;
+	long total = 0;
+	while (total < ASYNC_LOOP_BUFFER_SIZE) {
+		long size = async_stream_borrow(stream, &data);
+		int borrowed = (size >= 0);
+		if (borrowed == 0) {
+			data = codec->loop->cache;
+			size = async_stream_read(stream, codec->loop->cache,
+					ASYNC_LOOP_BUFFER_SIZE);
+		}
+		if (size <= 0) break;
+		if (size > ASYNC_LOOP_BUFFER_SIZE - total) {
+			size = ASYNC_LOOP_BUFFER_SIZE - total;
+		}
+		async_codec_feed(codec, data, size);
+		total += size;
+		if (borrowed == 0) break;
+		async_stream_consume(stream, size);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// stream event callback
+//---------------------------------------------------------------------
+static void async_codec_callback(CAsyncStream *stream, int event, int args)
+{
+	CAsyncCodec *codec = (CAsyncCodec*)stream->user;
+	(void)args;
+
+	if (codec == NULL) return;
+
+	// HTTP: a response without framing ends with the connection,
+	// complete it before EOF reaches the user
+	if ((event & ASYNC_STREAM_EVT_EOF) && codec->codec == ASYNC_CODEC_HTTP) {
+		async_codec_pull(codec);
+		ib_http_reader_finish((ib_http_reader*)codec->reader);
+		if (async_codec_dispatch_reading(codec) != 0) return;
+		event &= ~ASYNC_STREAM_EVT_READING;
+	}
+
+	// state event callback (ESTAB/EOF etc)
+	if (codec->callback) {
+		codec->busy = 1;
+		codec->callback(codec, event);
+		codec->busy = 0;
+		if (codec->releasing) {
+			async_codec_delete(codec);
+			return;
+		}
+	}
+
+	// data arrived
+	if (event & ASYNC_STREAM_EVT_READING) {
+		async_codec_pull(codec);
+		async_codec_dispatch_reading(codec);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// create a new codec
+//---------------------------------------------------------------------
+CAsyncCodec *async_codec_new(CAsyncStream *stream, int codec_type,
+		int borrow,
+		void (*callback)(CAsyncCodec *codec, int event),
+		void (*receiver)(CAsyncCodec *codec, const ib_object *obj))
+{
+	CAsyncCodec *codec;
+
+	assert(stream);
+	assert(stream->loop);
+
+	codec = (CAsyncCodec*)ikmem_malloc(sizeof(CAsyncCodec));
+	if (codec == NULL) return NULL;
+
+	memset(codec, 0, sizeof(CAsyncCodec));
+
+	codec->loop = stream->loop;
+	codec->stream = stream;
+	codec->borrow = borrow;
+	codec->codec = codec_type;
+	codec->callback = callback;
+	codec->receiver = receiver;
+
+	// allocate zonebuf
+	codec->zonebuf = ikmem_malloc(ASYNC_CODEC_ZONE_SIZE);
+	if (codec->zonebuf == NULL) {
+		ikmem_free(codec);
+		return NULL;
+	}
+	codec->zonebuf_size = ASYNC_CODEC_ZONE_SIZE;
+	codec->zone_base = ASYNC_CODEC_ZONE_SIZE;
+	codec->zone_limit = ASYNC_CODEC_ZONE_LIMIT;
+
+	// init zone with static page
 	ib_zone_init(&codec->zone, codec->zonebuf,
-			(size_t)codec->zonebuf_size, &codec->alloc);
+			(size_t)codec->zonebuf_size, NULL);
 	ib_zone_setup(&codec->zone, &codec->alloc);
 
-	// create reader
-	switch (codec_type) {
-	case ASYNC_CODEC_RESP:
-		codec->reader = ib_resp_reader_new();
-		break;
-	case ASYNC_CODEC_MSGPACK:
-		codec->reader = ib_msgpack_reader_new();
-		break;
-	case ASYNC_CODEC_JSON:
-		codec->reader = ib_json_reader_new();
-		break;
-	default:
-		ikmem_free(codec->zonebuf);
-		ikmem_free(codec);
-		return NULL;
+	// create reader
+	switch (codec_type) {
+	case ASYNC_CODEC_RESP:
+		codec->reader = ib_resp_reader_new();
+		break;
+	case ASYNC_CODEC_MSGPACK:
+		codec->reader = ib_msgpack_reader_new();
+		break;
+	case ASYNC_CODEC_JSON:
+		codec->reader = ib_json_reader_new();
+		break;
+	case ASYNC_CODEC_HTTP:
+		codec->reader = ib_http_reader_new();
+		break;
+	default:
+		ikmem_free(codec->zonebuf);
+		ikmem_free(codec);
+		return NULL;
+	}
+
+	if (codec->reader == NULL) {
+		ikmem_free(codec->zonebuf);
+		ikmem_free(codec);
+		return NULL;
+	}
+
+	// create encode buffer
+	codec->encode_buf = ib_string_new();
+	if (codec->encode_buf == NULL) {
+		switch (codec_type) {
+		case ASYNC_CODEC_RESP:
+			ib_resp_reader_delete((ib_resp_reader*)codec->reader);
+			break;
+		case ASYNC_CODEC_MSGPACK:
+			ib_msgpack_reader_delete((ib_msgpack_reader*)codec->reader);
+			break;
+		case ASYNC_CODEC_JSON:
+			ib_json_reader_delete((ib_json_reader*)codec->reader);
+			break;
+		case ASYNC_CODEC_HTTP:
+			ib_http_reader_delete((ib_http_reader*)codec->reader);
+			break;
+		}
+		ikmem_free(codec->zonebuf);
+		ikmem_free(codec);
+		return NULL;
+	}
+
+	// take over stream
+	stream->user = codec;
+	stream->callback = async_codec_callback;
+
+	return codec;
+}
+
+
+//---------------------------------------------------------------------
+// delete codec (safe to call inside callback/receiver)
+//---------------------------------------------------------------------
+void async_codec_delete(CAsyncCodec *codec)
+{
+	if (codec == NULL) return;
+
+	// if busy, defer: mark releasing and return
+	if (codec->busy) {
+		codec->releasing = 1;
+		return;
+	}
+
+	// close or detach stream
+	if (codec->borrow == 0) {
+		if (codec->stream) {
+			async_stream_close(codec->stream);
+		}
+	}
+	else {
+		if (codec->stream) {
+			codec->stream->user = NULL;
+			codec->stream->callback = NULL;
+		}
+	}
+	codec->stream = NULL;
+
+	// delete reader
+	switch (codec->codec) {
+	case ASYNC_CODEC_RESP:
+		if (codec->reader)
+			ib_resp_reader_delete((ib_resp_reader*)codec->reader);
+		break;
+	case ASYNC_CODEC_MSGPACK:
+		if (codec->reader)
+			ib_msgpack_reader_delete((ib_msgpack_reader*)codec->reader);
+		break;
+	case ASYNC_CODEC_JSON:
+		if (codec->reader)
+			ib_json_reader_delete((ib_json_reader*)codec->reader);
+		break;
+	case ASYNC_CODEC_HTTP:
+		if (codec->reader)
+			ib_http_reader_delete((ib_http_reader*)codec->reader);
+		break;
+	}
+	codec->reader = NULL;
+
+	// release zone
+	ib_zone_destroy(&codec->zone);
+	if (codec->zonebuf) {
+		ikmem_free(codec->zonebuf);
+		codec->zonebuf = NULL;
+		codec->zonebuf_size = 0;
+	}
+
+	// release encode buffer
+	if (codec->encode_buf) {
+		ib_string_delete(codec->encode_buf);
+		codec->encode_buf = NULL;
+	}
+
+	// reset state
+	codec->releasing = 0;
+	codec->busy = 0;
+	codec->loop = NULL;
+	codec->callback = NULL;
+	codec->receiver = NULL;
+
+	ikmem_free(codec);
+}
+
+
+//---------------------------------------------------------------------
+// encode ib_object and write to stream
+//---------------------------------------------------------------------
+int async_codec_send(CAsyncCodec *codec, const ib_object *obj)
+{
+	int hr;
+
+	assert(codec);
+	assert(codec->stream);
+
+	if (obj == NULL) return -1;
+
+	// clear encode_buf (preserves capacity)
+	ib_string_clear(codec->encode_buf);
+
+	// encode
+	switch (codec->codec) {
+	case ASYNC_CODEC_RESP:
+		hr = ib_resp_encode(codec->encode_buf, obj);
+		break;
+	case ASYNC_CODEC_MSGPACK:
+		hr = ib_msgpack_encode(codec->encode_buf, obj);
+		break;
+	case ASYNC_CODEC_JSON:
+		hr = ib_json_encode(codec->encode_buf, obj);
+		break;
+	case ASYNC_CODEC_HTTP:
+		hr = ib_http_encode(codec->encode_buf, obj);
+		break;
+	default:
+		return -1;
+	}
+
+	if (hr != 0) return -1;
+
+	// write to stream
+	async_stream_write(codec->stream,
+			ib_string_ptr(codec->encode_buf),
+			ib_string_size(codec->encode_buf));
+
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// write raw bytes to stream
+//---------------------------------------------------------------------
+void async_codec_write(CAsyncCodec *codec, const void *ptr, long size)
+{
+	assert(codec);
+	assert(codec->stream);
+	if (ptr && size > 0) {
+		async_stream_write(codec->stream, ptr, size);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// enable/disable stream events
+//---------------------------------------------------------------------
+void async_codec_enable(CAsyncCodec *codec, int event)
+{
+	assert(codec);
+	assert(codec->stream);
+	async_stream_enable(codec->stream, event);
+}
+
+void async_codec_disable(CAsyncCodec *codec, int event)
+{
+	assert(codec);
+	assert(codec->stream);
+	async_stream_disable(codec->stream, event);
+}
+
+
+//---------------------------------------------------------------------
+// configure reader limits
+//---------------------------------------------------------------------
+void async_codec_set_limits(CAsyncCodec *codec,
+		int max_depth, long max_bulk, int max_elements)
+{
+	assert(codec);
+	switch (codec->codec) {
+	case ASYNC_CODEC_RESP:
+		ib_resp_reader_set_limits(
+				(ib_resp_reader*)codec->reader,
+				max_depth, max_bulk, max_elements);
+		break;
+	case ASYNC_CODEC_MSGPACK:
+		ib_msgpack_reader_set_limits(
+				(ib_msgpack_reader*)codec->reader,
+				max_depth, max_bulk, max_elements);
+		break;
+	case ASYNC_CODEC_JSON:
+		ib_json_reader_set_limits(
+				(ib_json_reader*)codec->reader,
+				max_depth, max_bulk, max_elements);
+		break;
+	case ASYNC_CODEC_HTTP:
+		ib_http_reader_set_limits(
+				(ib_http_reader*)codec->reader,
+				(long)max_depth, max_bulk, max_elements);
+		break;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// enable/disable inline command parsing (RESP only)
+//---------------------------------------------------------------------
+void async_codec_set_inline(CAsyncCodec *codec, int enable)
+{
+	assert(codec);
+	if (codec->codec == ASYNC_CODEC_RESP && codec->reader) {
+		ib_resp_reader_set_inline((ib_resp_reader*)codec->reader, enable);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// signal end-of-input (JSON and HTTP)
+//---------------------------------------------------------------------
+void async_codec_set_finish(CAsyncCodec *codec)
+{
+	assert(codec);
+	if (codec->codec == ASYNC_CODEC_JSON && codec->reader) {
+		ib_json_reader_finish((ib_json_reader*)codec->reader);
+	}
+	else if (codec->codec == ASYNC_CODEC_HTTP && codec->reader) {
+		ib_http_reader_finish((ib_http_reader*)codec->reader);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// next HTTP response answers a HEAD request
+//---------------------------------------------------------------------
+void async_codec_expect_head(CAsyncCodec *codec)
+{
+	assert(codec);
+	if (codec->codec == ASYNC_CODEC_HTTP && codec->reader) {
+		ib_http_reader_expect_head((ib_http_reader*)codec->reader);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// set zonebuf size (deferred, applied on next zone_clear)
+//---------------------------------------------------------------------
+void async_codec_set_zone_size(CAsyncCodec *codec, size_t size)
+{
+	assert(codec);
+	codec->pending_resize = (size > 0)? size : ASYNC_CODEC_ZONE_DROP;
+	codec->zone_base = size;
+	if (size == 0) {
+		// pure dynamic: the learner must not grow a page again
+		codec->zone_limit = 0;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// set adaptive zonebuf ceiling
+//---------------------------------------------------------------------
+void async_codec_set_zone_limit(CAsyncCodec *codec, size_t limit)
+{
+	assert(codec);
+	codec->zone_limit = limit;
+}
+
+
+//---------------------------------------------------------------------
+// query stream pending data size
+//---------------------------------------------------------------------
+long async_codec_remain(const CAsyncCodec *codec)
+{
+	assert(codec);
+	if (codec->stream) {
+		return async_stream_remain(codec->stream);
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// query protocol error state
+//---------------------------------------------------------------------
+int async_codec_error(const CAsyncCodec *codec)
+{
+	assert(codec);
+	return codec->error;
+}
+
+
+//---------------------------------------------------------------------
+// reset: clear error, clear reader buffer
+//---------------------------------------------------------------------
+void async_codec_reset(CAsyncCodec *codec)
+{
+	assert(codec);
+	codec->error = 0;
+	switch (codec->codec) {
+	case ASYNC_CODEC_RESP:
+		ib_resp_reader_clear((ib_resp_reader*)codec->reader);
+		break;
+	case ASYNC_CODEC_MSGPACK:
+		ib_msgpack_reader_clear((ib_msgpack_reader*)codec->reader);
+		break;
+	case ASYNC_CODEC_JSON:
+		ib_json_reader_clear((ib_json_reader*)codec->reader);
+		break;
+	case ASYNC_CODEC_HTTP:
+		ib_http_reader_clear((ib_http_reader*)codec->reader);
+		break;
+	}
+}
+
+
+//=====================================================================
+// CAsyncPipeline - pipelined RESP client on CAsyncCodec
+//=====================================================================
+struct CAsyncPipelineEntry {
+	CAsyncPipelineReply reply;
+	void *user;
+};
+
+#ifndef ASYNC_PIPELINE_INIT
+#define ASYNC_PIPELINE_INIT    64
+#endif
+
+static void async_pipeline_evt_flush(CAsyncLoop *loop, CAsyncPostpone *post);
+static void async_pipeline_codec_callback(CAsyncCodec *codec, int event);
+static void async_pipeline_receiver(CAsyncCodec *codec, const ib_object *obj);
+
+
+//---------------------------------------------------------------------
+// create a pipeline on stream
+//---------------------------------------------------------------------
+CAsyncPipeline *async_pipeline_new(CAsyncStream *stream, int borrow,
+	void (*callback)(CAsyncPipeline *pipe, int event))
+{
+	CAsyncPipeline *pipe;
+	pipe = (CAsyncPipeline*)ikmem_malloc(sizeof(CAsyncPipeline));
+	if (pipe == NULL) return NULL;
+	memset(pipe, 0, sizeof(CAsyncPipeline));
+	pipe->queue = (struct CAsyncPipelineEntry*)ikmem_malloc(
+			sizeof(struct CAsyncPipelineEntry) * ASYNC_PIPELINE_INIT);
+	pipe->batch = ib_string_new();
+	if (pipe->queue == NULL || pipe->batch == NULL) {
+		if (pipe->queue) ikmem_free(pipe->queue);
+		if (pipe->batch) ib_string_delete(pipe->batch);
+		ikmem_free(pipe);
+		return NULL;
+	}
+	pipe->codec = async_codec_new(stream, ASYNC_CODEC_RESP, borrow,
+			async_pipeline_codec_callback, async_pipeline_receiver);
+	if (pipe->codec == NULL) {
+		ikmem_free(pipe->queue);
+		ib_string_delete(pipe->batch);
+		ikmem_free(pipe);
+		return NULL;
+	}
+	pipe->codec->user = pipe;
+	pipe->loop = stream->loop;
+	pipe->capacity = ASYNC_PIPELINE_INIT;
+	pipe->callback = callback;
+	async_post_init(&pipe->evt_flush, async_pipeline_evt_flush);
+	pipe->evt_flush.user = pipe;
+	return pipe;
+}
+
+
+//---------------------------------------------------------------------
+// delete pipeline
+//---------------------------------------------------------------------
+void async_pipeline_delete(CAsyncPipeline *pipe)
+{
+	if (pipe == NULL) return;
+	if (pipe->busy) {
+		pipe->releasing = 1;
+		return;
+	}
+	if (async_post_is_active(&pipe->evt_flush)) {
+		async_post_stop(pipe->loop, &pipe->evt_flush);
+	}
+	if (pipe->codec) {
+		// the codec may be dispatching to us, it defers its own delete
+		pipe->codec->user = NULL;
+		pipe->codec->receiver = NULL;
+		pipe->codec->callback = NULL;
+		async_codec_delete(pipe->codec);
+		pipe->codec = NULL;
+	}
+	ikmem_free(pipe->queue);
+	ib_string_delete(pipe->batch);
+	pipe->queue = NULL;
+	pipe->batch = NULL;
+	ikmem_free(pipe);
+}
+
+
+//---------------------------------------------------------------------
+// append an outstanding request, the ring doubles when full
+//---------------------------------------------------------------------
+static int async_pipeline_push(CAsyncPipeline *pipe, 
+	CAsyncPipelineReply reply, void *user)
+{
+	struct CAsyncPipelineEntry *entry;
+	if (pipe->count >= pipe->capacity) {
+		struct CAsyncPipelineEntry *queue;
+		int capacity = pipe->capacity * 2, i;
+		queue = (struct CAsyncPipelineEntry*)ikmem_malloc(
+				sizeof(struct CAsyncPipelineEntry) * capacity);
+		if (queue == NULL) return -1;
+		for (i = 0; i < pipe->count; i++) {
+			int pos = (pipe->head + i) & (pipe->capacity - 1);
+			queue[i] = pipe->queue[pos];
+		}
+		ikmem_free(pipe->queue);
+		pipe->queue = queue;
+		pipe->capacity = capacity;
+		pipe->head = 0;
+	}
+	entry = &pipe->queue[(pipe->head + pipe->count) & (pipe->capacity - 1)];
+	entry->reply = reply;
+	entry->user = user;
+	pipe->count++;
+	pipe->num_requests++;
+	if (async_post_is_active(&pipe->evt_flush) == 0) {
+		async_post_start(pipe->loop, &pipe->evt_flush);
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// queue a command of argc arguments
+//---------------------------------------------------------------------
+int async_pipeline_command(CAsyncPipeline *pipe, CAsyncPipelineReply reply,
+	void *user, int argc, const char * const argv[], const int argvlen[])
+{
+	int size, i;
+	if (pipe->error || argc <= 0) {
+		return -1;
+	}
+	size = ib_string_size(pipe->batch);
+	ib_resp_write_array(pipe->batch, argc);
+	for (i = 0; i < argc; i++) {
+		int len = (argvlen)? argvlen[i] : (int)strlen(argv[i]);
+		ib_resp_write_bulk(pipe->batch, argv[i], len);
+	}
+	if (async_pipeline_push(pipe, reply, user) != 0) {
+		ib_string_resize(pipe->batch, size);
+		return -1;
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// queue a command encoded from obj
+//---------------------------------------------------------------------
+int async_pipeline_send(CAsyncPipeline *pipe, CAsyncPipelineReply reply,
+	void *user, const ib_object *obj)
+{
+	int size;
+	if (pipe->error || obj == NULL) {
+		return -1;
+	}
+	size = ib_string_size(pipe->batch);
+	if (ib_resp_encode(pipe->batch, obj) != 0 ||
+		async_pipeline_push(pipe, reply, user) != 0) {
+		ib_string_resize(pipe->batch, size);
+		return -1;
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// write the current batch
+//---------------------------------------------------------------------
+void async_pipeline_flush(CAsyncPipeline *pipe)
+{
+	if (ib_string_size(pipe->batch) > 0) {
+		if (pipe->error == 0 && pipe->codec != NULL) {
+			async_codec_write(pipe->codec, ib_string_ptr(pipe->batch),
+					ib_string_size(pipe->batch));
+			pipe->num_flushes++;
+		}
+		ib_string_clear(pipe->batch);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// number of requests waiting for replies
+//---------------------------------------------------------------------
+int async_pipeline_pending(const CAsyncPipeline *pipe)
+{
+	return pipe->count;
+}
+
+
+//---------------------------------------------------------------------
+// connection lost: every outstanding request gets a NULL reply
+//---------------------------------------------------------------------
+static void async_pipeline_fail(CAsyncPipeline *pipe, int event)
+{
+	pipe->error = 1;
+	ib_string_clear(pipe->batch);
+	pipe->busy = 1;
+	while (pipe->count > 0) {
+		struct CAsyncPipelineEntry entry = pipe->queue[pipe->head];
+		pipe->head = (pipe->head + 1) & (pipe->capacity - 1);
+		pipe->count--;
+		if (entry.reply) {
+			entry.reply(pipe, entry.user, NULL);
+		}
+	}
+	if (pipe->callback && pipe->releasing == 0) {
+		pipe->callback(pipe, event);
+	}
+	pipe->busy = 0;
+	if (pipe->releasing) {
+		async_pipeline_delete(pipe);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// after the iteration: write the batch, or fail the requests once
+// the replies that came with EOF have been dispatched
+//---------------------------------------------------------------------
+static void async_pipeline_evt_flush(CAsyncLoop *loop, CAsyncPostpone *post)
+{
+	CAsyncPipeline *pipe = (CAsyncPipeline*)post->user;
+	(void)loop;
+	if (pipe->lost != 0) {
+		int event = pipe->lost;
+		pipe->lost = 0;
+		async_pipeline_fail(pipe, event);
+		return;
 	}
+	async_pipeline_flush(pipe);
+}
 
-	if (codec->reader == NULL) {
-		ikmem_free(codec->zonebuf);
-		ikmem_free(codec);
-		return NULL;
+
+//---------------------------------------------------------------------
+// stream events from the codec
+//---------------------------------------------------------------------
+static void async_pipeline_codec_callback(CAsyncCodec *codec, int event)
+{
+	CAsyncPipeline *pipe = (CAsyncPipeline*)codec->user;
+	if (pipe == NULL) return;
+	if (event & (ASYNC_STREAM_EVT_EOF | ASYNC_STREAM_EVT_ERROR)) {
+		if (pipe->error == 0) {
+			pipe->error = 1;
+			pipe->lost = event & (ASYNC_STREAM_EVT_EOF | 
+					ASYNC_STREAM_EVT_ERROR);
+			if (async_post_is_active(&pipe->evt_flush) == 0) {
+				async_post_start(pipe->loop, &pipe->evt_flush);
+			}
+		}
+		return;
 	}
+	if (pipe->callback) {
+		pipe->busy = 1;
+		pipe->callback(pipe, event);
+		pipe->busy = 0;
+		if (pipe->releasing) {
+			async_pipeline_delete(pipe);
+		}
+	}
+}
 
-	// create encode buffer
-	codec->encode_buf = ib_string_new();
-	if (codec->encode_buf == NULL) {
-		switch (codec_type) {
-		case ASYNC_CODEC_RESP:
-			ib_resp_reader_delete((ib_resp_reader*)codec->reader);
-			break;
-		case ASYNC_CODEC_MSGPACK:
-			ib_msgpack_reader_delete((ib_msgpack_reader*)codec->reader);
-			break;
-		case ASYNC_CODEC_JSON:
-			ib_json_reader_delete((ib_json_reader*)codec->reader);
-			break;
+
+//---------------------------------------------------------------------
+// replies from the codec, matched to requests in order
+//---------------------------------------------------------------------
+static void async_pipeline_receiver(CAsyncCodec *codec, const ib_object *obj)
+{
+	CAsyncPipeline *pipe = (CAsyncPipeline*)codec->user;
+	struct CAsyncPipelineEntry entry;
+	if (pipe == NULL) return;
+	if (obj->type == IB_OBJECT_ARRAY && (obj->flags & IB_OBJECT_FLAG_PUSH)) {
+		if (pipe->push) {
+			pipe->busy = 1;
+			pipe->push(pipe, obj);
+			pipe->busy = 0;
 		}
-		ikmem_free(codec->zonebuf);
-		ikmem_free(codec);
-		return NULL;
 	}
+	else if (pipe->count == 0) {
+		// a reply nobody asked for: the stream is out of sync
+		if (pipe->error == 0) {
+			pipe->error = 1;
+			pipe->lost = ASYNC_CODEC_EVT_ERROR;
+			async_codec_disable(codec, ASYNC_EVENT_READ);
+			if (async_post_is_active(&pipe->evt_flush) == 0) {
+				async_post_start(pipe->loop, &pipe->evt_flush);
+			}
+		}
+	}
+	else {
+		entry = pipe->queue[pipe->head];
+		pipe->head = (pipe->head + 1) & (pipe->capacity - 1);
+		pipe->count--;
+		pipe->num_replies++;
+		if (entry.reply) {
+			pipe->busy = 1;
+			entry.reply(pipe, entry.user, obj);
+			pipe->busy = 0;
+		}
+	}
+	if (pipe->releasing) {
+		async_pipeline_delete(pipe);
+	}
+}
 
-	// take over stream
-	stream->user = codec;
-	stream->callback = async_codec_callback;
 
-	return codec;
+
+//=====================================================================
+// CAsyncCache - Redis protocol in-memory key/value server
+//=====================================================================
+typedef struct CAsyncCacheEntry {
+	ib_string *key;
+	ib_string *value;
+	CAsyncCache *cache;
+	CAsyncTimer expire;
+	IINT64 deadline;        // loop clock in milliseconds, 0 for none
+}	CAsyncCacheEntry;
+
+typedef struct CAsyncCacheClient {
+	CAsyncCache *cache;
+	CAsyncCodec *codec;
+	ilist_head node;
+	ilist_head channels;
+	int nchannels;          // channels and patterns
+	int npatterns;          // patterns only
+	int resp3;
+	int quit;
+}	CAsyncCacheClient;
+
+typedef struct CAsyncCacheChannel {
+	CAsyncSubscribe sub;
+	CAsyncCacheClient *client;
+	ilist_head node;
+	ib_string *name;
+	int pattern;            // PSUBSCRIBE pattern, 0 for a literal name
+}	CAsyncCacheChannel;
+
+typedef void (*CAsyncCacheHandler)(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv);
+
+typedef struct CAsyncCacheCommand {
+	const char *name;       // lower case
+	int minargs;            // including the command name
+	int maxargs;            // -1 for no limit
+	int pubsub;             // allowed in RESP2 subscribed mode
+	CAsyncCacheHandler handler;
+}	CAsyncCacheCommand;
+
+// max wait for replies to drain after QUIT, in milliseconds
+#ifndef ASYNC_CACHE_LINGER
+#define ASYNC_CACHE_LINGER   3000
+#endif
+
+static void async_cache_codec_callback(CAsyncCodec *codec, int event);
+static void async_cache_receiver(CAsyncCodec *codec, const ib_object *obj);
+static void async_cache_evt_expire(CAsyncLoop *loop, CAsyncTimer *timer);
+
+
+//---------------------------------------------------------------------
+// loop clock in milliseconds
+//---------------------------------------------------------------------
+static IINT64 async_cache_now(const CAsyncCache *cache)
+{
+	return cache->loop->monotonic / 1000000;
 }
 
 
 //---------------------------------------------------------------------
-// delete codec (safe to call inside callback/receiver)
+// format integer, returns length
 //---------------------------------------------------------------------
-void async_codec_delete(CAsyncCodec *codec)
+static int async_cache_itoa(char *out, IINT64 value)
 {
-	if (codec == NULL) return;
+	char text[24];
+	IUINT64 x = (value < 0)? ((IUINT64)0 - (IUINT64)value) : (IUINT64)value;
+	int size = 0, n = 0;
+	do {
+		text[n++] = (char)('0' + (int)(x % 10));
+		x /= 10;
+	}	while (x > 0);
+	if (value < 0) out[size++] = '-';
+	while (n > 0) out[size++] = text[--n];
+	out[size] = 0;
+	return size;
+}
 
-	// if busy, defer: mark releasing and return
-	if (codec->busy) {
-		codec->releasing = 1;
+
+//---------------------------------------------------------------------
+// parse a decimal integer, returns 0 for success
+//---------------------------------------------------------------------
+static int async_cache_atoi(const char *text, int size, IINT64 *value)
+{
+	IUINT64 x = 0, limit = 0x7fffffffffffffffULL;
+	int i = 0, neg = 0;
+	if (size > 0 && text[0] == '-') {
+		neg = 1;
+		limit++;
+		i++;
+	}
+	if (i >= size || size - i > 19) return -1;
+	if (text[i] == '0' && size - i > 1) return -1;
+	for (; i < size; i++) {
+		int c = text[i];
+		if (c < '0' || c > '9') return -1;
+		if (x > (limit - (IUINT64)(c - '0')) / 10) return -1;
+		x = x * 10 + (IUINT64)(c - '0');
+	}
+	if (neg) {
+		*value = (x == 0)? 0 : (IINT64)(0 - (x - 1)) - 1;
+	}	else {
+		*value = (IINT64)x;
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// reply helpers, replies are collected in cache->reply
+//---------------------------------------------------------------------
+static void async_cache_flush(CAsyncCacheClient *client)
+{
+	ib_string *out = client->cache->reply;
+	if (ib_string_size(out) > 0) {
+		async_codec_write(client->codec, out->ptr, out->size);
+		ib_string_clear(out);
+	}
+}
+
+static void async_cache_reply_error(CAsyncCacheClient *client, 
+	const char *error)
+{
+	ib_resp_write_error(client->cache->reply, error);
+}
+
+static void async_cache_reply_header(ib_string *out, char mark, IINT64 n)
+{
+	char text[32];
+	int size;
+	text[0] = mark;
+	size = async_cache_itoa(text + 1, n) + 1;
+	text[size++] = '\r';
+	text[size++] = '\n';
+	ib_string_append_size(out, text, size);
+}
+
+// large values skip the reply buffer: the pending replies, the header,
+// the value and CRLF are gathered into the stream buffer at once
+static void async_cache_reply_bulk(CAsyncCacheClient *client, 
+	const void *ptr, int size)
+{
+	ib_string *out = client->cache->reply;
+	if (size < ASYNC_CACHE_INLINE) {
+		ib_resp_write_bulk(out, ptr, size);
+	}
+	else {
+		const void *vecptr[3];
+		long veclen[3];
+		async_cache_reply_header(out, '$', size);
+		vecptr[0] = out->ptr;
+		veclen[0] = out->size;
+		vecptr[1] = ptr;
+		veclen[1] = size;
+		vecptr[2] = "\r\n";
+		veclen[2] = 2;
+		async_stream_writev(client->codec->stream, vecptr, veclen, 3);
+		ib_string_clear(out);
+	}
+}
+
+static void async_cache_reply_push(CAsyncCacheClient *client, int count)
+{
+	if (client->resp3) {
+		ib_resp_write_push(client->cache->reply, count);
+	}	else {
+		ib_resp_write_array(client->cache->reply, count);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// entries
+//---------------------------------------------------------------------
+static void async_cache_entry_free(CAsyncCacheEntry *entry)
+{
+	if (async_timer_is_active(&entry->expire)) {
+		async_timer_stop(entry->cache->loop, &entry->expire);
+	}
+	ib_string_delete(entry->key);
+	ib_string_delete(entry->value);
+	ikmem_free(entry);
+}
+
+static void async_cache_entry_erase(CAsyncCache *cache, 
+	CAsyncCacheEntry *entry)
+{
+	ib_map_remove(&cache->keys, entry->key);
+	async_cache_entry_free(entry);
+}
+
+// lookup key, an entry past its deadline is removed here even if its
+// timer has not fired yet
+static CAsyncCacheEntry *async_cache_find(CAsyncCache *cache,
+	const void *key, int keylen)
+{
+	struct ib_hash_entry *hentry;
+	CAsyncCacheEntry *entry;
+	ib_string name;
+	name.ptr = (char*)key;
+	name.size = keylen;
+	hentry = ib_map_find_str(&cache->keys, &name);
+	if (hentry == NULL) return NULL;
+	entry = (CAsyncCacheEntry*)hentry->value;
+	if (entry->deadline > 0 && entry->deadline <= async_cache_now(cache)) {
+		async_cache_entry_erase(cache, entry);
+		cache->num_expired++;
+		return NULL;
+	}
+	return entry;
+}
+
+// find or create key
+static CAsyncCacheEntry *async_cache_ensure(CAsyncCache *cache,
+	const void *key, int keylen)
+{
+	CAsyncCacheEntry *entry = async_cache_find(cache, key, keylen);
+	if (entry != NULL) return entry;
+	entry = (CAsyncCacheEntry*)ikmem_malloc(sizeof(CAsyncCacheEntry));
+	if (entry == NULL) return NULL;
+	entry->key = ib_string_new_size((const char*)key, keylen);
+	entry->value = ib_string_new();
+	entry->cache = cache;
+	entry->deadline = 0;
+	async_timer_init(&entry->expire, async_cache_evt_expire);
+	entry->expire.user = entry;
+	ib_map_set(&cache->keys, entry->key, entry);
+	return entry;
+}
+
+// arm the timer for the remaining time, long ttls take several rounds
+static void async_cache_entry_arm(CAsyncCache *cache, 
+	CAsyncCacheEntry *entry)
+{
+	IINT64 remain = entry->deadline - async_cache_now(cache);
+	if (remain < 1) remain = 1;
+	if (remain > 0x3fffffff) remain = 0x3fffffff;
+	async_timer_start(cache->loop, &entry->expire, (IUINT32)remain, 0);
+}
+
+// ttl in milliseconds, ttl <= 0 removes the deadline
+static void async_cache_entry_expire(CAsyncCache *cache,
+	CAsyncCacheEntry *entry, IINT64 ttl)
+{
+	if (async_timer_is_active(&entry->expire)) {
+		async_timer_stop(cache->loop, &entry->expire);
+	}
+	entry->deadline = 0;
+	if (ttl > 0) {
+		entry->deadline = async_cache_now(cache) + ttl;
+		async_cache_entry_arm(cache, entry);
+	}
+}
+
+static void async_cache_evt_expire(CAsyncLoop *loop, CAsyncTimer *timer)
+{
+	CAsyncCacheEntry *entry = (CAsyncCacheEntry*)timer->user;
+	CAsyncCache *cache = entry->cache;
+	async_timer_stop(loop, timer);
+	if (entry->deadline > async_cache_now(cache)) {
+		async_cache_entry_arm(cache, entry);
 		return;
 	}
+	async_cache_entry_erase(cache, entry);
+	cache->num_expired++;
+}
 
-	// close or detach stream
-	if (codec->borrow == 0) {
-		if (codec->stream) {
-			async_stream_close(codec->stream);
+
+//---------------------------------------------------------------------
+// in-process access
+//---------------------------------------------------------------------
+const ib_string *async_cache_get(CAsyncCache *cache, const void *key,
+	int keylen)
+{
+	CAsyncCacheEntry *entry = async_cache_find(cache, key, keylen);
+	return (entry)? entry->value : NULL;
+}
+
+int async_cache_set(CAsyncCache *cache, const void *key, int keylen,
+	const void *value, int size, IINT64 ttl)
+{
+	CAsyncCacheEntry *entry = async_cache_ensure(cache, key, keylen);
+	if (entry == NULL) return -1;
+	ib_string_assign_size(entry->value, (const char*)value, size);
+	async_cache_entry_expire(cache, entry, ttl);
+	return 0;
+}
+
+int async_cache_del(CAsyncCache *cache, const void *key, int keylen)
+{
+	CAsyncCacheEntry *entry = async_cache_find(cache, key, keylen);
+	if (entry == NULL) return 0;
+	async_cache_entry_erase(cache, entry);
+	return 1;
+}
+
+
+//---------------------------------------------------------------------
+// commands
+//---------------------------------------------------------------------
+static void async_cache_cmd_ping(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	ib_string *out = client->cache->reply;
+	if (client->nchannels > 0 && client->resp3 == 0) {
+		ib_resp_write_array(out, 2);
+		ib_resp_write_bulk(out, "pong", 4);
+		if (argc > 1) {
+			async_cache_reply_bulk(client, argv[1]->str, argv[1]->size);
+		}	else {
+			ib_resp_write_bulk(out, "", 0);
 		}
 	}
+	else if (argc > 1) {
+		async_cache_reply_bulk(client, argv[1]->str, argv[1]->size);
+	}
 	else {
-		if (codec->stream) {
-			codec->stream->user = NULL;
-			codec->stream->callback = NULL;
+		ib_resp_write_status(out, "PONG");
+	}
+}
+
+static void async_cache_cmd_echo(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	(void)argc;
+	async_cache_reply_bulk(client, argv[1]->str, argv[1]->size);
+}
+
+static void async_cache_cmd_hello(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	ib_string *out = client->cache->reply;
+	if (argc > 1) {
+		IINT64 version = 0;
+		async_cache_atoi((char*)argv[1]->str, argv[1]->size, &version);
+		if (version != 2 && version != 3) {
+			async_cache_reply_error(client, 
+					"NOPROTO unsupported protocol version");
+			return;
 		}
+		client->resp3 = (version == 3)? 1 : 0;
 	}
-	codec->stream = NULL;
+	if (client->resp3) {
+		ib_resp_write_map(out, 2);
+	}	else {
+		ib_resp_write_array(out, 4);
+	}
+	ib_resp_write_bulk(out, "server", 6);
+	ib_resp_write_bulk(out, "asyncnet", 8);
+	ib_resp_write_bulk(out, "proto", 5);
+	ib_resp_write_int(out, client->resp3? 3 : 2);
+}
 
-	// delete reader
-	switch (codec->codec) {
-	case ASYNC_CODEC_RESP:
-		if (codec->reader)
-			ib_resp_reader_delete((ib_resp_reader*)codec->reader);
-		break;
-	case ASYNC_CODEC_MSGPACK:
-		if (codec->reader)
-			ib_msgpack_reader_delete((ib_msgpack_reader*)codec->reader);
-		break;
-	case ASYNC_CODEC_JSON:
-		if (codec->reader)
-			ib_json_reader_delete((ib_json_reader*)codec->reader);
-		break;
+static void async_cache_cmd_quit(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	(void)argc;
+	(void)argv;
+	ib_resp_write_status(client->cache->reply, "OK");
+	client->quit = 1;
+}
+
+static void async_cache_cmd_get(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	CAsyncCache *cache = client->cache;
+	CAsyncCacheEntry *entry;
+	(void)argc;
+	entry = async_cache_find(cache, argv[1]->str, argv[1]->size);
+	if (entry == NULL) {
+		cache->num_misses++;
+		ib_resp_write_nil(cache->reply);
+	}	else {
+		cache->num_hits++;
+		async_cache_reply_bulk(client, entry->value->ptr, 
+				entry->value->size);
 	}
-	codec->reader = NULL;
+}
 
-	// release zone
-	ib_zone_destroy(&codec->zone);
-	if (codec->zonebuf) {
-		ikmem_free(codec->zonebuf);
-		codec->zonebuf = NULL;
-		codec->zonebuf_size = 0;
+static void async_cache_cmd_mget(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	CAsyncCache *cache = client->cache;
+	int i;
+	ib_resp_write_array(cache->reply, argc - 1);
+	for (i = 1; i < argc; i++) {
+		CAsyncCacheEntry *entry;
+		entry = async_cache_find(cache, argv[i]->str, argv[i]->size);
+		if (entry == NULL) {
+			cache->num_misses++;
+			ib_resp_write_nil(cache->reply);
+		}	else {
+			cache->num_hits++;
+			async_cache_reply_bulk(client, entry->value->ptr, 
+					entry->value->size);
+		}
+	}
+}
+
+// SET key value [NX|XX] [EX seconds|PX milliseconds]
+static void async_cache_cmd_set(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	CAsyncCache *cache = client->cache;
+	CAsyncCacheEntry *entry;
+	IINT64 ttl = 0;
+	int nx = 0, xx = 0, i;
+	for (i = 3; i < argc; i++) {
+		const char *opt = (const char*)argv[i]->str;
+		int size = argv[i]->size;
+		if (size == 2 && (opt[0] | 32) == 'n' && (opt[1] | 32) == 'x') {
+			nx = 1;
+		}
+		else if (size == 2 && (opt[0] | 32) == 'x' && (opt[1] | 32) == 'x') {
+			xx = 1;
+		}
+		else if (size == 2 && (opt[1] | 32) == 'x' && i + 1 < argc &&
+			((opt[0] | 32) == 'e' || (opt[0] | 32) == 'p')) {
+			i++;
+			if (async_cache_atoi((char*)argv[i]->str, argv[i]->size, 
+						&ttl) != 0 || ttl <= 0 || 
+					ttl > 0x7fffffffffffLL) {
+				async_cache_reply_error(client, 
+						"ERR invalid expire time in 'set' command");
+				return;
+			}
+			if ((opt[0] | 32) == 'e') ttl *= 1000;
+		}
+		else {
+			async_cache_reply_error(client, "ERR syntax error");
+			return;
+		}
+	}
+	if (nx && xx) {
+		async_cache_reply_error(client, "ERR syntax error");
+		return;
+	}
+	entry = async_cache_find(cache, argv[1]->str, argv[1]->size);
+	if ((nx && entry != NULL) || (xx && entry == NULL)) {
+		ib_resp_write_nil(cache->reply);
+		return;
+	}
+	if (entry == NULL) {
+		entry = async_cache_ensure(cache, argv[1]->str, argv[1]->size);
+	}
+	ib_string_assign_size(entry->value, (char*)argv[2]->str, argv[2]->size);
+	async_cache_entry_expire(cache, entry, ttl);
+	ib_resp_write_status(cache->reply, "OK");
+}
+
+static void async_cache_cmd_del(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	int count = 0, i;
+	for (i = 1; i < argc; i++) {
+		count += async_cache_del(client->cache, argv[i]->str, 
+				argv[i]->size);
+	}
+	ib_resp_write_int(client->cache->reply, count);
+}
+
+static void async_cache_cmd_exists(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	int count = 0, i;
+	for (i = 1; i < argc; i++) {
+		if (async_cache_find(client->cache, argv[i]->str, 
+					argv[i]->size) != NULL) {
+			count++;
+		}
+	}
+	ib_resp_write_int(client->cache->reply, count);
+}
+
+// EXPIRE/PEXPIRE: a deadline in the past removes the key
+static void async_cache_cmd_expire(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	CAsyncCache *cache = client->cache;
+	CAsyncCacheEntry *entry;
+	IINT64 ttl;
+	(void)argc;
+	if (async_cache_atoi((char*)argv[2]->str, argv[2]->size, &ttl) != 0 ||
+		ttl > 0x7fffffffffffLL || ttl < -0x7fffffffffffLL) {
+		async_cache_reply_error(client, 
+				"ERR value is not an integer or out of range");
+		return;
+	}
+	entry = async_cache_find(cache, argv[1]->str, argv[1]->size);
+	if (entry == NULL) {
+		ib_resp_write_int(cache->reply, 0);
+		return;
+	}
+	if ((argv[0]->str[0] | 32) == 'e') ttl *= 1000;
+	if (ttl <= 0) {
+		async_cache_entry_erase(cache, entry);
+	}	else {
+		async_cache_entry_expire(cache, entry, ttl);
+	}
+	ib_resp_write_int(cache->reply, 1);
+}
+
+// TTL/PTTL: -2 for missing keys, -1 for keys without deadline
+static void async_cache_cmd_ttl(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	CAsyncCache *cache = client->cache;
+	CAsyncCacheEntry *entry;
+	IINT64 remain = -2;
+	(void)argc;
+	entry = async_cache_find(cache, argv[1]->str, argv[1]->size);
+	if (entry != NULL) {
+		remain = -1;
+		if (entry->deadline > 0) {
+			remain = entry->deadline - async_cache_now(cache);
+			if ((argv[0]->str[0] | 32) == 't') {
+				remain = (remain + 500) / 1000;
+			}
+		}
 	}
+	ib_resp_write_int(cache->reply, remain);
+}
 
-	// release encode buffer
-	if (codec->encode_buf) {
-		ib_string_delete(codec->encode_buf);
-		codec->encode_buf = NULL;
+// INCR/DECR/INCRBY/DECRBY
+static void async_cache_cmd_incr(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	CAsyncCache *cache = client->cache;
+	CAsyncCacheEntry *entry;
+	IINT64 value = 0, delta = 1;
+	char text[24];
+	int size;
+	if (argc > 2) {
+		if (async_cache_atoi((char*)argv[2]->str, argv[2]->size, 
+					&delta) != 0) {
+			async_cache_reply_error(client, 
+					"ERR value is not an integer or out of range");
+			return;
+		}
 	}
+	if ((argv[0]->str[0] | 32) == 'd') {
+		if (delta == (-0x7fffffffffffffffLL - 1)) {
+			async_cache_reply_error(client, 
+					"ERR decrement would overflow");
+			return;
+		}
+		delta = -delta;
+	}
+	entry = async_cache_find(cache, argv[1]->str, argv[1]->size);
+	if (entry != NULL) {
+		if (async_cache_atoi(entry->value->ptr, entry->value->size, 
+					&value) != 0) {
+			async_cache_reply_error(client, 
+					"ERR value is not an integer or out of range");
+			return;
+		}
+	}
+	if ((delta > 0 && value > 0x7fffffffffffffffLL - delta) ||
+		(delta < 0 && value < (-0x7fffffffffffffffLL - 1) - delta)) {
+		async_cache_reply_error(client, 
+				"ERR increment or decrement would overflow");
+		return;
+	}
+	value += delta;
+	if (entry == NULL) {
+		entry = async_cache_ensure(cache, argv[1]->str, argv[1]->size);
+		if (entry == NULL) {
+			async_cache_reply_error(client, "ERR out of memory");
+			return;
+		}
+	}
+	size = async_cache_itoa(text, value);
+	ib_string_assign_size(entry->value, text, size);
+	ib_resp_write_int(cache->reply, value);
+}
 
-	// reset state
-	codec->releasing = 0;
-	codec->busy = 0;
-	codec->loop = NULL;
-	codec->callback = NULL;
-	codec->receiver = NULL;
-
-	ikmem_free(codec);
+static void async_cache_cmd_dbsize(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	(void)argc;
+	(void)argv;
+	ib_resp_write_int(client->cache->reply, 
+			(IINT64)ib_map_count(&client->cache->keys));
 }
 
 
 //---------------------------------------------------------------------
-// encode ib_object and write to stream
+// pub/sub: channels are names of cache->topic
 //---------------------------------------------------------------------
-int async_codec_send(CAsyncCodec *codec, const ib_object *obj)
-{
-	int hr;
-
-	assert(codec);
-	assert(codec->stream);
 
-	if (obj == NULL) return -1;
-
-	// clear encode_buf (preserves capacity)
-	ib_string_clear(codec->encode_buf);
-
-	// encode
-	switch (codec->codec) {
-	case ASYNC_CODEC_RESP:
-		hr = ib_resp_encode(codec->encode_buf, obj);
-		break;
-	case ASYNC_CODEC_MSGPACK:
-		hr = ib_msgpack_encode(codec->encode_buf, obj);
-		break;
-	case ASYNC_CODEC_JSON:
-		hr = ib_json_encode(codec->encode_buf, obj);
-		break;
-	default:
-		return -1;
+// message from the topic: the concrete name is topic->name, the data
+// is gathered into the stream buffer without an intermediate copy.
+static int async_cache_channel_message(CAsyncSubscribe *sub, 
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size)
+{
+	CAsyncCacheChannel *channel = (CAsyncCacheChannel*)sub->user;
+	CAsyncCacheClient *client = channel->client;
+	ib_string *out = client->cache->scratch;
+	const char *name = sub->topic->name;
+	const void *vecptr[3];
+	long veclen[3];
+	int count = (channel->pattern)? 4 : 3;
+	(void)wparam;
+	(void)lparam;
+	if (name == NULL) name = channel->name->ptr;
+	ib_string_clear(out);
+	if (client->resp3) {
+		ib_resp_write_push(out, count);
+	}	else {
+		ib_resp_write_array(out, count);
 	}
+	if (channel->pattern) {
+		ib_resp_write_bulk(out, "pmessage", 8);
+		ib_resp_write_bulk(out, channel->name->ptr, channel->name->size);
+	}	else {
+		ib_resp_write_bulk(out, "message", 7);
+	}
+	ib_resp_write_bulk(out, name, (int)strlen(name));
+	async_cache_reply_header(out, '$', size);
+	vecptr[0] = out->ptr;
+	veclen[0] = out->size;
+	vecptr[1] = ptr;
+	veclen[1] = size;
+	vecptr[2] = "\r\n";
+	veclen[2] = 2;
+	async_stream_writev(client->codec->stream, vecptr, veclen, 3);
+	ib_string_clear(out);
+	return 0;
+}
 
-	if (hr != 0) return -1;
-
-	// write to stream
-	async_stream_write(codec->stream,
-			ib_string_ptr(codec->encode_buf),
-			ib_string_size(codec->encode_buf));
+static CAsyncCacheChannel *async_cache_channel_find(
+	CAsyncCacheClient *client, const void *name, int size, int pattern)
+{
+	ilist_head *it;
+	for (it = client->channels.next; it != &client->channels; 
+			it = it->next) {
+		CAsyncCacheChannel *channel;
+		channel = ilist_entry(it, CAsyncCacheChannel, node);
+		if (channel->pattern == pattern &&
+			channel->name->size == size && 
+			memcmp(channel->name->ptr, name, size) == 0) {
+			return channel;
+		}
+	}
+	return NULL;
+}
 
-	return 0;
+static void async_cache_channel_free(CAsyncCacheChannel *channel)
+{
+	async_sub_deregister(&channel->sub);
+	ilist_del(&channel->node);
+	channel->client->nchannels--;
+	if (channel->pattern) channel->client->npatterns--;
+	ib_string_delete(channel->name);
+	ikmem_free(channel);
 }
 
+// SUBSCRIBE (pattern = 0) and PSUBSCRIBE (pattern = 1)
+static void async_cache_subscribe(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv, int pattern)
+{
+	CAsyncCache *cache = client->cache;
+	const char *kind = (pattern)? "psubscribe" : "subscribe";
+	int i;
+	for (i = 1; i < argc; i++) {
+		const char *name = (const char*)argv[i]->str;
+		int size = argv[i]->size;
+		if (async_cache_channel_find(client, name, size, pattern) == NULL) {
+			CAsyncCacheChannel *channel;
+			channel = (CAsyncCacheChannel*)
+				ikmem_malloc(sizeof(CAsyncCacheChannel));
+			if (channel == NULL) {
+				async_cache_reply_error(client, "ERR out of memory");
+				continue;
+			}
+			channel->name = ib_string_new_size(name, size);
+			channel->client = client;
+			channel->pattern = pattern;
+			async_sub_init(&channel->sub, async_cache_channel_message);
+			channel->sub.user = channel;
+			if (memchr(name, 0, size) != NULL || async_sub_register_node(
+					cache->topic, &channel->sub, channel->name->ptr, 
+					(pattern)? 0 : 1) != 0) {
+				ib_string_delete(channel->name);
+				ikmem_free(channel);
+				async_cache_reply_error(client, "ERR invalid channel");
+				continue;
+			}
+			ilist_add_tail(&channel->node, &client->channels);
+			client->nchannels++;
+			if (pattern) client->npatterns++;
+		}
+		async_cache_reply_push(client, 3);
+		ib_resp_write_bulk(cache->reply, kind, (int)strlen(kind));
+		ib_resp_write_bulk(cache->reply, name, size);
+		ib_resp_write_int(cache->reply, client->nchannels);
+	}
+}
 
-//---------------------------------------------------------------------
-// write raw bytes to stream
-//---------------------------------------------------------------------
-void async_codec_write(CAsyncCodec *codec, const void *ptr, long size)
+// UNSUBSCRIBE (pattern = 0) and PUNSUBSCRIBE (pattern = 1)
+static void async_cache_unsubscribe(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv, int pattern)
 {
-	assert(codec);
-	assert(codec->stream);
-	if (ptr && size > 0) {
-		async_stream_write(codec->stream, ptr, size);
+	ib_string *out = client->cache->reply;
+	const char *kind = (pattern)? "punsubscribe" : "unsubscribe";
+	int size = (int)strlen(kind);
+	int i;
+	if (argc == 1) {
+		ilist_head *it, *next;
+		int count = (pattern)? client->npatterns : 
+			client->nchannels - client->npatterns;
+		if (count == 0) {
+			async_cache_reply_push(client, 3);
+			ib_resp_write_bulk(out, kind, size);
+			ib_resp_write_nil(out);
+			ib_resp_write_int(out, client->nchannels);
+		}
+		for (it = client->channels.next; it != &client->channels; 
+				it = next) {
+			CAsyncCacheChannel *channel;
+			channel = ilist_entry(it, CAsyncCacheChannel, node);
+			next = it->next;
+			if (channel->pattern != pattern) continue;
+			async_cache_reply_push(client, 3);
+			ib_resp_write_bulk(out, kind, size);
+			ib_resp_write_bulk(out, channel->name->ptr, channel->name->size);
+			async_cache_channel_free(channel);
+			ib_resp_write_int(out, client->nchannels);
+		}
+		return;
+	}
+	for (i = 1; i < argc; i++) {
+		CAsyncCacheChannel *channel;
+		channel = async_cache_channel_find(client, argv[i]->str, 
+				argv[i]->size, pattern);
+		if (channel != NULL) {
+			async_cache_channel_free(channel);
+		}
+		async_cache_reply_push(client, 3);
+		ib_resp_write_bulk(out, kind, size);
+		ib_resp_write_bulk(out, argv[i]->str, argv[i]->size);
+		ib_resp_write_int(out, client->nchannels);
 	}
 }
 
+static void async_cache_cmd_subscribe(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	async_cache_subscribe(client, argc, argv, 0);
+}
 
-//---------------------------------------------------------------------
-// enable/disable stream events
-//---------------------------------------------------------------------
-void async_codec_enable(CAsyncCodec *codec, int event)
+static void async_cache_cmd_unsubscribe(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
 {
-	assert(codec);
-	assert(codec->stream);
-	async_stream_enable(codec->stream, event);
+	async_cache_unsubscribe(client, argc, argv, 0);
 }
 
-void async_codec_disable(CAsyncCodec *codec, int event)
+static void async_cache_cmd_psubscribe(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
 {
-	assert(codec);
-	assert(codec->stream);
-	async_stream_disable(codec->stream, event);
+	async_cache_subscribe(client, argc, argv, 1);
 }
 
+static void async_cache_cmd_punsubscribe(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
+{
+	async_cache_unsubscribe(client, argc, argv, 1);
+}
 
-//---------------------------------------------------------------------
-// configure reader limits
-//---------------------------------------------------------------------
-void async_codec_set_limits(CAsyncCodec *codec,
-		int max_depth, long max_bulk, int max_elements)
+// replies the number of channels of this cache matching the name,
+// subscribers of the topic in this process receive it as well
+static void async_cache_cmd_publish(CAsyncCacheClient *client, 
+	int argc, ib_object * const *argv)
 {
-	assert(codec);
-	switch (codec->codec) {
-	case ASYNC_CODEC_RESP:
-		ib_resp_reader_set_limits(
-				(ib_resp_reader*)codec->reader,
-				max_depth, max_bulk, max_elements);
-		break;
-	case ASYNC_CODEC_MSGPACK:
-		ib_msgpack_reader_set_limits(
-				(ib_msgpack_reader*)codec->reader,
-				max_depth, max_bulk, max_elements);
-		break;
-	case ASYNC_CODEC_JSON:
-		ib_json_reader_set_limits(
-				(ib_json_reader*)codec->reader,
-				max_depth, max_bulk, max_elements);
-		break;
+	CAsyncCache *cache = client->cache;
+	ib_string *name = cache->scratch;
+	ilist_head *it, *ic;
+	int count = 0;
+	(void)argc;
+	ib_string_assign_size(name, (char*)argv[1]->str, argv[1]->size);
+	if (memchr(name->ptr, 0, name->size) != NULL ||
+		async_topic_publish_name(cache->topic, name->ptr, 0, 0, 
+			argv[2]->str, argv[2]->size) != 0) {
+		async_cache_reply_error(client, "ERR invalid channel");
+		return;
+	}
+	for (it = cache->clients.next; it != &cache->clients; it = it->next) {
+		CAsyncCacheClient *peer = ilist_entry(it, CAsyncCacheClient, node);
+		for (ic = peer->channels.next; ic != &peer->channels; 
+				ic = ic->next) {
+			CAsyncCacheChannel *channel;
+			channel = ilist_entry(ic, CAsyncCacheChannel, node);
+			if (channel->pattern == 0) {
+				if (strcmp(channel->name->ptr, name->ptr) == 0) count++;
+			}
+			else if (async_topic_match(channel->name->ptr, name->ptr)) {
+				count++;
+			}
+		}
 	}
+	ib_resp_write_int(cache->reply, count);
 }
 
 
 //---------------------------------------------------------------------
-// enable/disable inline command parsing (RESP only)
+// command table
 //---------------------------------------------------------------------
-void async_codec_set_inline(CAsyncCodec *codec, int enable)
+static const CAsyncCacheCommand async_cache_commands[] = {
+	{ "get", 2, 2, 0, async_cache_cmd_get },
+	{ "set", 3, -1, 0, async_cache_cmd_set },
+	{ "del", 2, -1, 0, async_cache_cmd_del },
+	{ "mget", 2, -1, 0, async_cache_cmd_mget },
+	{ "incr", 2, 2, 0, async_cache_cmd_incr },
+	{ "decr", 2, 2, 0, async_cache_cmd_incr },
+	{ "incrby", 3, 3, 0, async_cache_cmd_incr },
+	{ "decrby", 3, 3, 0, async_cache_cmd_incr },
+	{ "exists", 2, -1, 0, async_cache_cmd_exists },
+	{ "expire", 3, 3, 0, async_cache_cmd_expire },
+	{ "pexpire", 3, 3, 0, async_cache_cmd_expire },
+	{ "ttl", 2, 2, 0, async_cache_cmd_ttl },
+	{ "pttl", 2, 2, 0, async_cache_cmd_ttl },
+	{ "dbsize", 1, 1, 0, async_cache_cmd_dbsize },
+	{ "publish", 3, 3, 0, async_cache_cmd_publish },
+	{ "subscribe", 2, -1, 1, async_cache_cmd_subscribe },
+	{ "unsubscribe", 1, -1, 1, async_cache_cmd_unsubscribe },
+	{ "psubscribe", 2, -1, 1, async_cache_cmd_psubscribe },
+	{ "punsubscribe", 1, -1, 1, async_cache_cmd_punsubscribe },
+	{ "ping", 1, 2, 1, async_cache_cmd_ping },
+	{ "echo", 2, 2, 0, async_cache_cmd_echo },
+	{ "hello", 1, 2, 0, async_cache_cmd_hello },
+	{ "quit", 1, 1, 1, async_cache_cmd_quit },
+	{ NULL, 0, 0, 0, NULL },
+};
+
+static const CAsyncCacheCommand *async_cache_command(const char *name, 
+	int size)
 {
-	assert(codec);
-	if (codec->codec == ASYNC_CODEC_RESP && codec->reader) {
-		ib_resp_reader_set_inline((ib_resp_reader*)codec->reader, enable);
+	const CAsyncCacheCommand *cmd;
+	for (cmd = async_cache_commands; cmd->name; cmd++) {
+		int i;
+		for (i = 0; i < size; i++) {
+			int ch = (unsigned char)name[i];
+			if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+			if (cmd->name[i] != ch || ch == 0) break;
+		}
+		if (i == size && cmd->name[size] == 0) {
+			return cmd;
+		}
 	}
+	return NULL;
 }
 
 
 //---------------------------------------------------------------------
-// signal end-of-input (JSON only)
+// clients
 //---------------------------------------------------------------------
-void async_codec_set_finish(CAsyncCodec *codec)
+static void async_cache_client_close(CAsyncCacheClient *client, 
+	int graceful)
 {
-	assert(codec);
-	if (codec->codec == ASYNC_CODEC_JSON && codec->reader) {
-		ib_json_reader_finish((ib_json_reader*)codec->reader);
+	CAsyncCodec *codec = client->codec;
+	CAsyncStream *stream = codec->stream;
+	while (!ilist_is_empty(&client->channels)) {
+		CAsyncCacheChannel *channel;
+		channel = ilist_entry(client->channels.next, 
+				CAsyncCacheChannel, node);
+		async_cache_channel_free(channel);
+	}
+	ilist_del(&client->node);
+	client->cache->num_clients--;
+	// the codec may be dispatching to us and defers its own delete,
+	// so the stream is taken from it and closed here
+	codec->user = NULL;
+	codec->receiver = NULL;
+	codec->callback = NULL;
+	codec->stream = NULL;
+	async_codec_delete(codec);
+	stream->user = NULL;
+	stream->callback = NULL;
+	if (graceful) {
+		async_stream_graceful(stream, ASYNC_CACHE_LINGER);
+	}	else {
+		async_stream_close(stream);
 	}
+	ikmem_free(client);
 }
 
-
-//---------------------------------------------------------------------
-// set zonebuf size (deferred, applied on next zone_clear)
-//---------------------------------------------------------------------
-void async_codec_set_zone_size(CAsyncCodec *codec, size_t size)
+static void async_cache_codec_callback(CAsyncCodec *codec, int event)
 {
-	assert(codec);
-	codec->pending_resize = size;
+	CAsyncCacheClient *client = (CAsyncCacheClient*)codec->user;
+	if (client == NULL) return;
+	// ASYNC_CODEC_EVT_ERROR shares the bit with stream errors
+	if ((event & ASYNC_CODEC_EVT_ERROR) && codec->error) {
+		ib_string_clear(client->cache->reply);
+		async_cache_reply_error(client, "ERR Protocol error");
+		async_cache_flush(client);
+		async_cache_client_close(client, 1);
+	}
+	else if (event & ASYNC_STREAM_EVT_ERROR) {
+		async_cache_client_close(client, 0);
+	}
+	else if (event & ASYNC_STREAM_EVT_EOF) {
+		async_cache_client_close(client, 1);
+	}
 }
 
+static void async_cache_receiver(CAsyncCodec *codec, const ib_object *obj)
+{
+	CAsyncCacheClient *client = (CAsyncCacheClient*)codec->user;
+	CAsyncCache *cache;
+	const CAsyncCacheCommand *cmd = NULL;
+	ib_object * const *argv;
+	int argc, i;
+	if (client == NULL) return;
+	cache = client->cache;
+	if (obj->type != IB_OBJECT_ARRAY || obj->size == 0) {
+		async_cache_reply_error(client, "ERR Protocol error");
+		async_cache_flush(client);
+		return;
+	}
+	argc = obj->size;
+	argv = obj->element;
+	for (i = 0; i < argc; i++) {
+		if (argv[i]->type != IB_OBJECT_STR && 
+			argv[i]->type != IB_OBJECT_BIN) {
+			break;
+		}
+	}
+	if (i < argc) {
+		async_cache_reply_error(client, "ERR Protocol error");
+	}
+	else if ((cmd = async_cache_command((char*)argv[0]->str, 
+					argv[0]->size)) == NULL) {
+		async_cache_reply_error(client, "ERR unknown command");
+	}
+	else if (argc < cmd->minargs || 
+			(cmd->maxargs >= 0 && argc > cmd->maxargs)) {
+		async_cache_reply_error(client, "ERR wrong number of arguments");
+	}
+	else if (client->nchannels > 0 && client->resp3 == 0 && 
+			cmd->pubsub == 0) {
+		async_cache_reply_error(client, "ERR only (P)SUBSCRIBE / "
+				"(P)UNSUBSCRIBE / PING / QUIT are allowed in this context");
+	}
+	else {
+		cache->num_commands++;
+		cmd->handler(client, argc, argv);
+	}
+	async_cache_flush(client);
+	if (client->quit) {
+		async_cache_client_close(client, 1);
+	}
+}
 
-//---------------------------------------------------------------------
-// query stream pending data size
-//---------------------------------------------------------------------
-long async_codec_remain(const CAsyncCodec *codec)
+int async_cache_attach(CAsyncCache *cache, CAsyncStream *stream)
 {
-	assert(codec);
-	if (codec->stream) {
-		return async_stream_remain(codec->stream);
+	CAsyncCacheClient *client;
+	client = (CAsyncCacheClient*)ikmem_malloc(sizeof(CAsyncCacheClient));
+	if (client == NULL) return -1;
+	client->codec = async_codec_new(stream, ASYNC_CODEC_RESP, 0,
+			async_cache_codec_callback, async_cache_receiver);
+	if (client->codec == NULL) {
+		ikmem_free(client);
+		return -1;
 	}
+	client->cache = cache;
+	client->codec->user = client;
+	client->nchannels = 0;
+	client->npatterns = 0;
+	client->resp3 = 0;
+	client->quit = 0;
+	ilist_init(&client->channels);
+	ilist_add_tail(&client->node, &cache->clients);
+	cache->num_clients++;
+	async_codec_set_inline(client->codec, 1);
+	async_codec_enable(client->codec, ASYNC_EVENT_READ | ASYNC_EVENT_WRITE);
 	return 0;
 }
 
 
 //---------------------------------------------------------------------
-// query protocol error state
+// server
 //---------------------------------------------------------------------
-int async_codec_error(const CAsyncCodec *codec)
+static void async_cache_accept(CAsyncListener *listener, int fd,
+	const struct sockaddr *addr, int len)
 {
-	assert(codec);
-	return codec->error;
+	CAsyncCache *cache = (CAsyncCache*)listener->user;
+	CAsyncStream *stream;
+	(void)addr;
+	(void)len;
+	stream = async_stream_tcp_assign(cache->loop, NULL, fd, 1);
+	if (stream == NULL) {
+		iclose(fd);
+		return;
+	}
+	if (async_cache_attach(cache, stream) != 0) {
+		async_stream_close(stream);
+	}
 }
 
+CAsyncCache *async_cache_new(CAsyncLoop *loop, CAsyncTopic *topic)
+{
+	CAsyncCache *cache;
+	cache = (CAsyncCache*)ikmem_malloc(sizeof(CAsyncCache));
+	if (cache == NULL) return NULL;
+	memset(cache, 0, sizeof(CAsyncCache));
+	cache->loop = loop;
+	cache->topic = topic;
+	if (topic == NULL) {
+		cache->topic = async_topic_new(loop);
+		cache->own_topic = 1;
+	}
+	ib_map_init(&cache->keys, ib_hash_func_str, ib_hash_compare_str);
+	ilist_init(&cache->clients);
+	cache->reply = ib_string_new();
+	cache->scratch = ib_string_new();
+	return cache;
+}
 
-//---------------------------------------------------------------------
-// reset: clear error, clear reader buffer
-//---------------------------------------------------------------------
-void async_codec_reset(CAsyncCodec *codec)
+void async_cache_delete(CAsyncCache *cache)
 {
-	assert(codec);
-	codec->error = 0;
-	switch (codec->codec) {
-	case ASYNC_CODEC_RESP:
-		ib_resp_reader_clear((ib_resp_reader*)codec->reader);
-		break;
-	case ASYNC_CODEC_MSGPACK:
-		ib_msgpack_reader_clear((ib_msgpack_reader*)codec->reader);
-		break;
-	case ASYNC_CODEC_JSON:
-		ib_json_reader_clear((ib_json_reader*)codec->reader);
-		break;
+	struct ib_hash_entry *hentry;
+	if (cache == NULL) return;
+	if (cache->listener) {
+		async_listener_delete(cache->listener);
+		cache->listener = NULL;
+	}
+	while (!ilist_is_empty(&cache->clients)) {
+		CAsyncCacheClient *client;
+		client = ilist_entry(cache->clients.next, CAsyncCacheClient, node);
+		async_cache_client_close(client, 0);
+	}
+	ib_map_foreach(hentry, &cache->keys) {
+		async_cache_entry_free((CAsyncCacheEntry*)hentry->value);
+	}
+	ib_map_destroy(&cache->keys);
+	if (cache->own_topic) {
+		async_topic_delete(cache->topic);
+	}
+	ib_string_delete(cache->reply);
+	ib_string_delete(cache->scratch);
+	ikmem_free(cache);
+}
+
+int async_cache_listen(CAsyncCache *cache, const struct sockaddr *addr,
+	int addrlen, int flags)
+{
+	int hr;
+	if (cache->listener == NULL) {
+		cache->listener = async_listener_new(cache->loop, async_cache_accept);
+		if (cache->listener == NULL) return -1;
+		cache->listener->user = cache;
 	}
+	async_listener_stop(cache->listener);
+	hr = async_listener_start(cache->listener, 1024, flags, addr, addrlen);
+	return hr;
 }
 
 
+
 //=====================================================================
 // CAsyncPoll - an epoll like API based for CAsyncLoop
 //=====================================================================
+static void async_poll_evt_ready(CAsyncLoop *loop, CAsyncHook *hook,
+	CAsyncReady *ready, int count);
 
 // create a new CAsyncPoll object
 CAsyncPoll *async_poll_new(CAsyncLoop *loop,
@@ -1071,55 +4210,46 @@ CAsyncPoll *async_poll_new(CAsyncLoop *loop,
 	poll->closing = 0;
 	poll->count = 0;
 	poll->callback = callback;
-	ib_map_init(&poll->fds, ib_hash_func_int, ib_hash_compare_int);
+	poll->batch_callback = NULL;
+	async_hook_init(&poll->hook, async_poll_evt_ready);
+	poll->hook.user = poll;
 	return poll;
 }
 
 // delete CAsyncPoll object
 void async_poll_delete(CAsyncPoll *poll)
 {
-	CAsyncLoop *loop;
 	if (poll == NULL) return;
-	loop = poll->loop;
 	if (poll->busy) {
 		poll->closing = 1;
 		return;
 	}
-	while (ib_map_count(&poll->fds) > 0) {
-		struct ib_hash_entry *entry = ib_map_first(&poll->fds);
-		CAsyncPollItem *item = (CAsyncPollItem*)ib_hash_value(entry);
-		if (async_event_is_active(&item->evt)) {
-			async_event_stop(loop, &item->evt);
-		}
-		item->poll = NULL;
-		item->fd = -1;
-		item->events = 0;
-		item->udata = NULL;
-		ikmem_free(item);
-		ib_map_erase(&poll->fds, entry);
-	}
-	ib_map_destroy(&poll->fds);
+	async_hook_clear(poll->loop, &poll->hook);
+	async_hook_destroy(&poll->hook);
 	poll->loop = NULL;
 	poll->count = 0;
 	ikmem_free(poll);
 }
 
-
-// CAsyncEvent callback for poll items
-static void async_poll_callback(CAsyncLoop *loop, CAsyncEvent *event, int evt)
+// ready fds of this iteration, straight from the loop's fd table
+static void async_poll_evt_ready(CAsyncLoop *loop, CAsyncHook *hook,
+	CAsyncReady *ready, int count)
 {
-	CAsyncPollItem *item = (CAsyncPollItem*)event->user;
-	CAsyncPoll *poll;
-	int fd;
-	(void)loop;
-	if (item == NULL) return;
-	if (item->poll == NULL) return;
-	poll = item->poll;
-	if (poll->closing) return;
-	fd = item->fd;
+	CAsyncPoll *poll = (CAsyncPoll*)hook->user;
+	int i;
 	poll->busy++;
-	if (poll->callback) {
-		poll->callback(poll, fd, evt, item->udata);
+	if (poll->batch_callback) {
+		poll->batch_callback(poll, ready, count);
+	}
+	else {
+		// skip fds removed by an earlier callback
+		for (i = 0; i < count && poll->closing == 0; i++) {
+			if (async_hook_mask(loop, hook, ready[i].fd) < 0) continue;
+			if (poll->callback) {
+				poll->callback(poll, ready[i].fd, ready[i].events, 
+						ready[i].udata);
+			}
+		}
 	}
 	poll->busy--;
 	if (poll->closing) {
@@ -1131,35 +4261,10 @@ static void async_poll_callback(CAsyncLoop *loop, CAsyncEvent *event, int evt)
 // returns 0 on success, -1 on failure (e.g., fd already added)
 int async_poll_add(CAsyncPoll *poll, int fd, int events, void *udata)
 {
-	CAsyncPollItem *item = NULL;
-	struct ib_hash_entry *entry = NULL;
 	if (poll->closing) return -1;
 	if (fd < 0) return -1;
-	if (ib_map_find_int(&poll->fds, fd) != NULL) {
-		return -1; // fd already added
-	}
 	events &= (ASYNC_EVENT_READ | ASYNC_EVENT_WRITE);
-	item = (CAsyncPollItem*)ikmem_malloc(sizeof(CAsyncPollItem));
-	if (item == NULL) return -1;
-	memset(item, 0, sizeof(CAsyncPollItem));
-	item->poll = poll;
-	item->fd = fd;
-	item->events = events;
-	item->udata = udata;
-	async_event_init(&item->evt, async_poll_callback, fd, events);
-	item->evt.user = item;
-	if (item->events != 0) {
-		if (async_event_start(poll->loop, &item->evt) != 0) {
-			ikmem_free(item);
-			return -1;
-		}
-	}
-	entry = ib_map_set(&poll->fds, (void*)((size_t)fd), item);
-	if (entry == NULL) {
-		if (async_event_is_active(&item->evt)) {
-			async_event_stop(poll->loop, &item->evt);
-		}
-		ikmem_free(item);
+	if (async_hook_add(poll->loop, &poll->hook, fd, events, udata) != 0) {
 		return -1;
 	}
 	poll->count++;
@@ -1171,25 +4276,10 @@ int async_poll_add(CAsyncPoll *poll, int fd, int events, void *udata)
 // returns 0 on success, -1 on failure (e.g., fd not found)
 int async_poll_del(CAsyncPoll *poll, int fd)
 {
-	CAsyncPollItem *item = NULL;
-	struct ib_hash_entry *entry = NULL;
 	if (poll->closing) return -1;
-	if (fd < 0) return -1;
-	entry = ib_map_find_int(&poll->fds, fd);
-	if (entry == NULL) {
+	if (async_hook_del(poll->loop, &poll->hook, fd) != 0) {
 		return -1; // fd not found
 	}
-	item = (CAsyncPollItem*)ib_hash_value(entry);
-	if (item == NULL) return -1; // fd not found
-	if (async_event_is_active(&item->evt)) {
-		async_event_stop(poll->loop, &item->evt);
-	}
-	item->poll = NULL;
-	item->fd = -1;
-	item->events = 0;
-	item->udata = NULL;
-	ikmem_free(item);
-	ib_map_erase(&poll->fds, entry);
 	poll->count--;
 	return 0;
 }
@@ -1198,46 +4288,19 @@ int async_poll_del(CAsyncPoll *poll, int fd)
 // returns 0 on success, -1 on failure (e.g., fd not found)
 int async_poll_set(CAsyncPoll *poll, int fd, int events)
 {
-	CAsyncPollItem *item = NULL;
-	struct ib_hash_entry *entry = NULL;
 	if (poll->closing) return -1;
-	if (fd < 0) return -1;
-	entry = ib_map_find_int(&poll->fds, fd);
-	if (entry == NULL) {
-		return -1; // fd not found
-	}
 	events &= (ASYNC_EVENT_READ | ASYNC_EVENT_WRITE);
-	item = (CAsyncPollItem*)ib_hash_value(entry);
-	if (item == NULL) return -1; // fd not found
-	if (item->events == events) {
-		if (async_event_is_active(&item->evt) == 0) {
-			if (item->events != 0) {
-				if (async_event_start(poll->loop, &item->evt) != 0) {
-					return -1;
-				}
-			}
-		}
-		return 0;
-	}
-	if (async_event_is_active(&item->evt)) {
-		async_event_stop(poll->loop, &item->evt);
-	}
-	async_event_modify(&item->evt, events);
-	if (events != 0) {
-		if (async_event_start(poll->loop, &item->evt) != 0) {
-			async_event_modify(&item->evt, item->events);
-			if (item->events != 0) {
-				if (async_event_start(poll->loop, &item->evt) != 0) {
-					// failed to restore, mark as inactive
-					item->events = 0;
-					async_event_modify(&item->evt, item->events);
-				}
-			}
-			return -1;
-		}
+	if (async_hook_set(poll->loop, &poll->hook, fd, events) != 0) {
+		return -1; // fd not found
 	}
-	item->events = events;
 	return 0;
 }
 
+// switch between batch and per-fd delivery
+void async_poll_set_batch(CAsyncPoll *poll, void (*batch_callback)
+	(CAsyncPoll *poll, const CAsyncPollEvent *events, int count))
+{
+	poll->batch_callback = batch_callback;
+}
+
 
@@ -24,20 +24,34 @@ extern "C" {
 //---------------------------------------------------------------------
 struct CAsyncTopic;
 struct CAsyncSubscribe;
+struct CAsyncPayload;
+struct CAsyncBus;
+struct CAsyncBusPort;
 struct CAsyncSignal;
+struct CAsyncProcess;
 struct CAsyncCodec;
+struct CAsyncPipeline;
+struct CAsyncCache;
 struct CAsyncPoll;
 
 typedef struct CAsyncTopic CAsyncTopic;
 typedef struct CAsyncSubscribe CAsyncSubscribe;
+typedef struct CAsyncPayload CAsyncPayload;
+typedef struct CAsyncBus CAsyncBus;
+typedef struct CAsyncBusPort CAsyncBusPort;
 typedef struct CAsyncSignal CAsyncSignal;
+typedef struct CAsyncProcess CAsyncProcess;
 typedef struct CAsyncCodec CAsyncCodec;
+typedef struct CAsyncPipeline CAsyncPipeline;
+typedef struct CAsyncCache CAsyncCache;
 typedef struct CAsyncPoll CAsyncPoll;
 
 
 //---------------------------------------------------------------------
 // AsyncTopic/Subscribe
 //---------------------------------------------------------------------
+struct CAsyncTopicNode;
+
 struct CAsyncTopic {
 	CAsyncLoop *loop;
 	CAsyncPostpone evt_postpone;
@@ -47,18 +61,36 @@ struct CAsyncTopic {
 	struct ib_array *pendings;
 	struct ib_fastbin allocator;
 	struct ib_hash_map hash_map;
+	struct CAsyncTopicNode *patterns;   // trie of hierarchical patterns
+	struct ib_hash_map routes;          // concrete name -> subscribers
+	struct ib_string *scratch;
+	const char *name;       // name being dispatched, NULL for tids
 };
 
+#ifndef ASYNC_TOPIC_ROUTE_LIMIT
+#define ASYNC_TOPIC_ROUTE_LIMIT   4096
+#endif
+
 struct CAsyncSubscribe {
 	CAsyncTopic *topic;
 	ilist_head node;
 	int pending;
 	int tid;
+	struct CAsyncTopicNode *pattern;
 	void *user;
 	int (*callback)(CAsyncSubscribe *sub, IINT32 wparam, 
 		IINT32 lparam, const void *ptr, int size);
 };
 
+// refcounted message payload: published once, handed to every
+// subscriber without copy. The count is atomic, so a payload can be
+// shared by topics in different threads (see CAsyncBus).
+struct CAsyncPayload {
+	int refcnt;
+	int size;
+	char *data;       // size bytes followed by '\0'
+};
+
 
 //---------------------------------------------------------------------
 // topic subscribe management
@@ -70,10 +102,43 @@ CAsyncTopic *async_topic_new(CAsyncLoop *loop);
 // delete topic object
 void async_topic_delete(CAsyncTopic *topic);
 
-// publish a message
-void async_topic_publish(CAsyncTopic *topic, int tid, 
+// publish a message, data is copied into the topic queue and handed
+// to subscribers from the queue page when it is contiguous there.
+// returns 0 for success, -1 for invalid tid or size
+int async_topic_publish(CAsyncTopic *topic, int tid, 
 	IINT32 wparam, IINT32 lparam, const void *ptr, int size);
 
+// publish a refcounted payload without copying it: the topic holds a
+// reference until the message is dispatched, the caller keeps its own.
+// returns 0 for success, -1 for invalid tid or NULL payload
+int async_topic_publish_payload(CAsyncTopic *topic, int tid, 
+	IINT32 wparam, IINT32 lparam, CAsyncPayload *payload);
+
+// publish to a concrete hierarchical name like "feed.eu.fx", it is
+// delivered to every subscriber whose pattern matches the name.
+// returns 0 for success, -1 for invalid name or size
+int async_topic_publish_name(CAsyncTopic *topic, const char *name,
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size);
+
+// publish a refcounted payload to a hierarchical name
+int async_topic_publish_name_payload(CAsyncTopic *topic, const char *name,
+	IINT32 wparam, IINT32 lparam, CAsyncPayload *payload);
+
+// test a pattern against a concrete name, returns 1 for match:
+// segments are separated by '.', "*" matches exactly one segment and
+// a trailing "#" matches zero or more segments
+int async_topic_match(const char *pattern, const char *name);
+
+// allocate a payload (refcnt = 1) with size bytes, copied from ptr
+// when ptr is not NULL, otherwise left for the caller to fill
+CAsyncPayload *async_payload_new(const void *ptr, int size);
+
+// add a reference
+CAsyncPayload *async_payload_ref(CAsyncPayload *payload);
+
+// drop a reference, the payload is freed when it reaches zero
+void async_payload_unref(CAsyncPayload *payload);
+
 // initialize a new subscriber
 void async_sub_init(CAsyncSubscribe *sub, int (*callback)
 		(CAsyncSubscribe *sub, IINT32 wparam, IINT32 lparam,
@@ -85,22 +150,118 @@ void async_sub_init(CAsyncSubscribe *sub, int (*callback)
 // register a subscriber to a topic
 void async_sub_register(CAsyncTopic *topic, CAsyncSubscribe *sub, int tid);
 
+// register a subscriber to a hierarchical pattern ("feed.eu.*" or
+// "feed.#"), matched against names given to async_topic_publish_name.
+// returns 0 for success, -1 for invalid pattern ('#' not trailing)
+int async_sub_register_pattern(CAsyncTopic *topic, CAsyncSubscribe *sub,
+	const char *pattern);
+
+// register a subscriber to an exact name, '*' and '#' segments in it
+// are plain text. returns 0 for success, -1 for NULL name
+int async_sub_register_name(CAsyncTopic *topic, CAsyncSubscribe *sub,
+	const char *name);
+
 // unregister a subscriber from a topic
 void async_sub_deregister(CAsyncSubscribe *sub);
 
 
+//---------------------------------------------------------------------
+// CAsyncBus - topic bus spanning loops in different threads
+//---------------------------------------------------------------------
+// publishers read an immutable snapshot of the port list, which is
+// rebuilt and swapped under the lock when a port joins or leaves.
+// replaced snapshots are retired until no publisher holds them.
+struct CAsyncBus {
+	IMUTEX_TYPE lock;
+	ilist_head ports;
+	int count;
+	void *snapshot;
+	void *retired;
+};
+
+// one port per loop: publishers on any thread push messages into its
+// lock-free inbox, the loop drains the whole inbox once per wakeup and
+// hands the batch to its local topic, where subscribers register.
+struct CAsyncBusPort {
+	CAsyncBus *bus;
+	CAsyncLoop *loop;
+	CAsyncTopic *topic;
+	CAsyncSemaphore evt_sem;
+	ilist_head node;
+	void * volatile inbox;
+	void *user;
+	IINT64 num_batches;
+	IINT64 num_messages;
+};
+
+
+//---------------------------------------------------------------------
+// bus management
+//---------------------------------------------------------------------
+
+// create a new bus
+CAsyncBus *async_bus_new(void);
+
+// delete a bus, every port must be deleted before
+void async_bus_delete(CAsyncBus *bus);
+
+// publish a message to every port of the bus, from any thread. data
+// is copied once into a payload shared by all ports, and the inbox
+// nodes of all ports are allocated with it in a single block.
+// returns 0 for success, -1 for invalid tid or size, -2 when the block
+// can not be allocated (no port receives the message)
+int async_bus_publish(CAsyncBus *bus, int tid, 
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size);
+
+// publish to a hierarchical name on every port, from any thread
+int async_bus_publish_name(CAsyncBus *bus, const char *name,
+	IINT32 wparam, IINT32 lparam, const void *ptr, int size);
+
+// create a port of the bus for the loop, called from the loop thread.
+// register subscribers to port->topic, callbacks run in that loop.
+CAsyncBusPort *async_bus_port_new(CAsyncBus *bus, CAsyncLoop *loop);
+
+// delete the port from the loop thread, pending messages are dropped
+void async_bus_port_delete(CAsyncBusPort *port);
+
+
 //---------------------------------------------------------------------
 // CAsyncSignal
 //---------------------------------------------------------------------
 #define CASYNC_SIGNAL_MAX  256
+
+// use signalfd(2) instead of the handler + self-pipe, linux only and
+// off by default (-DASYNC_SIGNAL_SIGNALFD=1 to enable): it blocks the
+// installed signals in the starting thread, so a thread created before
+// async_signal_start still takes them with the default action.
+#ifndef ASYNC_SIGNAL_SIGNALFD
+#define ASYNC_SIGNAL_SIGNALFD  0
+#elif ASYNC_SIGNAL_SIGNALFD && !defined(__linux__)
+#undef ASYNC_SIGNAL_SIGNALFD
+#define ASYNC_SIGNAL_SIGNALFD  0
+#endif
+
+// max siginfo records taken by one read of the signalfd
+#ifndef ASYNC_SIGNAL_BATCH
+#define ASYNC_SIGNAL_BATCH  32
+#endif
+
 struct CAsyncSignal {
 	void (*callback)(CAsyncSignal *signal, int signum);
+	void (*child)(CAsyncSignal *signal, int pid, int status);
 	int fd_reader;
 	int fd_writer;
 	CAsyncEvent evt_read;
+	CAsyncEvent evt_signal;     // watching the shared signalfd
 	CAsyncLoop *loop;
+	ilist_head node;            // in the started list (signalfd)
 	void *user;
 	int active;
+	int busy;
+	int releasing;
+	IINT64 num_signals;         // siginfo records read by this loop
+	IINT64 num_reaped;          // children collected for child()
+	struct ib_hash_map *processes;   // pid -> CAsyncProcess
 	int installed[CASYNC_SIGNAL_MAX];
 	volatile int signaled[CASYNC_SIGNAL_MAX];
 };
@@ -113,8 +274,11 @@ CAsyncSignal *async_signal_new(CAsyncLoop *loop,
 // delete signal object
 void async_signal_delete(CAsyncSignal *sig);
 
-// start wating system signals, only one CAsyncSignal
-// can be started at the same time.
+// start wating system signals. with the signalfd backend several
+// loops may be started at once and each installed signal is delivered
+// to every one of them; the signals are blocked in the calling thread,
+// so start before creating other threads (they inherit the mask).
+// without signalfd only one CAsyncSignal can be started at a time.
 int async_signal_start(CAsyncSignal *sig);
 
 // stop from the system signal interface
@@ -129,10 +293,70 @@ int async_signal_ignore(CAsyncSignal *sig, int signum);
 // remove a system signal
 int async_signal_remove(CAsyncSignal *sig, int signum);
 
+// reap exited children on SIGCHLD: installs SIGCHLD and calls child()
+// for each pid collected by waitpid(-1, WNOHANG), one wakeup reaps all
+// of them. pass NULL to restore the plain callback. only one object in
+// the process should reap, it's safe to delete sig inside callbacks.
+// without child(), CAsyncProcess pids are waited for one by one and
+// other children are left alone.
+int async_signal_reap(CAsyncSignal *sig, 
+	void (*child)(CAsyncSignal *signal, int pid, int status));
+
 // install default handler for a CAsyncLoop
 int async_signal_default(CAsyncLoop *loop);
 
 
+//---------------------------------------------------------------------
+// CAsyncProcess - child process with stdio streams
+//---------------------------------------------------------------------
+#define ASYNC_PROCESS_STDIN     1    // stdin from proc->input
+#define ASYNC_PROCESS_STDOUT    2    // stdout to proc->output
+#define ASYNC_PROCESS_STDERR    4    // stderr to proc->error
+#define ASYNC_PROCESS_MERGE     8    // stderr shares proc->output
+#define ASYNC_PROCESS_NULL     16    // unpiped stdio is /dev/null
+#define ASYNC_PROCESS_GROUP    32    // child leads a new process group
+
+struct CAsyncProcess {
+	CAsyncLoop *loop;
+	CAsyncSignal *reaper;       // delivers the exit status
+	CAsyncStream *input;        // write end of child's stdin
+	CAsyncStream *output;       // read end of child's stdout
+	CAsyncStream *error;        // read end of child's stderr
+	void (*callback)(CAsyncProcess *proc, int status);
+	void *user;
+	int pid;
+	int status;                 // waitpid() status once exited
+	int exited;
+	int busy;
+	int releasing;
+};
+
+
+// create a process object, exits are collected by the reaper, which
+// must belong to the same loop and be started to see SIGCHLD. the
+// child callback of the reaper still gets pids of other children.
+CAsyncProcess *async_process_new(CAsyncSignal *reaper,
+	void (*callback)(CAsyncProcess *proc, int status));
+
+// delete process object and close its streams, the child is not
+// killed; safe to call inside the exit callback.
+void async_process_delete(CAsyncProcess *proc);
+
+// spawn file (searched in PATH) with argv and envp (NULL for environ),
+// piped stdio become non-blocking streams owned by proc with user set
+// to proc, use their watermarks for backpressure. returns zero for
+// success, -1 for already spawned, -2 for pipe error, -3 spawn error.
+int async_process_spawn(CAsyncProcess *proc, const char *file,
+	char * const argv[], char * const envp[], int flags,
+	void (*callback)(CAsyncStream *stream, int event, int args));
+
+// flush pending input then close it, the child reads EOF
+void async_process_close_input(CAsyncProcess *proc, int timeout_ms);
+
+// send a signal to a running child
+int async_process_kill(CAsyncProcess *proc, int signum);
+
+
 //---------------------------------------------------------------------
 // CAsyncCodec - protocol codec for CAsyncStream
 //---------------------------------------------------------------------
@@ -141,6 +365,7 @@ int async_signal_default(CAsyncLoop *loop);
 #define ASYNC_CODEC_RESP      0    // Redis RESP2/3
 #define ASYNC_CODEC_MSGPACK  1    // MessagePack
 #define ASYNC_CODEC_JSON     2    // JSON (RFC 8259)
+#define ASYNC_CODEC_HTTP     3    // HTTP/1.1 requests/responses
 
 // codec event type (for callback)
 #define ASYNC_CODEC_EVT_ESTAB    0x01
@@ -152,6 +377,11 @@ int async_signal_default(CAsyncLoop *loop);
 #define ASYNC_CODEC_ZONE_SIZE   2048
 #endif
 
+// default upper bound of the adaptive zonebuf
+#ifndef ASYNC_CODEC_ZONE_LIMIT
+#define ASYNC_CODEC_ZONE_LIMIT  (256 * 1024)
+#endif
+
 struct CAsyncCodec {
     CAsyncLoop *loop;
     CAsyncStream *stream;      // underlying stream
@@ -159,12 +389,18 @@ struct CAsyncCodec {
     int busy;                   // dispatch ref count
     int releasing;              // deferred delete flag
     int error;                  // protocol error state
-    int codec;                  // ASYNC_CODEC_RESP / MSGPACK / JSON
-    void *reader;               // ib_resp_reader* / ib_msgpack_reader* / ib_json_reader*
+    int codec;                  // ASYNC_CODEC_RESP / MSGPACK / JSON / HTTP
+    void *reader;               // ib_resp_reader* / ib_msgpack_reader* / ib_json_reader* / ib_http_reader*
     void *user;                 // user data
     void *zonebuf;              // zone static page (heap-allocated)
     size_t zonebuf_size;        // current zonebuf bytes
-    size_t pending_resize;      // pending zonebuf resize (0=none)
+    size_t pending_resize;      // pending zonebuf resize (0=none, ~0=free)
+    size_t zone_base;           // zonebuf floor (async_codec_set_zone_size)
+    size_t zone_limit;          // adaptive zonebuf ceiling, 0=fixed
+    size_t zone_peak;           // learned high-water mark of decoded bytes
+    IINT64 num_decoded;         // messages decoded
+    IINT64 num_overflows;       // messages that needed dynamic pages
+    IINT64 num_resizes;         // zonebuf resizes
     struct ib_zone zone;        // zone for zero-copy decoding
     struct IALLOCATOR alloc;    // allocator from zone
     void (*callback)(CAsyncCodec *codec, int event);
@@ -172,9 +408,13 @@ struct CAsyncCodec {
     ib_string *encode_buf;      // reusable encoding buffer
 };
 
-// create a codec bound to stream. codec type: ASYNC_CODEC_RESP/MSGPACK/JSON.
+// create a codec bound to stream. codec type: ASYNC_CODEC_RESP/MSGPACK/JSON/HTTP.
 // borrow=0: close stream on delete; borrow=1: detach stream on delete.
 // default zonebuf size: ASYNC_CODEC_ZONE_SIZE (2048).
+// HTTP: receiver gets one message per call (see ib_http_reader), its
+// strings are slices of the reader buffer valid only inside receiver.
+// Pipelined messages are delivered in order, a close-delimited body
+// is completed when the stream reports EOF.
 CAsyncCodec *async_codec_new(CAsyncStream *stream, int codec_type,
         int borrow,
         void (*callback)(CAsyncCodec *codec, int event),
@@ -196,6 +436,8 @@ void async_codec_enable(CAsyncCodec *codec, int event);
 void async_codec_disable(CAsyncCodec *codec, int event);
 
 // configure safety limits: max_depth, max_bulk/max_size, max_elements
+// (HTTP: max_depth is the max header block, max_bulk the max body and
+// max_elements the max header fields)
 void async_codec_set_limits(CAsyncCodec *codec,
         int max_depth, long max_bulk, int max_elements);
 
@@ -203,12 +445,25 @@ void async_codec_set_limits(CAsyncCodec *codec,
 void async_codec_set_inline(CAsyncCodec *codec, int enable);
 
 // signal end-of-input for JSON reader (allows bare numbers at buffer end)
+// or HTTP reader (completes a close-delimited body)
 void async_codec_set_finish(CAsyncCodec *codec);
 
+// HTTP only: the next final response has no body (it answers a HEAD),
+// see ib_http_reader_expect_head
+void async_codec_expect_head(CAsyncCodec *codec);
+
 // set zonebuf size. applied on next zone_clear (deferred).
-// size=0: disable static page (pure dynamic allocation).
+// size=0: disable static page (pure dynamic allocation), this also
+// sets the zone limit to 0 so the adaptive zonebuf stays disabled.
+// it is also the floor the adaptive zonebuf shrinks back to.
 void async_codec_set_zone_size(CAsyncCodec *codec, size_t size);
 
+// zonebuf grows to the learned high-water mark of decoded messages
+// (up to limit) so bulky messages reuse one retained page instead of
+// allocating pages per message, and shrinks back when the mark decays.
+// limit=0: keep the zonebuf size fixed.
+void async_codec_set_zone_limit(CAsyncCodec *codec, size_t limit);
+
 // query stream pending data size
 long async_codec_remain(const CAsyncCodec *codec);
 
@@ -220,28 +475,146 @@ void async_codec_reset(CAsyncCodec *codec);
 
 
 //---------------------------------------------------------------------
-// CAsyncPoll - an epoll like API based for CAsyncLoop
+// CAsyncPipeline - pipelined RESP client on CAsyncCodec
 //---------------------------------------------------------------------
-struct _CAsyncPollItem {
-	CAsyncEvent evt;
-	CAsyncPoll *poll;
-	int fd;
-	int events;
-	void *udata;
+struct CAsyncPipelineEntry;
+
+// commands are encoded into one batch per loop iteration and written
+// with a single stream write after the iteration; replies are matched 
+// to the outstanding requests in order. requests live in a ring that
+// only grows, so issuing a command does not allocate.
+struct CAsyncPipeline {
+	CAsyncLoop *loop;
+	CAsyncCodec *codec;
+	CAsyncPostpone evt_flush;
+	struct CAsyncPipelineEntry *queue;
+	int capacity;               // ring capacity, power of 2
+	int head;                   // oldest outstanding request
+	int count;                  // outstanding requests
+	int busy;
+	int releasing;
+	int error;                  // no more commands accepted
+	int lost;                   // event that ended the connection
+	ib_string *batch;           // commands of this iteration
+	void *user;
+	IINT64 num_requests;
+	IINT64 num_replies;
+	IINT64 num_flushes;
+	void (*callback)(CAsyncPipeline *pipe, int event);
+	void (*push)(CAsyncPipeline *pipe, const ib_object *obj);
 };
 
+// reply handler: reply is only valid inside the call, error replies
+// carry IB_OBJECT_FLAG_ERROR, reply is NULL when the connection is 
+// lost before the reply arrives.
+typedef void (*CAsyncPipelineReply)(CAsyncPipeline *pipe, void *user,
+	const ib_object *reply);
+
+// create a pipeline on stream (borrow: same as async_codec_new).
+// callback receives stream events (ASYNC_STREAM_EVT_*) and
+// ASYNC_CODEC_EVT_ERROR; set pipe->push to receive RESP3 pushes.
+CAsyncPipeline *async_pipeline_new(CAsyncStream *stream, int borrow,
+	void (*callback)(CAsyncPipeline *pipe, int event));
+
+// delete pipeline, outstanding requests are dropped without reply.
+// safe to call inside callbacks.
+void async_pipeline_delete(CAsyncPipeline *pipe);
+
+// queue a command of argc arguments (argvlen can be NULL for C strings),
+// returns 0 for success, -1 after a connection error
+int async_pipeline_command(CAsyncPipeline *pipe, CAsyncPipelineReply reply,
+	void *user, int argc, const char * const argv[], const int argvlen[]);
+
+// queue a command encoded from obj (usually an ARRAY of STR)
+int async_pipeline_send(CAsyncPipeline *pipe, CAsyncPipelineReply reply,
+	void *user, const ib_object *obj);
+
+// write the current batch now instead of after the iteration
+void async_pipeline_flush(CAsyncPipeline *pipe);
+
+// number of requests waiting for replies
+int async_pipeline_pending(const CAsyncPipeline *pipe);
+
+
+//---------------------------------------------------------------------
+// CAsyncCache - Redis protocol in-memory key/value server
+//---------------------------------------------------------------------
+struct CAsyncCacheEntry;
+
+// serves GET/SET/DEL/EXISTS/EXPIRE/PEXPIRE/TTL/PTTL/MGET/INCR/INCRBY/
+// DECR/DBSIZE/PING/ECHO/HELLO/QUIT, PUBLISH and (P)SUBSCRIBE/
+// (P)UNSUBSCRIBE on the streams attached to it. keys expire on the loop
+// timers, channels are names of the topic, so PUBLISH reaches in-process
+// subscribers too. SUBSCRIBE takes names literally, PSUBSCRIBE takes
+// AsyncTopic patterns ('*' one segment, '#' the rest, not redis globs)
+// and replies "pmessage" with the pattern and the concrete channel.
+struct CAsyncCache {
+	CAsyncLoop *loop;
+	CAsyncListener *listener;
+	CAsyncTopic *topic;
+	int own_topic;
+	int num_clients;
+	struct ib_hash_map keys;    // ib_string* -> CAsyncCacheEntry*
+	ilist_head clients;
+	ib_string *reply;           // replies of the current command
+	ib_string *scratch;
+	void *user;
+	IINT64 num_commands;
+	IINT64 num_hits;
+	IINT64 num_misses;
+	IINT64 num_expired;
+};
+
+// bulk values from this size are written to the stream directly
+// instead of being copied into the reply buffer first
+#ifndef ASYNC_CACHE_INLINE
+#define ASYNC_CACHE_INLINE   512
+#endif
+
+// create a cache server, topic can be NULL to use a private one
+CAsyncCache *async_cache_new(CAsyncLoop *loop, CAsyncTopic *topic);
+
+// delete cache server, close all clients
+void async_cache_delete(CAsyncCache *cache);
+
+// accept connections on addr (flags: ASYNC_LISTENER_*), 
+// returns 0 for success, others for error
+int async_cache_listen(CAsyncCache *cache, const struct sockaddr *addr,
+	int addrlen, int flags);
+
+// serve an established stream, the cache takes it over
+int async_cache_attach(CAsyncCache *cache, CAsyncStream *stream);
+
+// in-process access: value of key or NULL, valid until the next write
+const ib_string *async_cache_get(CAsyncCache *cache, const void *key,
+	int keylen);
+
+// in-process access: set value, ttl in milliseconds (0 for none)
+int async_cache_set(CAsyncCache *cache, const void *key, int keylen,
+	const void *value, int size, IINT64 ttl);
+
+// in-process access: returns 1 if the key was removed
+int async_cache_del(CAsyncCache *cache, const void *key, int keylen);
+
+
+//---------------------------------------------------------------------
+// CAsyncPoll - an epoll like API based for CAsyncLoop
+//---------------------------------------------------------------------
+// one entry of a batch delivery: fd, events and udata
+typedef CAsyncReady CAsyncPollEvent;
+
 struct CAsyncPoll {
 	CAsyncLoop *loop;
 	void *user;
 	int busy;
 	int closing;
 	int count;
-	struct ib_hash_map fds;   // hash map of fd -> CAsyncPollItem*
+	CAsyncHook hook;            // fds live in the loop's fd table
 	void (*callback)(CAsyncPoll *poll, int fd, int events, void *udata);
+	void (*batch_callback)(CAsyncPoll *poll, const CAsyncPollEvent *events,
+		int count);
 };
 
-typedef struct _CAsyncPollItem CAsyncPollItem;
-
 // create a new CAsyncPoll object
 CAsyncPoll *async_poll_new(CAsyncLoop *loop,
 	void (*callback)(CAsyncPoll *poll, int fd, int events, void *udata));
@@ -261,6 +634,13 @@ int async_poll_del(CAsyncPoll *poll, int fd);
 // returns 0 on success, -1 on failure (e.g., fd not found)
 int async_poll_set(CAsyncPoll *poll, int fd, int events);
 
+// deliver the events of each loop iteration in one call instead of 
+// one callback per fd (NULL to switch back). like epoll_wait, an fd
+// removed inside the call can still appear later in the same batch.
+// the array is the loop's ready list of this poll, it is not copied.
+void async_poll_set_batch(CAsyncPoll *poll, void (*batch_callback)
+	(CAsyncPoll *poll, const CAsyncPollEvent *events, int count));
+
 
 #ifdef __cplusplus
 }